@@ -0,0 +1,201 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "accumulators.h"
+#include "memory-accounting.h"
+
+/*
+ * Create the accumulators of a collection of documents
+ */
+Accumulators *createAccumulators(int numOfDocuments) {
+    Accumulators *accumulators = trackedMalloc(MEMORY_QUERY, sizeof(Accumulators));
+
+    accumulators->numOfDocuments = numOfDocuments;
+    accumulators->sums = trackedCalloc(MEMORY_QUERY, numOfDocuments, sizeof(float));
+    accumulators->touchedBits = trackedCalloc(MEMORY_QUERY, (numOfDocuments + 63) / 64, sizeof(uint64_t));
+    accumulators->touched = trackedMalloc(MEMORY_QUERY, numOfDocuments * sizeof(int));
+    accumulators->numOfTouched = 0;
+
+    return accumulators;
+}
+
+/*
+ * Release the memory of the accumulators
+ */
+void freeAccumulators(Accumulators *accumulators) {
+    if (accumulators == NULL) {
+        return;
+    }
+
+    trackedFree(MEMORY_QUERY, accumulators->sums);
+    trackedFree(MEMORY_QUERY, accumulators->touchedBits);
+    trackedFree(MEMORY_QUERY, accumulators->touched);
+    trackedFree(MEMORY_QUERY, accumulators);
+}
+
+/*
+ * Clear the accumulators of the touched documents only
+ */
+void resetAccumulators(Accumulators *accumulators) {
+    int i;
+
+    for (i = 0; i < accumulators->numOfTouched; i++) {
+        int position = accumulators->touched[i];
+
+        accumulators->sums[position] = 0;
+        accumulators->touchedBits[position >> 6] = 0;
+    }
+
+    accumulators->numOfTouched = 0;
+}
+
+/*
+ * Insert a document in the top list if its score is higher than the lowest one (or the list is not full).
+ * Returns the new size of the list
+ */
+int insertTopAccumulator(int k, int count, int topPositions[], float topScores[], int position, float score) {
+    if (count == k && score <= topScores[k - 1]) {
+        return count;
+    }
+
+    int j = count < k ? count++ : k - 1;
+
+    /* Insertion sort step: shift the smaller scores one position to the right */
+    for (; j > 0 && topScores[j - 1] < score; j--) {
+        topPositions[j] = topPositions[j - 1];
+        topScores[j] = topScores[j - 1];
+    }
+
+    topPositions[j] = position;
+    topScores[j] = score;
+
+    return count;
+}
+
+/*
+ * Lowest score a document must beat to enter the top list
+ */
+float getTopThreshold(int k, int count, const float topScores[]) {
+    return count < k ? -INFINITY : topScores[k - 1];
+}
+
+/*
+ * Select the top documents walking the touched list. Used when few documents were touched
+ */
+int selectTopTouched(const Accumulators *accumulators, const float inverseNorms[], int k, int topPositions[], float topScores[]) {
+    int count = 0;
+
+    int i;
+
+    for (i = 0; i < accumulators->numOfTouched; i++) {
+        int position = accumulators->touched[i];
+
+        count = insertTopAccumulator(k, count, topPositions, topScores, position,
+                                     accumulators->sums[position] * inverseNorms[position]);
+    }
+
+    return count;
+}
+
+/*
+ * Select the top documents scanning the dense arrays: the cossenes of 8 (AVX2) or 4 (SSE2) documents are
+ * computed at once and compared with the current threshold, and only the touched documents that beat it
+ * are inserted in the top list. Used when many documents were touched
+ */
+int selectTopDense(const Accumulators *accumulators, const float inverseNorms[], int k, int topPositions[], float topScores[]) {
+    const unsigned char *touchedBytes = (const unsigned char *) accumulators->touchedBits;
+
+    int count = 0;
+
+    int i = 0;
+
+#if defined(__AVX2__)
+    for (; i + 8 <= accumulators->numOfDocuments; i += 8) {
+        int touched = touchedBytes[i >> 3];
+
+        if (touched == 0) {
+            continue;
+        }
+
+        __m256 scores = _mm256_mul_ps(_mm256_loadu_ps(accumulators->sums + i), _mm256_loadu_ps(inverseNorms + i));
+
+        __m256 threshold = _mm256_set1_ps(getTopThreshold(k, count, topScores));
+
+        int candidates = _mm256_movemask_ps(_mm256_cmp_ps(scores, threshold, _CMP_GT_OQ)) & touched;
+
+        while (candidates != 0) {
+            int lane = __builtin_ctz(candidates);
+
+            count = insertTopAccumulator(k, count, topPositions, topScores, i + lane,
+                                         accumulators->sums[i + lane] * inverseNorms[i + lane]);
+
+            candidates &= candidates - 1;
+        }
+    }
+#elif defined(__SSE2__)
+    for (; i + 4 <= accumulators->numOfDocuments; i += 4) {
+        /* 4 documents take half of a byte of the touched bits */
+        int touched = (touchedBytes[i >> 3] >> (i & 4)) & 0xF;
+
+        if (touched == 0) {
+            continue;
+        }
+
+        __m128 scores = _mm_mul_ps(_mm_loadu_ps(accumulators->sums + i), _mm_loadu_ps(inverseNorms + i));
+
+        __m128 threshold = _mm_set1_ps(getTopThreshold(k, count, topScores));
+
+        int candidates = _mm_movemask_ps(_mm_cmpgt_ps(scores, threshold)) & touched;
+
+        while (candidates != 0) {
+            int lane = __builtin_ctz(candidates);
+
+            count = insertTopAccumulator(k, count, topPositions, topScores, i + lane,
+                                         accumulators->sums[i + lane] * inverseNorms[i + lane]);
+
+            candidates &= candidates - 1;
+        }
+    }
+#endif
+
+    for (; i < accumulators->numOfDocuments; i++) {
+        if ((accumulators->touchedBits[i >> 6] >> (i & 63)) & 1) {
+            count = insertTopAccumulator(k, count, topPositions, topScores, i, accumulators->sums[i] * inverseNorms[i]);
+        }
+    }
+
+    return count;
+}
+
+/*
+ * Select the 'k' touched documents with the highest sum * inverseNorms[position] (the cossene), in
+ * descending order. Returns the number of selected documents
+ */
+int selectTopAccumulators(const Accumulators *accumulators, const float inverseNorms[], int k, int topPositions[], float topScores[]) {
+    /* Walking the touched list reads scattered positions, so the dense scan wins above ~1/8 of the collection */
+    if (accumulators->numOfTouched * 8 < accumulators->numOfDocuments) {
+        return selectTopTouched(accumulators, inverseNorms, k, topPositions, topScores);
+    }
+
+    return selectTopDense(accumulators, inverseNorms, k, topPositions, topScores);
+}
+
+/*
+ * Name of the instruction set used to select the top documents
+ */
+const char *getAccumulatorsInstructionSet() {
+#if defined(__AVX2__)
+    return "AVX2";
+#elif defined(__SSE2__)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,61 @@
+#ifndef ACCUMULATORS_H
+#define ACCUMULATORS_H
+
+#include <stdint.h>
+
+/* This struct represents the scoring state of a query as dense arrays indexed by document position */
+typedef struct Accumulators {
+    int numOfDocuments;
+    float *sums; /* accumulator (wi,j) of each document */
+    uint64_t *touchedBits; /* one bit per document with an accumulator */
+    int *touched; /* positions of the documents with an accumulator, so a reset costs O(touched) */
+    int numOfTouched;
+} Accumulators;
+
+/*
+ * Create the accumulators of a collection of documents
+ */
+Accumulators *createAccumulators(int numOfDocuments);
+
+/*
+ * Release the memory of the accumulators
+ */
+void freeAccumulators(Accumulators *accumulators);
+
+/*
+ * Clear the accumulators of the touched documents only
+ */
+void resetAccumulators(Accumulators *accumulators);
+
+/*
+ * Add a value to the accumulator of a document
+ */
+static inline void addToAccumulator(Accumulators *accumulators, int position, float value) {
+    uint64_t bit = (uint64_t) 1 << (position & 63);
+
+    if (!(accumulators->touchedBits[position >> 6] & bit)) {
+        accumulators->touchedBits[position >> 6] |= bit;
+        accumulators->touched[accumulators->numOfTouched++] = position;
+    }
+
+    accumulators->sums[position] += value;
+}
+
+/*
+ * Select the 'k' touched documents with the highest sum * inverseNorms[position] (the cossene), in
+ * descending order. Returns the number of selected documents
+ */
+int selectTopAccumulators(const Accumulators *accumulators, const float inverseNorms[], int k, int topPositions[], float topScores[]);
+
+/*
+ * Insert a document in the top list if its score is higher than the lowest one (or the list is not full).
+ * Returns the new size of the list
+ */
+int insertTopAccumulator(int k, int count, int topPositions[], float topScores[], int position, float score);
+
+/*
+ * Name of the instruction set used to select the top documents
+ */
+const char *getAccumulatorsInstructionSet();
+
+#endif
@@ -0,0 +1,708 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <libxml/parser.h>
+
+/*
+ * Generator of synthetic collections in the schema of the Dafiti/Posthaus dataset (produtos/produto with
+ * id, titulo, categoria, preco, descricao and img) and of query sets for them, at any number of products.
+ *
+ * The terms of the descriptions are drawn from a Zipf distribution (the term of rank r has probability
+ * proportional to 1 / r^s) and the vocabulary grows with the size of the collection by Heaps' law
+ * (V = K * n^b). With --fit, s and b are fitted to the descriptions of a real dataset, whose terms are used
+ * for the first ranks and whose description lengths, categories and prices are sampled
+ */
+
+#define ANSI_COLOR_RED     "\x1b[31m"
+#define ANSI_COLOR_GREEN   "\x1b[32m"
+#define ANSI_COLOR_YELLOW  "\x1b[33m"
+#define ANSI_COLOR_RESET   "\x1b[0m"
+#define ANSI_BOLD_WHITE    "\x1b[1m"
+
+/* Max size of a term of the descriptions */
+#define MAX_TERM_SIZE 64
+/* Max number of terms of a generated query */
+#define MAX_QUERY_TERMS 3
+/* Ranks fitted by least squares: the tail of the terms found once or twice flattens the curve */
+#define MIN_FITTED_FREQUENCY 3
+
+/* Terms of the first ranks when no dataset is fitted, in decreasing order of frequency */
+const char *DEFAULT_TERMS[] = {
+    "vestido", "de", "com", "e", "em", "manga", "decote", "estampado", "curto", "longo", "midi", "renda",
+    "alcinha", "preto", "azul", "tubinho", "festa", "algodao", "costas", "floral", "fenda", "saia", "cintura",
+    "evase", "branco", "vermelho", "rosa", "verde", "amarração", "bojo", "babado", "malha", "viscose",
+    "listrado", "tomara", "que", "caia", "gola", "botões", "bordado", "transpassado", "plissado", "jeans",
+    "nude", "vinho", "marinho", "tule", "cetim", "crepe", "poa", "xadrez", "ombro", "assimétrico", "barra",
+    "forro", "elastano", "ajustado", "soltinho", "recortes", "zíper"
+};
+
+/* Categories of the products when no dataset is fitted */
+const char *DEFAULT_CATEGORIES[] = {
+    "Vestidos Longos", "Vestidos Curtos", "Vestidos Midi", "Vestidos de Festa", "Vestidos Casuais"
+};
+
+/* Syllables of the synthetic terms, which take the ranks after the known terms */
+const char *SYLLABLES[] = {
+    "ba", "be", "ca", "co", "da", "de", "fa", "fi", "ga", "la", "li", "ma", "mo", "na", "pa", "po", "ra", "ri",
+    "sa", "se", "ta", "te", "va", "vi"
+};
+
+/* Zipf exponent when no dataset is fitted */
+#define DEFAULT_ZIPF_EXPONENT 1.0
+/* Heaps' law (V = K * n^b) when no dataset is fitted */
+#define DEFAULT_HEAPS_K 10.0
+#define DEFAULT_HEAPS_EXPONENT 0.5
+/* Description lengths (uniform) when no dataset is fitted */
+#define DEFAULT_MIN_LENGTH 5
+#define DEFAULT_MAX_LENGTH 40
+
+/* This struct represents the statistics the synthetic collection is generated from */
+typedef struct CorpusModel {
+    double zipfExponent;
+    double heapsK;
+    double heapsExponent;
+    char **terms; /* known terms by rank */
+    int numOfTerms;
+    int *lengths; /* description lengths, sampled uniformly */
+    int numOfLengths;
+    char **categories; /* one per product, so sampling follows their distribution */
+    int numOfCategories;
+    double *prices;
+    int numOfPrices;
+} CorpusModel;
+
+/* This struct represents a term of the fitted dataset and its frequency */
+typedef struct TermCount {
+    char *term;
+    long count;
+} TermCount;
+
+/* State of the xorshift64* generator */
+uint64_t randomState = 88172645463325252ULL;
+
+/*
+ * Next pseudo-random number of the generator
+ */
+uint64_t nextRandom() {
+    randomState ^= randomState >> 12;
+    randomState ^= randomState << 25;
+    randomState ^= randomState >> 27;
+
+    return randomState * 2685821657736338717ULL;
+}
+
+/*
+ * Pseudo-random number in [0, 1)
+ */
+double nextUniform() {
+    return (nextRandom() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * Hash of a term (djb2)
+ */
+uint64_t hashTerm(const char term[]) {
+    uint64_t hash = 5381;
+
+    for (; *term; term++) {
+        hash = hash * 33 + (unsigned char) *term;
+    }
+
+    return hash;
+}
+
+/*
+ * Find the slot of a term in an open addressing table of counts, growing the table when it is half full
+ */
+TermCount *findTermCount(TermCount **table, int *capacity, int *numOfTerms, const char term[]) {
+    if (*numOfTerms * 2 >= *capacity) {
+        int newCapacity = *capacity == 0 ? 1024 : *capacity * 2;
+
+        TermCount *newTable = calloc(newCapacity, sizeof(TermCount));
+
+        int i;
+
+        for (i = 0; i < *capacity; i++) {
+            if ((*table)[i].term != NULL) {
+                uint64_t slot = hashTerm((*table)[i].term) & (newCapacity - 1);
+
+                while (newTable[slot].term != NULL) {
+                    slot = (slot + 1) & (newCapacity - 1);
+                }
+
+                newTable[slot] = (*table)[i];
+            }
+        }
+
+        free(*table);
+
+        *table = newTable;
+        *capacity = newCapacity;
+    }
+
+    uint64_t slot = hashTerm(term) & (*capacity - 1);
+
+    while ((*table)[slot].term != NULL && strcmp((*table)[slot].term, term) != 0) {
+        slot = (slot + 1) & (*capacity - 1);
+    }
+
+    if ((*table)[slot].term == NULL) {
+        (*table)[slot].term = strdup(term);
+
+        (*numOfTerms)++;
+    }
+
+    return &(*table)[slot];
+}
+
+/*
+ * Compare two term counts by decreasing count (ties by term, so the ranks are deterministic)
+ */
+int compareTermCounts(const void *a, const void *b) {
+    const TermCount *countA = a;
+    const TermCount *countB = b;
+
+    if (countA->count != countB->count) {
+        return countA->count < countB->count ? 1 : -1;
+    }
+
+    return strcmp(countA->term, countB->term);
+}
+
+/*
+ * Text of the first child of a node with the given name, or NULL
+ */
+char *getChildText(xmlNodePtr node, const char name[]) {
+    for (node = node->xmlChildrenNode; node != NULL; node = node->next) {
+        if (!xmlStrcmp(node->name, (const xmlChar *) name)) {
+            return (char *) xmlNodeGetContent(node);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Fit the model to the descriptions of a real dataset. Returns false if the dataset could not be read
+ */
+bool fitCorpusModel(CorpusModel *model, const char fileName[]) {
+    xmlDocPtr doc = xmlParseFile(fileName);
+
+    if (doc == NULL) {
+        fprintf(stderr, "Could not parse %s\n", fileName);
+
+        return false;
+    }
+
+    xmlNodePtr root = xmlDocGetRootElement(doc);
+
+    if (root == NULL || xmlStrcmp(root->name, (const xmlChar *) "produtos")) {
+        fprintf(stderr, "Document with wrong type! (root node != produtos)\n");
+
+        xmlFreeDoc(doc);
+
+        return false;
+    }
+
+    TermCount *table = NULL;
+
+    int capacity = 0;
+    int numOfTerms = 0;
+
+    int numOfDocuments = 0;
+
+    int capacityOfDocuments = 1024;
+
+    model->lengths = malloc(capacityOfDocuments * sizeof(int));
+    model->categories = malloc(capacityOfDocuments * sizeof(char *));
+    model->prices = malloc(capacityOfDocuments * sizeof(double));
+
+    model->numOfCategories = 0;
+    model->numOfPrices = 0;
+
+    /* Vocabulary size after half of the documents, for the Heaps' law exponent */
+    int halfNumOfTerms = 0;
+
+    int numOfProducts = 0;
+
+    xmlNodePtr cur;
+
+    for (cur = root->xmlChildrenNode; cur != NULL; cur = cur->next) {
+        if (!xmlStrcmp(cur->name, (const xmlChar *) "produto")) {
+            numOfProducts++;
+        }
+    }
+
+    for (cur = root->xmlChildrenNode; cur != NULL; cur = cur->next) {
+        if (xmlStrcmp(cur->name, (const xmlChar *) "produto")) {
+            continue;
+        }
+
+        if (numOfDocuments == capacityOfDocuments) {
+            capacityOfDocuments *= 2;
+
+            model->lengths = realloc(model->lengths, capacityOfDocuments * sizeof(int));
+            model->categories = realloc(model->categories, capacityOfDocuments * sizeof(char *));
+            model->prices = realloc(model->prices, capacityOfDocuments * sizeof(double));
+        }
+
+        char *description = getChildText(cur, "descricao");
+
+        int length = 0;
+
+        if (description != NULL) {
+            char term[MAX_TERM_SIZE];
+
+            int size = 0;
+
+            char *c;
+
+            /* Terms are split at the ASCII punctuation and spaces; accented (UTF-8) bytes are kept */
+            for (c = description; ; c++) {
+                unsigned char byte = (unsigned char) *c;
+
+                if (byte != '\0' && (isalnum(byte) || byte >= 128)) {
+                    if (size < MAX_TERM_SIZE - 1) {
+                        term[size++] = tolower(byte);
+                    }
+
+                    continue;
+                }
+
+                if (size > 0) {
+                    term[size] = '\0';
+
+                    findTermCount(&table, &capacity, &numOfTerms, term)->count++;
+
+                    length++;
+
+                    size = 0;
+                }
+
+                if (byte == '\0') {
+                    break;
+                }
+            }
+
+            xmlFree(description);
+        }
+
+        model->lengths[numOfDocuments] = length > 0 ? length : 1;
+
+        char *category = getChildText(cur, "categoria");
+
+        if (category != NULL) {
+            model->categories[model->numOfCategories++] = strdup(category);
+
+            xmlFree(category);
+        }
+
+        char *price = getChildText(cur, "preco");
+
+        if (price != NULL) {
+            char *comma = strchr(price, ',');
+
+            if (comma != NULL) {
+                *comma = '.';
+            }
+
+            model->prices[model->numOfPrices++] = atof(price);
+
+            xmlFree(price);
+        }
+
+        numOfDocuments++;
+
+        if (numOfDocuments == numOfProducts / 2) {
+            halfNumOfTerms = numOfTerms;
+        }
+    }
+
+    xmlFreeDoc(doc);
+
+    model->numOfLengths = numOfDocuments;
+
+    if (numOfDocuments < 2 || numOfTerms < 2) {
+        fprintf(stderr, "Not enough documents in %s to fit the model\n", fileName);
+
+        return false;
+    }
+
+    /* Terms by rank */
+    TermCount *counts = malloc(numOfTerms * sizeof(TermCount));
+
+    int i;
+    int n = 0;
+
+    for (i = 0; i < capacity; i++) {
+        if (table[i].term != NULL) {
+            counts[n++] = table[i];
+        }
+    }
+
+    free(table);
+
+    qsort(counts, numOfTerms, sizeof(TermCount), compareTermCounts);
+
+    /* Zipf exponent: least squares fit of log(frequency) = c - s * log(rank) */
+    double sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+
+    int numOfPoints = 0;
+
+    for (i = 0; i < numOfTerms && counts[i].count >= MIN_FITTED_FREQUENCY; i++) {
+        double x = log(i + 1);
+        double y = log(counts[i].count);
+
+        sumX += x;
+        sumY += y;
+        sumXX += x * x;
+        sumXY += x * y;
+
+        numOfPoints++;
+    }
+
+    if (numOfPoints >= 2 && numOfPoints * sumXX - sumX * sumX > 0) {
+        model->zipfExponent = -(numOfPoints * sumXY - sumX * sumY) / (numOfPoints * sumXX - sumX * sumX);
+    }
+
+    /* Heaps' law from the vocabulary at half and at all of the documents */
+    if (halfNumOfTerms > 0 && halfNumOfTerms < numOfTerms) {
+        model->heapsExponent = log((double) numOfTerms / halfNumOfTerms) / log(2.0);
+    }
+
+    model->heapsK = numOfTerms / pow(numOfDocuments, model->heapsExponent);
+
+    model->terms = malloc(numOfTerms * sizeof(char *));
+    model->numOfTerms = numOfTerms;
+
+    for (i = 0; i < numOfTerms; i++) {
+        model->terms[i] = counts[i].term;
+    }
+
+    free(counts);
+
+    return true;
+}
+
+/*
+ * Model with the default parameters, used when no dataset is fitted
+ */
+void initDefaultCorpusModel(CorpusModel *model) {
+    model->zipfExponent = DEFAULT_ZIPF_EXPONENT;
+    model->heapsK = DEFAULT_HEAPS_K;
+    model->heapsExponent = DEFAULT_HEAPS_EXPONENT;
+
+    model->numOfTerms = sizeof(DEFAULT_TERMS) / sizeof(DEFAULT_TERMS[0]);
+    model->terms = malloc(model->numOfTerms * sizeof(char *));
+
+    int i;
+
+    for (i = 0; i < model->numOfTerms; i++) {
+        model->terms[i] = strdup(DEFAULT_TERMS[i]);
+    }
+
+    model->numOfLengths = DEFAULT_MAX_LENGTH - DEFAULT_MIN_LENGTH + 1;
+    model->lengths = malloc(model->numOfLengths * sizeof(int));
+
+    for (i = 0; i < model->numOfLengths; i++) {
+        model->lengths[i] = DEFAULT_MIN_LENGTH + i;
+    }
+
+    model->numOfCategories = sizeof(DEFAULT_CATEGORIES) / sizeof(DEFAULT_CATEGORIES[0]);
+    model->categories = malloc(model->numOfCategories * sizeof(char *));
+
+    for (i = 0; i < model->numOfCategories; i++) {
+        model->categories[i] = strdup(DEFAULT_CATEGORIES[i]);
+    }
+
+    model->numOfPrices = 0;
+    model->prices = NULL;
+}
+
+/*
+ * Release the memory of a model
+ */
+void freeCorpusModel(CorpusModel *model) {
+    int i;
+
+    for (i = 0; i < model->numOfTerms; i++) {
+        free(model->terms[i]);
+    }
+
+    for (i = 0; i < model->numOfCategories; i++) {
+        free(model->categories[i]);
+    }
+
+    free(model->terms);
+    free(model->categories);
+    free(model->lengths);
+    free(model->prices);
+}
+
+/*
+ * Term of a rank: the known terms first, then synthetic terms made of syllables (unique per rank)
+ */
+char *getTermOfRank(const CorpusModel *model, int rank) {
+    if (rank < model->numOfTerms) {
+        return strdup(model->terms[rank]);
+    }
+
+    const int NUM_OF_SYLLABLES = sizeof(SYLLABLES) / sizeof(SYLLABLES[0]);
+
+    char term[MAX_TERM_SIZE] = "";
+
+    int value = rank - model->numOfTerms;
+
+    /* At least 3 syllables, so the synthetic terms hardly collide with the known ones */
+    int i;
+
+    for (i = 0; i < 3 || value > 0; i++) {
+        strcat(term, SYLLABLES[value % NUM_OF_SYLLABLES]);
+
+        value /= NUM_OF_SYLLABLES;
+    }
+
+    return strdup(term);
+}
+
+/*
+ * Cumulative distribution of the Zipf distribution over 'numOfTerms' ranks
+ */
+double *createZipfDistribution(int numOfTerms, double exponent) {
+    double *distribution = malloc(numOfTerms * sizeof(double));
+
+    double sum = 0;
+
+    int i;
+
+    for (i = 0; i < numOfTerms; i++) {
+        sum += 1.0 / pow(i + 1, exponent);
+
+        distribution[i] = sum;
+    }
+
+    for (i = 0; i < numOfTerms; i++) {
+        distribution[i] /= sum;
+    }
+
+    return distribution;
+}
+
+/*
+ * Draw a rank from a cumulative distribution
+ */
+int drawRank(const double distribution[], int numOfTerms) {
+    double value = nextUniform();
+
+    int low = 0;
+    int high = numOfTerms - 1;
+
+    while (low < high) {
+        int middle = (low + high) / 2;
+
+        if (distribution[middle] < value) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+/*
+ * Write a text escaping the XML special characters
+ */
+void writeEscapedText(FILE *out, const char text[]) {
+    for (; *text; text++) {
+        switch (*text) {
+            case '&': fputs("&amp;", out); break;
+            case '<': fputs("&lt;", out); break;
+            case '>': fputs("&gt;", out); break;
+            default: fputc(*text, out);
+        }
+    }
+}
+
+/*
+ * Write the synthetic collection. Ids are sequential from 1, so the products take the positions 0 to n - 1
+ */
+void writeCorpus(FILE *out, const CorpusModel *model, char **terms, const double distribution[], int numOfTerms, int numOfProducts) {
+    fprintf(out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<produtos>\n");
+
+    int i, j;
+
+    for (i = 0; i < numOfProducts; i++) {
+        int length = model->lengths[nextRandom() % model->numOfLengths];
+
+        const char *category = model->categories[nextRandom() % model->numOfCategories];
+
+        double price = model->numOfPrices > 0 ? model->prices[nextRandom() % model->numOfPrices]
+                                              : 30 + (nextRandom() % 50000) / 100.0;
+
+        int ranks[3];
+
+        fprintf(out, "<produto><id>%d</id><titulo>", i + 1);
+
+        /* The title repeats the first terms of the description, as in the real products */
+        for (j = 0; j < length && j < 3; j++) {
+            ranks[j] = drawRank(distribution, numOfTerms);
+
+            fprintf(out, j == 0 ? "%s" : " %s", terms[ranks[j]]);
+        }
+
+        fprintf(out, "</titulo><categoria>");
+
+        writeEscapedText(out, category);
+
+        char priceText[32];
+
+        snprintf(priceText, sizeof(priceText), "%.2f", price);
+
+        *strchr(priceText, '.') = ',';
+
+        fprintf(out, "</categoria><preco>%s</preco><descricao>", priceText);
+
+        /* The description starts with the title terms */
+        for (j = 0; j < length; j++) {
+            int rank = j < 3 ? ranks[j] : drawRank(distribution, numOfTerms);
+
+            fprintf(out, j == 0 ? "%s" : " %s", terms[rank]);
+        }
+
+        fprintf(out, "</descricao><img>%d.jpg</img></produto>\n", i + 1);
+    }
+
+    fprintf(out, "</produtos>\n");
+}
+
+/*
+ * Write the query set: 1 to MAX_QUERY_TERMS terms per query, drawn from the same distribution of the
+ * descriptions, so the frequent terms are also the frequent queries
+ */
+void writeQueries(FILE *out, char **terms, const double distribution[], int numOfTerms, int numOfQueries) {
+    int i, j;
+
+    for (i = 0; i < numOfQueries; i++) {
+        int numOfQueryTerms = 1 + nextRandom() % MAX_QUERY_TERMS;
+
+        for (j = 0; j < numOfQueryTerms; j++) {
+            fprintf(out, j == 0 ? "%s" : " %s", terms[drawRank(distribution, numOfTerms)]);
+        }
+
+        fprintf(out, "\n");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        printf("Usage: %s <num of products> <xml file> <queries file> [options]\n", argv[0]);
+        printf("\n--fit <xml file> - Fit the term distribution, lengths, categories and prices to a real dataset");
+        printf("\n--queries <n> - Number of queries (1000 by default)");
+        printf("\n--seed <n> - Seed of the generator\n");
+
+        return EXIT_FAILURE;
+    }
+
+    int numOfProducts = atoi(argv[1]);
+
+    const char *fitFileName = NULL;
+
+    int numOfQueries = 1000;
+
+    int i;
+
+    for (i = 4; i < argc; i++) {
+        if (strcmp(argv[i], "--fit") == 0 && i + 1 < argc) {
+            fitFileName = argv[++i];
+        } else if (strcmp(argv[i], "--queries") == 0 && i + 1 < argc) {
+            numOfQueries = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            randomState = strtoull(argv[++i], NULL, 10) * 0x9e3779b97f4a7c15ULL + 1;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (numOfProducts <= 0) {
+        fprintf(stderr, "The number of products must be positive\n");
+
+        return EXIT_FAILURE;
+    }
+
+    CorpusModel model;
+
+    initDefaultCorpusModel(&model);
+
+    if (fitFileName != NULL) {
+        CorpusModel fitted = model;
+
+        if (!fitCorpusModel(&fitted, fitFileName)) {
+            return EXIT_FAILURE;
+        }
+
+        /* The fitted lists replace the default ones */
+        freeCorpusModel(&model);
+
+        model = fitted;
+
+        if (model.numOfCategories == 0) {
+            model.numOfCategories = 1;
+            model.categories = realloc(model.categories, sizeof(char *));
+            model.categories[0] = strdup(DEFAULT_CATEGORIES[0]);
+        }
+    }
+
+    int numOfTerms = (int) ceil(model.heapsK * pow(numOfProducts, model.heapsExponent));
+
+    if (numOfTerms < 1) {
+        numOfTerms = 1;
+    }
+
+    char **terms = malloc(numOfTerms * sizeof(char *));
+
+    for (i = 0; i < numOfTerms; i++) {
+        terms[i] = getTermOfRank(&model, i);
+    }
+
+    double *distribution = createZipfDistribution(numOfTerms, model.zipfExponent);
+
+    FILE *corpusFile = fopen(argv[2], "w");
+    FILE *queriesFile = fopen(argv[3], "w");
+
+    if (corpusFile == NULL || queriesFile == NULL) {
+        fprintf(stderr, "Could not open the output files\n");
+
+        return EXIT_FAILURE;
+    }
+
+    writeCorpus(corpusFile, &model, terms, distribution, numOfTerms, numOfProducts);
+    writeQueries(queriesFile, terms, distribution, numOfTerms, numOfQueries);
+
+    fclose(corpusFile);
+    fclose(queriesFile);
+
+    printf(ANSI_BOLD_WHITE "[" ANSI_COLOR_GREEN " DONE " ANSI_COLOR_RESET ANSI_BOLD_WHITE "]" ANSI_COLOR_RESET
+           " - " ANSI_COLOR_YELLOW "%d" ANSI_COLOR_RESET " products and " ANSI_COLOR_YELLOW "%d" ANSI_COLOR_RESET
+           " queries over %d terms (Zipf s = %.3f, Heaps V = %.2f * n^%.3f%s)\n", numOfProducts, numOfQueries,
+           numOfTerms, model.zipfExponent, model.heapsK, model.heapsExponent, fitFileName != NULL ? ", fitted" : "");
+
+    for (i = 0; i < numOfTerms; i++) {
+        free(terms[i]);
+    }
+
+    free(terms);
+    free(distribution);
+
+    freeCorpusModel(&model);
+
+    xmlCleanupParser();
+
+    return EXIT_SUCCESS;
+}
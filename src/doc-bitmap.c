@@ -0,0 +1,402 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "doc-bitmap.h"
+
+/*
+ * Create an empty bitmap, accounted to a subsystem
+ */
+DocBitmap *createDocBitmap(MemorySubsystem subsystem) {
+    DocBitmap *bitmap = trackedMalloc(subsystem, sizeof(DocBitmap));
+
+    bitmap->numOfContainers = 0;
+    bitmap->capacity = 0;
+    bitmap->containers = NULL;
+    bitmap->subsystem = subsystem;
+
+    return bitmap;
+}
+
+/*
+ * Release the memory of a bitmap
+ */
+void freeDocBitmap(DocBitmap *bitmap) {
+    if (bitmap == NULL) {
+        return;
+    }
+
+    int i;
+
+    for (i = 0; i < bitmap->numOfContainers; i++) {
+        trackedFree(bitmap->subsystem, bitmap->containers[i].values);
+        trackedFree(bitmap->subsystem, bitmap->containers[i].words);
+    }
+
+    trackedFree(bitmap->subsystem, bitmap->containers);
+    trackedFree(bitmap->subsystem, bitmap);
+}
+
+/*
+ * Find the position of the first container with key greater than or equal to 'key'
+ */
+int findBitmapContainer(const DocBitmap *bitmap, uint16_t key) {
+    int low = 0;
+    int high = bitmap->numOfContainers;
+
+    while (low < high) {
+        int middle = (low + high) / 2;
+
+        if (bitmap->containers[middle].key < key) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+/*
+ * Find the position of the first value of an array container greater than or equal to 'value'
+ */
+int findContainerValue(const BitmapContainer *container, uint16_t value) {
+    int low = 0;
+    int high = container->cardinality;
+
+    while (low < high) {
+        int middle = (low + high) / 2;
+
+        if (container->values[middle] < value) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+/*
+ * Insert an empty array container with the given key at a position of the bitmap
+ */
+BitmapContainer *insertBitmapContainer(DocBitmap *bitmap, int position, uint16_t key) {
+    if (bitmap->numOfContainers == bitmap->capacity) {
+        bitmap->capacity = bitmap->capacity == 0 ? 4 : bitmap->capacity * 2;
+
+        bitmap->containers = trackedRealloc(bitmap->subsystem, bitmap->containers, bitmap->capacity * sizeof(BitmapContainer));
+    }
+
+    memmove(&bitmap->containers[position + 1], &bitmap->containers[position],
+            (bitmap->numOfContainers - position) * sizeof(BitmapContainer));
+
+    bitmap->numOfContainers++;
+
+    BitmapContainer *container = &bitmap->containers[position];
+
+    container->key = key;
+    container->cardinality = 0;
+    container->values = NULL;
+    container->words = NULL;
+
+    return container;
+}
+
+/*
+ * Convert an array container that became too big to a bitmap container
+ */
+void convertToBitmapContainer(MemorySubsystem subsystem, BitmapContainer *container) {
+    container->words = trackedCalloc(subsystem, BITMAP_CONTAINER_WORDS, sizeof(uint64_t));
+
+    int i;
+
+    for (i = 0; i < container->cardinality; i++) {
+        container->words[container->values[i] >> 6] |= (uint64_t) 1 << (container->values[i] & 63);
+    }
+
+    trackedFree(subsystem, container->values);
+
+    container->values = NULL;
+}
+
+/*
+ * Add a doc id to a bitmap
+ */
+void addToDocBitmap(DocBitmap *bitmap, int docId) {
+    uint16_t key = docId >> 16;
+    uint16_t value = docId & 0xFFFF;
+
+    int position = findBitmapContainer(bitmap, key);
+
+    if (position == bitmap->numOfContainers || bitmap->containers[position].key != key) {
+        insertBitmapContainer(bitmap, position, key);
+    }
+
+    BitmapContainer *container = &bitmap->containers[position];
+
+    if (container->words != NULL) {
+        uint64_t bit = (uint64_t) 1 << (value & 63);
+
+        if (!(container->words[value >> 6] & bit)) {
+            container->words[value >> 6] |= bit;
+            container->cardinality++;
+        }
+
+        return;
+    }
+
+    int i = findContainerValue(container, value);
+
+    if (i < container->cardinality && container->values[i] == value) {
+        return;
+    }
+
+    container->values = trackedRealloc(bitmap->subsystem, container->values, (container->cardinality + 1) * sizeof(uint16_t));
+
+    memmove(&container->values[i + 1], &container->values[i], (container->cardinality - i) * sizeof(uint16_t));
+
+    container->values[i] = value;
+    container->cardinality++;
+
+    if (container->cardinality > BITMAP_ARRAY_MAX_SIZE) {
+        convertToBitmapContainer(bitmap->subsystem, container);
+    }
+}
+
+/*
+ * Return true if the bitmap contains the doc id
+ */
+bool docBitmapContains(const DocBitmap *bitmap, int docId) {
+    uint16_t key = docId >> 16;
+    uint16_t value = docId & 0xFFFF;
+
+    int position = findBitmapContainer(bitmap, key);
+
+    if (position == bitmap->numOfContainers || bitmap->containers[position].key != key) {
+        return false;
+    }
+
+    const BitmapContainer *container = &bitmap->containers[position];
+
+    if (container->words != NULL) {
+        return (container->words[value >> 6] >> (value & 63)) & 1;
+    }
+
+    int i = findContainerValue(container, value);
+
+    return i < container->cardinality && container->values[i] == value;
+}
+
+/*
+ * Return the smallest value of a container greater than or equal to 'value', or -1 if there is none
+ */
+int nextContainerValue(const BitmapContainer *container, int value) {
+    if (container->words == NULL) {
+        int i = findContainerValue(container, value);
+
+        return i < container->cardinality ? container->values[i] : -1;
+    }
+
+    int word = value >> 6;
+
+    /* Ignore the bits of the first word below 'value' */
+    uint64_t bits = container->words[word] & (~(uint64_t) 0 << (value & 63));
+
+    while (bits == 0) {
+        if (++word == BITMAP_CONTAINER_WORDS) {
+            return -1;
+        }
+
+        bits = container->words[word];
+    }
+
+    return word * 64 + __builtin_ctzll(bits);
+}
+
+/*
+ * Return the smallest doc id of the bitmap greater than or equal to 'docId', or -1 if there is none
+ */
+int nextDocBitmapDocId(const DocBitmap *bitmap, int docId) {
+    uint16_t key = docId >> 16;
+
+    int position = findBitmapContainer(bitmap, key);
+
+    for (; position < bitmap->numOfContainers; position++) {
+        const BitmapContainer *container = &bitmap->containers[position];
+
+        /* The following containers start at their lowest value */
+        int value = nextContainerValue(container, container->key == key ? docId & 0xFFFF : 0);
+
+        if (value >= 0) {
+            return (container->key << 16) | value;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * Expand a container to one bit per value
+ */
+void getContainerWords(const BitmapContainer *container, uint64_t words[]) {
+    if (container->words != NULL) {
+        memcpy(words, container->words, BITMAP_CONTAINER_WORDS * sizeof(uint64_t));
+
+        return;
+    }
+
+    memset(words, 0, BITMAP_CONTAINER_WORDS * sizeof(uint64_t));
+
+    int i;
+
+    for (i = 0; i < container->cardinality; i++) {
+        words[container->values[i] >> 6] |= (uint64_t) 1 << (container->values[i] & 63);
+    }
+}
+
+/*
+ * Append a container built from one bit per value to a bitmap, choosing the smallest representation.
+ * Empty containers are not appended
+ */
+void appendContainerFromWords(DocBitmap *bitmap, uint16_t key, const uint64_t words[]) {
+    int cardinality = 0;
+
+    int i;
+
+    for (i = 0; i < BITMAP_CONTAINER_WORDS; i++) {
+        cardinality += __builtin_popcountll(words[i]);
+    }
+
+    if (cardinality == 0) {
+        return;
+    }
+
+    BitmapContainer *container = insertBitmapContainer(bitmap, bitmap->numOfContainers, key);
+
+    container->cardinality = cardinality;
+
+    if (cardinality > BITMAP_ARRAY_MAX_SIZE) {
+        container->words = trackedMalloc(bitmap->subsystem, BITMAP_CONTAINER_WORDS * sizeof(uint64_t));
+
+        memcpy(container->words, words, BITMAP_CONTAINER_WORDS * sizeof(uint64_t));
+
+        return;
+    }
+
+    container->values = trackedMalloc(bitmap->subsystem, cardinality * sizeof(uint16_t));
+
+    int numOfValues = 0;
+
+    for (i = 0; i < BITMAP_CONTAINER_WORDS; i++) {
+        uint64_t bits = words[i];
+
+        while (bits != 0) {
+            container->values[numOfValues++] = i * 64 + __builtin_ctzll(bits);
+
+            bits &= bits - 1;
+        }
+    }
+}
+
+/*
+ * Combine two bitmaps container by container, with AND (intersection) or OR (union). The result is
+ * accounted to the subsystem of 'a'
+ */
+DocBitmap *combineDocBitmaps(const DocBitmap *a, const DocBitmap *b, bool isIntersection) {
+    DocBitmap *result = createDocBitmap(a->subsystem);
+
+    uint64_t *wordsA = trackedMalloc(a->subsystem, BITMAP_CONTAINER_WORDS * sizeof(uint64_t));
+    uint64_t *wordsB = trackedMalloc(a->subsystem, BITMAP_CONTAINER_WORDS * sizeof(uint64_t));
+
+    int i = 0;
+    int j = 0;
+
+    while (i < a->numOfContainers || j < b->numOfContainers) {
+        bool hasA = i < a->numOfContainers;
+        bool hasB = j < b->numOfContainers;
+
+        uint16_t keyA = hasA ? a->containers[i].key : 0;
+        uint16_t keyB = hasB ? b->containers[j].key : 0;
+
+        /* A key found in only one of the bitmaps */
+        if (!hasB || (hasA && keyA < keyB)) {
+            if (!isIntersection) {
+                getContainerWords(&a->containers[i], wordsA);
+                appendContainerFromWords(result, keyA, wordsA);
+            }
+
+            i++;
+        } else if (!hasA || keyB < keyA) {
+            if (!isIntersection) {
+                getContainerWords(&b->containers[j], wordsB);
+                appendContainerFromWords(result, keyB, wordsB);
+            }
+
+            j++;
+        } else {
+            getContainerWords(&a->containers[i], wordsA);
+            getContainerWords(&b->containers[j], wordsB);
+
+            int w;
+
+            for (w = 0; w < BITMAP_CONTAINER_WORDS; w++) {
+                wordsA[w] = isIntersection ? wordsA[w] & wordsB[w] : wordsA[w] | wordsB[w];
+            }
+
+            appendContainerFromWords(result, keyA, wordsA);
+
+            i++;
+            j++;
+        }
+    }
+
+    trackedFree(a->subsystem, wordsA);
+    trackedFree(a->subsystem, wordsB);
+
+    return result;
+}
+
+/*
+ * Return a new bitmap with the doc ids found in both bitmaps, accounted to the subsystem of 'a'
+ */
+DocBitmap *intersectDocBitmaps(const DocBitmap *a, const DocBitmap *b) {
+    return combineDocBitmaps(a, b, true);
+}
+
+/*
+ * Return a new bitmap with the doc ids found in any of the bitmaps, accounted to the subsystem of 'a'
+ */
+DocBitmap *uniteDocBitmaps(const DocBitmap *a, const DocBitmap *b) {
+    return combineDocBitmaps(a, b, false);
+}
+
+/*
+ * Number of doc ids of a bitmap
+ */
+long getDocBitmapCardinality(const DocBitmap *bitmap) {
+    long cardinality = 0;
+
+    int i;
+
+    for (i = 0; i < bitmap->numOfContainers; i++) {
+        cardinality += bitmap->containers[i].cardinality;
+    }
+
+    return cardinality;
+}
+
+/*
+ * Size in bytes of a bitmap
+ */
+long getDocBitmapSize(const DocBitmap *bitmap) {
+    long size = sizeof(DocBitmap) + bitmap->capacity * sizeof(BitmapContainer);
+
+    int i;
+
+    for (i = 0; i < bitmap->numOfContainers; i++) {
+        const BitmapContainer *container = &bitmap->containers[i];
+
+        size += container->words != NULL ? BITMAP_CONTAINER_WORDS * sizeof(uint64_t) : container->cardinality * sizeof(uint16_t);
+    }
+
+    return size;
+}
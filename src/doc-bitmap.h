@@ -0,0 +1,75 @@
+#ifndef DOC_BITMAP_H
+#define DOC_BITMAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "memory-accounting.h"
+
+/* Max cardinality of an array container. Above it a container is stored as a bitmap of 2^16 bits */
+#define BITMAP_ARRAY_MAX_SIZE 4096
+/* Number of 64 bits words of a bitmap container */
+#define BITMAP_CONTAINER_WORDS 1024
+
+/* This struct represents the doc ids of a compressed bitmap sharing the same 16 high bits */
+typedef struct BitmapContainer {
+    uint16_t key; /* 16 high bits of the doc ids */
+    int cardinality;
+    uint16_t *values; /* array container: 16 low bits of the doc ids, sorted. NULL for bitmap containers */
+    uint64_t *words; /* bitmap container: one bit per 16 low bits value. NULL for array containers */
+} BitmapContainer;
+
+/* This struct represents a set of doc ids as a compressed (roaring-style) bitmap */
+typedef struct DocBitmap {
+    int numOfContainers;
+    int capacity;
+    BitmapContainer *containers; /* sorted by key */
+    MemorySubsystem subsystem; /* owner of the memory: the document table (categories) or a query (filters) */
+} DocBitmap;
+
+/*
+ * Create an empty bitmap, accounted to a subsystem
+ */
+DocBitmap *createDocBitmap(MemorySubsystem subsystem);
+
+/*
+ * Release the memory of a bitmap
+ */
+void freeDocBitmap(DocBitmap *bitmap);
+
+/*
+ * Add a doc id to a bitmap
+ */
+void addToDocBitmap(DocBitmap *bitmap, int docId);
+
+/*
+ * Return true if the bitmap contains the doc id
+ */
+bool docBitmapContains(const DocBitmap *bitmap, int docId);
+
+/*
+ * Return the smallest doc id of the bitmap greater than or equal to 'docId', or -1 if there is none
+ */
+int nextDocBitmapDocId(const DocBitmap *bitmap, int docId);
+
+/*
+ * Return a new bitmap with the doc ids found in both bitmaps, accounted to the subsystem of 'a'
+ */
+DocBitmap *intersectDocBitmaps(const DocBitmap *a, const DocBitmap *b);
+
+/*
+ * Return a new bitmap with the doc ids found in any of the bitmaps, accounted to the subsystem of 'a'
+ */
+DocBitmap *uniteDocBitmaps(const DocBitmap *a, const DocBitmap *b);
+
+/*
+ * Number of doc ids of a bitmap
+ */
+long getDocBitmapCardinality(const DocBitmap *bitmap);
+
+/*
+ * Size in bytes of a bitmap
+ */
+long getDocBitmapSize(const DocBitmap *bitmap);
+
+#endif
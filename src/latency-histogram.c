@@ -0,0 +1,128 @@
+#include <stdlib.h>
+
+#include "latency-histogram.h"
+#include "memory-accounting.h"
+
+/* Highest latency kept, in nanoseconds. The longer latencies are counted in the last bucket */
+#define MAX_LATENCY_NANOSECONDS ((1L << 42) - 1)
+
+/*
+ * Create an empty histogram
+ */
+LatencyHistogram *createLatencyHistogram() {
+    return trackedCalloc(MEMORY_QUERY, 1, sizeof(LatencyHistogram));
+}
+
+/*
+ * Release the memory of a histogram
+ */
+void freeLatencyHistogram(LatencyHistogram *histogram) {
+    trackedFree(MEMORY_QUERY, histogram);
+}
+
+/*
+ * Bucket of a latency in nanoseconds: the values below 2 * LATENCY_SUB_BUCKETS have their own bucket, the
+ * other ones keep the 6 bits after their most significant bit
+ */
+int getLatencyBucket(long nanoseconds) {
+    if (nanoseconds < 2 * LATENCY_SUB_BUCKETS) {
+        return nanoseconds;
+    }
+
+    int shift = 63 - __builtin_clzl(nanoseconds) - 6;
+
+    return 2 * LATENCY_SUB_BUCKETS + (shift - 1) * LATENCY_SUB_BUCKETS + (int) (nanoseconds >> shift) - LATENCY_SUB_BUCKETS;
+}
+
+/*
+ * Highest latency, in nanoseconds, counted in a bucket
+ */
+long getLatencyBucketUpperBound(int bucket) {
+    if (bucket < 2 * LATENCY_SUB_BUCKETS) {
+        return bucket;
+    }
+
+    int shift = (bucket - 2 * LATENCY_SUB_BUCKETS) / LATENCY_SUB_BUCKETS + 1;
+
+    long mantissa = (bucket - 2 * LATENCY_SUB_BUCKETS) % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS;
+
+    return ((mantissa + 1) << shift) - 1;
+}
+
+/*
+ * Record a latency, in seconds
+ */
+void recordLatency(LatencyHistogram *histogram, double seconds) {
+    long nanoseconds = seconds > 0 ? (long) (seconds * 1e9) : 0;
+
+    if (nanoseconds > MAX_LATENCY_NANOSECONDS) {
+        nanoseconds = MAX_LATENCY_NANOSECONDS;
+    }
+
+    histogram->counts[getLatencyBucket(nanoseconds)]++;
+    histogram->totalCount++;
+    histogram->sumSeconds += seconds;
+
+    if (seconds > histogram->maxSeconds) {
+        histogram->maxSeconds = seconds;
+    }
+}
+
+/*
+ * Add the latencies of a histogram to another one
+ */
+void addLatencyHistogram(LatencyHistogram *histogram, const LatencyHistogram *other) {
+    int i;
+
+    for (i = 0; i < NUM_OF_LATENCY_BUCKETS; i++) {
+        histogram->counts[i] += other->counts[i];
+    }
+
+    histogram->totalCount += other->totalCount;
+    histogram->sumSeconds += other->sumSeconds;
+
+    if (other->maxSeconds > histogram->maxSeconds) {
+        histogram->maxSeconds = other->maxSeconds;
+    }
+}
+
+/*
+ * Latency, in seconds, below which the given percentile (0 to 100) of the latencies are. It is the upper
+ * bound of the bucket of the percentile, so it is never lower than the real value
+ */
+double getLatencyPercentile(const LatencyHistogram *histogram, double percentile) {
+    if (histogram->totalCount == 0) {
+        return 0;
+    }
+
+    /* Rank of the latency of the percentile, from 1 to totalCount */
+    long rank = (long) (percentile / 100 * histogram->totalCount + 0.5);
+
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    long count = 0;
+
+    int i;
+
+    for (i = 0; i < NUM_OF_LATENCY_BUCKETS; i++) {
+        count += histogram->counts[i];
+
+        if (count >= rank) {
+            double upperBound = getLatencyBucketUpperBound(i) / 1e9;
+
+            /* No percentile is above the highest latency recorded */
+            return upperBound < histogram->maxSeconds ? upperBound : histogram->maxSeconds;
+        }
+    }
+
+    return histogram->maxSeconds;
+}
+
+/*
+ * Average latency, in seconds
+ */
+double getMeanLatency(const LatencyHistogram *histogram) {
+    return histogram->totalCount > 0 ? histogram->sumSeconds / histogram->totalCount : 0;
+}
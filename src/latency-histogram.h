@@ -0,0 +1,50 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+/* Each power of two of nanoseconds is split in 64 buckets, so a latency is kept with an error below 1.6% */
+#define LATENCY_SUB_BUCKETS 64
+
+/* Number of buckets: exact values up to 127 ns, then 64 buckets per power of two up to 2^42 ns (73 minutes) */
+#define NUM_OF_LATENCY_BUCKETS (2 * LATENCY_SUB_BUCKETS + 35 * LATENCY_SUB_BUCKETS)
+
+/* This struct represents a log-linear histogram of latencies (HdrHistogram style): recording a latency
+ costs a few instructions and the memory does not grow with the number of latencies */
+typedef struct LatencyHistogram {
+    long counts[NUM_OF_LATENCY_BUCKETS];
+    long totalCount;
+    double sumSeconds;
+    double maxSeconds;
+} LatencyHistogram;
+
+/*
+ * Create an empty histogram
+ */
+LatencyHistogram *createLatencyHistogram();
+
+/*
+ * Release the memory of a histogram
+ */
+void freeLatencyHistogram(LatencyHistogram *histogram);
+
+/*
+ * Record a latency, in seconds
+ */
+void recordLatency(LatencyHistogram *histogram, double seconds);
+
+/*
+ * Add the latencies of a histogram to another one
+ */
+void addLatencyHistogram(LatencyHistogram *histogram, const LatencyHistogram *other);
+
+/*
+ * Latency, in seconds, below which the given percentile (0 to 100) of the latencies are. It is the upper
+ * bound of the bucket of the percentile, so it is never lower than the real value
+ */
+double getLatencyPercentile(const LatencyHistogram *histogram, double percentile);
+
+/*
+ * Average latency, in seconds
+ */
+double getMeanLatency(const LatencyHistogram *histogram);
+
+#endif
@@ -0,0 +1,251 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+/* Usable size of a block, from the allocator when it tells it. Otherwise (or when MEMORY_SIZE_HEADER is
+ defined) each block keeps its size in a header in front of it */
+#if !defined(MEMORY_SIZE_HEADER) && defined(__APPLE__)
+#include <malloc/malloc.h>
+#define getUsableSize(pointer) malloc_size(pointer)
+#elif !defined(MEMORY_SIZE_HEADER) && defined(__FreeBSD__)
+#include <malloc_np.h>
+#define getUsableSize(pointer) malloc_usable_size(pointer)
+#elif !defined(MEMORY_SIZE_HEADER) && defined(__linux__)
+#include <malloc.h>
+#define getUsableSize(pointer) malloc_usable_size(pointer)
+#elif !defined(MEMORY_SIZE_HEADER)
+#define MEMORY_SIZE_HEADER
+#endif
+
+#include "memory-accounting.h"
+
+/* This struct represents the counters of a subsystem, updated by any thread (searches, workers, reloads) */
+typedef struct MemoryCounters {
+    atomic_long liveBytes;
+    atomic_long peakBytes;
+    atomic_long numOfAllocations;
+    atomic_long numOfFrees;
+} MemoryCounters;
+
+static MemoryCounters memoryCounters[NUM_OF_MEMORY_SUBSYSTEMS];
+
+/* Counters of all the subsystems together, so the peak is the one of their sum at a time */
+static MemoryCounters totalMemoryCounters;
+
+static const char *memorySubsystemNames[NUM_OF_MEMORY_SUBSYSTEMS] = {
+    "dictionary", "postings", "documents", "image vectors", "ingest scratch", "query scratch"
+};
+
+#ifdef MEMORY_SIZE_HEADER
+/* Header of a block with its requested size, aligned for any type so the block after it is too */
+typedef union BlockHeader {
+    size_t size;
+    max_align_t alignment;
+} BlockHeader;
+
+/*
+ * Header of a block
+ */
+static BlockHeader *getBlockHeader(void *pointer) {
+    return (BlockHeader *) pointer - 1;
+}
+
+/*
+ * Size of a block, as requested
+ */
+static size_t getBlockSize(void *pointer) {
+    return getBlockHeader(pointer)->size;
+}
+
+/*
+ * Block with a size header: realloc() of the header of a block, or malloc() of a new one for NULL
+ */
+static void *reallocateBlock(void *pointer, size_t size) {
+    if (size > SIZE_MAX - sizeof(BlockHeader)) {
+        return NULL;
+    }
+
+    BlockHeader *header = realloc(pointer != NULL ? getBlockHeader(pointer) : NULL, sizeof(BlockHeader) + size);
+
+    if (header == NULL) {
+        return NULL;
+    }
+
+    header->size = size;
+
+    return header + 1;
+}
+
+/*
+ * Block with a size header: calloc()
+ */
+static void *allocateZeroedBlock(size_t count, size_t size) {
+    if (size > 0 && count > SIZE_MAX / size) {
+        return NULL;
+    }
+
+    void *pointer = reallocateBlock(NULL, count * size);
+
+    if (pointer != NULL) {
+        memset(pointer, 0, count * size);
+    }
+
+    return pointer;
+}
+
+/*
+ * Block with a size header: free()
+ */
+static void freeBlock(void *pointer) {
+    free(getBlockHeader(pointer));
+}
+#else
+#define getBlockSize(pointer) getUsableSize(pointer)
+#define reallocateBlock(pointer, size) realloc(pointer, size)
+#define allocateZeroedBlock(count, size) calloc(count, size)
+#define freeBlock(pointer) free(pointer)
+#endif
+
+/*
+ * Add a number of bytes (negative for a release) to the live bytes of some counters, raising their peak if needed
+ */
+void addCountersLiveBytes(MemoryCounters *counters, long bytes) {
+    long live = atomic_fetch_add(&counters->liveBytes, bytes) + bytes;
+
+    long peak = atomic_load(&counters->peakBytes);
+
+    while (live > peak && !atomic_compare_exchange_weak(&counters->peakBytes, &peak, live)) {
+    }
+}
+
+/*
+ * Add a number of bytes (negative for a release) to the live bytes of a subsystem and of the total
+ */
+void addLiveBytes(MemorySubsystem subsystem, long bytes) {
+    addCountersLiveBytes(&memoryCounters[subsystem], bytes);
+    addCountersLiveBytes(&totalMemoryCounters, bytes);
+}
+
+/*
+ * Count an allocation or a release of a subsystem and of the total
+ */
+void countBlock(MemorySubsystem subsystem, bool isAllocation) {
+    atomic_fetch_add(isAllocation ? &memoryCounters[subsystem].numOfAllocations : &memoryCounters[subsystem].numOfFrees, 1);
+    atomic_fetch_add(isAllocation ? &totalMemoryCounters.numOfAllocations : &totalMemoryCounters.numOfFrees, 1);
+}
+
+/*
+ * Account a new block to a subsystem. The size of the block is read back, so the free of the block, which
+ * has no size, subtracts exactly what was added
+ */
+void *accountAllocation(MemorySubsystem subsystem, void *pointer) {
+    if (pointer != NULL) {
+        addLiveBytes(subsystem, getBlockSize(pointer));
+
+        countBlock(subsystem, true);
+    }
+
+    return pointer;
+}
+
+/*
+ * malloc() accounted to a subsystem
+ */
+void *trackedMalloc(MemorySubsystem subsystem, size_t size) {
+    return accountAllocation(subsystem, reallocateBlock(NULL, size));
+}
+
+/*
+ * calloc() accounted to a subsystem
+ */
+void *trackedCalloc(MemorySubsystem subsystem, size_t count, size_t size) {
+    return accountAllocation(subsystem, allocateZeroedBlock(count, size));
+}
+
+/*
+ * realloc() of a block of a subsystem (NULL allocates a new one)
+ */
+void *trackedRealloc(MemorySubsystem subsystem, void *pointer, size_t size) {
+    if (pointer == NULL) {
+        return trackedMalloc(subsystem, size);
+    }
+
+    long previousSize = getBlockSize(pointer);
+
+    void *newPointer = reallocateBlock(pointer, size);
+
+    /* On failure the block is still the previous one */
+    if (newPointer != NULL) {
+        addLiveBytes(subsystem, (long) getBlockSize(newPointer) - previousSize);
+    }
+
+    return newPointer;
+}
+
+/*
+ * strdup() accounted to a subsystem
+ */
+char *trackedStrdup(MemorySubsystem subsystem, const char string[]) {
+    size_t size = strlen(string) + 1;
+
+    char *copy = reallocateBlock(NULL, size);
+
+    if (copy != NULL) {
+        memcpy(copy, string, size);
+    }
+
+    return accountAllocation(subsystem, copy);
+}
+
+/*
+ * free() of a block allocated for a subsystem. The subsystem must be the one of the allocation
+ */
+void trackedFree(MemorySubsystem subsystem, void *pointer) {
+    if (pointer == NULL) {
+        return;
+    }
+
+    addLiveBytes(subsystem, -(long) getBlockSize(pointer));
+
+    countBlock(subsystem, false);
+
+    freeBlock(pointer);
+}
+
+/*
+ * Read some counters
+ */
+MemoryUsage readMemoryCounters(MemoryCounters *counters) {
+    MemoryUsage usage;
+
+    usage.liveBytes = atomic_load(&counters->liveBytes);
+    usage.peakBytes = atomic_load(&counters->peakBytes);
+    usage.numOfAllocations = atomic_load(&counters->numOfAllocations);
+    usage.numOfFrees = atomic_load(&counters->numOfFrees);
+
+    return usage;
+}
+
+/*
+ * Heap usage of a subsystem
+ */
+MemoryUsage getMemoryUsage(MemorySubsystem subsystem) {
+    return readMemoryCounters(&memoryCounters[subsystem]);
+}
+
+/*
+ * Heap usage of all the subsystems together
+ */
+MemoryUsage getTotalMemoryUsage() {
+    return readMemoryCounters(&totalMemoryCounters);
+}
+
+/*
+ * Name of a subsystem, as printed in the reports
+ */
+const char *getMemorySubsystemName(MemorySubsystem subsystem) {
+    return memorySubsystemNames[subsystem];
+}
@@ -0,0 +1,66 @@
+#ifndef MEMORY_ACCOUNTING_H
+#define MEMORY_ACCOUNTING_H
+
+#include <stddef.h>
+
+/* Subsystems the heap allocations of the index and of the searches are accounted to */
+typedef enum MemorySubsystem {
+    MEMORY_DICTIONARY, /* vocabulary hash table, terms, frozen dictionary and suggestions trie */
+    MEMORY_POSTINGS, /* documents of each term, positions, impact-ordered and compressed postings */
+    MEMORY_DOCUMENTS, /* document table: entries, norms, categories and price column */
+    MEMORY_VECTORS, /* quantized image vectors, their codebooks and the exact vectors of the re-ranking */
+    MEMORY_INGEST, /* scratch of the indexing: products, descriptions, tokens and layout buffers */
+    MEMORY_QUERY, /* scratch of the searches: accumulators, parsed queries, filters and cursors */
+    NUM_OF_MEMORY_SUBSYSTEMS
+} MemorySubsystem;
+
+/* This struct represents the heap usage of a subsystem. Sizes are the usable sizes of the blocks, or their
+ requested sizes where the allocator does not report them */
+typedef struct MemoryUsage {
+    long liveBytes;
+    long peakBytes; /* highest live bytes so far */
+    long numOfAllocations;
+    long numOfFrees;
+} MemoryUsage;
+
+/*
+ * malloc() accounted to a subsystem
+ */
+void *trackedMalloc(MemorySubsystem subsystem, size_t size);
+
+/*
+ * calloc() accounted to a subsystem
+ */
+void *trackedCalloc(MemorySubsystem subsystem, size_t count, size_t size);
+
+/*
+ * realloc() of a block of a subsystem (NULL allocates a new one)
+ */
+void *trackedRealloc(MemorySubsystem subsystem, void *pointer, size_t size);
+
+/*
+ * strdup() accounted to a subsystem
+ */
+char *trackedStrdup(MemorySubsystem subsystem, const char string[]);
+
+/*
+ * free() of a block allocated for a subsystem. The subsystem must be the one of the allocation
+ */
+void trackedFree(MemorySubsystem subsystem, void *pointer);
+
+/*
+ * Heap usage of a subsystem
+ */
+MemoryUsage getMemoryUsage(MemorySubsystem subsystem);
+
+/*
+ * Heap usage of all the subsystems together. The peak is the highest sum of their live bytes at a time
+ */
+MemoryUsage getTotalMemoryUsage();
+
+/*
+ * Name of a subsystem, as printed in the reports
+ */
+const char *getMemorySubsystemName(MemorySubsystem subsystem);
+
+#endif
@@ -0,0 +1,254 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "near-duplicates.h"
+#include "memory-accounting.h"
+
+/*
+ * Next value of a SplitMix64 sequence, used to derive the hash functions of the signature
+ */
+uint64_t nextSplitMix64(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+    return z ^ (z >> 31);
+}
+
+/*
+ * Create an empty index of texts whose near-duplicates have at least an estimated Jaccard similarity
+ */
+NearDuplicateIndex *createNearDuplicateIndex(double minSimilarity) {
+    NearDuplicateIndex *index = trackedCalloc(MEMORY_INGEST, 1, sizeof(NearDuplicateIndex));
+
+    index->minSimilarity = minSimilarity;
+    index->numOfBuckets = 1024;
+    index->buckets = trackedMalloc(MEMORY_INGEST, index->numOfBuckets * sizeof(int));
+
+    memset(index->buckets, -1, index->numOfBuckets * sizeof(int));
+
+    return index;
+}
+
+/*
+ * Release the memory of an index
+ */
+void freeNearDuplicateIndex(NearDuplicateIndex *index) {
+    if (index == NULL) {
+        return;
+    }
+
+    trackedFree(MEMORY_INGEST, index->signatures);
+    trackedFree(MEMORY_INGEST, index->ids);
+    trackedFree(MEMORY_INGEST, index->nodes);
+    trackedFree(MEMORY_INGEST, index->buckets);
+    trackedFree(MEMORY_INGEST, index);
+}
+
+/*
+ * MinHash signature of the shingles of a text, its words case folded. A text shorter than a shingle is one
+ * shingle. Returns false if the text has no words
+ */
+bool computeMinHashSignature(const char text[], uint32_t signature[MINHASH_SIGNATURE_SIZE]) {
+    int numOfWords = 0;
+    int capacity = 64;
+
+    uint64_t *wordHashes = trackedMalloc(MEMORY_INGEST, capacity * sizeof(uint64_t));
+
+    const char *character = text;
+
+    while (*character != '\0') {
+        while (*character != '\0' && isspace((unsigned char) *character)) {
+            character++;
+        }
+
+        if (*character == '\0') {
+            break;
+        }
+
+        /* FNV-1a of the word */
+        uint64_t hash = 0xCBF29CE484222325ULL;
+
+        for (; *character != '\0' && !isspace((unsigned char) *character); character++) {
+            hash = (hash ^ (unsigned char) tolower((unsigned char) *character)) * 0x100000001B3ULL;
+        }
+
+        if (numOfWords == capacity) {
+            capacity *= 2;
+
+            wordHashes = trackedRealloc(MEMORY_INGEST, wordHashes, capacity * sizeof(uint64_t));
+        }
+
+        wordHashes[numOfWords++] = hash;
+    }
+
+    if (numOfWords == 0) {
+        trackedFree(MEMORY_INGEST, wordHashes);
+
+        return false;
+    }
+
+    /* Hash functions of the signature: a * x + b on 64 bits, keeping the high 32 bits */
+    uint64_t multipliers[MINHASH_SIGNATURE_SIZE];
+    uint64_t increments[MINHASH_SIGNATURE_SIZE];
+
+    uint64_t state = 0x5EED;
+
+    int i, j;
+
+    for (i = 0; i < MINHASH_SIGNATURE_SIZE; i++) {
+        multipliers[i] = nextSplitMix64(&state) | 1;
+        increments[i] = nextSplitMix64(&state);
+
+        signature[i] = UINT32_MAX;
+    }
+
+    int shingleSize = numOfWords < SHINGLE_SIZE ? numOfWords : SHINGLE_SIZE;
+
+    for (j = 0; j + shingleSize <= numOfWords; j++) {
+        uint64_t shingle = 0;
+
+        /* The order of the words matters, so the hash of the shingle is rotated before each one */
+        for (i = 0; i < shingleSize; i++) {
+            shingle = ((shingle << 21) | (shingle >> 43)) ^ wordHashes[j + i];
+        }
+
+        shingle = nextSplitMix64(&shingle);
+
+        for (i = 0; i < MINHASH_SIGNATURE_SIZE; i++) {
+            uint32_t value = (multipliers[i] * shingle + increments[i]) >> 32;
+
+            if (value < signature[i]) {
+                signature[i] = value;
+            }
+        }
+    }
+
+    trackedFree(MEMORY_INGEST, wordHashes);
+
+    return true;
+}
+
+/*
+ * Hash of a band of a signature, different for each band
+ */
+uint64_t getBandKey(const uint32_t signature[MINHASH_SIGNATURE_SIZE], int band) {
+    uint64_t key = band;
+
+    int i;
+
+    for (i = 0; i < MINHASH_ROWS; i++) {
+        key = (key ^ signature[band * MINHASH_ROWS + i]) * 0x9E3779B97F4A7C15ULL;
+
+        key ^= key >> 29;
+    }
+
+    return key;
+}
+
+/*
+ * Id of the text of the index most similar to a signature, if its estimated similarity is at least the minimum
+ * of the index. Returns -1 if there is no such text
+ */
+int findNearDuplicate(const NearDuplicateIndex *index, const uint32_t signature[MINHASH_SIGNATURE_SIZE]) {
+    int bestSignature = -1;
+    int bestMatches = 0;
+
+    int band, i;
+
+    for (band = 0; band < MINHASH_BANDS; band++) {
+        uint64_t key = getBandKey(signature, band);
+
+        int node = index->buckets[key & (index->numOfBuckets - 1)];
+
+        for (; node >= 0; node = index->nodes[node].next) {
+            /* The best candidate so far is not compared again for its other equal bands */
+            if (index->nodes[node].key != key || index->nodes[node].signature == bestSignature) {
+                continue;
+            }
+
+            const uint32_t *candidate = index->signatures + (long) index->nodes[node].signature * MINHASH_SIGNATURE_SIZE;
+
+            int matches = 0;
+
+            for (i = 0; i < MINHASH_SIGNATURE_SIZE; i++) {
+                matches += candidate[i] == signature[i];
+            }
+
+            if (matches > bestMatches) {
+                bestMatches = matches;
+                bestSignature = index->nodes[node].signature;
+            }
+        }
+    }
+
+    if (bestSignature < 0 || bestMatches < index->minSimilarity * MINHASH_SIGNATURE_SIZE) {
+        return -1;
+    }
+
+    return index->ids[bestSignature];
+}
+
+/*
+ * Link a node to the chain of its bucket
+ */
+void linkLshNode(NearDuplicateIndex *index, int node) {
+    int bucket = index->nodes[node].key & (index->numOfBuckets - 1);
+
+    index->nodes[node].next = index->buckets[bucket];
+    index->buckets[bucket] = node;
+}
+
+/*
+ * Add the signature of a text to the index
+ */
+void addNearDuplicateCandidate(NearDuplicateIndex *index, const uint32_t signature[MINHASH_SIGNATURE_SIZE], int id) {
+    if (index->numOfSignatures == index->signaturesCapacity) {
+        index->signaturesCapacity = index->signaturesCapacity == 0 ? 256 : index->signaturesCapacity * 2;
+
+        index->signatures = trackedRealloc(MEMORY_INGEST, index->signatures,
+                                           (long) index->signaturesCapacity * MINHASH_SIGNATURE_SIZE * sizeof(uint32_t));
+        index->ids = trackedRealloc(MEMORY_INGEST, index->ids, index->signaturesCapacity * sizeof(int));
+        index->nodes = trackedRealloc(MEMORY_INGEST, index->nodes, (long) index->signaturesCapacity * MINHASH_BANDS * sizeof(LshNode));
+    }
+
+    int numOfNodes = (index->numOfSignatures + 1) * MINHASH_BANDS;
+
+    /* The buckets are doubled as the nodes reach their number, so the chains stay short */
+    if (numOfNodes > index->numOfBuckets) {
+        while (numOfNodes > index->numOfBuckets) {
+            index->numOfBuckets *= 2;
+        }
+
+        trackedFree(MEMORY_INGEST, index->buckets);
+
+        index->buckets = trackedMalloc(MEMORY_INGEST, index->numOfBuckets * sizeof(int));
+
+        memset(index->buckets, -1, index->numOfBuckets * sizeof(int));
+
+        int node;
+
+        for (node = 0; node < index->numOfSignatures * MINHASH_BANDS; node++) {
+            linkLshNode(index, node);
+        }
+    }
+
+    int signatureIndex = index->numOfSignatures++;
+
+    memcpy(index->signatures + (long) signatureIndex * MINHASH_SIGNATURE_SIZE, signature, MINHASH_SIGNATURE_SIZE * sizeof(uint32_t));
+
+    index->ids[signatureIndex] = id;
+
+    int band;
+
+    for (band = 0; band < MINHASH_BANDS; band++) {
+        int node = signatureIndex * MINHASH_BANDS + band;
+
+        index->nodes[node].key = getBandKey(signature, band);
+        index->nodes[node].signature = signatureIndex;
+
+        linkLshNode(index, node);
+    }
+}
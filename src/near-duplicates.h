@@ -0,0 +1,64 @@
+#ifndef NEAR_DUPLICATES_H
+#define NEAR_DUPLICATES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Number of words of a shingle */
+#define SHINGLE_SIZE 3
+/* Number of min hashes of a signature. The share of equal min hashes of two signatures estimates the
+ Jaccard similarity of their shingles with a standard deviation below 0.07 */
+#define MINHASH_SIGNATURE_SIZE 64
+/* The signature is split in bands of MINHASH_ROWS min hashes, and two texts are compared if any band is equal:
+ a pair with similarity s is found with probability 1 - (1 - s^4)^16, 0.89 at 0.6 and 0.9998 at 0.8 */
+#define MINHASH_BANDS 16
+#define MINHASH_ROWS (MINHASH_SIGNATURE_SIZE / MINHASH_BANDS)
+
+/* This struct represents a band of a signature in the chain of its LSH bucket */
+typedef struct LshNode {
+    uint64_t key; /* hash of the band and its index */
+    int signature;
+    int next; /* next node of the bucket, -1 for the last one */
+} LshNode;
+
+/* This struct represents the MinHash signatures of the texts seen so far, with their bands hashed to LSH
+ buckets, so the texts similar to a new one are found without comparing it to all of them */
+typedef struct NearDuplicateIndex {
+    double minSimilarity; /* estimated Jaccard similarity of a near-duplicate */
+    int numOfSignatures;
+    int signaturesCapacity;
+    uint32_t *signatures; /* MINHASH_SIGNATURE_SIZE per text */
+    int *ids; /* caller id of each text */
+    LshNode *nodes; /* MINHASH_BANDS per text */
+    int *buckets; /* first node of each bucket, -1 if empty */
+    int numOfBuckets; /* power of two, at least the number of nodes */
+} NearDuplicateIndex;
+
+/*
+ * Create an empty index of texts whose near-duplicates have at least an estimated Jaccard similarity
+ */
+NearDuplicateIndex *createNearDuplicateIndex(double minSimilarity);
+
+/*
+ * Release the memory of an index
+ */
+void freeNearDuplicateIndex(NearDuplicateIndex *index);
+
+/*
+ * MinHash signature of the shingles of a text, its words case folded. A text shorter than a shingle is one
+ * shingle. Returns false if the text has no words
+ */
+bool computeMinHashSignature(const char text[], uint32_t signature[MINHASH_SIGNATURE_SIZE]);
+
+/*
+ * Id of the text of the index most similar to a signature, if its estimated similarity is at least the minimum
+ * of the index. Returns -1 if there is no such text
+ */
+int findNearDuplicate(const NearDuplicateIndex *index, const uint32_t signature[MINHASH_SIGNATURE_SIZE]);
+
+/*
+ * Add the signature of a text to the index
+ */
+void addNearDuplicateCandidate(NearDuplicateIndex *index, const uint32_t signature[MINHASH_SIGNATURE_SIZE], int id);
+
+#endif
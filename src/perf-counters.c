@@ -0,0 +1,119 @@
+#include <string.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "perf-counters.h"
+
+#ifdef __linux__
+/* Generic hardware event of each counter */
+static const unsigned long long perfEventConfigs[NUM_OF_PERF_COUNTERS] = {
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_REFERENCES,
+    PERF_COUNT_HW_CACHE_MISSES
+};
+
+/*
+ * Open one hardware event of the current thread, counting user space only
+ */
+int openPerfEvent(unsigned long long config) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+/*
+ * Open the hardware counters of the current thread. Returns false when none of them is available
+ * (e.g. not Linux, a virtual machine without a PMU or perf_event_paranoid too restrictive)
+ */
+bool openPerfCounters(PerfCounters *counters) {
+    bool available = false;
+
+    int i;
+
+    for (i = 0; i < NUM_OF_PERF_COUNTERS; i++) {
+#ifdef __linux__
+        counters->fds[i] = openPerfEvent(perfEventConfigs[i]);
+#else
+        counters->fds[i] = -1;
+#endif
+        counters->values[i] = 0;
+
+        available = available || counters->fds[i] >= 0;
+    }
+
+    return available;
+}
+
+/*
+ * Reset and enable the counters
+ */
+void startPerfCounters(PerfCounters *counters) {
+#ifdef __linux__
+    int i;
+
+    for (i = 0; i < NUM_OF_PERF_COUNTERS; i++) {
+        if (counters->fds[i] >= 0) {
+            ioctl(counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+/*
+ * Disable the counters and read their values
+ */
+void stopPerfCounters(PerfCounters *counters) {
+#ifdef __linux__
+    int i;
+
+    for (i = 0; i < NUM_OF_PERF_COUNTERS; i++) {
+        if (counters->fds[i] >= 0) {
+            ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+            if (read(counters->fds[i], &counters->values[i], sizeof(long long)) != sizeof(long long)) {
+                counters->values[i] = 0;
+            }
+        }
+    }
+#endif
+}
+
+/*
+ * Return true if the event was counted
+ */
+bool isPerfCounterAvailable(const PerfCounters *counters, PerfCounterEvent event) {
+    return counters->fds[event] >= 0;
+}
+
+/*
+ * Close the counters
+ */
+void closePerfCounters(PerfCounters *counters) {
+#ifdef __linux__
+    int i;
+
+    for (i = 0; i < NUM_OF_PERF_COUNTERS; i++) {
+        if (counters->fds[i] >= 0) {
+            close(counters->fds[i]);
+        }
+
+        counters->fds[i] = -1;
+    }
+#endif
+}
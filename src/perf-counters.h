@@ -0,0 +1,46 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdbool.h>
+
+/* Hardware events counted around a piece of code */
+typedef enum PerfCounterEvent {
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_REFERENCES,
+    PERF_CACHE_MISSES,
+    NUM_OF_PERF_COUNTERS
+} PerfCounterEvent;
+
+/* This struct represents a group of hardware performance counters of the current thread */
+typedef struct PerfCounters {
+    int fds[NUM_OF_PERF_COUNTERS]; /* -1 when the event could not be opened */
+    long long values[NUM_OF_PERF_COUNTERS];
+} PerfCounters;
+
+/*
+ * Open the hardware counters of the current thread. Returns false when none of them is available
+ * (e.g. not Linux, a virtual machine without a PMU or perf_event_paranoid too restrictive)
+ */
+bool openPerfCounters(PerfCounters *counters);
+
+/*
+ * Reset and enable the counters
+ */
+void startPerfCounters(PerfCounters *counters);
+
+/*
+ * Disable the counters and read their values
+ */
+void stopPerfCounters(PerfCounters *counters);
+
+/*
+ * Return true if the event was counted
+ */
+bool isPerfCounterAvailable(const PerfCounters *counters, PerfCounterEvent event);
+
+/*
+ * Close the counters
+ */
+void closePerfCounters(PerfCounters *counters);
+
+#endif
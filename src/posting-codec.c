@@ -0,0 +1,664 @@
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "posting-codec.h"
+#include "memory-accounting.h"
+
+/* Number of values of a lane of a full block */
+#define VALUES_PER_LANE (POSTING_BLOCK_SIZE / POSTING_BLOCK_LANES)
+
+/*
+ * Number of bits needed to represent a value
+ */
+int getBitsNeeded(uint32_t value) {
+    int bits = 0;
+
+    while (value != 0) {
+        bits++;
+
+        value >>= 1;
+    }
+
+    return bits;
+}
+
+/*
+ * Number of 32 bits words used to pack a block of values
+ */
+unsigned int getPackedWords(int numOfValues, int bits) {
+    if (numOfValues == POSTING_BLOCK_SIZE) {
+        return POSTING_BLOCK_LANES * ((VALUES_PER_LANE * bits + 31) / 32);
+    }
+
+    return (numOfValues * bits + 31) / 32;
+}
+
+/*
+ * Pack 'numOfValues' values with 'bits' bits each in a stream of words. The strides allow the
+ * same routine to pack a sequential block or one lane of an interleaved block
+ */
+void packStream(const uint32_t *in, int inStride, int numOfValues, int bits, uint32_t *out, int outStride) {
+    uint64_t buffer = 0;
+
+    int filled = 0;
+
+    int i;
+
+    for (i = 0; i < numOfValues; i++) {
+        buffer |= (uint64_t) in[i * inStride] << filled;
+
+        filled += bits;
+
+        if (filled >= 32) {
+            *out = (uint32_t) buffer;
+            out += outStride;
+
+            buffer >>= 32;
+            filled -= 32;
+        }
+    }
+
+    if (filled > 0) {
+        *out = (uint32_t) buffer;
+    }
+}
+
+/*
+ * Unpack a stream of words packed by packStream()
+ */
+void unpackStream(const uint32_t *in, int inStride, int numOfValues, int bits, uint32_t *out, int outStride) {
+    uint64_t buffer = 0;
+
+    uint64_t mask = bits == 32 ? 0xFFFFFFFFu : (1u << bits) - 1;
+
+    int filled = 0;
+
+    int i;
+
+    for (i = 0; i < numOfValues; i++) {
+        if (filled < bits) {
+            buffer |= (uint64_t) *in << filled;
+            in += inStride;
+
+            filled += 32;
+        }
+
+        out[i * outStride] = (uint32_t) (buffer & mask);
+
+        buffer >>= bits;
+        filled -= bits;
+    }
+}
+
+#if defined(__AVX2__)
+
+/*
+ * Unpack the 8 interleaved lanes of a full block at once, one value of every lane per step
+ */
+void unpackLanes(const uint32_t *in, int bits, uint32_t *out) {
+    __m256i mask = _mm256_set1_epi32(bits == 32 ? -1 : (int) ((1u << bits) - 1));
+
+    __m256i current = _mm256_loadu_si256((const __m256i *) in);
+
+    int shift = 0;
+
+    int j;
+
+    for (j = 0; j < VALUES_PER_LANE; j++) {
+        __m256i value = _mm256_srl_epi32(current, _mm_cvtsi32_si128(shift));
+
+        int consumed = shift;
+
+        shift += bits;
+
+        if (shift >= 32) {
+            shift -= 32;
+
+            /* The next word is only loaded if there are more bits to read from it */
+            if (j < VALUES_PER_LANE - 1 || shift > 0) {
+                in += POSTING_BLOCK_LANES;
+
+                current = _mm256_loadu_si256((const __m256i *) in);
+
+                value = _mm256_or_si256(value, _mm256_sll_epi32(current, _mm_cvtsi32_si128(32 - consumed)));
+            }
+        }
+
+        _mm256_storeu_si256((__m256i *) (out + j * POSTING_BLOCK_LANES), _mm256_and_si256(value, mask));
+    }
+}
+
+#elif defined(__SSE2__)
+
+/*
+ * Unpack the 8 interleaved lanes of a full block as two halves of 4 lanes, one value of every
+ * lane of the half per step
+ */
+void unpackLanes(const uint32_t *in, int bits, uint32_t *out) {
+    __m128i mask = _mm_set1_epi32(bits == 32 ? -1 : (int) ((1u << bits) - 1));
+
+    int half;
+
+    for (half = 0; half < POSTING_BLOCK_LANES; half += 4) {
+        const uint32_t *word = in + half;
+
+        __m128i current = _mm_loadu_si128((const __m128i *) word);
+
+        int shift = 0;
+
+        int j;
+
+        for (j = 0; j < VALUES_PER_LANE; j++) {
+            __m128i value = _mm_srl_epi32(current, _mm_cvtsi32_si128(shift));
+
+            int consumed = shift;
+
+            shift += bits;
+
+            if (shift >= 32) {
+                shift -= 32;
+
+                /* The next word is only loaded if there are more bits to read from it */
+                if (j < VALUES_PER_LANE - 1 || shift > 0) {
+                    word += POSTING_BLOCK_LANES;
+
+                    current = _mm_loadu_si128((const __m128i *) word);
+
+                    value = _mm_or_si128(value, _mm_sll_epi32(current, _mm_cvtsi32_si128(32 - consumed)));
+                }
+            }
+
+            _mm_storeu_si128((__m128i *) (out + j * POSTING_BLOCK_LANES + half), _mm_and_si128(value, mask));
+        }
+    }
+}
+
+#else
+
+/*
+ * Unpack the 8 interleaved lanes of a full block, one lane at a time
+ */
+void unpackLanes(const uint32_t *in, int bits, uint32_t *out) {
+    int lane;
+
+    for (lane = 0; lane < POSTING_BLOCK_LANES; lane++) {
+        unpackStream(in + lane, POSTING_BLOCK_LANES, VALUES_PER_LANE, bits, out + lane, POSTING_BLOCK_LANES);
+    }
+}
+
+#endif
+
+/*
+ * Name of the instruction set used to unpack the blocks
+ */
+const char *getPostingCodecInstructionSet() {
+#if defined(__AVX2__)
+    return "AVX2";
+#elif defined(__SSE2__)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+/*
+ * Pack a block of values. Full blocks are interleaved in lanes, so they can be unpacked by SIMD
+ * instructions, and the last (partial) block of a term is packed sequentially
+ */
+void packBlock(const uint32_t values[], int numOfValues, int bits, uint32_t out[]) {
+    if (numOfValues == POSTING_BLOCK_SIZE) {
+        int lane;
+
+        for (lane = 0; lane < POSTING_BLOCK_LANES; lane++) {
+            packStream(values + lane, POSTING_BLOCK_LANES, VALUES_PER_LANE, bits, out + lane, POSTING_BLOCK_LANES);
+        }
+    } else {
+        packStream(values, 1, numOfValues, bits, out, 1);
+    }
+}
+
+/*
+ * Unpack a block of values packed by packBlock()
+ */
+void unpackBlock(const uint32_t in[], int numOfValues, int bits, uint32_t values[]) {
+    if (bits == 0) {
+        memset(values, 0, numOfValues * sizeof(uint32_t));
+    } else if (numOfValues == POSTING_BLOCK_SIZE) {
+        unpackLanes(in, bits, values);
+    } else {
+        unpackStream(in, 1, numOfValues, bits, values, 1);
+    }
+}
+
+/*
+ * Compress the postings of a term. The doc ids must be sorted in ascending order
+ */
+CompressedPostings *compressPostings(const int docIds[], const int tfs[], const double impacts[], int numOfPostings, bool packed) {
+    CompressedPostings *postings = trackedMalloc(MEMORY_POSTINGS, sizeof(CompressedPostings));
+
+    postings->numOfPostings = numOfPostings;
+    postings->numOfBlocks = (numOfPostings + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE;
+    postings->packed = packed;
+    postings->blocks = trackedMalloc(MEMORY_POSTINGS, postings->numOfBlocks * sizeof(PostingBlock));
+
+    /* A packed block never needs more words than values, so this is the size of the worst case */
+    postings->data = trackedMalloc(MEMORY_POSTINGS, (2 * numOfPostings + 1) * sizeof(uint32_t));
+    postings->dataSize = 0;
+
+    uint32_t docIdValues[POSTING_BLOCK_SIZE];
+    uint32_t tfValues[POSTING_BLOCK_SIZE];
+
+    int block;
+
+    for (block = 0; block < postings->numOfBlocks; block++) {
+        PostingBlock *skipEntry = &postings->blocks[block];
+
+        int first = block * POSTING_BLOCK_SIZE;
+        int numOfValues = numOfPostings - first < POSTING_BLOCK_SIZE ? numOfPostings - first : POSTING_BLOCK_SIZE;
+
+        skipEntry->firstDocId = docIds[first];
+        skipEntry->lastDocId = docIds[first + numOfValues - 1];
+        skipEntry->numOfPostings = numOfValues;
+        skipEntry->maxImpact = 0;
+
+        uint32_t maxDocIdValue = 0;
+        uint32_t maxTFValue = 0;
+
+        int i;
+
+        for (i = 0; i < numOfValues; i++) {
+            /* Doc ids are delta-encoded inside the block, as the first one is kept by the skip entry */
+            if (packed) {
+                docIdValues[i] = i == 0 ? 0 : docIds[first + i] - docIds[first + i - 1];
+            } else {
+                docIdValues[i] = docIds[first + i];
+            }
+
+            tfValues[i] = tfs[first + i] - 1;
+
+            if (docIdValues[i] > maxDocIdValue) {
+                maxDocIdValue = docIdValues[i];
+            }
+
+            if (tfValues[i] > maxTFValue) {
+                maxTFValue = tfValues[i];
+            }
+
+            if (impacts != NULL && impacts[first + i] > skipEntry->maxImpact) {
+                skipEntry->maxImpact = impacts[first + i];
+            }
+        }
+
+        skipEntry->docIdBits = packed ? getBitsNeeded(maxDocIdValue) : 32;
+        skipEntry->tfBits = packed ? getBitsNeeded(maxTFValue) : 32;
+
+        skipEntry->docIdOffset = postings->dataSize;
+
+        packBlock(docIdValues, numOfValues, skipEntry->docIdBits, postings->data + postings->dataSize);
+
+        postings->dataSize += getPackedWords(numOfValues, skipEntry->docIdBits);
+
+        skipEntry->tfOffset = postings->dataSize;
+
+        packBlock(tfValues, numOfValues, skipEntry->tfBits, postings->data + postings->dataSize);
+
+        postings->dataSize += getPackedWords(numOfValues, skipEntry->tfBits);
+    }
+
+    postings->data = trackedRealloc(MEMORY_POSTINGS, postings->data, (postings->dataSize + 1) * sizeof(uint32_t));
+
+    return postings;
+}
+
+/*
+ * Release the memory of compressed postings
+ */
+void freeCompressedPostings(CompressedPostings *postings) {
+    if (postings == NULL) {
+        return;
+    }
+
+    trackedFree(MEMORY_POSTINGS, postings->blocks);
+    trackedFree(MEMORY_POSTINGS, postings->data);
+    trackedFree(MEMORY_POSTINGS, postings);
+}
+
+/*
+ * Size in bytes of compressed postings, including the skip entries
+ */
+long getCompressedPostingsSize(const CompressedPostings *postings) {
+    return sizeof(CompressedPostings) + postings->numOfBlocks * sizeof(PostingBlock) + postings->dataSize * sizeof(uint32_t);
+}
+
+/*
+ * Decode the doc ids of a block
+ */
+void decodePostingBlockDocIds(const CompressedPostings *postings, int block, uint32_t docIds[]) {
+    const PostingBlock *skipEntry = &postings->blocks[block];
+
+    unpackBlock(postings->data + skipEntry->docIdOffset, skipEntry->numOfPostings, skipEntry->docIdBits, docIds);
+
+    if (postings->packed) {
+        docIds[0] = skipEntry->firstDocId;
+
+        int i;
+
+        for (i = 1; i < skipEntry->numOfPostings; i++) {
+            docIds[i] += docIds[i - 1];
+        }
+    }
+}
+
+/*
+ * Decode the tfs of a block
+ */
+void decodePostingBlockTFs(const CompressedPostings *postings, int block, uint32_t tfs[]) {
+    const PostingBlock *skipEntry = &postings->blocks[block];
+
+    unpackBlock(postings->data + skipEntry->tfOffset, skipEntry->numOfPostings, skipEntry->tfBits, tfs);
+
+    int i;
+
+    for (i = 0; i < skipEntry->numOfPostings; i++) {
+        tfs[i]++;
+    }
+}
+
+/*
+ * Decode the doc ids and tfs of a block
+ */
+void decodePostingBlock(const CompressedPostings *postings, int block, uint32_t docIds[], uint32_t tfs[]) {
+    decodePostingBlockDocIds(postings, block, docIds);
+    decodePostingBlockTFs(postings, block, tfs);
+}
+
+/*
+ * Move the cursor to the first posting of a block, decoding only its doc ids
+ */
+void enterPostingBlock(PostingCursor *cursor, int block) {
+    cursor->block = block;
+    cursor->index = 0;
+    cursor->tfDecoded = false;
+
+    decodePostingBlockDocIds(cursor->postings, block, cursor->docIds);
+
+    cursor->decodedBlocks++;
+
+    cursor->docId = cursor->docIds[0];
+}
+
+/*
+ * Position the cursor on the first posting of the postings
+ */
+void openPostingCursor(PostingCursor *cursor, const CompressedPostings *postings) {
+    cursor->postings = postings;
+    cursor->decodedBlocks = 0;
+    cursor->block = 0;
+    cursor->index = 0;
+    cursor->docId = -1;
+
+    if (postings != NULL && postings->numOfPostings > 0) {
+        enterPostingBlock(cursor, 0);
+    }
+}
+
+/*
+ * Move the cursor to the next posting. Returns false when there are no more postings
+ */
+bool nextPosting(PostingCursor *cursor) {
+    if (cursor->docId < 0) {
+        return false;
+    }
+
+    cursor->index++;
+
+    if (cursor->index < cursor->postings->blocks[cursor->block].numOfPostings) {
+        cursor->docId = cursor->docIds[cursor->index];
+
+        return true;
+    }
+
+    if (cursor->block + 1 < cursor->postings->numOfBlocks) {
+        enterPostingBlock(cursor, cursor->block + 1);
+
+        return true;
+    }
+
+    cursor->docId = -1;
+
+    return false;
+}
+
+/*
+ * Find the first block after 'block' whose last doc id is greater than or equal to 'docId', probing the
+ * skip entries at exponentially growing distances and then binary searching the last range. Returns
+ * the number of blocks if there is no such block
+ */
+int gallopToBlock(const CompressedPostings *postings, int block, int docId) {
+    int low = block + 1;
+    int bound = 1;
+
+    while (low + bound - 1 < postings->numOfBlocks && postings->blocks[low + bound - 1].lastDocId < docId) {
+        low += bound;
+        bound *= 2;
+    }
+
+    int high = low + bound - 1 < postings->numOfBlocks ? low + bound - 1 : postings->numOfBlocks;
+
+    /* The answer is in [low, high], where 'high' may be the number of blocks */
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+
+        if (postings->blocks[middle].lastDocId < docId) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+/*
+ * Find the first position after 'index' of a decoded block whose doc id is greater than or equal to
+ * 'docId', by the same galloping search. The last doc id of the block must be greater than or equal to 'docId'
+ */
+int gallopInBlock(const uint32_t docIds[], int numOfPostings, int index, int docId) {
+    int low = index + 1;
+    int bound = 1;
+
+    while (low + bound - 1 < numOfPostings && (int) docIds[low + bound - 1] < docId) {
+        low += bound;
+        bound *= 2;
+    }
+
+    int high = low + bound - 1 < numOfPostings - 1 ? low + bound - 1 : numOfPostings - 1;
+
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+
+        if ((int) docIds[middle] < docId) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+/*
+ * Move the cursor to the first posting with doc id greater than or equal to 'docId', galloping over
+ * the skip entries so the blocks that end before it are never decoded. Returns false when there is no such posting
+ */
+bool nextPostingGEQ(PostingCursor *cursor, int docId) {
+    if (cursor->docId < 0) {
+        return false;
+    }
+
+    if (cursor->docId >= docId) {
+        return true;
+    }
+
+    const CompressedPostings *postings = cursor->postings;
+
+    if (postings->blocks[cursor->block].lastDocId < docId) {
+        int block = gallopToBlock(postings, cursor->block, docId);
+
+        if (block == postings->numOfBlocks) {
+            cursor->docId = -1;
+
+            return false;
+        }
+
+        enterPostingBlock(cursor, block);
+
+        if (cursor->docId >= docId) {
+            return true;
+        }
+    }
+
+    cursor->index = gallopInBlock(cursor->docIds, postings->blocks[cursor->block].numOfPostings, cursor->index, docId);
+
+    cursor->docId = cursor->docIds[cursor->index];
+
+    return true;
+}
+
+/*
+ * Term frequency of the current posting of the cursor
+ */
+int getPostingCursorTF(PostingCursor *cursor) {
+    if (!cursor->tfDecoded) {
+        decodePostingBlockTFs(cursor->postings, cursor->block, cursor->tfs);
+
+        cursor->tfDecoded = true;
+    }
+
+    return cursor->tfs[cursor->index];
+}
+
+/*
+ * Ordinal of the current posting of the cursor, used to find its positions
+ */
+int getPostingCursorOrdinal(const PostingCursor *cursor) {
+    return cursor->block * POSTING_BLOCK_SIZE + cursor->index;
+}
+
+/*
+ * Write a value as a variable-byte integer: 7 bits per byte, the high bit set on all bytes but the last.
+ * Returns the number of bytes written
+ */
+int encodeVarByte(uint32_t value, unsigned char out[]) {
+    int size = 0;
+
+    while (value >= 0x80) {
+        out[size++] = (unsigned char) (value | 0x80);
+
+        value >>= 7;
+    }
+
+    out[size++] = (unsigned char) value;
+
+    return size;
+}
+
+/*
+ * Compress the positions of the doc-ordered postings of a term. Each posting has 'tfs[i]' positions,
+ * sorted in ascending order
+ */
+PositionalPostings *compressPositions(int numOfPostings, const int tfs[], const int *const positions[]) {
+    PositionalPostings *compressed = trackedMalloc(MEMORY_POSTINGS, sizeof(PositionalPostings));
+
+    long numOfPositions = 0;
+
+    int i, j;
+
+    for (i = 0; i < numOfPostings; i++) {
+        numOfPositions += tfs[i];
+    }
+
+    compressed->numOfPostings = numOfPostings;
+    compressed->offsets = trackedMalloc(MEMORY_POSTINGS, (numOfPostings + 1) * sizeof(unsigned int));
+
+    /* A 32 bits value never needs more than 5 bytes */
+    compressed->data = trackedMalloc(MEMORY_POSTINGS, numOfPositions * 5 + 1);
+
+    unsigned int size = 0;
+
+    for (i = 0; i < numOfPostings; i++) {
+        compressed->offsets[i] = size;
+
+        int previous = 0;
+
+        for (j = 0; j < tfs[i]; j++) {
+            size += encodeVarByte(positions[i][j] - previous, compressed->data + size);
+
+            previous = positions[i][j];
+        }
+    }
+
+    compressed->offsets[numOfPostings] = size;
+
+    compressed->data = trackedRealloc(MEMORY_POSTINGS, compressed->data, size + 1);
+
+    return compressed;
+}
+
+/*
+ * Release the memory of compressed positions
+ */
+void freePositionalPostings(PositionalPostings *positions) {
+    if (positions == NULL) {
+        return;
+    }
+
+    trackedFree(MEMORY_POSTINGS, positions->offsets);
+    trackedFree(MEMORY_POSTINGS, positions->data);
+    trackedFree(MEMORY_POSTINGS, positions);
+}
+
+/*
+ * Size in bytes of compressed positions
+ */
+long getPositionalPostingsSize(const PositionalPostings *positions) {
+    return sizeof(PositionalPostings) + (positions->numOfPostings + 1) * sizeof(unsigned int) + positions->offsets[positions->numOfPostings];
+}
+
+/*
+ * Decode the positions of the posting with the given ordinal. Returns the number of positions
+ */
+int decodePositions(const PositionalPostings *positions, int ordinal, int out[]) {
+    const unsigned char *p = positions->data + positions->offsets[ordinal];
+    const unsigned char *end = positions->data + positions->offsets[ordinal + 1];
+
+    int numOfPositions = 0;
+
+    int previous = 0;
+
+    while (p < end) {
+        uint32_t value = 0;
+
+        int shift = 0;
+
+        while (*p & 0x80) {
+            value |= (uint32_t) (*p++ & 0x7F) << shift;
+
+            shift += 7;
+        }
+
+        value |= (uint32_t) *p++ << shift;
+
+        previous += value;
+
+        out[numOfPositions++] = previous;
+    }
+
+    return numOfPositions;
+}
@@ -0,0 +1,126 @@
+#ifndef POSTING_CODEC_H
+#define POSTING_CODEC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Number of postings per compressed block. Full blocks are packed in 8 interleaved lanes of 16 values */
+#define POSTING_BLOCK_SIZE 128
+/* Number of interleaved lanes of a full block (one AVX2 register of 32 bits integers) */
+#define POSTING_BLOCK_LANES 8
+
+/* This struct represents the skip entry of a block of postings */
+typedef struct PostingBlock {
+    int firstDocId;
+    int lastDocId;
+    float maxImpact; /* highest idf * document tf of the block */
+    unsigned int docIdOffset; /* offset (in 32 bits words) of the packed doc ids in 'data' */
+    unsigned int tfOffset; /* offset (in 32 bits words) of the packed tfs in 'data' */
+    unsigned char numOfPostings;
+    unsigned char docIdBits;
+    unsigned char tfBits;
+} PostingBlock;
+
+/* This struct represents the postings of a term in doc id order, split into compressed blocks */
+typedef struct CompressedPostings {
+    int numOfPostings;
+    int numOfBlocks;
+    bool packed; /* false means doc ids and tfs are stored as plain 32 bits values */
+    PostingBlock *blocks; /* skip entries */
+    uint32_t *data;
+    unsigned int dataSize; /* number of 32 bits words in 'data' */
+} CompressedPostings;
+
+/* This struct represents the positions of a term in each of its doc-ordered postings, as a section
+ apart from the postings. The positions of a posting are delta-encoded as variable-byte integers */
+typedef struct PositionalPostings {
+    int numOfPostings;
+    unsigned int *offsets; /* numOfPostings + 1 offsets of the positions of each posting in 'data' */
+    unsigned char *data;
+} PositionalPostings;
+
+/* This struct iterates the postings of a term, decoding a block only when the cursor enters it */
+typedef struct PostingCursor {
+    const CompressedPostings *postings;
+    int block; /* current block */
+    int index; /* position inside the current block */
+    int docId; /* current doc id, or -1 after the last posting */
+    bool tfDecoded; /* the tfs of the current block are decoded on the first getPostingCursorTF() */
+    uint32_t docIds[POSTING_BLOCK_SIZE];
+    uint32_t tfs[POSTING_BLOCK_SIZE];
+    long decodedBlocks;
+} PostingCursor;
+
+/*
+ * Compress the postings of a term. The doc ids must be sorted in ascending order
+ */
+CompressedPostings *compressPostings(const int docIds[], const int tfs[], const double impacts[], int numOfPostings, bool packed);
+
+/*
+ * Release the memory of compressed postings
+ */
+void freeCompressedPostings(CompressedPostings *postings);
+
+/*
+ * Size in bytes of compressed postings, including the skip entries
+ */
+long getCompressedPostingsSize(const CompressedPostings *postings);
+
+/*
+ * Decode the doc ids and tfs of a block
+ */
+void decodePostingBlock(const CompressedPostings *postings, int block, uint32_t docIds[], uint32_t tfs[]);
+
+/*
+ * Position the cursor on the first posting of the postings
+ */
+void openPostingCursor(PostingCursor *cursor, const CompressedPostings *postings);
+
+/*
+ * Move the cursor to the next posting. Returns false when there are no more postings
+ */
+bool nextPosting(PostingCursor *cursor);
+
+/*
+ * Move the cursor to the first posting with doc id greater than or equal to 'docId', galloping over
+ * the skip entries so the blocks that end before it are never decoded. Returns false when there is no such posting
+ */
+bool nextPostingGEQ(PostingCursor *cursor, int docId);
+
+/*
+ * Term frequency of the current posting of the cursor
+ */
+int getPostingCursorTF(PostingCursor *cursor);
+
+/*
+ * Ordinal of the current posting of the cursor, used to find its positions
+ */
+int getPostingCursorOrdinal(const PostingCursor *cursor);
+
+/*
+ * Compress the positions of the doc-ordered postings of a term. Each posting has 'tfs[i]' positions,
+ * sorted in ascending order
+ */
+PositionalPostings *compressPositions(int numOfPostings, const int tfs[], const int *const positions[]);
+
+/*
+ * Release the memory of compressed positions
+ */
+void freePositionalPostings(PositionalPostings *positions);
+
+/*
+ * Size in bytes of compressed positions
+ */
+long getPositionalPostingsSize(const PositionalPostings *positions);
+
+/*
+ * Decode the positions of the posting with the given ordinal. Returns the number of positions
+ */
+int decodePositions(const PositionalPostings *positions, int ordinal, int out[]);
+
+/*
+ * Name of the instruction set used to unpack the blocks
+ */
+const char *getPostingCodecInstructionSet();
+
+#endif
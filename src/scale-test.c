@@ -0,0 +1,441 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/*
+ * Scale test of the search engine: for each scale (number of products), a synthetic collection and its
+ * query set are generated by the corpus generator, and the search engine indexes the collection and answers
+ * the queries. Its output is read through a pipe: the index time goes from the start to the "were indexed"
+ * message and the query time from the message to the exit. The peak RSS of the run is also measured. The
+ * results are printed as a table and optionally written as CSV, one line per scale, so they can be plotted
+ * against the previous results
+ */
+
+#define ANSI_COLOR_RED     "\x1b[31m"
+#define ANSI_COLOR_GREEN   "\x1b[32m"
+#define ANSI_COLOR_YELLOW  "\x1b[33m"
+#define ANSI_COLOR_RESET   "\x1b[0m"
+#define ANSI_BOLD_WHITE    "\x1b[1m"
+
+/* Max number of scales of a test */
+#define MAX_SCALES 32
+/* Max number of options passed to the search engine */
+#define MAX_ENGINE_OPTIONS 32
+/* Max size of a path built by the harness */
+#define MAX_PATH_SIZE 1024
+
+/* This struct represents the measures of a run of a program */
+typedef struct RunMeasures {
+    double wallSeconds;
+    double peakRssMegabytes;
+    int exitStatus;
+} RunMeasures;
+
+/* This struct represents the results of a scale */
+typedef struct ScaleResult {
+    int numOfProducts;
+    int numOfIndexedDocuments;
+    double indexSeconds;
+    double querySeconds;
+    double queriesPerSecond;
+    double peakRssMegabytes;
+} ScaleResult;
+
+/*
+ * Wall clock time in seconds
+ */
+double getWallSeconds() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*
+ * Start a program with its stdin redirected to a file (NULL for /dev/null) and its stdout to a file descriptor.
+ * Returns the pid of the program
+ */
+pid_t startProgram(char *const arguments[], const char inputFileName[], int output) {
+    pid_t pid = fork();
+
+    if (pid < 0) {
+        perror("fork");
+
+        exit(EXIT_FAILURE);
+    }
+
+    if (pid == 0) {
+        int input = open(inputFileName != NULL ? inputFileName : "/dev/null", O_RDONLY);
+
+        if (input < 0) {
+            perror(inputFileName);
+
+            _exit(127);
+        }
+
+        dup2(input, STDIN_FILENO);
+        dup2(output, STDOUT_FILENO);
+
+        execv(arguments[0], arguments);
+
+        perror(arguments[0]);
+
+        _exit(127);
+    }
+
+    return pid;
+}
+
+/*
+ * Wait for a program and fill its exit status and peak RSS in the measures
+ */
+void waitProgram(pid_t pid, RunMeasures *measures) {
+    int status;
+
+    struct rusage usage;
+
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        perror("wait4");
+
+        measures->exitStatus = -1;
+
+        return;
+    }
+
+    measures->peakRssMegabytes = usage.ru_maxrss / 1024.0; /* ru_maxrss is in kilobytes on Linux */
+    measures->exitStatus = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+/*
+ * Run a program with its output discarded and measure it
+ */
+RunMeasures runProgram(char *const arguments[]) {
+    RunMeasures measures = {0, 0, -1};
+
+    double begin = getWallSeconds();
+
+    int output = open("/dev/null", O_WRONLY);
+
+    pid_t pid = startProgram(arguments, NULL, output);
+
+    close(output);
+
+    waitProgram(pid, &measures);
+
+    measures.wallSeconds = getWallSeconds() - begin;
+
+    return measures;
+}
+
+/*
+ * Remove the color codes (ESC [ ... m) of a line in place
+ */
+void removeColorCodes(char line[]) {
+    char *in = line;
+    char *out = line;
+
+    while (*in) {
+        if (*in == '\x1b' && in[1] == '[') {
+            in += 2;
+
+            while (*in && *in != 'm') {
+                in++;
+            }
+
+            if (*in) {
+                in++;
+            }
+        } else {
+            *out++ = *in++;
+        }
+    }
+
+    *out = '\0';
+}
+
+/*
+ * Run the search engine on the input of a scale, reading its output to split the index and the query times
+ */
+RunMeasures runSearchEngine(char *const arguments[], const char inputFileName[], ScaleResult *result) {
+    RunMeasures measures = {0, 0, -1};
+
+    int pipeFds[2];
+
+    if (pipe(pipeFds) < 0) {
+        perror("pipe");
+
+        return measures;
+    }
+
+    double begin = getWallSeconds();
+
+    pid_t pid = startProgram(arguments, inputFileName, pipeFds[1]);
+
+    close(pipeFds[1]);
+
+    FILE *output = fdopen(pipeFds[0], "r");
+
+    char line[4096];
+
+    double indexedSeconds = -1;
+
+    result->numOfIndexedDocuments = -1;
+
+    while (fgets(line, sizeof(line), output) != NULL) {
+        if (indexedSeconds >= 0 || strstr(line, "were indexed") == NULL) {
+            continue;
+        }
+
+        indexedSeconds = getWallSeconds();
+
+        removeColorCodes(line);
+
+        /* "[ DONE ] - <n> documents ... were indexed in <s> seconds!" */
+        char *number = strstr(line, " - ");
+
+        if (number != NULL) {
+            result->numOfIndexedDocuments = atoi(number + 3);
+        }
+    }
+
+    fclose(output);
+
+    waitProgram(pid, &measures);
+
+    double end = getWallSeconds();
+
+    measures.wallSeconds = end - begin;
+
+    if (indexedSeconds < 0) {
+        indexedSeconds = end;
+    }
+
+    result->indexSeconds = indexedSeconds - begin;
+    result->querySeconds = end - indexedSeconds;
+    result->peakRssMegabytes = measures.peakRssMegabytes;
+
+    return measures;
+}
+
+/*
+ * Write the input of the query run: the queries followed by the exit command. Returns the number of queries
+ */
+int writeQueryInput(const char queriesFileName[], const char inputFileName[]) {
+    FILE *in = fopen(queriesFileName, "r");
+    FILE *out = fopen(inputFileName, "w");
+
+    if (in == NULL || out == NULL) {
+        fprintf(stderr, "Could not write the input of the queries\n");
+
+        exit(EXIT_FAILURE);
+    }
+
+    char line[4096];
+
+    int numOfQueries = 0;
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+        if (line[0] != '\n') {
+            fputs(line, out);
+
+            numOfQueries++;
+        }
+    }
+
+    fprintf(out, "!q\n");
+
+    fclose(in);
+    fclose(out);
+
+    return numOfQueries;
+}
+
+/*
+ * Parse a comma separated list of scales. Returns the number of scales
+ */
+int parseScales(char *list, int scales[]) {
+    int numOfScales = 0;
+
+    char *token = strtok(list, ",");
+
+    while (token != NULL && numOfScales < MAX_SCALES) {
+        scales[numOfScales++] = atoi(token);
+
+        token = strtok(NULL, ",");
+    }
+
+    return numOfScales;
+}
+
+int main(int argc, char *argv[]) {
+    char *enginePath = "./search-engine";
+    char *generatorPath = "./corpus-generator";
+    char *fitFileName = NULL;
+    char *csvFileName = NULL;
+    char *workDirectory = "/tmp";
+    char *numOfQueriesText = "1000";
+
+    char defaultScales[] = "1000,10000,23155";
+
+    int scales[MAX_SCALES];
+    int numOfScales = parseScales(defaultScales, scales);
+
+    char *engineOptions[MAX_ENGINE_OPTIONS];
+    int numOfEngineOptions = 0;
+
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            enginePath = argv[++i];
+        } else if (strcmp(argv[i], "--generator") == 0 && i + 1 < argc) {
+            generatorPath = argv[++i];
+        } else if (strcmp(argv[i], "--scales") == 0 && i + 1 < argc) {
+            numOfScales = parseScales(argv[++i], scales);
+        } else if (strcmp(argv[i], "--queries") == 0 && i + 1 < argc) {
+            numOfQueriesText = argv[++i];
+        } else if (strcmp(argv[i], "--fit") == 0 && i + 1 < argc) {
+            fitFileName = argv[++i];
+        } else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            csvFileName = argv[++i];
+        } else if (strcmp(argv[i], "--work-dir") == 0 && i + 1 < argc) {
+            workDirectory = argv[++i];
+        } else if (strcmp(argv[i], "--") == 0) {
+            /* The rest of the options are passed to the search engine, e.g. --compress-postings */
+            for (i++; i < argc && numOfEngineOptions < MAX_ENGINE_OPTIONS - 5; i++) {
+                engineOptions[numOfEngineOptions++] = argv[i];
+            }
+        } else {
+            printf("Usage: %s [options] [-- <search engine options>]\n", argv[0]);
+            printf("\n--engine <path> - Search engine binary (./search-engine by default)");
+            printf("\n--generator <path> - Corpus generator binary (./corpus-generator by default)");
+            printf("\n--scales <n,n,...> - Numbers of products of the collections (1000,10000,23155 by default)");
+            printf("\n--queries <n> - Number of queries of each scale (1000 by default)");
+            printf("\n--fit <xml file> - Fit the collections to a real dataset");
+            printf("\n--csv <file> - Write the results as CSV");
+            printf("\n--work-dir <path> - Folder of the generated files (/tmp by default)\n");
+
+            return EXIT_FAILURE;
+        }
+    }
+
+    ScaleResult results[MAX_SCALES];
+
+    bool isTruncated = false;
+
+    int s;
+
+    for (s = 0; s < numOfScales; s++) {
+        ScaleResult *result = &results[s];
+
+        memset(result, 0, sizeof(ScaleResult));
+
+        result->numOfProducts = scales[s];
+
+        char corpusFileName[MAX_PATH_SIZE], queriesFileName[MAX_PATH_SIZE], inputFileName[MAX_PATH_SIZE],
+             numOfProductsText[32];
+
+        snprintf(corpusFileName, MAX_PATH_SIZE, "%s/scale-%d.xml", workDirectory, scales[s]);
+        snprintf(queriesFileName, MAX_PATH_SIZE, "%s/scale-%d-queries.txt", workDirectory, scales[s]);
+        snprintf(inputFileName, MAX_PATH_SIZE, "%s/scale-%d-input.txt", workDirectory, scales[s]);
+        snprintf(numOfProductsText, sizeof(numOfProductsText), "%d", scales[s]);
+
+        printf("Generating %d products... ", scales[s]);
+
+        fflush(stdout);
+
+        /* The seed is the scale, so a scale always gets the same collection */
+        char *generatorArguments[] = {generatorPath, numOfProductsText, corpusFileName, queriesFileName,
+                                      "--queries", numOfQueriesText, "--seed", numOfProductsText,
+                                      fitFileName != NULL ? "--fit" : NULL, fitFileName, NULL};
+
+        RunMeasures generation = runProgram(generatorArguments);
+
+        if (generation.exitStatus != 0) {
+            printf(ANSI_COLOR_RED "failed (exit status %d)\n" ANSI_COLOR_RESET, generation.exitStatus);
+
+            return EXIT_FAILURE;
+        }
+
+        printf("%.2lf seconds\n", generation.wallSeconds);
+
+        char *engineArguments[MAX_ENGINE_OPTIONS];
+
+        int numOfArguments = 0;
+
+        engineArguments[numOfArguments++] = enginePath;
+        engineArguments[numOfArguments++] = "1";
+        engineArguments[numOfArguments++] = "--dataset";
+        engineArguments[numOfArguments++] = corpusFileName;
+
+        for (i = 0; i < numOfEngineOptions; i++) {
+            engineArguments[numOfArguments++] = engineOptions[i];
+        }
+
+        engineArguments[numOfArguments] = NULL;
+
+        int numOfQueries = writeQueryInput(queriesFileName, inputFileName);
+
+        RunMeasures run = runSearchEngine(engineArguments, inputFileName, result);
+
+        if (run.exitStatus != 0) {
+            printf(ANSI_COLOR_RED "The search engine failed at %d products (exit status %d)\n" ANSI_COLOR_RESET,
+                   scales[s], run.exitStatus);
+
+            return EXIT_FAILURE;
+        }
+
+        result->queriesPerSecond = result->querySeconds > 0 ? numOfQueries / result->querySeconds : 0;
+
+        if (result->numOfIndexedDocuments < result->numOfProducts) {
+            isTruncated = true;
+        }
+
+        remove(inputFileName);
+    }
+
+    printf("\n" ANSI_BOLD_WHITE "%10s %10s %12s %12s %12s %14s" ANSI_COLOR_RESET "\n", "Products", "Indexed",
+           "Index (s)", "Queries (s)", "Queries/s", "Peak RSS (MB)");
+
+    for (s = 0; s < numOfScales; s++) {
+        printf("%10d %10d %12.3lf %12.3lf %12.1lf %14.1lf\n", results[s].numOfProducts,
+               results[s].numOfIndexedDocuments, results[s].indexSeconds, results[s].querySeconds,
+               results[s].queriesPerSecond, results[s].peakRssMegabytes);
+    }
+
+    if (isTruncated) {
+        printf(ANSI_COLOR_YELLOW "\nSome collections were not fully indexed: build the search engine with a larger "
+               "-DNUM_OF_DOCUMENTS (and -DNUM_OF_TERMS)\n" ANSI_COLOR_RESET);
+    }
+
+    if (csvFileName != NULL) {
+        FILE *out = fopen(csvFileName, "w");
+
+        if (out == NULL) {
+            fprintf(stderr, "Could not open %s\n", csvFileName);
+
+            return EXIT_FAILURE;
+        }
+
+        fprintf(out, "products,indexed_documents,index_seconds,query_seconds,queries_per_second,peak_rss_mb\n");
+
+        for (s = 0; s < numOfScales; s++) {
+            fprintf(out, "%d,%d,%.6lf,%.6lf,%.1lf,%.1lf\n", results[s].numOfProducts,
+                    results[s].numOfIndexedDocuments, results[s].indexSeconds, results[s].querySeconds,
+                    results[s].queriesPerSecond, results[s].peakRssMegabytes);
+        }
+
+        fclose(out);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "scoring-model.h"
+#include "memory-accounting.h"
+
+static const char *scoringModelNames[NUM_OF_SCORING_MODELS] = { "cosine", "bm25" };
+
+/*
+ * Create the statistics of a model for a number of document positions, with no documents yet
+ */
+void initScoringStatistics(ScoringStatistics *statistics, ScoringModel model, double k1, double b, int numOfPositions) {
+    statistics->model = model;
+    statistics->k1 = k1;
+    statistics->b = b;
+    statistics->numOfDocuments = 0;
+    statistics->totalDocumentLength = 0;
+    statistics->averageDocumentLength = 0;
+    statistics->documentLengths = trackedCalloc(MEMORY_DOCUMENTS, numOfPositions, sizeof(uint32_t));
+    statistics->lengthNorms = NULL;
+}
+
+/*
+ * Release the memory of the statistics of a model
+ */
+void freeScoringStatistics(ScoringStatistics *statistics) {
+    trackedFree(MEMORY_DOCUMENTS, statistics->documentLengths);
+    trackedFree(MEMORY_DOCUMENTS, statistics->lengthNorms);
+
+    statistics->documentLengths = NULL;
+    statistics->lengthNorms = NULL;
+}
+
+/*
+ * Compute the average document length and the BM25 length norms, once the documents and their total length
+ * are counted
+ */
+void computeScoringStatistics(ScoringStatistics *statistics, int numOfPositions) {
+    statistics->averageDocumentLength = statistics->numOfDocuments > 0
+        ? (double) statistics->totalDocumentLength / statistics->numOfDocuments : 0;
+
+    if (statistics->model != SCORING_BM25) {
+        return;
+    }
+
+    trackedFree(MEMORY_DOCUMENTS, statistics->lengthNorms);
+
+    statistics->lengthNorms = trackedMalloc(MEMORY_DOCUMENTS, numOfPositions * sizeof(float));
+
+    int i;
+
+    for (i = 0; i < numOfPositions; i++) {
+        double relativeLength = statistics->averageDocumentLength > 0 ? statistics->documentLengths[i] / statistics->averageDocumentLength : 0;
+
+        statistics->lengthNorms[i] = statistics->k1 * (1 - statistics->b + statistics->b * relativeLength);
+    }
+}
+
+/*
+ * Model of a name (cosine or bm25). Returns false if the name is not a model
+ */
+bool parseScoringModel(const char name[], ScoringModel *model) {
+    int i;
+
+    for (i = 0; i < NUM_OF_SCORING_MODELS; i++) {
+        if (strcmp(name, scoringModelNames[i]) == 0) {
+            *model = i;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Name of a model, as printed in the reports
+ */
+const char *getScoringModelName(ScoringModel model) {
+    return scoringModelNames[model];
+}
@@ -0,0 +1,87 @@
+#ifndef SCORING_MODEL_H
+#define SCORING_MODEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+/* Default BM25 parameters: saturation of the document tf and strength of the length normalization */
+#define BM25_DEFAULT_K1 1.2
+#define BM25_DEFAULT_B 0.75
+
+/* Scoring model of an index */
+typedef enum ScoringModel {
+    SCORING_COSINE, /* tf-idf cossene: idf * (1 + log tf) on both sides, divided by the norm of the document */
+    SCORING_BM25, /* Okapi BM25: the tf of a document saturates with k1 and is normalized by its length with b */
+    NUM_OF_SCORING_MODELS
+} ScoringModel;
+
+/* This struct represents the scoring model of an index with the statistics of the documents it needs */
+typedef struct ScoringStatistics {
+    ScoringModel model;
+    double k1;
+    double b;
+    int numOfDocuments; /* documents with postings, in the whole collection for a shard (the N of the BM25 idf) */
+    long totalDocumentLength; /* indexed words of the documents, in the whole collection for a shard */
+    double averageDocumentLength;
+    uint32_t *documentLengths; /* indexed words of each document position, stopwords excluded */
+    float *lengthNorms; /* BM25 only: k1 * (1 - b + b * length / average length) of each document position */
+} ScoringStatistics;
+
+/*
+ * Weight of a posting: the share of the score of a document given by a term with the tf of the posting, before
+ * the query weight and the norm of the document. The model is a constant in the scoring loops, which are
+ * specialized for each model, so only its branch is compiled in them
+ */
+static inline __attribute__((always_inline)) double getPostingWeight(ScoringModel model, const ScoringStatistics *statistics,
+                                                                   double idf, int tf, int position) {
+    if (model == SCORING_BM25) {
+        return idf * (tf * (statistics->k1 + 1) / (tf + statistics->lengthNorms[position]));
+    }
+
+    return tf > 0 ? idf * (1 + log(tf)) : 0;
+}
+
+/*
+ * Weight of a query term from its (weighted) tf in the query: the cossene weights the query like the documents,
+ * while BM25 counts the idf once, in the postings
+ */
+static inline __attribute__((always_inline)) double getQueryTermWeight(ScoringModel model, double idf, double queryTF) {
+    return model == SCORING_BM25 ? queryTF : idf * queryTF;
+}
+
+/*
+ * BM25 idf of a term found in 'df' of 'numOfDocuments' documents. It is never negative, even for a term in
+ * most of the documents
+ */
+static inline double getBM25IDF(int numOfDocuments, int df) {
+    return log(1 + (numOfDocuments - df + 0.5) / (df + 0.5));
+}
+
+/*
+ * Create the statistics of a model for a number of document positions, with no documents yet
+ */
+void initScoringStatistics(ScoringStatistics *statistics, ScoringModel model, double k1, double b, int numOfPositions);
+
+/*
+ * Release the memory of the statistics of a model
+ */
+void freeScoringStatistics(ScoringStatistics *statistics);
+
+/*
+ * Compute the average document length and the BM25 length norms, once the documents and their total length
+ * are counted
+ */
+void computeScoringStatistics(ScoringStatistics *statistics, int numOfPositions);
+
+/*
+ * Model of a name (cosine or bm25). Returns false if the name is not a model
+ */
+bool parseScoringModel(const char name[], ScoringModel *model);
+
+/*
+ * Name of a model, as printed in the reports
+ */
+const char *getScoringModelName(ScoringModel model);
+
+#endif
@@ -7,14 +7,115 @@
 #include <ctype.h>
 #include <time.h>
 #include <dirent.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
 
 #include "search-engine.h"
 
-Term *vocabulary[NUM_OF_TERMS];
-Entry *entries[NUM_OF_DOCUMENTS];
+/* Index snapshot used by the current thread: the one being built by an indexing thread, or the one
+ acquired by a search thread for the command it runs */
+__thread IndexSnapshot *currentIndex = NULL;
+
+/* Snapshot of each kind of index answering the new commands, NULL for the kinds not served. They are only read
+ or replaced holding the mutex, so a reader never gets a snapshot whose last reference is being dropped, and
+ the indexes built together are published together */
+IndexSnapshot *publishedIndexes[NUM_OF_INDEX_KINDS] = { NULL };
+pthread_mutex_t publishedIndexMutex = PTHREAD_MUTEX_INITIALIZER;
+long indexVersion = 0;
+
+/* A new index is being built by a background thread (!r) */
+atomic_bool isReloadingIndex = false;
+
+/* Scoring state of the current query of each thread. A thread creates its accumulators before its first search */
+__thread Accumulators *accumulators = NULL;
+
+/* The searches share the last result page, the search workers and the sockets of the shards, so the clients
+ of a query log replay (!l) run them one at a time */
+pthread_mutex_t searchMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Workers of the parallel queries and the range of positions scored by each one. NULL when the queries run on one thread */
+WorkerPool *workerPool = NULL;
+QueryPartition *queryPartitions = NULL;
+
+/* Accumulators of the image retrieval of the hybrid queries (!h), which runs on a thread of its own. NULL when
+ the image index is not served with the text one */
+Accumulators *hybridAccumulators = NULL;
+
+/* The workers score one query at a time. A query that finds them busy (the other index of a hybrid query) is
+ scored by its own thread */
+pthread_mutex_t searchWorkersMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Number of search workers (--workers), 0 means one per online processor, and min cost, in postings,
+ of a query scored by them (--parallel-cost) */
+int SEARCH_WORKERS = 0;
+long PARALLEL_QUERY_COST = 20000;
+
+/* First page of results of the last search, with the cossenes that the paginated results don't keep */
+SearchResultPage lastSearchPage;
+
+/* Cursors of the interactive searches with more than one page, and the count used to generate their ids */
+SearchCursor searchCursors[MAX_SEARCH_CURSORS];
+pthread_mutex_t searchCursorsMutex = PTHREAD_MUTEX_INITIALIZER;
+uint64_t numOfCreatedCursors = 0;
+
+/* Sharded index (--shards): the coordinator process keeps a socket per shard process, and each shard
+ process indexes the documents whose position hashes to its id and answers the queries of the coordinator */
+int NUM_OF_SHARDS = 1;
+int SHARD_ID = -1; /* shard served by this process, -1 for the coordinator or a single index */
+int coordinatorSocket = -1;
+int *shardSockets = NULL; /* -1 for the shards that failed */
+pid_t *shardProcesses = NULL;
+
+/* Results of the shards merged by the coordinator, which has no entries of its own */
+Entry shardResults[MAX_SEARCH_RESULT];
+
+/* Bit-pack the doc-ordered postings (--compress-postings). Otherwise they are stored as plain 32 bits values */
+bool COMPRESS_POSTINGS = false;
+
+/* Keep the positions of the terms in the documents (--positions), so phrase queries can be verified */
+bool POSITIONAL_INDEX = false;
+
+/* Analysis chain of the text terms, applied to the documents and the queries alike: drop the Portuguese
+ stopwords (--stopwords) and reduce the terms to their stems (--stemming). Both fold the accents first */
+bool REMOVE_STOPWORDS = false;
+bool STEM_TERMS = false;
 
-int DESCRIPTION_SIZE = 0;
-int TERM_SIZE = 0;
+/* Dataset indexed instead of the Dafiti/Posthaus one (--dataset), e.g. a synthetic corpus. NULL for the default dataset */
+const char *DATASET_PATH = NULL;
+
+/* Folder of the images indexed with the text (option 3) instead of the Dafiti/Posthaus one (--image-dataset) */
+const char *IMAGE_DATASET_PATH = NULL;
+
+/* Weight of the text cossene in the score of a hybrid query (--text-weight), the image cossene has the rest */
+double HYBRID_TEXT_WEIGHT = 0.5;
+
+/* Quantization of the vectors of the image index (--quantize-images), scored instead of its postings: product
+ quantization with PQ_SUBSPACES bytes per image (--pq-subspaces), or int8 with one byte per histogram bin.
+ The best RERANK_CANDIDATES of a query are scored again by their exact vectors (--rerank), 0 keeps none */
+VectorQuantization IMAGE_QUANTIZATION = QUANTIZATION_NONE;
+int PQ_SUBSPACES = 64;
+int RERANK_CANDIDATES = 200;
+
+/* Scoring model of the text index (--scoring) and its BM25 parameters (--bm25-k1, --bm25-b). The image index
+ is always scored by the cossene of its histograms */
+ScoringModel TEXT_SCORING_MODEL = SCORING_COSINE;
+double BM25_K1 = BM25_DEFAULT_K1;
+double BM25_B = BM25_DEFAULT_B;
+
+/* Min estimated Jaccard similarity of the shingles of two descriptions for the second product to be collapsed
+ into the group of the first one at ingest (--near-duplicates), 0 indexes every product */
+double NEAR_DUPLICATE_SIMILARITY = 0;
+
+/* Max share of the documents a term may occur in (--max-df). The terms above it are pruned, 0 keeps all of them */
+double MAX_DOCUMENT_FREQUENCY = 0;
+
+/* Release the whole index at exit and fail if any accounted memory outlived it (--leak-check) */
+bool LEAK_CHECK = false;
 
 unsigned int sumValues(const char string[]) {
     
@@ -108,617 +209,4517 @@ void normalizeTerm(char *str) {
 }
 
 /*
- * Generate the term IDF (Inverse Document Frequency)
+ * Find a term pruned for its df (--max-df). Returns NULL if the term was not pruned
  */
-double generateTermIDF(Term *term) {
-    double result;
+Term *findPrunedTerm(const char termName[]) {
+    Term *term = currentIndex->prunedTerms;
     
-    if (term->totalNumOfDocuments == 0) {
-        result = 0;
-    } else {
-        result = log((double)NUM_OF_DOCUMENTS / term->totalNumOfDocuments);
+    while (term != NULL && strcmp(term->name, termName) != 0) {
+        term = term->next;
     }
     
-    return result;
+    return term;
 }
 
 /*
- * Generate the document TF (Term Frequency)
+ * Apply the analysis chain to a normalized term, in place: fold its accents, drop it if it is a stopword
+ * and reduce it to its stem. Returns false if the term is dropped (a stopword or a pruned term)
  */
-double getDocumentTF(Document *document) {
-    double result;
+bool analyzeTerm(char termName[]) {
+    /* The words of an image are its histogram, not Portuguese */
+    bool isText = currentIndex->kind == INDEX_TEXT;
     
-    if (document->tf == 0) {
-        result = 0;
-    } else {
-        result = 1 + log(document->tf);
+    if (isText && (REMOVE_STOPWORDS || STEM_TERMS)) {
+        foldAccents(termName);
     }
     
-    return result;
-}
-
-/*
- * Generate Doc magnitude and vocabulary terms IDF for the terms of the vocabulary
- */
-void generateDocMagnitudeAndVocabularyTermsIDF() {
-    int i;
+    if (isText && REMOVE_STOPWORDS && isPortugueseStopword(termName)) {
+        return false;
+    }
     
-    Entry *entryTmp;
-
-    for (i = 0; i < NUM_OF_TERMS; i++) {
-        if (vocabulary[i] == NULL) {
-            continue;
-        }
-        
-        Term *term = vocabulary[i];
-        
-        while (term != NULL) {
-            
-            term->idf = generateTermIDF(term);
-            
-            Document *documentTmp = term->document;
-            
-            for (; documentTmp != NULL; documentTmp = documentTmp->next) {
-                double documentTF = getDocumentTF(documentTmp);
-
-                int position = generateHashById(documentTmp->id);
-
-                entryTmp = entries[position];
-
-                if (entryTmp == NULL) {
-                    continue;
-                }
-
-                /* This multiplication is to improve the performance of the pow (tf-idf, 2) */
-                entryTmp->magnitude += (term->idf * documentTF) * (term->idf * documentTF);
-            }
-            
-            term = term->next;
-        }
+    if (isText && STEM_TERMS) {
+        stemPortugueseTerm(termName);
     }
+    
+    return currentIndex->prunedTerms == NULL || findPrunedTerm(termName) == NULL;
 }
 
 /*
- * This method index all the terms based on a hash function
+ * Apply the analysis chain to each word of a query, in place, removing the dropped ones. The words are
+ * left as they are without stopwords and stemming
  */
-unsigned int indexTerm(const char documentId[], const char documentName[], char termName[]) {
-    unsigned int position;
+void analyzeQuery(char query[]) {
+    if (currentIndex->kind != INDEX_TEXT || (!REMOVE_STOPWORDS && !STEM_TERMS)) {
+        return;
+    }
     
-    normalizeTerm(termName);
+    char *analyzedQuery = trackedMalloc(MEMORY_QUERY, strlen(query) + 1);
     
-    position = generateHash(termName);
+    analyzedQuery[0] = '\0';
     
-    Term *term = (Term *)malloc(sizeof(Term));
-    term->name = termName;
-    term->document = NULL;
-    term->next = NULL;
-    term->totalNumOfOccurrences = 1;
-    term->totalNumOfDocuments = 1;
+    char *savePointer = NULL;
     
-    Document *document = (Document *)malloc(sizeof(Document));
-    document->id = documentId;
-    document->name = documentName;
-    document->term = termName;
-    document->tf = 1;
-    document->next = NULL;
+    char *token = strtok_r(query, " ", &savePointer);
     
-    /* Empty position, just include the new term here */
-    if (vocabulary[position] == NULL) {
-        term->document = document;
-        
-        vocabulary[position] = term;
-        /* Same term was found! So, let's use the 'next' document attribute to add the new occurrence of
-         the term in another document or increase the numOfOccurrence of the document that contains the term */
-    } else {
-        Term *termTmp = vocabulary[position];
-        
-        Term *firstTermTmp = (Term *) malloc(sizeof(Term));
-        
-        firstTermTmp = termTmp;
-        
-        bool hasTerm = false;
+    while (token != NULL) {
+        normalizeTerm(token);
         
-        for (; termTmp != NULL; termTmp = termTmp->next) {
-            
-            if (strcmp(termTmp->name, termName) == 0) {
-                
-                Document *documentTmp = termTmp->document;
-                
-                termTmp->totalNumOfOccurrences++;
-                
-                hasTerm = true;
-                
-                if (strcmp(documentTmp->id, documentId) == 0) {
-                    documentTmp->tf++;
-                    
-                    break;
-                }
-                
-                Document *documentAux = termTmp->document;
-                document->next = documentAux;
-                
-                termTmp->document = document;
-                
-                termTmp->totalNumOfDocuments++;
+        if (analyzeTerm(token) && *token != '\0') {
+            if (analyzedQuery[0] != '\0') {
+                strcat(analyzedQuery, " ");
             }
-        }
-        
-        /* if the term names are different but the position generated by the hash function is the same,
-         an collision has occurred. So, we need to add this new term    as the first term of this position */
-        if (!hasTerm) {
-            term->next = firstTermTmp->next;
-            term->document = document;
             
-            firstTermTmp->next = term;
+            strcat(analyzedQuery, token);
         }
         
+        token = strtok_r(NULL, " ", &savePointer);
     }
     
-    return position;
+    /* The analyzed query is never longer: the stems and the folded letters are shorter than the words */
+    strcpy(query, analyzedQuery);
+    
+    trackedFree(MEMORY_QUERY, analyzedQuery);
 }
 
 /*
- * Index all the terms of the description attribute  based on a hash function
+ * Create an empty document table
  */
-void indexEntry(Product *product) {
-    char *cpDocumentId = malloc(NUM_OF_DOCUMENTS * sizeof(char));
+DocumentTable *createDocumentTable() {
+    DocumentTable *documents = trackedCalloc(MEMORY_DOCUMENTS, 1, sizeof(DocumentTable));
     
-    strcpy(cpDocumentId, product->id);
+    documents->entries = trackedCalloc(MEMORY_DOCUMENTS, NUM_OF_DOCUMENTS, sizeof(Entry *));
     
-    Entry *entry = malloc(sizeof (Entry));
-    entry->documentId = malloc(NUM_OF_DOCUMENTS * sizeof(char));
-    entry->documentName = malloc(DOCUMENT_NAME_SIZE * sizeof(char));
+    atomic_init(&documents->references, 0);
+    
+    return documents;
+}
+
+/*
+ * Drop the reference of an index to a document table. The last index releases its entries, categories and prices
+ */
+void releaseDocumentTable(DocumentTable *documents) {
+    if (atomic_fetch_sub(&documents->references, 1) != 1) {
+        return;
+    }
     
-    strcpy(entry->documentId, cpDocumentId);
-    strcpy(entry->documentName, product->imgFileName);
+    int i;
     
-    int position = generateHashById(cpDocumentId);
+    for (i = 0; i < NUM_OF_DOCUMENTS; i++) {
+        Entry *entry = documents->entries[i];
+        
+        if (entry != NULL) {
+            trackedFree(MEMORY_DOCUMENTS, entry->documentId);
+            trackedFree(MEMORY_DOCUMENTS, entry->documentName);
+            trackedFree(MEMORY_DOCUMENTS, entry->title);
+            trackedFree(MEMORY_DOCUMENTS, entry);
+        }
+    }
     
-    entries[position] = entry;
+    for (i = 0; i < documents->numOfCategories; i++) {
+        trackedFree(MEMORY_DOCUMENTS, documents->categories[i].name);
+        trackedFree(MEMORY_DOCUMENTS, documents->categories[i].key);
+        
+        freeDocBitmap(documents->categories[i].documents);
+    }
     
-    char *cpDescription = malloc(DESCRIPTION_SIZE * sizeof(char));
+    trackedFree(MEMORY_DOCUMENTS, documents->entries);
+    trackedFree(MEMORY_DOCUMENTS, documents->prices);
+    trackedFree(MEMORY_DOCUMENTS, documents);
+}
+
+/*
+ * Create an empty index snapshot of a kind, to be filled by the indexing functions as the 'currentIndex'.
+ * The index uses the given document table, shared with the indexes built before it, or a new one if NULL
+ */
+IndexSnapshot *createIndexSnapshot(IndexKind kind, DocumentTable *documents) {
+    IndexSnapshot *snapshot = trackedCalloc(MEMORY_DOCUMENTS, 1, sizeof(IndexSnapshot));
     
-    strcpy(cpDescription, product->description);
+    snapshot->kind = kind;
+    snapshot->documents = documents != NULL ? documents : createDocumentTable();
     
-    char *token = malloc(TERM_SIZE * sizeof(char));
-    token = strtok(cpDescription, " ");
+    atomic_fetch_add(&snapshot->documents->references, 1);
     
-    char *cpToken = NULL;
+    /* calloc only maps the pages of the vocabulary that are written, but its whole size is accounted */
+    snapshot->vocabulary = trackedCalloc(MEMORY_DICTIONARY, NUM_OF_TERMS, sizeof(Term *));
+    snapshot->inverseNorms = trackedCalloc(MEMORY_DOCUMENTS, NUM_OF_DOCUMENTS, sizeof(float));
     
-    char *cpDocumentNameTmp = malloc(DOCUMENT_NAME_SIZE * sizeof(char));
-    strcpy(cpDocumentNameTmp, product->imgFileName);
+    initScoringStatistics(&snapshot->scoring, kind == INDEX_TEXT ? TEXT_SCORING_MODEL : SCORING_COSINE, BM25_K1, BM25_B,
+                          NUM_OF_DOCUMENTS);
     
-    char *cpDocumentIdTmp = malloc(NUM_OF_DOCUMENTS * sizeof(char));
-    strcpy(cpDocumentIdTmp, cpDocumentId);
+    atomic_init(&snapshot->references, 0);
     
-    while (token != NULL) {
-        cpToken = malloc(TERM_SIZE * sizeof(char));
-        
-        strcpy(cpToken, token);
-        
-        indexTerm(cpDocumentIdTmp, cpDocumentNameTmp, cpToken);
-        
-        token = strtok(NULL, " ");
-    }
+    return snapshot;
 }
 
 /*
- * Sort entries collection by the value of cossene in descending order
+ * Release the memory of an index snapshot: its terms with their postings, and its document table if no
+ * other index uses it
  */
-void sortEntriesByCosDesc(Entry *values[]) {
-    
-    int i,j;
-    
-    Entry *aux;
+void freeIndexSnapshot(IndexSnapshot *snapshot) {
+    int i;
     
-    for (i = 0; i < NUM_OF_DOCUMENTS; ++i) {
-        for (j = i + 1; j < NUM_OF_DOCUMENTS; ++j) {
-            if(values[i] == NULL || values[j] == NULL) {
-                continue;
-            }
+    for (i = 0; i < NUM_OF_TERMS; i++) {
+        Term *term = snapshot->vocabulary[i];
+        
+        while (term != NULL) {
+            Term *nextTerm = term->next;
             
-            double cos1 = values[i]->sum / sqrt(values[i]->magnitude);
-            double cos2 = values[j]->sum / sqrt(values[j]->magnitude);
+            Document *document = term->document;
             
-            if (cos1 < cos2) {
-                aux =  values[i];
-                values[i] = values[j];
-                values[j] = aux;
+            while (document != NULL) {
+                Document *nextDocument = document->next;
+                
+                trackedFree(MEMORY_POSTINGS, document->positions);
+                trackedFree(MEMORY_POSTINGS, document);
+                
+                document = nextDocument;
             }
+            
+            trackedFree(MEMORY_DICTIONARY, (char *) term->name);
+            trackedFree(MEMORY_POSTINGS, term->impactPositions);
+            trackedFree(MEMORY_POSTINGS, term->impacts);
+            
+            freeCompressedPostings(term->postings);
+            freePositionalPostings(term->positions);
+            
+            trackedFree(MEMORY_DICTIONARY, term);
+            
+            term = nextTerm;
         }
     }
-}
-
-/*
- * Get the term frequency of an term in the query
- */
-double getQueryTF(char *query, char *term) {
-    char *p = query;
-    int len1 = strlen(term);
-    
-    int count = 0;
     
-    while ((p = strstr(p, term)) != NULL && p != term) {
-        count++;
-        p += len1;
+    while (snapshot->prunedTerms != NULL) {
+        Term *nextTerm = snapshot->prunedTerms->next;
+        
+        trackedFree(MEMORY_DICTIONARY, (char *) snapshot->prunedTerms->name);
+        trackedFree(MEMORY_DICTIONARY, snapshot->prunedTerms);
+        
+        snapshot->prunedTerms = nextTerm;
     }
     
-    double result = 0;
+    freeTermDictionary(snapshot->dictionary);
+    freeTermSuggestions(snapshot->suggestions);
+    freeVectorStore(snapshot->vectors);
     
-    if (count == 0) {
-        result = 0;
-    } else {
-        result = 1 + log(count);
-    }
+    trackedFree(MEMORY_DICTIONARY, snapshot->dictionaryTerms);
+    trackedFree(MEMORY_DICTIONARY, snapshot->vocabulary);
+    trackedFree(MEMORY_DOCUMENTS, snapshot->inverseNorms);
     
-    return result;
+    freeScoringStatistics(&snapshot->scoring);
+    
+    releaseDocumentTable(snapshot->documents);
+    
+    trackedFree(MEMORY_DOCUMENTS, snapshot);
 }
 
 /*
- * Search term occurrences using the inverted index
+ * Get a reference to the published index snapshot of a kind, or NULL if the kind is not served. It stays
+ * valid, even if a new snapshot is published, until it is released
  */
-Entry **searchByVectorModel(char termName[], bool verbose, Entry **paginatedResult) {
+IndexSnapshot *acquireIndexSnapshot(IndexKind kind) {
+    pthread_mutex_lock(&publishedIndexMutex);
     
-    if (strcmp(termName, "") == 0) {
-        return NULL;
-    }
+    IndexSnapshot *snapshot = publishedIndexes[kind];
     
-    clock_t begin, end;
+    if (snapshot != NULL) {
+        atomic_fetch_add(&snapshot->references, 1);
+    }
     
-    double searchTimeSpent;
+    pthread_mutex_unlock(&publishedIndexMutex);
     
-    begin = clock();
+    return snapshot;
+}
+
+/*
+ * Get a reference to the published snapshot of every kind of index at once, so the snapshots share their
+ * document table. The kinds not served are NULL
+ */
+void acquireIndexSnapshots(IndexSnapshot *snapshots[NUM_OF_INDEX_KINDS]) {
+    pthread_mutex_lock(&publishedIndexMutex);
     
-    Entry *results[NUM_OF_DOCUMENTS] = { NULL };
+    int kind;
     
-    char *cpTermName = (char *) malloc(QUERY_SIZE * sizeof(char));
+    for (kind = 0; kind < NUM_OF_INDEX_KINDS; kind++) {
+        snapshots[kind] = publishedIndexes[kind];
+        
+        if (snapshots[kind] != NULL) {
+            atomic_fetch_add(&snapshots[kind]->references, 1);
+        }
+    }
     
-    normalizeTerm(termName);
+    pthread_mutex_unlock(&publishedIndexMutex);
+}
+
+/*
+ * Drop a reference to an index snapshot. The last reader of a replaced snapshot releases its memory
+ */
+void releaseIndexSnapshot(IndexSnapshot *snapshot) {
+    if (snapshot != NULL && atomic_fetch_sub(&snapshot->references, 1) == 1) {
+        freeIndexSnapshot(snapshot);
+    }
+}
+
+/*
+ * Make the fully built snapshots of the indexes built together (NULL for the kinds not built) answer the new
+ * commands, all at once and with the same version. The commands running on the previous snapshots finish on
+ * them, and each one is released when the last of them leaves
+ */
+void publishIndexSnapshots(IndexSnapshot *snapshots[NUM_OF_INDEX_KINDS]) {
+    IndexSnapshot *previous[NUM_OF_INDEX_KINDS] = { NULL };
     
-    strcpy(cpTermName, termName);
+    int kind;
     
-    char *token = strtok(termName, " ");
+    pthread_mutex_lock(&publishedIndexMutex);
     
-    int countSearchResult = 0;
+    indexVersion++;
     
-    while (token != NULL) {
-        // char *cpToken = (char *)malloc(sizeof(token));
-        
-        char *cpToken = (char *) malloc(TERM_SIZE * sizeof(char));
-        
-        strcpy(cpToken, token);
-        
-        unsigned int position = generateHash(cpToken);
-        
-        Term *term = vocabulary[position];
-        
-        while (term != NULL && strcmp(term->name, cpToken) != 0) {
-            term = term->next;
-        }
-        
-        if (term != NULL) {
+    for (kind = 0; kind < NUM_OF_INDEX_KINDS; kind++) {
+        if (snapshots[kind] != NULL) {
+            atomic_store(&snapshots[kind]->references, 1);
             
-            Document *document = term->document;
+            snapshots[kind]->version = indexVersion;
             
-            int queryTF = getQueryTF(cpTermName, token);
+            previous[kind] = publishedIndexes[kind];
             
-            /* As the collection is not big, we are considering the whole collection. */
-            for (; document != NULL; document = document->next) {
-                int position = generateHashById(document->id);
-                
-                if (results[position] == NULL) {
-                    Entry *entry = entries[position];
-                    entry->sum = (term->idf * getDocumentTF(document)) * (term->idf * queryTF);
-                    
-                    results[position] = entry;
-                    
-                    countSearchResult++;
-                } else {
-                    Entry *entry = results[position];
-                    
-                    entry->sum += (term->idf * getDocumentTF(document)) * (term->idf * queryTF);
-                }
-            }
+            publishedIndexes[kind] = snapshots[kind];
         }
-        
-        token = strtok(NULL, " ");
     }
     
-    if (countSearchResult == 0) {
-        if (verbose) {
-            printf("\nNo results for query " ANSI_BOLD_WHITE "%.20s...\n" ANSI_COLOR_RESET, cpTermName);
-        }
-        
-        return NULL;
-    }
+    pthread_mutex_unlock(&publishedIndexMutex);
     
-    /* As the collection is not big, we are considering the whole result for sorting. */
-    sortEntriesByCosDesc(results);
+    for (kind = 0; kind < NUM_OF_INDEX_KINDS; kind++) {
+        releaseIndexSnapshot(previous[kind]);
+    }
+}
+
+/*
+ * Withdraw the published snapshots, so each one is released when its last reader leaves (at exit)
+ */
+void unpublishIndexSnapshots() {
+    IndexSnapshot *previous[NUM_OF_INDEX_KINDS];
     
-    end = clock();
+    int kind;
     
-    searchTimeSpent = (double)(end - begin) / CLOCKS_PER_SEC;
+    pthread_mutex_lock(&publishedIndexMutex);
     
-    if(verbose) {
-        printf(ANSI_COLOR_CYAN "\n----------------------------------------------------------------------------------------------------------------------");
-        
-        printf(ANSI_COLOR_RESET "\n  List of documents for query " ANSI_BOLD_WHITE "%.20s..." ANSI_COLOR_RESET, cpTermName);
-        
-        printf(ANSI_COLOR_CYAN "\n----------------------------------------------------------------------------------------------------------------------\n");
+    for (kind = 0; kind < NUM_OF_INDEX_KINDS; kind++) {
+        previous[kind] = publishedIndexes[kind];
         
-        printf(ANSI_COLOR_RESET "\t\t\t\t\t\t\t\t\t\tAbout " ANSI_COLOR_YELLOW "%d" ANSI_COLOR_RESET " results (%lf seconds)\n", countSearchResult, searchTimeSpent);
-        
-        printf(ANSI_COLOR_RESET);
-        
-        char COLUMN_SPACE[4] = "\t\t";
-        
-        printf(ANSI_BOLD_WHITE "\n    ID%sRelevance (cos)%sName\n" ANSI_COLOR_RESET, COLUMN_SPACE, COLUMN_SPACE);
+        publishedIndexes[kind] = NULL;
     }
     
-    int x;
-    
-    int countResult = 0;
+    pthread_mutex_unlock(&publishedIndexMutex);
     
-    for (x = 0; x < NUM_OF_DOCUMENTS && countResult < MAX_SEARCH_RESULT; x++) {
-        if (results[x] == NULL) {
-            continue;
-        }
-        
-        Entry *entry = results[x];
-        
-        double cos = entry->sum / sqrt(entry->magnitude);
-        
-        if (verbose) {
-            printf("    %-6s\t%-23lf\t%-12s\n", entry->documentId, cos, entry->documentName);
-        } else {
-            paginatedResult[countResult] = entry;
-        }
-        
-        countResult++;
+    for (kind = 0; kind < NUM_OF_INDEX_KINDS; kind++) {
+        releaseIndexSnapshot(previous[kind]);
     }
+}
+
+/*
+ * Generate the term IDF (Inverse Document Frequency)
+ */
+double generateTermIDF(Term *term) {
+    double result;
     
-    if (verbose) {
-        printf(ANSI_COLOR_CYAN "\n----------------------------------------------------------------------------------------------------------------------\n" ANSI_COLOR_RESET);
-        
-        printf("\t\t\t\t\t\t\t\t\t\tMaximum result size per search: " ANSI_COLOR_YELLOW "%d\n" ANSI_COLOR_RESET, MAX_SEARCH_RESULT);
+    /* A shard uses the df of the whole collection, so its scores are the same of a single index */
+    int numOfDocuments = term->collectionNumOfDocuments > 0 ? term->collectionNumOfDocuments : term->totalNumOfDocuments;
+    
+    if (numOfDocuments == 0) {
+        result = 0;
+    } else if (currentIndex->scoring.model == SCORING_BM25) {
+        result = getBM25IDF(currentIndex->scoring.numOfDocuments, numOfDocuments);
+    } else {
+        result = log((double)NUM_OF_DOCUMENTS / numOfDocuments);
     }
     
-    return paginatedResult;
+    return result;
 }
 
 /*
- * Creates and populates a product struct based on a XML cursor
+ * Generate the TF (Term Frequency) weight of a number of occurrences
  */
-Product *createPopulatedStructProduct(xmlNodePtr in_cur) {
+double getTFWeight(int tf) {
+    double result;
     
-    Product *newProduct = (Product *) malloc(sizeof(Product));
+    if (tf == 0) {
+        result = 0;
+    } else {
+        result = 1 + log(tf);
+    }
+    
+    return result;
+}
+
+/*
+ * Generate Doc magnitude and vocabulary terms IDF for the terms of the vocabulary, and count the length of the
+ * documents. The magnitudes are the ones of this index, so they are kept apart from the entries, which may be
+ * shared with other indexes. Only the cossene has magnitudes
+ */
+void generateDocMagnitudeAndVocabularyTermsIDF(double magnitudes[]) {
+    int i;
+
+    for (i = 0; i < NUM_OF_TERMS; i++) {
+        if (currentIndex->vocabulary[i] == NULL) {
+            continue;
+        }
+        
+        Term *term = currentIndex->vocabulary[i];
+        
+        while (term != NULL) {
+            
+            term->idf = generateTermIDF(term);
+            
+            Document *documentTmp = term->document;
+            
+            for (; documentTmp != NULL; documentTmp = documentTmp->next) {
+                int position = generateHashById(documentTmp->id);
+
+                if (currentIndex->documents->entries[position] == NULL) {
+                    continue;
+                }
+
+                if (currentIndex->scoring.model == SCORING_COSINE) {
+                    double weight = getPostingWeight(SCORING_COSINE, &currentIndex->scoring, term->idf, documentTmp->tf, position);
+
+                    /* This multiplication is to improve the performance of the pow (tf-idf, 2) */
+                    magnitudes[position] += weight * weight;
+                }
+            }
+            
+            term = term->next;
+        }
+    }
+}
+
+/*
+ * Generate the inverse of the vector magnitude of every document, or 1 for the models without magnitudes, and
+ * the statistics of the scoring model. It must be called after the documents magnitude were generated.
+ */
+void generateDocumentNorms(const double magnitudes[]) {
+    computeScoringStatistics(&currentIndex->scoring, NUM_OF_DOCUMENTS);
+    
+    int i;
+    
+    for (i = 0; i < NUM_OF_DOCUMENTS; i++) {
+        if (currentIndex->scoring.model == SCORING_COSINE) {
+            currentIndex->inverseNorms[i] = magnitudes[i] > 0 ? 1 / sqrt(magnitudes[i]) : 0;
+        } else {
+            currentIndex->inverseNorms[i] = currentIndex->scoring.documentLengths[i] > 0 ? 1 : 0;
+        }
+    }
+}
+
+/*
+ * Compare two impact postings by decreasing impact
+ */
+int compareImpactPostingsDesc(const void *a, const void *b) {
+    double impactA = ((const ImpactPosting *) a)->impact;
+    double impactB = ((const ImpactPosting *) b)->impact;
+    
+    return (impactA < impactB) - (impactA > impactB);
+}
+
+/*
+ * Compare two impact postings by ascending position
+ */
+int compareImpactPostingsByPosition(const void *a, const void *b) {
+    return ((const ImpactPosting *) a)->position - ((const ImpactPosting *) b)->position;
+}
+
+/*
+ * Copy the postings of a term from its documents list. Returns the number of postings
+ */
+int collectTermPostings(Term *term, ImpactPosting postings[]) {
+    int numOfPostings = 0;
+    
+    Document *document = term->document;
+    
+    for (; document != NULL && numOfPostings < NUM_OF_DOCUMENTS; document = document->next) {
+        postings[numOfPostings].position = generateHashById(document->id);
+        postings[numOfPostings].tf = document->tf;
+        postings[numOfPostings].positions = document->positions;
+        postings[numOfPostings].impact = getPostingWeight(currentIndex->scoring.model, &currentIndex->scoring, term->idf, document->tf,
+                                                          postings[numOfPostings].position);
+        
+        numOfPostings++;
+    }
+    
+    return numOfPostings;
+}
+
+/*
+ * Generate the impact-ordered layout of the postings of every term of the vocabulary.
+ * It must be called after the terms IDF were generated.
+ */
+void generateImpactOrderedPostings() {
+    int i;
+    
+    ImpactPosting *postings = trackedMalloc(MEMORY_INGEST, NUM_OF_DOCUMENTS * sizeof(ImpactPosting));
+    
+    for (i = 0; i < NUM_OF_TERMS; i++) {
+        Term *term = currentIndex->vocabulary[i];
+        
+        for (; term != NULL; term = term->next) {
+            int numOfPostings = collectTermPostings(term, postings);
+            
+            qsort(postings, numOfPostings, sizeof(ImpactPosting), compareImpactPostingsDesc);
+            
+            trackedFree(MEMORY_POSTINGS, term->impactPositions);
+            trackedFree(MEMORY_POSTINGS, term->impacts);
+            
+            term->impactPositions = trackedMalloc(MEMORY_POSTINGS, numOfPostings * sizeof(int));
+            term->impacts = trackedMalloc(MEMORY_POSTINGS, numOfPostings * sizeof(double));
+            
+            int j;
+            
+            for (j = 0; j < numOfPostings; j++) {
+                term->impactPositions[j] = postings[j].position;
+                term->impacts[j] = postings[j].impact;
+            }
+        }
+    }
+    
+    trackedFree(MEMORY_INGEST, postings);
+}
+
+/*
+ * Generate the doc-ordered (compressed) layout of the postings of every term of the vocabulary.
+ * It must be called after the terms IDF were generated, as each block keeps its max impact.
+ */
+void generateDocOrderedPostings() {
+    int i;
+    
+    ImpactPosting *postings = trackedMalloc(MEMORY_INGEST, NUM_OF_DOCUMENTS * sizeof(ImpactPosting));
+    
+    int *docIds = trackedMalloc(MEMORY_INGEST, NUM_OF_DOCUMENTS * sizeof(int));
+    int *tfs = trackedMalloc(MEMORY_INGEST, NUM_OF_DOCUMENTS * sizeof(int));
+    double *impacts = trackedMalloc(MEMORY_INGEST, NUM_OF_DOCUMENTS * sizeof(double));
+    const int **positions = trackedMalloc(MEMORY_INGEST, NUM_OF_DOCUMENTS * sizeof(int *));
+    
+    for (i = 0; i < NUM_OF_TERMS; i++) {
+        Term *term = currentIndex->vocabulary[i];
+        
+        for (; term != NULL; term = term->next) {
+            int numOfPostings = collectTermPostings(term, postings);
+            
+            qsort(postings, numOfPostings, sizeof(ImpactPosting), compareImpactPostingsByPosition);
+            
+            int j;
+            
+            for (j = 0; j < numOfPostings; j++) {
+                docIds[j] = postings[j].position;
+                tfs[j] = postings[j].tf;
+                impacts[j] = postings[j].impact;
+                positions[j] = postings[j].positions;
+            }
+            
+            freeCompressedPostings(term->postings);
+            
+            term->postings = compressPostings(docIds, tfs, impacts, numOfPostings, COMPRESS_POSTINGS);
+            
+            /* The positions are kept apart from the postings, so the term queries never read them */
+            if (POSITIONAL_INDEX) {
+                freePositionalPostings(term->positions);
+                
+                term->positions = compressPositions(numOfPostings, tfs, positions);
+            }
+        }
+    }
+    
+    trackedFree(MEMORY_INGEST, postings);
+    trackedFree(MEMORY_INGEST, docIds);
+    trackedFree(MEMORY_INGEST, tfs);
+    trackedFree(MEMORY_INGEST, impacts);
+    trackedFree(MEMORY_INGEST, positions);
+}
+
+/*
+ * Keep the position of an occurrence of a term in a document, when the positional index is enabled.
+ * The document tf must already count this occurrence
+ */
+void addDocumentPosition(Document *document, int termPosition) {
+    if (!POSITIONAL_INDEX) {
+        return;
+    }
+    
+    document->positions = trackedRealloc(MEMORY_POSTINGS, document->positions, document->tf * sizeof(int));
+    
+    document->positions[document->tf - 1] = termPosition;
+}
+
+/*
+ * Create the posting of a term in a document, with its first occurrence
+ */
+Document *createDocument(const char documentId[], const char documentName[], const char termName[], int termPosition) {
+    Document *document = trackedMalloc(MEMORY_POSTINGS, sizeof(Document));
+    document->id = documentId;
+    document->name = documentName;
+    document->term = termName;
+    document->tf = 1;
+    document->positions = NULL;
+    document->next = NULL;
+    
+    addDocumentPosition(document, termPosition);
+    
+    return document;
+}
+
+/*
+ * This method index all the terms based on a hash function. The index takes 'termName' (allocated for
+ * MEMORY_DICTIONARY) as the name of a new term, and releases it when the term is already indexed
+ */
+unsigned int indexTerm(const char documentId[], const char documentName[], char termName[], int termPosition) {
+    unsigned int position;
+    
+    normalizeTerm(termName);
+    
+    position = generateHash(termName);
+    
+    Term *term = currentIndex->vocabulary[position];
+    
+    for (; term != NULL && strcmp(term->name, termName) != 0; term = term->next);
+    
+    /* Same term was found! So, let's increase the tf of the document that contains the term, or add the
+     new document as the first one of the term (the documents are indexed one at a time) */
+    if (term != NULL) {
+        trackedFree(MEMORY_DICTIONARY, termName);
+        
+        term->totalNumOfOccurrences++;
+        
+        Document *document = term->document;
+        
+        if (strcmp(document->id, documentId) == 0) {
+            document->tf++;
+            
+            addDocumentPosition(document, termPosition);
+        } else {
+            document = createDocument(documentId, documentName, term->name, termPosition);
+            
+            document->next = term->document;
+            
+            term->document = document;
+            
+            term->totalNumOfDocuments++;
+        }
+        
+        return position;
+    }
+    
+    term = trackedMalloc(MEMORY_DICTIONARY, sizeof(Term));
+    term->name = termName;
+    term->document = createDocument(documentId, documentName, termName, termPosition);
+    term->impactPositions = NULL;
+    term->impacts = NULL;
+    term->postings = NULL;
+    term->positions = NULL;
+    term->totalNumOfOccurrences = 1;
+    term->totalNumOfDocuments = 1;
+    term->collectionNumOfDocuments = 0;
+    
+    /* Empty position, just include the new term here. Otherwise, if the term names are different but the
+     position generated by the hash function is the same, an collision has occurred. So, we need to add
+     this new term after the first term of this position */
+    if (currentIndex->vocabulary[position] == NULL) {
+        term->next = NULL;
+        
+        currentIndex->vocabulary[position] = term;
+    } else {
+        term->next = currentIndex->vocabulary[position]->next;
+        
+        currentIndex->vocabulary[position]->next = term;
+    }
+    
+    return position;
+}
+
+/*
+ * Convert a category name to the key typed in 'categoria:' filters: lower case, with '_' instead of spaces.
+ * The key is allocated for a subsystem
+ */
+char *getCategoryKey(const char name[], MemorySubsystem subsystem) {
+    char *key = trackedStrdup(subsystem, name);
+    
+    int i;
+    
+    for (i = 0; key[i] != '\0'; i++) {
+        key[i] = key[i] == ' ' ? '_' : tolower(key[i]);
+    }
+    
+    return key;
+}
+
+/*
+ * Find a category by its key. Returns -1 if there is no such category
+ */
+int findCategory(const char key[]) {
+    int i;
+    
+    for (i = 0; i < currentIndex->documents->numOfCategories; i++) {
+        if (strcmp(currentIndex->documents->categories[i].key, key) == 0) {
+            return i;
+        }
+    }
+    
+    return -1;
+}
+
+/*
+ * Return the id of a category, registering it on its first occurrence
+ */
+int getCategoryId(const char name[]) {
+    char *key = getCategoryKey(name, MEMORY_DOCUMENTS);
+    
+    int id = findCategory(key);
+    
+    if (id >= 0 || currentIndex->documents->numOfCategories == MAX_CATEGORIES) {
+        trackedFree(MEMORY_DOCUMENTS, key);
+        
+        return id;
+    }
+    
+    currentIndex->documents->categories[currentIndex->documents->numOfCategories].name = trackedStrdup(MEMORY_DOCUMENTS, name);
+    currentIndex->documents->categories[currentIndex->documents->numOfCategories].key = key;
+    currentIndex->documents->categories[currentIndex->documents->numOfCategories].documents = createDocBitmap(MEMORY_DOCUMENTS);
+    
+    return currentIndex->documents->numOfCategories++;
+}
+
+/*
+ * Convert a price as found in the dataset ("199,90") to a number
+ */
+double parsePrice(const char price[]) {
+    char cpPrice[32];
+    
+    snprintf(cpPrice, sizeof(cpPrice), "%s", price);
+    
+    char *comma = strchr(cpPrice, ',');
+    
+    if (comma != NULL) {
+        *comma = '.';
+    }
+    
+    return strtod(cpPrice, NULL);
+}
+
+/*
+ * Parse a bound of a price filter, with a dot or a comma before the cents. Returns false if the text is not a
+ * price as a whole
+ */
+bool parsePriceBound(const char text[], double *price) {
+    char cpPrice[32];
+    
+    if (snprintf(cpPrice, sizeof(cpPrice), "%s", text) >= (int) sizeof(cpPrice)) {
+        return false;
+    }
+    
+    char *comma = strchr(cpPrice, ',');
+    
+    if (comma != NULL) {
+        *comma = '.';
+    }
+    
+    char *end = NULL;
+    
+    *price = strtod(cpPrice, &end);
+    
+    return end != cpPrice && *end == '\0' && isfinite(*price) && *price >= 0;
+}
+
+/*
+ * Compare two entries of the price column by ascending price
+ */
+int comparePriceEntries(const void *a, const void *b) {
+    double priceA = ((const PriceEntry *) a)->price;
+    double priceB = ((const PriceEntry *) b)->price;
+    
+    return (priceA > priceB) - (priceA < priceB);
+}
+
+/*
+ * Generate the price column, sorted by price, from the documents with a price
+ */
+void generatePriceColumn() {
+    trackedFree(MEMORY_DOCUMENTS, currentIndex->documents->prices);
+    
+    currentIndex->documents->prices = trackedMalloc(MEMORY_DOCUMENTS, NUM_OF_DOCUMENTS * sizeof(PriceEntry));
+    currentIndex->documents->numOfPrices = 0;
+    
+    int i;
+    
+    for (i = 0; i < NUM_OF_DOCUMENTS; i++) {
+        if (currentIndex->documents->entries[i] != NULL && currentIndex->documents->entries[i]->price >= 0) {
+            currentIndex->documents->prices[currentIndex->documents->numOfPrices].price = currentIndex->documents->entries[i]->price;
+            currentIndex->documents->prices[currentIndex->documents->numOfPrices].position = i;
+            
+            currentIndex->documents->numOfPrices++;
+        }
+    }
+    
+    qsort(currentIndex->documents->prices, currentIndex->documents->numOfPrices, sizeof(PriceEntry), comparePriceEntries);
+}
+
+/*
+ * Create a bitmap of the documents with price in [minPrice, maxPrice], binary searching the price column
+ */
+DocBitmap *createPriceRangeBitmap(double minPrice, double maxPrice) {
+    DocBitmap *bitmap = createDocBitmap(MEMORY_QUERY);
+    
+    int low = 0;
+    int high = currentIndex->documents->numOfPrices;
+    
+    while (low < high) {
+        int middle = (low + high) / 2;
+        
+        if (currentIndex->documents->prices[middle].price < minPrice) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    
+    for (; low < currentIndex->documents->numOfPrices && currentIndex->documents->prices[low].price <= maxPrice; low++) {
+        addToDocBitmap(bitmap, currentIndex->documents->prices[low].position);
+    }
+    
+    return bitmap;
+}
+
+/*
+ * Intersect a filter with another bitmap, releasing both. A NULL filter means no filter yet
+ */
+DocBitmap *intersectSearchFilter(DocBitmap *filter, DocBitmap *bitmap) {
+    if (filter == NULL) {
+        return bitmap;
+    }
+    
+    DocBitmap *result = intersectDocBitmaps(filter, bitmap);
+    
+    freeDocBitmap(filter);
+    freeDocBitmap(bitmap);
+    
+    return result;
+}
+
+/*
+ * Remove the filters from a query and return the bitmap of the documents accepted by them, or NULL if
+ * the query has no filters. The filters are 'categoria:<name>' (several of them match any of the
+ * categories, spaces in the name are typed as '_') and 'preco:<min>-<max>' (any side may be omitted). A price
+ * filter that is not a valid range is reported and ignored
+ */
+DocBitmap *parseSearchFilter(char query[]) {
+    char *cpQuery = trackedStrdup(MEMORY_QUERY, query);
+    
+    query[0] = '\0';
+    
+    DocBitmap *filter = NULL;
+    DocBitmap *categoryFilter = NULL;
+    
+    char *savePointer = NULL;
+    
+    char *token = strtok_r(cpQuery, " ", &savePointer);
+    
+    while (token != NULL) {
+        if (strncmp(token, "categoria:", strlen("categoria:")) == 0) {
+            char *key = getCategoryKey(token + strlen("categoria:"), MEMORY_QUERY);
+            
+            int id = findCategory(key);
+            
+            if (categoryFilter == NULL) {
+                categoryFilter = createDocBitmap(MEMORY_QUERY);
+            }
+            
+            if (id >= 0) {
+                DocBitmap *united = uniteDocBitmaps(categoryFilter, currentIndex->documents->categories[id].documents);
+                
+                freeDocBitmap(categoryFilter);
+                
+                categoryFilter = united;
+            }
+            
+            trackedFree(MEMORY_QUERY, key);
+        } else if (strncmp(token, "preco:", strlen("preco:")) == 0) {
+            char *range = token + strlen("preco:");
+            char *separator = strchr(range, '-');
+            
+            double minPrice = 0;
+            double maxPrice = HUGE_VAL;
+            
+            bool isValid = true;
+            
+            if (separator != NULL) {
+                *separator = '\0';
+                
+                isValid = *(separator + 1) == '\0' || parsePriceBound(separator + 1, &maxPrice);
+            }
+            
+            isValid = isValid && (*range != '\0' ? parsePriceBound(range, &minPrice) : separator != NULL);
+            
+            /* Without '-' the filter is an exact price */
+            if (separator == NULL) {
+                maxPrice = minPrice;
+            } else {
+                *separator = '-';
+            }
+            
+            /* A bad filter is reported and ignored, so the query is not answered by an empty filter. The shards
+             share the query, so only the first one reports it */
+            if (!isValid || minPrice > maxPrice) {
+                if (SHARD_ID <= 0) {
+                    fprintf(stderr, "\nInvalid price filter %s (expected preco:<min>-<max>, min <= max), the query is not "
+                            "filtered by price\n", token);
+                }
+            } else {
+                filter = intersectSearchFilter(filter, createPriceRangeBitmap(minPrice, maxPrice));
+            }
+        } else {
+            if (query[0] != '\0') {
+                strcat(query, " ");
+            }
+            
+            strcat(query, token);
+        }
+        
+        token = strtok_r(NULL, " ", &savePointer);
+    }
+    
+    if (categoryFilter != NULL) {
+        filter = intersectSearchFilter(filter, categoryFilter);
+    }
+    
+    trackedFree(MEMORY_QUERY, cpQuery);
+    
+    return filter;
+}
+
+/*
+ * Index the terms of a description as the terms of the document of an entry
+ */
+void indexDescription(Entry *entry, const char description[]) {
+    char *cpDescription = trackedStrdup(MEMORY_INGEST, description);
+    
+    /* strtok_r, as an index may be built while the searches tokenize their queries */
+    char *savePointer = NULL;
+    
+    char *token = strtok_r(cpDescription, " ", &savePointer);
+    
+    char *cpToken = NULL;
+    
+    int termPosition = 0;
+    
+    int position = generateHashById(entry->documentId);
+    
+    while (token != NULL) {
+        /* The token becomes the name of the term if it is a new one */
+        cpToken = trackedStrdup(MEMORY_DICTIONARY, token);
+        
+        normalizeTerm(cpToken);
+        
+        currentIndex->numOfTokens++;
+        
+        /* A dropped word keeps its position, so the phrases still need a slop to skip it */
+        if (!analyzeTerm(cpToken)) {
+            currentIndex->numOfDroppedTokens++;
+            
+            trackedFree(MEMORY_DICTIONARY, cpToken);
+            
+            termPosition++;
+        } else {
+            /* The postings share the id and name of the entry, so they are released with the documents */
+            indexTerm(entry->documentId, entry->documentName, cpToken, termPosition++);
+            
+            currentIndex->scoring.documentLengths[position]++;
+        }
+        
+        token = strtok_r(NULL, " ", &savePointer);
+    }
+    
+    trackedFree(MEMORY_INGEST, cpDescription);
+}
+
+/*
+ * Create the entry of a product with its metadata, and add it to the 'entries' collection and to its category
+ */
+Entry *createEntry(Product *product) {
+    Entry *entry = trackedMalloc(MEMORY_DOCUMENTS, sizeof (Entry));
+    entry->documentId = trackedStrdup(MEMORY_DOCUMENTS, product->id);
+    entry->documentName = trackedStrdup(MEMORY_DOCUMENTS, product->imgFileName);
+    
+    int position = generateHashById(product->id);
+    
+    entry->title = product->title != NULL ? trackedStrdup(MEMORY_DOCUMENTS, product->title) : NULL;
+    entry->categoryId = product->category != NULL ? getCategoryId(product->category) : -1;
+    entry->price = product->price != NULL ? parsePrice(product->price) : -1;
+    
+    if (entry->categoryId >= 0) {
+        addToDocBitmap(currentIndex->documents->categories[entry->categoryId].documents, position);
+    }
+    
+    entry->duplicateOf = -1;
+    entry->nextDuplicate = -1;
+    entry->numOfDuplicates = 0;
+    
+    currentIndex->documents->entries[position] = entry;
+    currentIndex->documents->numOfEntries++;
+    
+    return entry;
+}
+
+/*
+ * Index all the terms of the description attribute  based on a hash function
+ */
+void indexEntry(Product *product) {
+    Entry *entry = createEntry(product);
+    
+    indexDescription(entry, product->description);
+}
+
+/*
+ * Index a product, unless its description is a near-duplicate of the one of a product indexed before it: then
+ * its entry keeps its metadata and is linked to the group of that product, but its description is not indexed.
+ * Returns false for a near-duplicate
+ */
+bool indexEntryOrNearDuplicate(Product *product, NearDuplicateIndex *nearDuplicates) {
+    uint32_t signature[MINHASH_SIGNATURE_SIZE];
+    
+    bool hasSignature = computeMinHashSignature(product->description, signature);
+    
+    int representative = hasSignature ? findNearDuplicate(nearDuplicates, signature) : -1;
+    
+    if (representative < 0) {
+        indexEntry(product);
+        
+        if (hasSignature) {
+            addNearDuplicateCandidate(nearDuplicates, signature, generateHashById(product->id));
+        }
+        
+        return true;
+    }
+    
+    Entry *entry = createEntry(product);
+    
+    Entry *representativeEntry = currentIndex->documents->entries[representative];
+    
+    entry->duplicateOf = representative;
+    entry->nextDuplicate = representativeEntry->nextDuplicate;
+    
+    representativeEntry->nextDuplicate = generateHashById(product->id);
+    representativeEntry->numOfDuplicates++;
+    
+    currentIndex->documents->numOfDuplicates++;
+    
+    return false;
+}
+
+/*
+ * Get the term frequency of an term in the query
+ */
+double getQueryTF(char *query, char *term) {
+    char *p = query;
+    int len1 = strlen(term);
+    
+    int count = 0;
+    
+    while ((p = strstr(p, term)) != NULL && p != term) {
+        count++;
+        p += len1;
+    }
+    
+    double result = 0;
+    
+    if (count == 0) {
+        result = 0;
+    } else {
+        result = 1 + log(count);
+    }
+    
+    return result;
+}
+
+/*
+ * Find a term walking the collision chain of its vocabulary hash position, as before the vocabulary is frozen
+ */
+Term *findChainedTerm(const char termName[]) {
+    Term *term = currentIndex->vocabulary[generateHash(termName)];
+    
+    while (term != NULL && strcmp(term->name, termName) != 0) {
+        term = term->next;
+    }
+    
+    return term;
+}
+
+/*
+ * Find a term in the vocabulary. Returns NULL if the term was not indexed
+ */
+Term *findTerm(const char termName[]) {
+    if (currentIndex->dictionary != NULL) {
+        int slot = lookupTermDictionary(currentIndex->dictionary, termName);
+        
+        return slot >= 0 ? currentIndex->dictionaryTerms[slot] : NULL;
+    }
+    
+    return findChainedTerm(termName);
+}
+
+/*
+ * Return a monotonic wall clock time in seconds
+ */
+double getWallClockSeconds() {
+    struct timespec now;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*
+ * Select the MAX_SEARCH_RESULT documents with the highest cossene among the documents with an accumulator,
+ * in descending order. Returns the number of selected documents
+ */
+int selectTopResults(Entry *topResults[], double topScores[]) {
+    int positions[MAX_SEARCH_RESULT];
+    float scores[MAX_SEARCH_RESULT];
+    
+    int countResult = selectTopAccumulators(accumulators, currentIndex->inverseNorms, MAX_SEARCH_RESULT, positions, scores);
+    
+    int i;
+    
+    for (i = 0; i < countResult; i++) {
+        topResults[i] = currentIndex->documents->entries[positions[i]];
+        topScores[i] = scores[i];
+    }
+    
+    return countResult;
+}
+
+/*
+ * Keep the first page of results of a search, with their cossenes
+ */
+void keepSearchResultPage(Entry *page[], double scores[], int countResult, int countSearchResult) {
+    lastSearchPage.countResult = countResult;
+    lastSearchPage.countSearchResult = countSearchResult;
+    
+    memcpy(lastSearchPage.entries, page, countResult * sizeof(Entry *));
+    memcpy(lastSearchPage.scores, scores, countResult * sizeof(double));
+}
+
+/*
+ * Print the ids of the near-duplicates collapsed into the group of an entry, if any, after its name
+ */
+void printNearDuplicates(const Entry *entry) {
+    if (entry->numOfDuplicates == 0) {
+        return;
+    }
+    
+    printf(ANSI_COLOR_CYAN "\t+%d near-duplicates:" ANSI_COLOR_RESET, entry->numOfDuplicates);
+    
+    int position = entry->nextDuplicate;
+    
+    int i;
+    
+    /* The coordinator of a sharded index only has the ids and names of its results */
+    for (i = 0; i < MAX_PRINTED_DUPLICATES && position >= 0 && currentIndex->documents->entries[position] != NULL; i++) {
+        printf(" %s", currentIndex->documents->entries[position]->documentId);
+        
+        position = currentIndex->documents->entries[position]->nextDuplicate;
+    }
+    
+    if (entry->numOfDuplicates > MAX_PRINTED_DUPLICATES) {
+        printf(" ...");
+    }
+}
+
+/*
+ * Print a page of search results. The budget is optional and only used to report truncated searches
+ */
+void printSearchResults(const char query[], Entry *page[], double scores[], int countResult, int countSearchResult,
+                        double searchTimeSpent, SearchBudget *budget) {
+    printf(ANSI_COLOR_CYAN "\n----------------------------------------------------------------------------------------------------------------------");
+    
+    printf(ANSI_COLOR_RESET "\n  List of documents for query " ANSI_BOLD_WHITE "%.20s..." ANSI_COLOR_RESET, query);
+    
+    printf(ANSI_COLOR_CYAN "\n----------------------------------------------------------------------------------------------------------------------\n");
+    
+    printf(ANSI_COLOR_RESET "\t\t\t\t\t\t\t\t\t\tAbout " ANSI_COLOR_YELLOW "%d" ANSI_COLOR_RESET " results (%lf seconds)\n", countSearchResult, searchTimeSpent);
+    
+    if (budget != NULL && budget->truncated) {
+        printf("\t\t\t\t\t\t\t\t\t\t" ANSI_COLOR_RED "Truncated" ANSI_COLOR_RESET " after " ANSI_COLOR_YELLOW "%ld" ANSI_COLOR_RESET " postings\n", budget->evaluatedPostings);
+    }
+    
+    printf(ANSI_COLOR_RESET);
+    
+    char COLUMN_SPACE[4] = "\t\t";
+    
+    printf(ANSI_BOLD_WHITE "\n    ID%sRelevance (%s)%sName\n" ANSI_COLOR_RESET, COLUMN_SPACE, getScoringModelName(currentIndex->scoring.model),
+           COLUMN_SPACE);
+    
+    int x;
+    
+    for (x = 0; x < countResult; x++) {
+        printf("    %-6s\t%-23lf\t%-12s", page[x]->documentId, scores[x], page[x]->documentName);
+        
+        printNearDuplicates(page[x]);
+        
+        printf("\n");
+    }
+    
+    printf(ANSI_COLOR_CYAN "\n----------------------------------------------------------------------------------------------------------------------\n" ANSI_COLOR_RESET);
+    
+    printf("\t\t\t\t\t\t\t\t\t\tMaximum result size per search: " ANSI_COLOR_YELLOW "%d\n" ANSI_COLOR_RESET, MAX_SEARCH_RESULT);
+}
+
+/*
+ * Select the (at most) 'k' best results of the query scored last, in decreasing order of cossene, from the
+ * shared accumulators or from the ones of the search workers. The first MAX_SEARCH_RESULT are the page
+ * returned by the search, as the same selection is used with a larger 'k'
+ */
+int selectRankedResults(bool isParallel, int k, int positions[], float scores[]) {
+    if (!isParallel) {
+        return selectTopAccumulators(accumulators, currentIndex->inverseNorms, k, positions, scores);
+    }
+    
+    int *partitionPositions = trackedMalloc(MEMORY_QUERY, k * sizeof(int));
+    float *partitionScores = trackedMalloc(MEMORY_QUERY, k * sizeof(float));
+    
+    int count = 0;
+    
+    int i, j;
+    
+    for (i = 0; i < workerPool->numOfWorkers; i++) {
+        QueryPartition *partition = &queryPartitions[i];
+        
+        int numOfResults = selectTopAccumulators(partition->accumulators, currentIndex->inverseNorms + partition->firstPosition,
+                                                 k, partitionPositions, partitionScores);
+        
+        for (j = 0; j < numOfResults; j++) {
+            count = insertTopAccumulator(k, count, positions, scores, partition->firstPosition + partitionPositions[j],
+                                         partitionScores[j]);
+        }
+    }
+    
+    trackedFree(MEMORY_QUERY, partitionPositions);
+    trackedFree(MEMORY_QUERY, partitionScores);
+    
+    return count;
+}
+
+/*
+ * Release a search cursor and its reference to the index snapshot. The caller holds the cursors mutex
+ */
+void freeSearchCursor(SearchCursor *cursor) {
+    if (cursor->id == 0) {
+        return;
+    }
+    
+    releaseIndexSnapshot(cursor->index);
+    
+    trackedFree(MEMORY_QUERY, cursor->query);
+    
+    cursor->id = 0;
+    cursor->index = NULL;
+    cursor->query = NULL;
+}
+
+/*
+ * Create a cursor with the ranked results of the query scored last. Returns the id of the cursor
+ */
+uint64_t createSearchCursor(const char query[], int countSearchResult, bool isParallel) {
+    pthread_mutex_lock(&searchCursorsMutex);
+    
+    double now = getWallClockSeconds();
+    
+    SearchCursor *cursor = &searchCursors[0];
+    
+    int i;
+    
+    /* A free or expired cursor, or else the least recently used one */
+    for (i = 0; i < MAX_SEARCH_CURSORS; i++) {
+        SearchCursor *candidate = &searchCursors[i];
+        
+        if (candidate->id != 0 && now - candidate->lastUseSeconds > SEARCH_CURSOR_TTL) {
+            freeSearchCursor(candidate);
+        }
+        
+        if (cursor->id != 0 && (candidate->id == 0 || candidate->lastUseSeconds < cursor->lastUseSeconds)) {
+            cursor = candidate;
+        }
+    }
+    
+    freeSearchCursor(cursor);
+    
+    /* An odd multiplier is a bijection, so the ids are unique but don't tell how many searches were made */
+    cursor->id = ++numOfCreatedCursors * 0x9e3779b97f4a7c15ULL;
+    cursor->lastUseSeconds = now;
+    cursor->index = currentIndex;
+    cursor->query = trackedStrdup(MEMORY_QUERY, query);
+    cursor->countSearchResult = countSearchResult;
+    cursor->numOfResults = selectRankedResults(isParallel, MAX_CURSOR_RESULTS, cursor->positions, cursor->scores);
+    
+    /* The search runs on a snapshot acquired by the command, so taking one more reference is safe */
+    atomic_fetch_add(&currentIndex->references, 1);
+    
+    uint64_t id = cursor->id;
+    
+    pthread_mutex_unlock(&searchCursorsMutex);
+    
+    return id;
+}
+
+/*
+ * Print the command that returns the page of a cursor starting at a rank, or that there are no more pages
+ */
+void printSearchCursor(uint64_t id, int offset, int numOfResults, int countSearchResult) {
+    if (offset < numOfResults) {
+        printf("\t\t\t\t\t\t\t\t\t\tNext page: " ANSI_COLOR_YELLOW "!n %llx:%d\n" ANSI_COLOR_RESET,
+               (unsigned long long) id, offset);
+    } else if (numOfResults < countSearchResult) {
+        printf("\t\t\t\t\t\t\t\t\t\tNo more pages: a search keeps its first %d results\n", MAX_CURSOR_RESULTS);
+    } else {
+        printf("\t\t\t\t\t\t\t\t\t\tNo more pages\n");
+    }
+}
+
+/*
+ * Print a page of results of a cursor (!n <cursor>), where the cursor is '<id>:<rank of the first result>'.
+ * The page is read from the ranked results of the cursor, so it costs the same for any rank
+ */
+void printSearchCursorPage(const char token[]) {
+    unsigned long long id = 0;
+    int offset = 0;
+    
+    while (*token == ' ') {
+        token++;
+    }
+    
+    if (*token == '\0') {
+        printf("\nUsage: !n <cursor>, with the cursor printed after the results of a search");
+        
+        return;
+    }
+    
+    if (sscanf(token, "%llx:%d", &id, &offset) != 2 || id == 0 || offset < 0) {
+        printf("\nInvalid cursor " ANSI_BOLD_WHITE "%s" ANSI_COLOR_RESET, token);
+        
+        return;
+    }
+    
+    double begin = getWallClockSeconds();
+    
+    pthread_mutex_lock(&searchCursorsMutex);
+    
+    SearchCursor *cursor = NULL;
+    
+    int i;
+    
+    for (i = 0; i < MAX_SEARCH_CURSORS && cursor == NULL; i++) {
+        if (searchCursors[i].id == id) {
+            cursor = &searchCursors[i];
+        }
+    }
+    
+    if (cursor != NULL && begin - cursor->lastUseSeconds > SEARCH_CURSOR_TTL) {
+        freeSearchCursor(cursor);
+        
+        cursor = NULL;
+    }
+    
+    if (cursor == NULL) {
+        pthread_mutex_unlock(&searchCursorsMutex);
+        
+        printf("\nThe cursor expired or was replaced by newer searches, search again");
+        
+        return;
+    }
+    
+    cursor->lastUseSeconds = begin;
+    
+    Entry *page[MAX_SEARCH_RESULT];
+    double scores[MAX_SEARCH_RESULT];
+    
+    int countResult = 0;
+    
+    for (i = offset; i < cursor->numOfResults && countResult < MAX_SEARCH_RESULT; i++) {
+        page[countResult] = cursor->index->documents->entries[cursor->positions[i]];
+        scores[countResult] = cursor->scores[i];
+        
+        countResult++;
+    }
+    
+    printSearchResults(cursor->query, page, scores, countResult, cursor->countSearchResult, getWallClockSeconds() - begin, NULL);
+    
+    printSearchCursor(cursor->id, offset + countResult, cursor->numOfResults, cursor->countSearchResult);
+    
+    pthread_mutex_unlock(&searchCursorsMutex);
+}
+
+/*
+ * Release all the search cursors
+ */
+void freeSearchCursors() {
+    pthread_mutex_lock(&searchCursorsMutex);
+    
+    int i;
+    
+    for (i = 0; i < MAX_SEARCH_CURSORS; i++) {
+        freeSearchCursor(&searchCursors[i]);
+    }
+    
+    pthread_mutex_unlock(&searchCursorsMutex);
+}
+
+/*
+ * Parse a vector model query: each query word found in the vocabulary becomes a term weighted by idf * query tf.
+ * The query is tokenized in place. The terms must be released by the caller
+ */
+VectorQuery parseVectorQuery(char query[], const DocBitmap *filter) {
+    char *cpQuery = trackedStrdup(MEMORY_QUERY, query);
+    
+    VectorQuery vectorQuery = { 0, NULL, 0, filter, currentIndex };
+    
+    int capacity = 0;
+    
+    /* strtok_r, as the text and image retrievals of a hybrid query tokenize their queries at the same time */
+    char *savePointer = NULL;
+    
+    char *token = strtok_r(query, " ", &savePointer);
+    
+    while (token != NULL) {
+        Term *term = findTerm(token);
+        
+        if (term != NULL) {
+            if (vectorQuery.numOfTerms == capacity) {
+                capacity = capacity == 0 ? 16 : capacity * 2;
+                
+                vectorQuery.terms = trackedRealloc(MEMORY_QUERY, vectorQuery.terms, capacity * sizeof(WeightedTerm));
+            }
+            
+            WeightedTerm *weightedTerm = &vectorQuery.terms[vectorQuery.numOfTerms++];
+            
+            /* The query tf weight is truncated to an integer, as the exhaustive search always did */
+            int queryTF = getQueryTF(cpQuery, token);
+            
+            weightedTerm->term = term;
+            weightedTerm->queryWeight = getQueryTermWeight(currentIndex->scoring.model, term->idf, queryTF);
+            
+            vectorQuery.cost += term->totalNumOfDocuments;
+        }
+        
+        token = strtok_r(NULL, " ", &savePointer);
+    }
+    
+    trackedFree(MEMORY_QUERY, cpQuery);
+    
+    return vectorQuery;
+}
+
+/*
+ * Score the postings of a vector model query whose positions are in [firstPosition, lastPosition) by a
+ * scoring model. It is inlined with a constant model in scoreVectorQueryRange(), so each model has its own
+ * loop, with no test of the model per posting
+ */
+static inline __attribute__((always_inline)) void scoreVectorQueryRangeByModel(ScoringModel model, const VectorQuery *query,
+                                                                             int firstPosition, int lastPosition,
+                                                                             Accumulators *rangeAccumulators) {
+    const ScoringStatistics *statistics = &query->index->scoring;
+    
+    int i;
+    
+    for (i = 0; i < query->numOfTerms; i++) {
+        const WeightedTerm *weightedTerm = &query->terms[i];
+        
+        PostingCursor cursor;
+        
+        openPostingCursor(&cursor, weightedTerm->term->postings);
+        
+        if (firstPosition > 0) {
+            nextPostingGEQ(&cursor, firstPosition);
+        }
+        
+        for (; cursor.docId >= 0 && cursor.docId < lastPosition; nextPosting(&cursor)) {
+            int position = cursor.docId;
+            
+            if (query->filter != NULL && !docBitmapContains(query->filter, position)) {
+                continue;
+            }
+            
+            double weight = getPostingWeight(model, statistics, weightedTerm->term->idf, getPostingCursorTF(&cursor), position);
+            
+            addToAccumulator(rangeAccumulators, position - firstPosition, weight * weightedTerm->queryWeight);
+        }
+    }
+}
+
+/*
+ * Score the postings of a vector model query whose positions are in [firstPosition, lastPosition).
+ * The accumulators are indexed by position - firstPosition
+ */
+void scoreVectorQueryRange(const VectorQuery *query, int firstPosition, int lastPosition, Accumulators *rangeAccumulators) {
+    switch (query->index->scoring.model) {
+        case SCORING_BM25:
+            scoreVectorQueryRangeByModel(SCORING_BM25, query, firstPosition, lastPosition, rangeAccumulators);
+            break;
+        default:
+            scoreVectorQueryRangeByModel(SCORING_COSINE, query, firstPosition, lastPosition, rangeAccumulators);
+            break;
+    }
+}
+
+/*
+ * Task of a worker of a parallel query: score its range of positions and select its top results
+ */
+void scoreQueryPartition(void *argument, int worker) {
+    const VectorQuery *query = argument;
+    
+    QueryPartition *partition = &queryPartitions[worker];
+    
+    resetAccumulators(partition->accumulators);
+    
+    scoreVectorQueryRange(query, partition->firstPosition, partition->lastPosition, partition->accumulators);
+    
+    partition->numOfResults = selectTopAccumulators(partition->accumulators, query->index->inverseNorms + partition->firstPosition,
+                                                    MAX_SEARCH_RESULT, partition->topPositions, partition->topScores);
+}
+
+/*
+ * Take the search workers for a query of a cost, in postings. Returns false if the query is scored by its own
+ * thread: the query is too cheap, there are no workers or they are scoring another query
+ */
+bool acquireSearchWorkers(long cost) {
+    return workerPool != NULL && cost >= PARALLEL_QUERY_COST && pthread_mutex_trylock(&searchWorkersMutex) == 0;
+}
+
+/*
+ * Let the search workers score other queries, once the results of the last one were read from their partitions
+ */
+void releaseSearchWorkers() {
+    pthread_mutex_unlock(&searchWorkersMutex);
+}
+
+/*
+ * Score a vector model query splitting the positions of the 'entries' collection among the search workers,
+ * and merge the top results of each range. Returns the number of documents with an accumulator
+ */
+int searchInParallel(const VectorQuery *query, Entry *topResults[], double topScores[], int *countResult) {
+    runWorkerPool(workerPool, scoreQueryPartition, (void *) query);
+    
+    int positions[MAX_SEARCH_RESULT];
+    float scores[MAX_SEARCH_RESULT];
+    
+    int countSearchResult = 0;
+    int count = 0;
+    
+    int i, j;
+    
+    for (i = 0; i < workerPool->numOfWorkers; i++) {
+        QueryPartition *partition = &queryPartitions[i];
+        
+        countSearchResult += partition->accumulators->numOfTouched;
+        
+        for (j = 0; j < partition->numOfResults; j++) {
+            count = insertTopAccumulator(MAX_SEARCH_RESULT, count, positions, scores,
+                                         partition->firstPosition + partition->topPositions[j], partition->topScores[j]);
+        }
+    }
+    
+    for (i = 0; i < count; i++) {
+        topResults[i] = currentIndex->documents->entries[positions[i]];
+        topScores[i] = scores[i];
+    }
+    
+    *countResult = count;
+    
+    return countSearchResult;
+}
+
+/*
+ * Search term occurrences using the inverted index. When a filter is given, only the documents
+ * of the filter bitmap are scored. Queries costing at least PARALLEL_QUERY_COST postings are
+ * scored by the search workers
+ */
+Entry **searchByVectorModel(char termName[], bool verbose, Entry **paginatedResult, const DocBitmap *filter) {
+    
+    if (strcmp(termName, "") == 0) {
+        return NULL;
+    }
+    
+    /* Wall clock time, as the CPU time of a parallel query adds the time of all the workers */
+    double begin = getWallClockSeconds();
+    
+    normalizeTerm(termName);
+    
+    analyzeQuery(termName);
+    
+    char *cpTermName = trackedStrdup(MEMORY_QUERY, termName);
+    
+    VectorQuery query = parseVectorQuery(termName, filter);
+    
+    Entry *page[MAX_SEARCH_RESULT];
+    double scores[MAX_SEARCH_RESULT];
+    
+    int countResult = 0;
+    int countSearchResult = 0;
+    
+    bool isParallel = acquireSearchWorkers(query.cost);
+    
+    if (isParallel) {
+        countSearchResult = searchInParallel(&query, page, scores, &countResult);
+    } else {
+        resetAccumulators(accumulators);
+        
+        scoreVectorQueryRange(&query, 0, NUM_OF_DOCUMENTS, accumulators);
+        
+        countSearchResult = accumulators->numOfTouched;
+        
+        countResult = selectTopResults(page, scores);
+    }
+    
+    trackedFree(MEMORY_QUERY, query.terms);
+    
+    if (countSearchResult == 0) {
+        if (isParallel) {
+            releaseSearchWorkers();
+        }
+        
+        if (verbose) {
+            printf("\nNo results for query " ANSI_BOLD_WHITE "%.20s...\n" ANSI_COLOR_RESET, cpTermName);
+        }
+        
+        trackedFree(MEMORY_QUERY, cpTermName);
+        
+        return NULL;
+    }
+    
+    double searchTimeSpent = getWallClockSeconds() - begin;
+    
+    keepSearchResultPage(page, scores, countResult, countSearchResult);
+    
+    if (verbose) {
+        printSearchResults(cpTermName, page, scores, countResult, countSearchResult, searchTimeSpent, NULL);
+        
+        /* Only the interactive searches with more than one page keep a cursor */
+        if (countSearchResult > countResult) {
+            uint64_t id = createSearchCursor(cpTermName, countSearchResult, isParallel);
+            
+            printSearchCursor(id, countResult, MAX_CURSOR_RESULTS, countSearchResult);
+        }
+    } else {
+        memcpy(paginatedResult, page, countResult * sizeof(Entry *));
+    }
+    
+    /* The cursor was filled from the partitions of the workers */
+    if (isParallel) {
+        releaseSearchWorkers();
+    }
+    
+    trackedFree(MEMORY_QUERY, cpTermName);
+    
+    return paginatedResult;
+}
+
+/*
+ * Select the MAX_SEARCH_RESULT best documents of a parsed query in the quantized vectors of its index, re-ranking
+ * the best 'numOfReranked' of them by their exact vectors. Returns the number of selected documents
+ */
+int searchVectorQueryInStore(const VectorQuery *query, int numOfReranked, int topPositions[], float topScores[]) {
+    int *dimensions = trackedMalloc(MEMORY_QUERY, (query->numOfTerms + 1) * sizeof(int));
+    float *weights = trackedMalloc(MEMORY_QUERY, (query->numOfTerms + 1) * sizeof(float));
+    
+    int i;
+    
+    for (i = 0; i < query->numOfTerms; i++) {
+        dimensions[i] = lookupTermDictionary(query->index->dictionary, query->terms[i].term->name);
+        weights[i] = query->terms[i].queryWeight;
+    }
+    
+    int count = searchVectorStore(query->index->vectors, query->numOfTerms, dimensions, weights, MAX_SEARCH_RESULT,
+                                  numOfReranked, topPositions, topScores);
+    
+    trackedFree(MEMORY_QUERY, weights);
+    trackedFree(MEMORY_QUERY, dimensions);
+    
+    return count;
+}
+
+/*
+ * Search an image query in the quantized vectors of the image index (--quantize-images) instead of its postings.
+ * Every image is scored by its codes, so all of them are counted as results
+ */
+Entry **searchByVectorStore(char query[], bool verbose, Entry **paginatedResult) {
+    
+    if (strcmp(query, "") == 0) {
+        return NULL;
+    }
+    
+    double begin = getWallClockSeconds();
+    
+    normalizeTerm(query);
+    
+    char *cpQuery = trackedStrdup(MEMORY_QUERY, query);
+    
+    VectorQuery vectorQuery = parseVectorQuery(query, NULL);
+    
+    int positions[MAX_SEARCH_RESULT];
+    float scores[MAX_SEARCH_RESULT];
+    
+    int countResult = 0;
+    
+    if (vectorQuery.numOfTerms > 0) {
+        countResult = searchVectorQueryInStore(&vectorQuery, RERANK_CANDIDATES, positions, scores);
+    }
+    
+    trackedFree(MEMORY_QUERY, vectorQuery.terms);
+    
+    if (countResult == 0) {
+        if (verbose) {
+            printf("\nNo results for query " ANSI_BOLD_WHITE "%.20s...\n" ANSI_COLOR_RESET, cpQuery);
+        }
+        
+        trackedFree(MEMORY_QUERY, cpQuery);
+        
+        return NULL;
+    }
+    
+    Entry *page[MAX_SEARCH_RESULT];
+    double pageScores[MAX_SEARCH_RESULT];
+    
+    int i;
+    
+    for (i = 0; i < countResult; i++) {
+        page[i] = currentIndex->documents->entries[positions[i]];
+        pageScores[i] = scores[i];
+    }
+    
+    double searchTimeSpent = getWallClockSeconds() - begin;
+    
+    int countSearchResult = currentIndex->vectors->numOfVectors;
+    
+    keepSearchResultPage(page, pageScores, countResult, countSearchResult);
+    
+    if (verbose) {
+        printSearchResults(cpQuery, page, pageScores, countResult, countSearchResult, searchTimeSpent, NULL);
+    } else {
+        memcpy(paginatedResult, page, countResult * sizeof(Entry *));
+    }
+    
+    trackedFree(MEMORY_QUERY, cpQuery);
+    
+    return paginatedResult;
+}
+
+/*
+ * Start the search workers, each one with the accumulators of an equal range of positions of the 'entries' collection
+ */
+void createSearchWorkers(int numOfWorkers) {
+    if (numOfWorkers <= 1) {
+        return;
+    }
+    
+    workerPool = createWorkerPool(numOfWorkers);
+    
+    queryPartitions = trackedMalloc(MEMORY_QUERY, numOfWorkers * sizeof(QueryPartition));
+    
+    int i;
+    
+    for (i = 0; i < numOfWorkers; i++) {
+        QueryPartition *partition = &queryPartitions[i];
+        
+        partition->firstPosition = (long) NUM_OF_DOCUMENTS * i / numOfWorkers;
+        partition->lastPosition = (long) NUM_OF_DOCUMENTS * (i + 1) / numOfWorkers;
+        partition->accumulators = createAccumulators(partition->lastPosition - partition->firstPosition);
+        partition->numOfResults = 0;
+    }
+}
+
+/*
+ * Stop the search workers and release their accumulators
+ */
+void freeSearchWorkers() {
+    if (workerPool == NULL) {
+        return;
+    }
+    
+    int i;
+    
+    for (i = 0; i < workerPool->numOfWorkers; i++) {
+        freeAccumulators(queryPartitions[i].accumulators);
+    }
+    
+    trackedFree(MEMORY_QUERY, queryPartitions);
+    
+    freeWorkerPool(workerPool);
+    
+    queryPartitions = NULL;
+    workerPool = NULL;
+}
+
+/*
+ * Swap two cursors of the impact-ordered search heap
+ */
+void swapImpactCursors(ImpactCursor heap[], int i, int j) {
+    ImpactCursor aux = heap[i];
+    
+    heap[i] = heap[j];
+    heap[j] = aux;
+}
+
+/*
+ * Upper bound of the score that the next block of a cursor can add to a document
+ */
+double getImpactCursorBound(ImpactCursor *cursor) {
+    return cursor->queryWeight * cursor->term->impacts[cursor->offset];
+}
+
+/*
+ * Restore the max-heap property (by block upper bound) from the position 'i' downwards
+ */
+void siftDownImpactCursors(ImpactCursor heap[], int size, int i) {
+    while (true) {
+        int largest = i;
+        int left = 2 * i + 1;
+        int right = 2 * i + 2;
+        
+        if (left < size && getImpactCursorBound(&heap[left]) > getImpactCursorBound(&heap[largest])) {
+            largest = left;
+        }
+        
+        if (right < size && getImpactCursorBound(&heap[right]) > getImpactCursorBound(&heap[largest])) {
+            largest = right;
+        }
+        
+        if (largest == i) {
+            return;
+        }
+        
+        swapImpactCursors(heap, i, largest);
+        
+        i = largest;
+    }
+}
+
+/*
+ * Return true if the search budget has run out
+ */
+bool isSearchBudgetExhausted(SearchBudget *budget, double beginSeconds) {
+    if (budget->maxPostings > 0 && budget->evaluatedPostings >= budget->maxPostings) {
+        return true;
+    }
+    
+    if (budget->maxSeconds > 0 && getWallClockSeconds() - beginSeconds >= budget->maxSeconds) {
+        return true;
+    }
+    
+    return false;
+}
+
+/*
+ * Search term occurrences using the impact-ordered layout of the inverted index.
+ *
+ * The blocks with the highest impact of all the query terms are scored first and the search stops
+ * when the budget runs out, returning the best-so-far results with budget->truncated set.
+ * When a filter is given, only the documents of the filter bitmap are scored.
+ */
+Entry **searchByImpactOrder(char termName[], bool verbose, Entry **paginatedResult, SearchBudget *budget,
+                            const DocBitmap *filter) {
+    
+    if (strcmp(termName, "") == 0) {
+        return NULL;
+    }
+    
+    double begin = getWallClockSeconds();
+    
+    budget->evaluatedPostings = 0;
+    budget->truncated = false;
+    
+    resetAccumulators(accumulators);
+    
+    normalizeTerm(termName);
+    
+    analyzeQuery(termName);
+    
+    char *cpTermName = trackedStrdup(MEMORY_QUERY, termName);
+    
+    int maxOfCursors = strlen(cpTermName) / 2 + 1;
+    
+    ImpactCursor *heap = trackedMalloc(MEMORY_QUERY, maxOfCursors * sizeof(ImpactCursor));
+    
+    int numOfCursors = 0;
+    
+    char *savePointer = NULL;
+    
+    char *token = strtok_r(termName, " ", &savePointer);
+    
+    while (token != NULL) {
+        Term *term = findTerm(token);
+        
+        if (term != NULL && term->totalNumOfDocuments > 0) {
+            int queryTF = getQueryTF(cpTermName, token);
+            
+            int i;
+            
+            /* A term repeated in the query is scored once, with its weight multiplied by the repetitions */
+            for (i = 0; i < numOfCursors && heap[i].term != term; i++);
+            
+            if (i == numOfCursors) {
+                heap[numOfCursors].term = term;
+                heap[numOfCursors].queryWeight = 0;
+                heap[numOfCursors].offset = 0;
+                
+                numOfCursors++;
+            }
+            
+            heap[i].queryWeight += getQueryTermWeight(currentIndex->scoring.model, term->idf, queryTF);
+        }
+        
+        token = strtok_r(NULL, " ", &savePointer);
+    }
+    
+    int i;
+    
+    for (i = numOfCursors / 2 - 1; i >= 0; i--) {
+        siftDownImpactCursors(heap, numOfCursors, i);
+    }
+    
+    while (numOfCursors > 0) {
+        if (isSearchBudgetExhausted(budget, begin)) {
+            budget->truncated = true;
+            
+            break;
+        }
+        
+        ImpactCursor *cursor = &heap[0];
+        
+        Term *term = cursor->term;
+        
+        int last = cursor->offset + IMPACT_BLOCK_SIZE;
+        
+        if (last > term->totalNumOfDocuments) {
+            last = term->totalNumOfDocuments;
+        }
+        
+        /* The last block is cut where the postings budget runs out, so no more postings than the budget are scored */
+        if (budget->maxPostings > 0 && last - cursor->offset > budget->maxPostings - budget->evaluatedPostings) {
+            last = cursor->offset + (int) (budget->maxPostings - budget->evaluatedPostings);
+        }
+        
+        for (i = cursor->offset; i < last; i++) {
+            int position = term->impactPositions[i];
+            
+            if (filter != NULL && !docBitmapContains(filter, position)) {
+                continue;
+            }
+            
+            addToAccumulator(accumulators, position, term->impacts[i] * cursor->queryWeight);
+        }
+        
+        budget->evaluatedPostings += last - cursor->offset;
+        
+        cursor->offset = last;
+        
+        /* All the blocks of this term were scored, so it leaves the heap */
+        if (cursor->offset >= term->totalNumOfDocuments) {
+            swapImpactCursors(heap, 0, --numOfCursors);
+        }
+        
+        siftDownImpactCursors(heap, numOfCursors, 0);
+    }
+    
+    trackedFree(MEMORY_QUERY, heap);
+    
+    int countSearchResult = accumulators->numOfTouched;
+    
+    if (countSearchResult == 0) {
+        if (verbose) {
+            printf("\nNo results for query " ANSI_BOLD_WHITE "%.20s...\n" ANSI_COLOR_RESET, cpTermName);
+        }
+        
+        trackedFree(MEMORY_QUERY, cpTermName);
+        
+        return NULL;
+    }
+    
+    Entry *page[MAX_SEARCH_RESULT];
+    double scores[MAX_SEARCH_RESULT];
+    
+    int countResult = selectTopResults(page, scores);
+    
+    double searchTimeSpent = getWallClockSeconds() - begin;
+    
+    keepSearchResultPage(page, scores, countResult, countSearchResult);
+    
+    if (verbose) {
+        printSearchResults(cpTermName, page, scores, countResult, countSearchResult, searchTimeSpent, budget);
+    } else {
+        for (i = 0; i < countResult; i++) {
+            paginatedResult[i] = page[i];
+        }
+    }
+    
+    trackedFree(MEMORY_QUERY, cpTermName);
+    
+    return paginatedResult;
+}
+
+/*
+ * Return true if the query uses the boolean operators: +term, -term, (grouped terms) or "phrase"
+ */
+bool isBooleanQuery(const char query[]) {
+    bool isTokenStart = true;
+    
+    for (; *query != '\0'; query++) {
+        if (isTokenStart && (*query == '+' || *query == '-' || *query == '(' || *query == '"')) {
+            return true;
+        }
+        
+        isTokenStart = *query == ' ';
+    }
+    
+    return false;
+}
+
+/*
+ * Add a term to the last clause of a boolean query. Terms that were not indexed are ignored, but
+ * they make a phrase clause match nothing. Returns false if the term was dropped by the analysis chain
+ */
+bool addBooleanQueryTerm(BooleanQuery *booleanQuery, char termName[]) {
+    QueryClause *clause = &booleanQuery->clauses[booleanQuery->numOfClauses - 1];
+    
+    normalizeTerm(termName);
+    
+    /* A dropped word still has a position in the documents, so a phrase allows one more word for it */
+    if (!analyzeTerm(termName)) {
+        if (clause->isPhrase) {
+            clause->slop++;
+        }
+        
+        return false;
+    }
+    
+    Term *term = findTerm(termName);
+    
+    if (term == NULL || booleanQuery->numOfTerms == MAX_QUERY_TERMS) {
+        clause->hasMissingTerm = clause->isPhrase;
+        
+        return true;
+    }
+    
+    QueryTerm *queryTerm = &booleanQuery->terms[booleanQuery->numOfTerms++];
+    
+    queryTerm->term = term;
+    queryTerm->queryWeight = 0;
+    
+    openPostingCursor(&queryTerm->cursor, term->postings);
+    
+    clause->numOfTerms++;
+    
+    /* A group matches the documents of any of its terms, but a phrase only the ones of all of them, so it
+     costs at most the postings of its rarest term */
+    if (!clause->isPhrase) {
+        clause->cost += term->postings->numOfPostings;
+    } else if (clause->numOfTerms == 1 || term->postings->numOfPostings < clause->cost) {
+        clause->cost = term->postings->numOfPostings;
+    }
+    
+    return true;
+}
+
+/*
+ * Parse a query made of clauses separated by spaces. A clause is a term, a group of terms
+ * between parentheses (matched if any of its terms is found) or a phrase between quotes, optionally
+ * followed by ~slop. Clauses may be prefixed by '+' (required) or '-' (excluded).
+ * Example: +vestido +(longo midi) -infantil "manga longa"~1 festa
+ */
+void parseBooleanQuery(char query[], BooleanQuery *booleanQuery) {
+    booleanQuery->numOfTerms = 0;
+    booleanQuery->numOfClauses = 0;
+    booleanQuery->hasMissingRequiredClause = false;
+    
+    char *p = query;
+    
+    while (*p != '\0' && booleanQuery->numOfClauses < MAX_QUERY_CLAUSES) {
+        if (*p == ' ') {
+            p++;
+            
+            continue;
+        }
+        
+        QueryClause *clause = &booleanQuery->clauses[booleanQuery->numOfClauses++];
+        
+        clause->occur = CLAUSE_SHOULD;
+        clause->firstTerm = booleanQuery->numOfTerms;
+        clause->numOfTerms = 0;
+        clause->isPhrase = false;
+        clause->slop = 0;
+        clause->hasMissingTerm = false;
+        clause->cost = 0;
+        clause->docId = -1;
+        
+        if (*p == '+') {
+            clause->occur = CLAUSE_MUST;
+            
+            p++;
+        } else if (*p == '-') {
+            clause->occur = CLAUSE_MUST_NOT;
+            
+            p++;
+        }
+        
+        clause->isPhrase = *p == '"';
+        
+        /* Character that closes a group or a phrase. A single term is closed by a space */
+        char closing = *p == '(' ? ')' : *p == '"' ? '"' : ' ';
+        
+        if (closing != ' ') {
+            p++;
+        }
+        
+        /* Words of the clause, and the ones dropped by the analysis chain */
+        int numOfWords = 0;
+        int numOfDroppedWords = 0;
+        
+        do {
+            while (closing != ' ' && *p == ' ') {
+                p++;
+            }
+            
+            char *termName = p;
+            
+            while (*p != '\0' && *p != ' ' && *p != closing) {
+                p++;
+            }
+            
+            char end = *p;
+            
+            *p = '\0';
+            
+            if (*termName != '\0') {
+                numOfWords++;
+                
+                if (!addBooleanQueryTerm(booleanQuery, termName)) {
+                    numOfDroppedWords++;
+                }
+            }
+            
+            *p = end;
+        } while (closing != ' ' && *p != '\0' && *p != closing);
+        
+        if (closing != ' ' && *p == closing) {
+            p++;
+        }
+        
+        if (clause->isPhrase && *p == '~') {
+            clause->slop += (int) strtol(p + 1, &p, 10);
+        }
+        
+        /* A clause without indexed terms (or a phrase missing any of them) matches nothing, but a clause of
+         dropped words only (as '+de') is just ignored */
+        if (clause->numOfTerms == 0 || clause->hasMissingTerm) {
+            if (clause->occur == CLAUSE_MUST && (clause->hasMissingTerm || numOfWords == 0 || numOfDroppedWords < numOfWords)) {
+                booleanQuery->hasMissingRequiredClause = true;
+            }
+            
+            booleanQuery->numOfClauses--;
+        }
+    }
+    
+    int i, j;
+    
+    /* Each distinct term of the required and optional clauses is scored once, weighted by its query tf as in the
+     vector queries */
+    for (i = 0; i < booleanQuery->numOfClauses; i++) {
+        QueryClause *clause = &booleanQuery->clauses[i];
+        
+        if (clause->occur == CLAUSE_MUST_NOT) {
+            continue;
+        }
+        
+        for (j = clause->firstTerm; j < clause->firstTerm + clause->numOfTerms; j++) {
+            int first = 0;
+            int queryTF = 0;
+            
+            int k;
+            
+            for (k = 0; k < booleanQuery->numOfClauses; k++) {
+                QueryClause *other = &booleanQuery->clauses[k];
+                
+                int t;
+                
+                for (t = other->firstTerm; other->occur != CLAUSE_MUST_NOT && t < other->firstTerm + other->numOfTerms; t++) {
+                    if (booleanQuery->terms[t].term == booleanQuery->terms[j].term) {
+                        first = queryTF++ == 0 ? t : first;
+                    }
+                }
+            }
+            
+            if (first == j) {
+                Term *term = booleanQuery->terms[j].term;
+                
+                booleanQuery->terms[j].queryWeight = getQueryTermWeight(currentIndex->scoring.model, term->idf, queryTF);
+            }
+        }
+    }
+}
+
+/*
+ * Check the positions of the terms of a phrase clause, whose cursors must all be on the same document.
+ * Each term must follow the previous one with at most 'slop' other words between them
+ */
+bool matchesPhrase(BooleanQuery *booleanQuery, QueryClause *clause) {
+    int maxTF = 0;
+    
+    int i, j;
+    
+    for (i = clause->firstTerm; i < clause->firstTerm + clause->numOfTerms; i++) {
+        QueryTerm *queryTerm = &booleanQuery->terms[i];
+        
+        /* Without the positional index, a phrase matches as a conjunction of its terms */
+        if (queryTerm->term->positions == NULL) {
+            return true;
+        }
+        
+        int tf = getPostingCursorTF(&queryTerm->cursor);
+        
+        maxTF = tf > maxTF ? tf : maxTF;
+    }
+    
+    int *reachable = trackedMalloc(MEMORY_QUERY, maxTF * sizeof(int));
+    int *positions = trackedMalloc(MEMORY_QUERY, maxTF * sizeof(int));
+    
+    QueryTerm *first = &booleanQuery->terms[clause->firstTerm];
+    
+    /* Positions of the current term that end a match of the phrase prefix */
+    int numOfReachable = decodePositions(first->term->positions, getPostingCursorOrdinal(&first->cursor), reachable);
+    
+    for (i = clause->firstTerm + 1; i < clause->firstTerm + clause->numOfTerms && numOfReachable > 0; i++) {
+        QueryTerm *queryTerm = &booleanQuery->terms[i];
+        
+        int numOfPositions = decodePositions(queryTerm->term->positions, getPostingCursorOrdinal(&queryTerm->cursor), positions);
+        
+        int numOfKept = 0;
+        
+        int k;
+        
+        /* Both lists are sorted, so a single merge keeps the positions with a reachable one right before them */
+        for (j = 0, k = 0; k < numOfPositions; k++) {
+            while (j < numOfReachable && reachable[j] + 1 + clause->slop < positions[k]) {
+                j++;
+            }
+            
+            if (j < numOfReachable && reachable[j] < positions[k]) {
+                positions[numOfKept++] = positions[k];
+            }
+        }
+        
+        int *aux = reachable;
+        reachable = positions;
+        positions = aux;
+        
+        numOfReachable = numOfKept;
+    }
+    
+    trackedFree(MEMORY_QUERY, reachable);
+    trackedFree(MEMORY_QUERY, positions);
+    
+    return numOfReachable > 0;
+}
+
+/*
+ * Find the next doc id greater than or equal to 'docId' that contains all the terms of a phrase
+ * clause, intersecting their postings first and only then verifying their positions
+ */
+int nextPhraseMatch(BooleanQuery *booleanQuery, QueryClause *clause, int docId) {
+    PostingCursor *first = &booleanQuery->terms[clause->firstTerm].cursor;
+    
+    int last = clause->firstTerm + clause->numOfTerms;
+    
+    while (nextPostingGEQ(first, docId)) {
+        int candidate = first->docId;
+        
+        int i;
+        
+        for (i = clause->firstTerm + 1; i < last; i++) {
+            PostingCursor *cursor = &booleanQuery->terms[i].cursor;
+            
+            if (!nextPostingGEQ(cursor, candidate)) {
+                return -1;
+            }
+            
+            if (cursor->docId > candidate) {
+                break;
+            }
+        }
+        
+        if (i < last) {
+            docId = booleanQuery->terms[i].cursor.docId;
+        } else if (matchesPhrase(booleanQuery, clause)) {
+            return candidate;
+        } else {
+            docId = candidate + 1;
+        }
+    }
+    
+    return -1;
+}
+
+/*
+ * Move all the terms of a clause to doc ids greater than or equal to 'docId'. Returns the smallest
+ * of them, which is the next doc id matched by the clause, or -1 if the clause has no more postings
+ */
+int advanceQueryClause(BooleanQuery *booleanQuery, QueryClause *clause, int docId) {
+    /* The cursors only move forward, so a clause already at or after 'docId' is still there */
+    if (clause->docId >= docId) {
+        return clause->docId;
+    }
+    
+    if (clause->isPhrase) {
+        clause->docId = nextPhraseMatch(booleanQuery, clause, docId);
+        
+        return clause->docId;
+    }
+    
+    int nextDocId = -1;
+    
+    int i;
+    
+    for (i = clause->firstTerm; i < clause->firstTerm + clause->numOfTerms; i++) {
+        PostingCursor *cursor = &booleanQuery->terms[i].cursor;
+        
+        if (nextPostingGEQ(cursor, docId) && (nextDocId < 0 || cursor->docId < nextDocId)) {
+            nextDocId = cursor->docId;
+        }
+    }
+    
+    clause->docId = nextDocId;
+    
+    return nextDocId;
+}
+
+/*
+ * Find the next doc id greater than or equal to 'docId' matched by all the required clauses,
+ * which must be sorted by cost so the rarest one proposes the candidates and the others gallop
+ * to them. Without required clauses, the next doc id matched by any optional clause is returned
+ */
+int nextBooleanMatch(BooleanQuery *booleanQuery, QueryClause *required[], int numOfRequired,
+                     QueryClause *optional[], int numOfOptional, int docId) {
+    int i;
+    
+    if (numOfRequired == 0) {
+        int nextDocId = -1;
+        
+        for (i = 0; i < numOfOptional; i++) {
+            int clauseDocId = advanceQueryClause(booleanQuery, optional[i], docId);
+            
+            if (clauseDocId >= 0 && (nextDocId < 0 || clauseDocId < nextDocId)) {
+                nextDocId = clauseDocId;
+            }
+        }
+        
+        return nextDocId;
+    }
+    
+    int candidate = advanceQueryClause(booleanQuery, required[0], docId);
+    
+    i = 1;
+    
+    while (candidate >= 0 && i < numOfRequired) {
+        int clauseDocId = advanceQueryClause(booleanQuery, required[i], candidate);
+        
+        if (clauseDocId < 0) {
+            return -1;
+        }
+        
+        if (clauseDocId > candidate) {
+            candidate = advanceQueryClause(booleanQuery, required[0], clauseDocId);
+            
+            i = 1;
+        } else {
+            i++;
+        }
+    }
+    
+    return candidate;
+}
+
+/*
+ * Search the documents matched by a boolean query (see parseBooleanQuery()), ranked by cossene.
+ * Only the matched documents are scored, and only the posting blocks reached by the intersection are decoded.
+ * When a filter is given, it takes part in the intersection as one more required clause
+ */
+Entry **searchByBooleanQuery(char query[], bool verbose, Entry **paginatedResult, const DocBitmap *filter) {
+    
+    if (strcmp(query, "") == 0) {
+        return NULL;
+    }
+    
+    double begin = getWallClockSeconds();
+    
+    char *cpQuery = trackedStrdup(MEMORY_QUERY, query);
+    
+    BooleanQuery *booleanQuery = trackedMalloc(MEMORY_QUERY, sizeof(BooleanQuery));
+    
+    parseBooleanQuery(query, booleanQuery);
+    
+    QueryClause *required[MAX_QUERY_CLAUSES];
+    QueryClause *optional[MAX_QUERY_CLAUSES];
+    QueryClause *excluded[MAX_QUERY_CLAUSES];
+    
+    int numOfRequired = 0;
+    int numOfOptional = 0;
+    int numOfExcluded = 0;
+    
+    int i, j;
+    
+    for (i = 0; i < booleanQuery->numOfClauses; i++) {
+        QueryClause *clause = &booleanQuery->clauses[i];
+        
+        if (clause->occur == CLAUSE_MUST) {
+            /* Insertion sort by cost, so the rarest clause leads the intersection */
+            for (j = numOfRequired++; j > 0 && required[j - 1]->cost > clause->cost; j--) {
+                required[j] = required[j - 1];
+            }
+            
+            required[j] = clause;
+        } else if (clause->occur == CLAUSE_SHOULD) {
+            optional[numOfOptional++] = clause;
+        } else {
+            excluded[numOfExcluded++] = clause;
+        }
+    }
+    
+    resetAccumulators(accumulators);
+    
+    int docId = -1;
+    
+    if (!booleanQuery->hasMissingRequiredClause) {
+        docId = nextBooleanMatch(booleanQuery, required, numOfRequired, optional, numOfOptional, 0);
+    }
+    
+    while (docId >= 0) {
+        /* Jump to the next document of the filter and look for a match from there */
+        if (filter != NULL && !docBitmapContains(filter, docId)) {
+            int filterDocId = nextDocBitmapDocId(filter, docId);
+            
+            docId = filterDocId < 0 ? -1 : nextBooleanMatch(booleanQuery, required, numOfRequired, optional, numOfOptional, filterDocId);
+            
+            continue;
+        }
+        
+        bool isExcluded = false;
+        
+        for (i = 0; i < numOfExcluded && !isExcluded; i++) {
+            isExcluded = advanceQueryClause(booleanQuery, excluded[i], docId) == docId;
+        }
+        
+        if (!isExcluded && currentIndex->documents->entries[docId] != NULL) {
+            /* Only the terms of the clauses matched by the document are scored, so an optional phrase (or group)
+             ranks the documents containing it above the ones that only contain its words */
+            bool isScored[MAX_QUERY_TERMS] = { false };
+            
+            for (i = 0; i < booleanQuery->numOfClauses; i++) {
+                QueryClause *clause = &booleanQuery->clauses[i];
+                
+                if (clause->occur == CLAUSE_MUST_NOT) {
+                    continue;
+                }
+                
+                if (clause->occur == CLAUSE_SHOULD) {
+                    advanceQueryClause(booleanQuery, clause, docId);
+                }
+                
+                if (clause->docId != docId) {
+                    continue;
+                }
+                
+                /* A term repeated in several clauses has its weight in its first occurrence only */
+                for (j = clause->firstTerm; j < clause->firstTerm + clause->numOfTerms; j++) {
+                    int k;
+                    
+                    for (k = 0; k < booleanQuery->numOfTerms; k++) {
+                        if (booleanQuery->terms[k].term == booleanQuery->terms[j].term && booleanQuery->terms[k].queryWeight > 0) {
+                            isScored[k] = true;
+                        }
+                    }
+                }
+            }
+            
+            double sum = 0;
+            
+            for (i = 0; i < booleanQuery->numOfTerms; i++) {
+                QueryTerm *queryTerm = &booleanQuery->terms[i];
+                
+                if (isScored[i] && nextPostingGEQ(&queryTerm->cursor, docId) && queryTerm->cursor.docId == docId) {
+                    double weight = getPostingWeight(currentIndex->scoring.model, &currentIndex->scoring, queryTerm->term->idf,
+                                                     getPostingCursorTF(&queryTerm->cursor), docId);
+                    
+                    sum += weight * queryTerm->queryWeight;
+                }
+            }
+            
+            addToAccumulator(accumulators, docId, sum);
+        }
+        
+        docId = nextBooleanMatch(booleanQuery, required, numOfRequired, optional, numOfOptional, docId + 1);
+    }
+    
+    long decodedBlocks = 0;
+    long totalBlocks = 0;
+    
+    for (i = 0; i < booleanQuery->numOfTerms; i++) {
+        decodedBlocks += booleanQuery->terms[i].cursor.decodedBlocks;
+        totalBlocks += booleanQuery->terms[i].term->postings->numOfBlocks;
+    }
+    
+    trackedFree(MEMORY_QUERY, booleanQuery);
+    
+    int countSearchResult = accumulators->numOfTouched;
+    
+    if (countSearchResult == 0) {
+        if (verbose) {
+            printf("\nNo results for query " ANSI_BOLD_WHITE "%.20s...\n" ANSI_COLOR_RESET, cpQuery);
+        }
+        
+        trackedFree(MEMORY_QUERY, cpQuery);
+        
+        return NULL;
+    }
+    
+    Entry *page[MAX_SEARCH_RESULT];
+    double scores[MAX_SEARCH_RESULT];
+    
+    int countResult = selectTopResults(page, scores);
+    
+    double searchTimeSpent = getWallClockSeconds() - begin;
+    
+    keepSearchResultPage(page, scores, countResult, countSearchResult);
+    
+    if (verbose) {
+        printSearchResults(cpQuery, page, scores, countResult, countSearchResult, searchTimeSpent, NULL);
+        
+        printf("\t\t\t\t\t\t\t\t\t\tPosting blocks decoded: " ANSI_COLOR_YELLOW "%ld" ANSI_COLOR_RESET " of %ld\n",
+               decodedBlocks, totalBlocks);
+    } else {
+        for (i = 0; i < countResult; i++) {
+            paginatedResult[i] = page[i];
+        }
+    }
+    
+    trackedFree(MEMORY_QUERY, cpQuery);
+    
+    return paginatedResult;
+}
+
+/*
+ * Creates and populates a product struct based on a XML cursor
+ */
+Product *createPopulatedStructProduct(xmlNodePtr in_cur) {
+    
+    /* The fields point to the text of the XML nodes, so only the struct is released after indexing */
+    Product *newProduct = (Product *) trackedCalloc(MEMORY_INGEST, 1, sizeof(Product));
     
     while (in_cur != NULL) {
         if(!xmlStrcmp(in_cur->name, (const xmlChar *) "id")) {
-            newProduct->id = malloc(NUM_OF_DOCUMENTS * sizeof(char));
             newProduct->id = (char *) in_cur->children->content;
         }
         
-        if(!xmlStrcmp(in_cur->name, (const xmlChar *) "descricao")) {
-            newProduct->description = malloc(DESCRIPTION_SIZE * sizeof(char));
-            newProduct->description = (char *) in_cur->children->content;
+        if(!xmlStrcmp(in_cur->name, (const xmlChar *) "descricao")) {
+            newProduct->description = (char *) in_cur->children->content;
+        }
+        
+        if(!xmlStrcmp(in_cur->name, (const xmlChar *) "preco")) {
+            newProduct->price = (char *) in_cur->children->content;
+        }
+        
+        if(!xmlStrcmp(in_cur->name, (const xmlChar *) "img")) {
+            newProduct->imgFileName = (char *) in_cur->children->content;
+        }
+        
+        if(!xmlStrcmp(in_cur->name, (const xmlChar *) "titulo")) {
+            newProduct->title = (char *) in_cur->children->content;
+        }
+        
+        if(!xmlStrcmp(in_cur->name, (const xmlChar *) "categoria")) {
+            newProduct->category = (char *) in_cur->children->content;
+        }
+        
+        in_cur = in_cur->next;
+    }
+    
+    return newProduct;
+}
+/*
+ * Shard of a position of the 'entries' collection (multiplicative hash, so consecutive ids are spread)
+ */
+int getShardOfPosition(int position) {
+    return (unsigned int) ((unsigned int) position * 2654435761u) % NUM_OF_SHARDS;
+}
+
+/*
+ * Return true if the document of a position must be indexed by this process
+ */
+bool isPositionOfShard(int position) {
+    return SHARD_ID < 0 || getShardOfPosition(position) == SHARD_ID;
+}
+
+/*
+ * Send the df of every term of the shard to the coordinator and replace them by the df in the whole
+ * collection, so the IDF, the magnitudes and the cossenes are the same of a single index. The length of
+ * the documents is exchanged too, for the BM25 average length. Returns the number of documents of the
+ * whole collection
+ */
+int exchangeDocumentFrequencies(int numOfDocuments) {
+    ShardMessage *message = createShardMessage(SHARD_DOCUMENT_FREQUENCIES);
+    
+    int numOfTerms = 0;
+    int maxOfTerms = 1024;
+    
+    Term **terms = trackedMalloc(MEMORY_INGEST, maxOfTerms * sizeof(Term *));
+    
+    int i;
+    
+    for (i = 0; i < NUM_OF_TERMS; i++) {
+        Term *term = currentIndex->vocabulary[i];
+        
+        for (; term != NULL; term = term->next) {
+            if (numOfTerms == maxOfTerms) {
+                maxOfTerms *= 2;
+                
+                terms = trackedRealloc(MEMORY_INGEST, terms, maxOfTerms * sizeof(Term *));
+            }
+            
+            terms[numOfTerms++] = term;
+        }
+    }
+    
+    appendShardMessageInt(message, numOfDocuments);
+    appendShardMessageLong(message, currentIndex->scoring.totalDocumentLength);
+    appendShardMessageInt(message, numOfTerms);
+    
+    for (i = 0; i < numOfTerms; i++) {
+        appendShardMessageString(message, terms[i]->name);
+        appendShardMessageInt(message, terms[i]->totalNumOfDocuments);
+    }
+    
+    sendShardMessage(coordinatorSocket, message);
+    
+    freeShardMessage(message);
+    
+    /* The coordinator answers with the df of the same terms, in the same order */
+    message = receiveShardMessage(coordinatorSocket);
+    
+    if (message == NULL) {
+        fprintf(stderr, "Shard %d: the coordinator is gone\n", SHARD_ID);
+        
+        exit(EXIT_FAILURE);
+    }
+    
+    int collectionNumOfDocuments = readShardMessageInt(message);
+    
+    currentIndex->scoring.totalDocumentLength = readShardMessageLong(message);
+    
+    for (i = 0; i < numOfTerms; i++) {
+        terms[i]->collectionNumOfDocuments = readShardMessageInt(message);
+    }
+    
+    freeShardMessage(message);
+    trackedFree(MEMORY_INGEST, terms);
+    
+    return collectionNumOfDocuments;
+}
+
+/*
+ * Prune the terms found in more than MAX_DOCUMENT_FREQUENCY of the documents (--max-df): their postings are
+ * released and they are moved to the pruned list, so the analysis chain drops them from the queries
+ */
+void pruneFrequentTerms(int numOfDocuments) {
+    if (MAX_DOCUMENT_FREQUENCY <= 0) {
+        return;
+    }
+    
+    int i;
+    
+    for (i = 0; i < NUM_OF_TERMS; i++) {
+        Term **link = &currentIndex->vocabulary[i];
+        
+        while (*link != NULL) {
+            Term *term = *link;
+            
+            /* A shard prunes by the df in the whole collection, so all the shards prune the same terms */
+            int df = term->collectionNumOfDocuments > 0 ? term->collectionNumOfDocuments : term->totalNumOfDocuments;
+            
+            if (df <= MAX_DOCUMENT_FREQUENCY * numOfDocuments) {
+                link = &term->next;
+                
+                continue;
+            }
+            
+            *link = term->next;
+            
+            Document *document = term->document;
+            
+            while (document != NULL) {
+                Document *nextDocument = document->next;
+                
+                trackedFree(MEMORY_POSTINGS, document->positions);
+                trackedFree(MEMORY_POSTINGS, document);
+                
+                document = nextDocument;
+            }
+            
+            term->document = NULL;
+            term->next = currentIndex->prunedTerms;
+            
+            currentIndex->prunedTerms = term;
+            currentIndex->numOfPrunedTerms++;
+        }
+    }
+}
+
+/*
+ * Freeze the vocabulary of the current index: build the minimal perfect hash dictionary of its terms, so
+ * every lookup from now on is a single probe instead of a walk in the collision chain of its hash position,
+ * and the trie of the prefix completions
+ */
+void freezeVocabulary() {
+    int numOfTerms = 0;
+    int i;
+    
+    for (i = 0; i < NUM_OF_TERMS; i++) {
+        Term *term = currentIndex->vocabulary[i];
+        
+        for (; term != NULL; term = term->next) {
+            numOfTerms++;
+        }
+    }
+    
+    Term **terms = trackedMalloc(MEMORY_INGEST, (numOfTerms + 1) * sizeof(Term *));
+    const char **names = trackedMalloc(MEMORY_INGEST, (numOfTerms + 1) * sizeof(char *));
+    uint32_t *slots = trackedMalloc(MEMORY_INGEST, (numOfTerms + 1) * sizeof(uint32_t));
+    uint32_t *weights = trackedMalloc(MEMORY_INGEST, (numOfTerms + 1) * sizeof(uint32_t));
+    
+    numOfTerms = 0;
+    
+    for (i = 0; i < NUM_OF_TERMS; i++) {
+        Term *term = currentIndex->vocabulary[i];
+        
+        for (; term != NULL; term = term->next) {
+            terms[numOfTerms] = term;
+            names[numOfTerms] = term->name;
+            
+            /* A shard suggests the terms by their df in the whole collection, like the coordinator */
+            weights[numOfTerms] = term->collectionNumOfDocuments > 0 ? term->collectionNumOfDocuments : term->totalNumOfDocuments;
+            
+            numOfTerms++;
+        }
+    }
+    
+    TermDictionary *dictionary = createTermDictionary(names, numOfTerms, slots);
+    
+    /* Without a dictionary the lookups keep walking the chains, which is slower but still correct */
+    if (dictionary != NULL) {
+        currentIndex->dictionaryTerms = trackedMalloc(MEMORY_DICTIONARY, (numOfTerms + 1) * sizeof(Term *));
+        
+        for (i = 0; i < numOfTerms; i++) {
+            currentIndex->dictionaryTerms[slots[i]] = terms[i];
+        }
+        
+        currentIndex->dictionary = dictionary;
+    }
+    
+    currentIndex->suggestions = createTermSuggestions(names, weights, numOfTerms);
+    
+    trackedFree(MEMORY_INGEST, weights);
+    trackedFree(MEMORY_INGEST, slots);
+    trackedFree(MEMORY_INGEST, names);
+    trackedFree(MEMORY_INGEST, terms);
+}
+
+/*
+ * Build the quantized vectors of the image index (--quantize-images) from its postings. The dimension of a term
+ * is its dictionary slot and its value in a document is idf * tf weight * inverse norm of the document, so the
+ * inner product with a query weighted by parseVectorQuery() is the cossene of the exhaustive search
+ */
+void buildImageVectorStore() {
+    if (IMAGE_QUANTIZATION == QUANTIZATION_NONE || currentIndex->dictionary == NULL) {
+        return;
+    }
+    
+    int numOfTerms = currentIndex->dictionary->numOfKeys;
+    
+    /* Number of values of each position, then offset of its next value */
+    uint32_t *rowOffsets = trackedCalloc(MEMORY_INGEST, NUM_OF_DOCUMENTS, sizeof(uint32_t));
+    int *positions = trackedMalloc(MEMORY_INGEST, NUM_OF_DOCUMENTS * sizeof(int));
+    
+    long numOfValues = 0;
+    
+    PostingCursor cursor;
+    
+    int slot, position;
+    
+    for (slot = 0; slot < numOfTerms; slot++) {
+        Term *term = currentIndex->dictionaryTerms[slot];
+        
+        if (term->postings == NULL) {
+            continue;
+        }
+        
+        for (openPostingCursor(&cursor, term->postings); cursor.docId >= 0; nextPosting(&cursor)) {
+            rowOffsets[cursor.docId]++;
+            
+            numOfValues++;
+        }
+    }
+    
+    int numOfVectors = 0;
+    
+    for (position = 0; position < NUM_OF_DOCUMENTS; position++) {
+        if (rowOffsets[position] > 0) {
+            positions[numOfVectors++] = position;
+        }
+    }
+    
+    SparseVectors *vectors = createSparseVectors(numOfVectors, numOfTerms, numOfValues);
+    
+    int row;
+    
+    for (row = 0; row < numOfVectors; row++) {
+        vectors->rowStarts[row + 1] = vectors->rowStarts[row] + rowOffsets[positions[row]];
+        
+        rowOffsets[positions[row]] = vectors->rowStarts[row];
+    }
+    
+    /* The slots are visited in order, so the dimensions of each vector are sorted */
+    for (slot = 0; slot < numOfTerms; slot++) {
+        Term *term = currentIndex->dictionaryTerms[slot];
+        
+        if (term->postings == NULL) {
+            continue;
+        }
+        
+        for (openPostingCursor(&cursor, term->postings); cursor.docId >= 0; nextPosting(&cursor)) {
+            uint32_t offset = rowOffsets[cursor.docId]++;
+            
+            vectors->indices[offset] = slot;
+            vectors->values[offset] = getPostingWeight(SCORING_COSINE, &currentIndex->scoring, term->idf, getPostingCursorTF(&cursor), cursor.docId)
+                * currentIndex->inverseNorms[cursor.docId];
+        }
+    }
+    
+    currentIndex->vectors = createVectorStore(IMAGE_QUANTIZATION, vectors, positions, PQ_SUBSPACES, RERANK_CANDIDATES > 0);
+    
+    if (currentIndex->vectors == NULL) {
+        fprintf(stderr, "The image vectors could not be quantized (%d histogram bins), their postings are scored instead\n", numOfTerms);
+    }
+    
+    trackedFree(MEMORY_INGEST, positions);
+    trackedFree(MEMORY_INGEST, rowOffsets);
+}
+
+/*
+ * Generate the inverted index processing a XML file
+ */
+int processXMLData(const char datasetFileName[]) {
+    xmlDocPtr doc;
+    xmlNodePtr cur;
+    
+    clock_t begin, end;
+
+    doc = xmlParseFile(datasetFileName);
+    
+    if(doc == NULL) {
+        fprintf(stderr, "Document not parsed sucessfully! \n");
+        
+        return EXIT_FAILURE;
+    }
+    
+    cur = xmlDocGetRootElement(doc);
+    
+    if(cur == NULL) {
+        fprintf(stderr, "Empty XML document! \n");
+        
+        xmlFreeDoc(doc);
+        
+        return EXIT_FAILURE;
+    }
+    
+    if (xmlStrcmp(cur->name, (const xmlChar *) "produtos")) {
+        fprintf(stderr,"Document with wrong type! (root node != produtos) \n");
+        
+        xmlFreeDoc(doc);
+        
+        return EXIT_FAILURE;
+    }
+    
+    printf("Indexing the documents... ");
+    
+    begin = clock();
+
+    fflush(stdout); /* Ensure that the printf above will be printed in the terminal before the indexing process */
+    
+    cur = cur->xmlChildrenNode;
+    
+    Product *currentProduct = NULL;
+    
+    int numOfDocuments = 0;
+    
+    int numOfSkippedDocuments = 0;
+    
+    int numOfIndexedDocuments = 0;
+    
+    NearDuplicateIndex *nearDuplicates = NEAR_DUPLICATE_SIMILARITY > 0 ? createNearDuplicateIndex(NEAR_DUPLICATE_SIMILARITY) : NULL;
+    
+    while (cur != NULL && numOfDocuments < NUM_OF_DOCUMENTS) {
+        
+        if (!xmlStrcmp(cur->name, (const xmlChar *) "produto")) {
+            
+            currentProduct = createPopulatedStructProduct(cur->xmlChildrenNode);
+            
+            if (generateHashById(currentProduct->id) >= NUM_OF_DOCUMENTS) {
+                /* Ids of a larger dataset (e.g. a synthetic one) than the positions of this build */
+                numOfSkippedDocuments++;
+            } else if (isPositionOfShard(generateHashById(currentProduct->id))) {
+                if (nearDuplicates == NULL) {
+                    indexEntry(currentProduct);
+                    
+                    numOfIndexedDocuments++;
+                } else if (indexEntryOrNearDuplicate(currentProduct, nearDuplicates)) {
+                    numOfIndexedDocuments++;
+                }
+                
+                numOfDocuments++;
+            }
+            
+            trackedFree(MEMORY_INGEST, currentProduct);
+        }
+        
+        cur = cur->next;
+    }
+    
+    /* The entries keep copies of the fields, so the parsed dataset is no longer needed */
+    xmlFreeDoc(doc);
+    
+    freeNearDuplicateIndex(nearDuplicates);
+    
+    if (numOfSkippedDocuments > 0) {
+        fprintf(stderr, "%d documents have ids above NUM_OF_DOCUMENTS (%d) and were skipped\n", numOfSkippedDocuments, NUM_OF_DOCUMENTS);
+    }
+    
+    /* The near-duplicates have no postings, so the df of the terms is counted on the indexed documents */
+    int collectionNumOfDocuments = numOfIndexedDocuments;
+    
+    currentIndex->scoring.totalDocumentLength = currentIndex->numOfTokens - currentIndex->numOfDroppedTokens;
+    
+    if (coordinatorSocket >= 0) {
+        collectionNumOfDocuments = exchangeDocumentFrequencies(numOfIndexedDocuments);
+    }
+    
+    pruneFrequentTerms(collectionNumOfDocuments);
+    
+    currentIndex->scoring.numOfDocuments = collectionNumOfDocuments;
+    
+    double *magnitudes = trackedCalloc(MEMORY_INGEST, NUM_OF_DOCUMENTS, sizeof(double));
+    
+    generateDocMagnitudeAndVocabularyTermsIDF(magnitudes);
+    
+    generateDocumentNorms(magnitudes);
+    
+    trackedFree(MEMORY_INGEST, magnitudes);
+    
+    generateImpactOrderedPostings();
+    
+    generateDocOrderedPostings();
+    
+    generatePriceColumn();
+    
+    freezeVocabulary();
+    
+    end = clock();
+
+    double searchTimeSpent = (double)(end - begin) / CLOCKS_PER_SEC;
+
+    printf(ANSI_BOLD_WHITE "[" ANSI_COLOR_GREEN " DONE " ANSI_COLOR_RESET 
+        ANSI_BOLD_WHITE "]" ANSI_COLOR_RESET " - " ANSI_COLOR_YELLOW "%d" ANSI_COLOR_RESET 
+        " documents (text) were indexed in %lf seconds!\n" ANSI_COLOR_RESET, numOfDocuments, searchTimeSpent);
+    
+    if (numOfIndexedDocuments < numOfDocuments) {
+        printf(ANSI_COLOR_YELLOW "%d" ANSI_COLOR_RESET " near-duplicates were collapsed into the groups of the indexed documents\n",
+               numOfDocuments - numOfIndexedDocuments);
+    }
+    
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Histogram of an image as a description of terms, allocated for a subsystem (the indexing or a query)
+ */
+char *getImageWord(const char imagePath[], MemorySubsystem subsystem) {
+    const int WORD_SIZE = 863 * 1296;
+
+    char *resultWord = trackedMalloc(subsystem, WORD_SIZE * sizeof(char));
+
+    FILE *in;
+
+    char *pythonCmd = "python ../../img-histogram-gen/src/img-histogram-gen.py ";
+
+    char *command = trackedMalloc(subsystem, strlen(pythonCmd) + strlen(imagePath) + 1);
+
+    strcpy(command, pythonCmd);
+
+    strcat(command, imagePath); // image filename
+
+    if (!(in = popen(command, "r"))) {
+        exit(1);
+    }
+
+    trackedFree(subsystem, command);
+
+    resultWord[0] = '\0';
+
+    fgets(resultWord, WORD_SIZE, in);
+
+    pclose(in);
+
+    return resultWord;
+}
+
+/*
+ * Compare two positions of the 'entries' collection by the document name (image file name) of their entries
+ */
+int compareEntriesByDocumentName(const void *a, const void *b) {
+    Entry **entries = currentIndex->documents->entries;
+    
+    return strcmp(entries[*(const int *) a]->documentName, entries[*(const int *) b]->documentName);
+}
+
+/*
+ * Positions of the entries of the document table sorted by document name, so the images of an index built on
+ * the documents of the text index find their products. The caller releases them (MEMORY_INGEST)
+ */
+int *sortEntriesByDocumentName() {
+    int *positions = trackedMalloc(MEMORY_INGEST, currentIndex->documents->numOfEntries * sizeof(int));
+    
+    int numOfPositions = 0;
+    
+    int i;
+    
+    for (i = 0; i < NUM_OF_DOCUMENTS; i++) {
+        if (currentIndex->documents->entries[i] != NULL) {
+            positions[numOfPositions++] = i;
+        }
+    }
+    
+    qsort(positions, numOfPositions, sizeof(int), compareEntriesByDocumentName);
+    
+    return positions;
+}
+
+/*
+ * Find the position of the entry of an image file name in the positions sorted by document name. Returns -1
+ * if no product has this image
+ */
+int findEntryByDocumentName(const int positions[], const char name[]) {
+    int low = 0;
+    int high = currentIndex->documents->numOfEntries - 1;
+    
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        
+        int comparison = strcmp(currentIndex->documents->entries[positions[middle]]->documentName, name);
+        
+        if (comparison == 0) {
+            return positions[middle];
+        } else if (comparison < 0) {
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    
+    return -1;
+}
+
+/*
+ * Process all the images in a specific folder. When the document table already has the products (the text
+ * index was built first), each image is indexed as the document of the product with its file name, and the
+ * images of no product are skipped; otherwise each image is a new document
+ */
+int processImageDataOnFolder(const char imgDatasetFolder[]) {
+    DIR *d;
+    
+    clock_t begin, end;
+
+    struct dirent *dir;
+
+    extern FILE *popen();
+
+    d = opendir(imgDatasetFolder);
+
+    printf("Indexing the images from folder %s... ", imgDatasetFolder);
+    
+    fflush(stdout); /* Ensure that the printf above will be printed in the terminal before the indexing process */
+
+    int count = 0;
+
+    int numOfDocuments = 0;
+
+    int numOfSkippedImages = 0;
+
+    int *positionsByName = currentIndex->documents->numOfEntries > 0 ? sortEntriesByDocumentName() : NULL;
+
+    begin = clock();
+
+    if (d) {
+        while ((dir = readdir(d)) != NULL && count < NUM_OF_DOCUMENTS) {
+            if (dir->d_type == DT_REG && positionsByName != NULL) {
+                int position = findEntryByDocumentName(positionsByName, dir->d_name);
+
+                if (position < 0) {
+                    numOfSkippedImages++;
+
+                    continue;
+                }
+
+                /* A near-duplicate is found through the indexed product of its group */
+                if (currentIndex->documents->entries[position]->duplicateOf >= 0) {
+                    continue;
+                }
+
+                char *imagePath = trackedMalloc(MEMORY_INGEST, strlen(imgDatasetFolder) + strlen(dir->d_name) + 1);
+
+                strcpy(imagePath, imgDatasetFolder);
+
+                strcat(imagePath, dir->d_name);
+
+                char *word = getImageWord(imagePath, MEMORY_INGEST);
+
+                indexDescription(currentIndex->documents->entries[position], word);
+
+                trackedFree(MEMORY_INGEST, word);
+                trackedFree(MEMORY_INGEST, imagePath);
+
+                numOfDocuments++;
+            } else if (dir->d_type == DT_REG) {
+                
+                /* The id of an image is its order in the folder, so the position is known before its histogram */
+                if (!isPositionOfShard(count++)) {
+                    continue;
+                }
+
+                char *imagePath = trackedMalloc(MEMORY_INGEST, strlen(imgDatasetFolder) + strlen(dir->d_name) + 1);
+
+                strcpy(imagePath, imgDatasetFolder);
+
+                strcat(imagePath, dir->d_name); // image filename
+                
+                char* word = getImageWord(imagePath, MEMORY_INGEST);
+
+                Product *newProduct = (Product *) trackedMalloc(MEMORY_INGEST, sizeof(Product));
+                
+                char documentId[16];
+        
+                snprintf(documentId, sizeof(documentId), "%d", count);
+                
+                newProduct->id = documentId;
+                newProduct->imgFileName = (char *) dir->d_name;
+                newProduct->description = (char *) word;
+                newProduct->title = NULL;
+                newProduct->category = NULL;
+                newProduct->price = NULL;
+            
+                indexEntry(newProduct);
+
+                trackedFree(MEMORY_INGEST, newProduct);
+                trackedFree(MEMORY_INGEST, word);
+                trackedFree(MEMORY_INGEST, imagePath);
+
+                numOfDocuments++;
+            }
+        }
+
+        closedir(d);
+    }
+    
+    trackedFree(MEMORY_INGEST, positionsByName);
+    
+    if (numOfSkippedImages > 0) {
+        fprintf(stderr, "%d images are not the image of any product and were skipped\n", numOfSkippedImages);
+    }
+    
+    int collectionNumOfDocuments = numOfDocuments;
+
+    currentIndex->scoring.totalDocumentLength = currentIndex->numOfTokens - currentIndex->numOfDroppedTokens;
+
+    if (coordinatorSocket >= 0) {
+        collectionNumOfDocuments = exchangeDocumentFrequencies(numOfDocuments);
+    }
+
+    pruneFrequentTerms(collectionNumOfDocuments);
+
+    currentIndex->scoring.numOfDocuments = collectionNumOfDocuments;
+
+    double *magnitudes = trackedCalloc(MEMORY_INGEST, NUM_OF_DOCUMENTS, sizeof(double));
+
+    generateDocMagnitudeAndVocabularyTermsIDF(magnitudes);
+
+    generateDocumentNorms(magnitudes);
+
+    trackedFree(MEMORY_INGEST, magnitudes);
+
+    generateImpactOrderedPostings();
+
+    generateDocOrderedPostings();
+
+    freezeVocabulary();
+
+    buildImageVectorStore();
+
+    end = clock();
+    
+    double searchTimeSpent = (double)(end - begin) / CLOCKS_PER_SEC;
+    
+    printf(ANSI_BOLD_WHITE "[" ANSI_COLOR_GREEN " DONE " ANSI_COLOR_RESET 
+        ANSI_BOLD_WHITE "]" ANSI_COLOR_RESET " - " 
+        ANSI_COLOR_YELLOW "%d" ANSI_COLOR_RESET 
+        " documents (images) were indexed in %lf seconds!\n" ANSI_COLOR_RESET, numOfDocuments, searchTimeSpent);
+
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Build a new index snapshot of a kind from its dataset, on a document table shared with the indexes built
+ * before it, or on a new one if NULL. Returns NULL if the dataset could not be indexed
+ */
+IndexSnapshot *buildIndexSnapshot(IndexKind kind, DocumentTable *documents) {
+    currentIndex = createIndexSnapshot(kind, documents);
+    
+    int result = EXIT_FAILURE;
+    
+    if (kind == INDEX_TEXT) {
+        result = processXMLData(DATASET_PATH != NULL ? DATASET_PATH : "../dataset/textDescDafitiPosthaus.xml");
+    } else if (IMAGE_DATASET_PATH != NULL) {
+        result = processImageDataOnFolder(IMAGE_DATASET_PATH);
+    } else if (DATASET_PATH != NULL && documents == NULL) {
+        /* Without the text index, --dataset is the folder of the images */
+        result = processImageDataOnFolder(DATASET_PATH);
+    } else {
+        result = processImageDataOnFolder("../dataset/images/colecaoDafitiPosthaus/");
+    }
+    
+    IndexSnapshot *snapshot = currentIndex;
+    
+    currentIndex = NULL;
+    
+    if (result == EXIT_FAILURE) {
+        freeIndexSnapshot(snapshot);
+        
+        return NULL;
+    }
+    
+    return snapshot;
+}
+
+/*
+ * Build new snapshots of the indexes of an option (1 - text, 2 - image, 3 - text and image) from their
+ * datasets. The image index of the option 3 is built on the documents of the text index. The kinds not
+ * built are NULL. Returns false, with no snapshot, if a dataset could not be indexed
+ */
+bool buildIndexSnapshots(const char option[], IndexSnapshot *snapshots[NUM_OF_INDEX_KINDS]) {
+    snapshots[INDEX_TEXT] = NULL;
+    snapshots[INDEX_IMAGE] = NULL;
+    
+    if (strcmp(option, "2") == 0) {
+        snapshots[INDEX_IMAGE] = buildIndexSnapshot(INDEX_IMAGE, NULL);
+        
+        return snapshots[INDEX_IMAGE] != NULL;
+    }
+    
+    snapshots[INDEX_TEXT] = buildIndexSnapshot(INDEX_TEXT, NULL);
+    
+    if (snapshots[INDEX_TEXT] == NULL || strcmp(option, "3") != 0) {
+        return snapshots[INDEX_TEXT] != NULL;
+    }
+    
+    snapshots[INDEX_IMAGE] = buildIndexSnapshot(INDEX_IMAGE, snapshots[INDEX_TEXT]->documents);
+    
+    if (snapshots[INDEX_IMAGE] == NULL) {
+        freeIndexSnapshot(snapshots[INDEX_TEXT]);
+        
+        snapshots[INDEX_TEXT] = NULL;
+        
+        return false;
+    }
+    
+    return true;
+}
+
+/*
+ * Thread of a background reload (!r): build new snapshots of the datasets and publish them. The searches keep
+ * running on the previous snapshots meanwhile
+ */
+void *reloadIndex(void *argument) {
+    const char *option = argument;
+    
+    IndexSnapshot *snapshots[NUM_OF_INDEX_KINDS];
+    
+    if (!buildIndexSnapshots(option, snapshots)) {
+        fprintf(stderr, "\nThe index could not be reloaded, the previous one is still answering the queries\n");
+    } else {
+        publishIndexSnapshots(snapshots);
+        
+        printf("\nIndex version " ANSI_COLOR_YELLOW "%ld" ANSI_COLOR_RESET " is now answering the queries\n",
+               (snapshots[INDEX_TEXT] != NULL ? snapshots[INDEX_TEXT] : snapshots[INDEX_IMAGE])->version);
+    }
+    
+    atomic_store(&isReloadingIndex, false);
+    
+    return NULL;
+}
+
+/*
+ * Start a background reload of the index, unless one is already running
+ */
+void startIndexReload(const char option[]) {
+    if (atomic_exchange(&isReloadingIndex, true)) {
+        printf("\nThe index is already being reloaded");
+        
+        return;
+    }
+    
+    pthread_t thread;
+    
+    if (pthread_create(&thread, NULL, reloadIndex, (void *) option) != 0) {
+        atomic_store(&isReloadingIndex, false);
+        
+        perror("pthread_create");
+        
+        return;
+    }
+    
+    pthread_detach(thread);
+    
+    printf("\nReloading the index in background, the queries are answered by the version %ld meanwhile", currentIndex->version);
+}
+
+/*
+ * Search a query by the same rules of the interactive search: the boolean search for text queries with
+ * operators, the quantized vectors for image queries when the image index has them, the impact-ordered
+ * search when there is a budget and the exhaustive search otherwise.
+ * The filters of a text query are parsed here
+ */
+Entry **searchQuery(char query[], bool isText, bool verbose, Entry **paginatedResult, SearchBudget *budget) {
+    DocBitmap *filter = NULL;
+    
+    if (isText) {
+        filter = parseSearchFilter(query);
+        
+        if (filter != NULL && verbose) {
+            printf("\nFilter matches " ANSI_COLOR_YELLOW "%ld" ANSI_COLOR_RESET " documents", getDocBitmapCardinality(filter));
+        }
+    }
+    
+    Entry **result = NULL;
+    
+    if (isText && isBooleanQuery(query)) {
+        result = searchByBooleanQuery(query, verbose, paginatedResult, filter);
+    } else if (!isText && currentIndex->vectors != NULL) {
+        /* The codes of all the images cost less than any budget of postings */
+        result = searchByVectorStore(query, verbose, paginatedResult);
+    } else if (budget != NULL) {
+        result = searchByImpactOrder(query, verbose, paginatedResult, budget, filter);
+    } else {
+        result = searchByVectorModel(query, verbose, paginatedResult, filter);
+    }
+    
+    freeDocBitmap(filter);
+    
+    return result;
+}
+
+/*
+ * Retrieval of a hybrid query on one index: score the query by the vector model and keep its HYBRID_CANDIDATES
+ * best documents. It runs on the thread of the command or on a thread of its own, which scores in the
+ * hybridAccumulators
+ */
+void *retrieveHybridCandidates(void *argument) {
+    HybridRetrieval *retrieval = argument;
+    
+    double begin = getWallClockSeconds();
+    
+    retrieval->numOfCandidates = 0;
+    retrieval->countSearchResult = 0;
+    retrieval->seconds = 0;
+    
+    if (retrieval->query[0] == '\0') {
+        return NULL;
+    }
+    
+    currentIndex = retrieval->index;
+    
+    bool isOwnThread = accumulators == NULL;
+    
+    if (isOwnThread) {
+        accumulators = hybridAccumulators;
+    }
+    
+    normalizeTerm(retrieval->query);
+    
+    analyzeQuery(retrieval->query);
+    
+    VectorQuery query = parseVectorQuery(retrieval->query, retrieval->filter);
+    
+    bool isParallel = acquireSearchWorkers(query.cost);
+    
+    int i;
+    
+    if (isParallel) {
+        runWorkerPool(workerPool, scoreQueryPartition, &query);
+        
+        for (i = 0; i < workerPool->numOfWorkers; i++) {
+            retrieval->countSearchResult += queryPartitions[i].accumulators->numOfTouched;
+        }
+    } else {
+        resetAccumulators(accumulators);
+        
+        scoreVectorQueryRange(&query, 0, NUM_OF_DOCUMENTS, accumulators);
+        
+        retrieval->countSearchResult = accumulators->numOfTouched;
+    }
+    
+    retrieval->numOfCandidates = selectRankedResults(isParallel, HYBRID_CANDIDATES, retrieval->positions, retrieval->scores);
+    
+    if (isParallel) {
+        releaseSearchWorkers();
+    }
+    
+    trackedFree(MEMORY_QUERY, query.terms);
+    
+    if (isOwnThread) {
+        accumulators = NULL;
+    }
+    
+    retrieval->seconds = getWallClockSeconds() - begin;
+    
+    return NULL;
+}
+
+/*
+ * Compare two hybrid candidates by position
+ */
+int compareHybridCandidatesByPosition(const void *a, const void *b) {
+    return ((const HybridCandidate *) a)->position - ((const HybridCandidate *) b)->position;
+}
+
+/*
+ * Compare two hybrid candidates by decreasing score, and by position between equal scores
+ */
+int compareHybridCandidatesDesc(const void *a, const void *b) {
+    const HybridCandidate *x = a;
+    const HybridCandidate *y = b;
+    
+    if (x->score != y->score) {
+        return (x->score < y->score) - (x->score > y->score);
+    }
+    
+    return x->position - y->position;
+}
+
+/*
+ * Merge the candidates of the text and the image retrievals of a hybrid query by a weighted sum of their
+ * cossenes, each one divided by the best cossene of its index so both are in [0, 1]. A candidate of only one
+ * index has 0 for the other one. The candidates are sorted by decreasing score. Returns their number
+ */
+int fuseHybridCandidates(const HybridRetrieval *text, const HybridRetrieval *image, HybridCandidate candidates[]) {
+    float bestTextScore = text->numOfCandidates > 0 ? text->scores[0] : 1;
+    float bestImageScore = image->numOfCandidates > 0 ? image->scores[0] : 1;
+    
+    int numOfCandidates = 0;
+    
+    int i;
+    
+    for (i = 0; i < text->numOfCandidates; i++) {
+        candidates[numOfCandidates].position = text->positions[i];
+        candidates[numOfCandidates].textScore = text->scores[i] / bestTextScore;
+        candidates[numOfCandidates].imageScore = 0;
+        
+        numOfCandidates++;
+    }
+    
+    /* The text candidates are sorted by position, so each image candidate finds its text cossene by a binary search */
+    qsort(candidates, numOfCandidates, sizeof(HybridCandidate), compareHybridCandidatesByPosition);
+    
+    int numOfTextCandidates = numOfCandidates;
+    
+    for (i = 0; i < image->numOfCandidates; i++) {
+        HybridCandidate key = { image->positions[i], 0, 0, 0 };
+        
+        HybridCandidate *candidate = bsearch(&key, candidates, numOfTextCandidates, sizeof(HybridCandidate),
+                                             compareHybridCandidatesByPosition);
+        
+        if (candidate == NULL) {
+            candidate = &candidates[numOfCandidates++];
+            
+            candidate->position = image->positions[i];
+            candidate->textScore = 0;
+        }
+        
+        candidate->imageScore = image->scores[i] / bestImageScore;
+    }
+    
+    for (i = 0; i < numOfCandidates; i++) {
+        candidates[i].score = HYBRID_TEXT_WEIGHT * candidates[i].textScore + (1 - HYBRID_TEXT_WEIGHT) * candidates[i].imageScore;
+    }
+    
+    qsort(candidates, numOfCandidates, sizeof(HybridCandidate), compareHybridCandidatesDesc);
+    
+    return numOfCandidates;
+}
+
+/*
+ * Print the first page of results of a hybrid query, with the normalized cossene of each index
+ */
+void printHybridResults(const char query[], const HybridCandidate candidates[], int countResult,
+                        const HybridRetrieval *text, const HybridRetrieval *image, double searchTimeSpent) {
+    printf(ANSI_COLOR_CYAN "\n----------------------------------------------------------------------------------------------------------------------");
+    
+    printf(ANSI_COLOR_RESET "\n  List of documents for hybrid query " ANSI_BOLD_WHITE "%.20s..." ANSI_COLOR_RESET " (text weight %.2lf)",
+           query, HYBRID_TEXT_WEIGHT);
+    
+    printf(ANSI_COLOR_CYAN "\n----------------------------------------------------------------------------------------------------------------------\n");
+    
+    printf(ANSI_COLOR_RESET "\t\t\t\t\t\t\t\t\t\tAbout " ANSI_COLOR_YELLOW "%d" ANSI_COLOR_RESET " text and " ANSI_COLOR_YELLOW "%d"
+           ANSI_COLOR_RESET " image results (%lf seconds)\n", text->countSearchResult, image->countSearchResult, searchTimeSpent);
+    
+    printf("\t\t\t\t\t\t\t\t\t\tText: %lf seconds, image: %lf seconds (at the same time)\n", text->seconds, image->seconds);
+    
+    printf(ANSI_BOLD_WHITE "\n    ID\t\tScore\t\tText\t\tImage\t\tName\n" ANSI_COLOR_RESET);
+    
+    int x;
+    
+    for (x = 0; x < countResult; x++) {
+        Entry *entry = currentIndex->documents->entries[candidates[x].position];
+        
+        printf("    %-6s\t%-8lf\t%-8lf\t%-8lf\t%-12s", entry->documentId, candidates[x].score, candidates[x].textScore,
+               candidates[x].imageScore, entry->documentName);
+        
+        printNearDuplicates(entry);
+        
+        printf("\n");
+    }
+    
+    printf(ANSI_COLOR_CYAN "\n----------------------------------------------------------------------------------------------------------------------\n" ANSI_COLOR_RESET);
+    
+    printf("\t\t\t\t\t\t\t\t\t\tMaximum result size per search: " ANSI_COLOR_YELLOW "%d\n" ANSI_COLOR_RESET, MAX_SEARCH_RESULT);
+}
+
+/*
+ * Search a hybrid query (!h <image path> <text query>) on the text and the image indexes of the option 3. Both
+ * retrievals run at the same time, the image one on a thread of its own, and their candidates are fused by
+ * fuseHybridCandidates(). The filters of the text query apply to both indexes, as they share their documents
+ */
+void searchHybridQuery(char query[]) {
+    char *textQuery = strchr(query, ' ');
+    
+    if (textQuery == NULL) {
+        printf("\nUsage: !h <image path> <text query>");
+        
+        return;
+    }
+    
+    *textQuery++ = '\0';
+    
+    IndexSnapshot *previousIndex = currentIndex;
+    
+    /* Snapshots of the same version, so the positions of both indexes are the ones of the same documents */
+    IndexSnapshot *snapshots[NUM_OF_INDEX_KINDS];
+    
+    acquireIndexSnapshots(snapshots);
+    
+    currentIndex = snapshots[INDEX_TEXT];
+    
+    char *cpQuery = trackedStrdup(MEMORY_QUERY, textQuery);
+    
+    HybridRetrieval retrievals[NUM_OF_INDEX_KINDS];
+    
+    retrievals[INDEX_TEXT].index = snapshots[INDEX_TEXT];
+    retrievals[INDEX_TEXT].query = textQuery;
+    retrievals[INDEX_TEXT].filter = parseSearchFilter(textQuery);
+    
+    retrievals[INDEX_IMAGE].index = snapshots[INDEX_IMAGE];
+    retrievals[INDEX_IMAGE].query = getImageWord(query, MEMORY_QUERY);
+    retrievals[INDEX_IMAGE].filter = retrievals[INDEX_TEXT].filter;
+    
+    double begin = getWallClockSeconds();
+    
+    pthread_t imageThread;
+    
+    bool isConcurrent = pthread_create(&imageThread, NULL, retrieveHybridCandidates, &retrievals[INDEX_IMAGE]) == 0;
+    
+    retrieveHybridCandidates(&retrievals[INDEX_TEXT]);
+    
+    if (isConcurrent) {
+        pthread_join(imageThread, NULL);
+    } else {
+        retrieveHybridCandidates(&retrievals[INDEX_IMAGE]);
+        
+        currentIndex = snapshots[INDEX_TEXT];
+    }
+    
+    HybridCandidate *candidates = trackedMalloc(MEMORY_QUERY, 2 * HYBRID_CANDIDATES * sizeof(HybridCandidate));
+    
+    int numOfCandidates = fuseHybridCandidates(&retrievals[INDEX_TEXT], &retrievals[INDEX_IMAGE], candidates);
+    
+    double searchTimeSpent = getWallClockSeconds() - begin;
+    
+    if (numOfCandidates == 0) {
+        printf("\nNo results for hybrid query " ANSI_BOLD_WHITE "%.20s...\n" ANSI_COLOR_RESET, cpQuery);
+    } else {
+        printHybridResults(cpQuery, candidates, numOfCandidates < MAX_SEARCH_RESULT ? numOfCandidates : MAX_SEARCH_RESULT,
+                           &retrievals[INDEX_TEXT], &retrievals[INDEX_IMAGE], searchTimeSpent);
+    }
+    
+    freeDocBitmap((DocBitmap *) retrievals[INDEX_TEXT].filter);
+    
+    trackedFree(MEMORY_QUERY, retrievals[INDEX_IMAGE].query);
+    trackedFree(MEMORY_QUERY, candidates);
+    trackedFree(MEMORY_QUERY, cpQuery);
+    
+    releaseIndexSnapshot(snapshots[INDEX_TEXT]);
+    releaseIndexSnapshot(snapshots[INDEX_IMAGE]);
+    
+    currentIndex = previousIndex;
+}
+
+/*
+ * Loop of a shard process: answer the queries of the coordinator with the first page of results of the shard,
+ * until the coordinator closes the socket
+ */
+void serveShardQueries(bool isText) {
+    Entry **paginatedResult = trackedMalloc(MEMORY_QUERY, MAX_SEARCH_RESULT * sizeof(Entry *));
+    
+    char *query = trackedMalloc(MEMORY_QUERY, QUERY_SIZE * sizeof(char));
+    
+    /* The coordinator reports the index as built once every shard is ready */
+    ShardMessage *message = createShardMessage(SHARD_READY);
+    
+    sendShardMessage(coordinatorSocket, message);
+    
+    freeShardMessage(message);
+    
+    while ((message = receiveShardMessage(coordinatorSocket)) != NULL) {
+        if (message->type != SHARD_QUERY) {
+            freeShardMessage(message);
+            
+            continue;
+        }
+        
+        snprintf(query, QUERY_SIZE, "%s", readShardMessageString(message));
+        
+        SearchBudget budget = { 0, 0, 0, false };
+        
+        budget.maxPostings = readShardMessageLong(message);
+        budget.maxSeconds = readShardMessageDouble(message);
+        
+        bool hasBudget = budget.maxPostings > 0 || budget.maxSeconds > 0;
+        
+        freeShardMessage(message);
+        
+        lastSearchPage.countResult = 0;
+        lastSearchPage.countSearchResult = 0;
+        
+        currentIndex = acquireIndexSnapshot(isText ? INDEX_TEXT : INDEX_IMAGE);
+        
+        searchQuery(query, isText, false, paginatedResult, hasBudget ? &budget : NULL);
+        
+        message = createShardMessage(SHARD_RESULTS);
+        
+        appendShardMessageInt(message, lastSearchPage.countSearchResult);
+        appendShardMessageInt(message, budget.truncated);
+        appendShardMessageLong(message, budget.evaluatedPostings);
+        appendShardMessageInt(message, lastSearchPage.countResult);
+        
+        int i;
+        
+        for (i = 0; i < lastSearchPage.countResult; i++) {
+            appendShardMessageString(message, lastSearchPage.entries[i]->documentId);
+            appendShardMessageString(message, lastSearchPage.entries[i]->documentName);
+            appendShardMessageDouble(message, lastSearchPage.scores[i]);
+        }
+        
+        releaseIndexSnapshot(currentIndex);
+        
+        currentIndex = NULL;
+        
+        bool sent = sendShardMessage(coordinatorSocket, message);
+        
+        freeShardMessage(message);
+        
+        if (!sent) {
+            break;
+        }
+    }
+    
+    trackedFree(MEMORY_QUERY, query);
+    trackedFree(MEMORY_QUERY, paginatedResult);
+}
+
+/*
+ * Fork a process per shard, connected to the coordinator by a local socket. Returns true in the shard
+ * processes, which must index their documents and serve the queries, and false in the coordinator
+ */
+bool startShards(int numOfShards) {
+    shardSockets = trackedMalloc(MEMORY_QUERY, numOfShards * sizeof(int));
+    shardProcesses = trackedMalloc(MEMORY_QUERY, numOfShards * sizeof(pid_t));
+    
+    fflush(stdout); /* The buffered output must not be written again by the children */
+    
+    int i;
+    
+    for (i = 0; i < numOfShards; i++) {
+        int sockets[2];
+        
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0) {
+            perror("socketpair");
+            
+            exit(EXIT_FAILURE);
+        }
+        
+        pid_t pid = fork();
+        
+        if (pid < 0) {
+            perror("fork");
+            
+            exit(EXIT_FAILURE);
+        }
+        
+        if (pid == 0) {
+            int j;
+            
+            /* The shard only keeps its own socket, so it sees the end of the coordinator */
+            for (j = 0; j < i; j++) {
+                close(shardSockets[j]);
+            }
+            
+            close(sockets[0]);
+            
+            trackedFree(MEMORY_QUERY, shardSockets);
+            trackedFree(MEMORY_QUERY, shardProcesses);
+            
+            shardSockets = NULL;
+            shardProcesses = NULL;
+            
+            SHARD_ID = i;
+            coordinatorSocket = sockets[1];
+            
+            /* The coordinator owns the terminal */
+            if (freopen("/dev/null", "w", stdout) == NULL) {
+                exit(EXIT_FAILURE);
+            }
+            
+            return true;
+        }
+        
+        close(sockets[1]);
+        
+        shardSockets[i] = sockets[0];
+        shardProcesses[i] = pid;
+    }
+    
+    return false;
+}
+
+/*
+ * Sum the df that each shard found for its terms and send back the df of the whole collection, then wait
+ * until every shard has built its index. The coordinator keeps the terms in its vocabulary, without documents
+ */
+int mergeDocumentFrequencies() {
+    printf("Indexing the documents in %d shards... ", NUM_OF_SHARDS);
+    
+    fflush(stdout);
+    
+    double begin = getWallClockSeconds();
+    
+    ShardMessage *messages[MAX_SHARDS];
+    
+    int numOfDocuments = 0;
+    long totalDocumentLength = 0;
+    
+    int i, j;
+    
+    for (i = 0; i < NUM_OF_SHARDS; i++) {
+        messages[i] = receiveShardMessage(shardSockets[i]);
+        
+        if (messages[i] == NULL || messages[i]->type != SHARD_DOCUMENT_FREQUENCIES) {
+            fprintf(stderr, "Shard %d failed while indexing! \n", i);
+            
+            return EXIT_FAILURE;
+        }
+        
+        numOfDocuments += readShardMessageInt(messages[i]);
+        totalDocumentLength += readShardMessageLong(messages[i]);
+        
+        int numOfTerms = readShardMessageInt(messages[i]);
+        
+        for (j = 0; j < numOfTerms; j++) {
+            const char *name = readShardMessageString(messages[i]);
+            
+            int df = readShardMessageInt(messages[i]);
+            
+            Term *term = findTerm(name);
+            
+            if (term == NULL) {
+                int position = generateHash(name);
+                
+                term = trackedCalloc(MEMORY_DICTIONARY, 1, sizeof(Term));
+                term->name = trackedStrdup(MEMORY_DICTIONARY, name);
+                term->next = currentIndex->vocabulary[position];
+                
+                currentIndex->vocabulary[position] = term;
+            }
+            
+            term->totalNumOfDocuments += df;
+        }
+    }
+    
+    for (i = 0; i < NUM_OF_SHARDS; i++) {
+        ShardMessage *reply = createShardMessage(SHARD_GLOBAL_FREQUENCIES);
+        
+        appendShardMessageInt(reply, numOfDocuments);
+        appendShardMessageLong(reply, totalDocumentLength);
+        
+        /* Read the terms of the shard again, skipping its number and length of documents */
+        messages[i]->offset = 0;
+        
+        readShardMessageInt(messages[i]);
+        readShardMessageLong(messages[i]);
+        
+        int numOfTerms = readShardMessageInt(messages[i]);
+        
+        for (j = 0; j < numOfTerms; j++) {
+            Term *term = findTerm(readShardMessageString(messages[i]));
+            
+            readShardMessageInt(messages[i]);
+            
+            appendShardMessageInt(reply, term->totalNumOfDocuments);
+        }
+        
+        sendShardMessage(shardSockets[i], reply);
+        
+        freeShardMessage(reply);
+        freeShardMessage(messages[i]);
+    }
+    
+    currentIndex->scoring.numOfDocuments = numOfDocuments;
+    currentIndex->scoring.totalDocumentLength = totalDocumentLength;
+    
+    /* The coordinator knows every term with its df, so it answers the lookups and the completions itself */
+    pruneFrequentTerms(numOfDocuments);
+    
+    freezeVocabulary();
+    
+    /* The shards still build their postings and norms, so the first queries would wait for them */
+    for (i = 0; i < NUM_OF_SHARDS; i++) {
+        ShardMessage *ready = receiveShardMessage(shardSockets[i]);
+        
+        if (ready == NULL || ready->type != SHARD_READY) {
+            fprintf(stderr, "Shard %d failed while indexing! \n", i);
+            
+            freeShardMessage(ready);
+            
+            return EXIT_FAILURE;
+        }
+        
+        freeShardMessage(ready);
+    }
+    
+    printf(ANSI_BOLD_WHITE "[" ANSI_COLOR_GREEN " DONE " ANSI_COLOR_RESET
+        ANSI_BOLD_WHITE "]" ANSI_COLOR_RESET " - " ANSI_COLOR_YELLOW "%d" ANSI_COLOR_RESET
+        " documents were indexed in %lf seconds!\n" ANSI_COLOR_RESET, numOfDocuments, getWallClockSeconds() - begin);
+    
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Compare two shard results by decreasing cossene, and by position between equal cossenes as a single index does
+ */
+int compareShardResultsDesc(const void *a, const void *b) {
+    const ShardResult *x = a;
+    const ShardResult *y = b;
+    
+    if (x->score != y->score) {
+        return (x->score < y->score) - (x->score > y->score);
+    }
+    
+    return x->position - y->position;
+}
+
+/*
+ * Send a query to all the shards and merge the first page of results of each one. The budget, when given,
+ * applies to each shard. A shard that fails is dropped and the results of the others are returned
+ */
+Entry **searchShards(char query[], bool verbose, Entry **paginatedResult, SearchBudget *budget) {
+    double begin = getWallClockSeconds();
+    
+    ShardMessage *message = createShardMessage(SHARD_QUERY);
+    
+    appendShardMessageString(message, query);
+    appendShardMessageLong(message, budget != NULL ? budget->maxPostings : 0);
+    appendShardMessageDouble(message, budget != NULL ? budget->maxSeconds : 0);
+    
+    int i, j;
+    
+    /* Scatter: the shards search at the same time */
+    for (i = 0; i < NUM_OF_SHARDS; i++) {
+        if (shardSockets[i] >= 0 && !sendShardMessage(shardSockets[i], message)) {
+            fprintf(stderr, "\nShard %d is unavailable, the results are partial", i);
+            
+            close(shardSockets[i]);
+            
+            shardSockets[i] = -1;
+        }
+    }
+    
+    freeShardMessage(message);
+    
+    if (budget != NULL) {
+        budget->evaluatedPostings = 0;
+        budget->truncated = false;
+    }
+    
+    ShardResult results[MAX_SHARDS * MAX_SEARCH_RESULT];
+    
+    int numOfResults = 0;
+    int countSearchResult = 0;
+    
+    /* Gather: collect the pages of the shards */
+    for (i = 0; i < NUM_OF_SHARDS; i++) {
+        if (shardSockets[i] < 0) {
+            continue;
+        }
+        
+        message = receiveShardMessage(shardSockets[i]);
+        
+        if (message == NULL || message->type != SHARD_RESULTS) {
+            fprintf(stderr, "\nShard %d is unavailable, the results are partial", i);
+            
+            freeShardMessage(message);
+            
+            close(shardSockets[i]);
+            
+            shardSockets[i] = -1;
+            
+            continue;
+        }
+        
+        countSearchResult += readShardMessageInt(message);
+        
+        bool truncated = readShardMessageInt(message);
+        long evaluatedPostings = readShardMessageLong(message);
+        
+        if (budget != NULL) {
+            budget->truncated = budget->truncated || truncated;
+            budget->evaluatedPostings += evaluatedPostings;
+        }
+        
+        int countShardResult = readShardMessageInt(message);
+        
+        for (j = 0; j < countShardResult && j < MAX_SEARCH_RESULT; j++) {
+            ShardResult *result = &results[numOfResults++];
+            
+            result->documentId = trackedStrdup(MEMORY_QUERY, readShardMessageString(message));
+            result->documentName = trackedStrdup(MEMORY_QUERY, readShardMessageString(message));
+            result->score = readShardMessageDouble(message);
+            result->position = generateHashById(result->documentId);
+        }
+        
+        freeShardMessage(message);
+    }
+    
+    if (countSearchResult == 0) {
+        if (verbose) {
+            printf("\nNo results for query " ANSI_BOLD_WHITE "%.20s...\n" ANSI_COLOR_RESET, query);
+        }
+        
+        return NULL;
+    }
+    
+    /* Merge: the best results of the shards by cossene */
+    qsort(results, numOfResults, sizeof(ShardResult), compareShardResultsDesc);
+    
+    Entry *page[MAX_SEARCH_RESULT];
+    double scores[MAX_SEARCH_RESULT];
+    
+    int countResult = numOfResults < MAX_SEARCH_RESULT ? numOfResults : MAX_SEARCH_RESULT;
+    
+    for (i = 0; i < numOfResults; i++) {
+        if (i >= countResult) {
+            trackedFree(MEMORY_QUERY, results[i].documentId);
+            trackedFree(MEMORY_QUERY, results[i].documentName);
+            
+            continue;
+        }
+        
+        trackedFree(MEMORY_QUERY, shardResults[i].documentId);
+        trackedFree(MEMORY_QUERY, shardResults[i].documentName);
+        
+        shardResults[i].documentId = results[i].documentId;
+        shardResults[i].documentName = results[i].documentName;
+        
+        page[i] = &shardResults[i];
+        scores[i] = results[i].score;
+    }
+    
+    double searchTimeSpent = getWallClockSeconds() - begin;
+    
+    keepSearchResultPage(page, scores, countResult, countSearchResult);
+    
+    if (verbose) {
+        printSearchResults(query, page, scores, countResult, countSearchResult, searchTimeSpent, budget);
+    } else {
+        memcpy(paginatedResult, page, countResult * sizeof(Entry *));
+    }
+    
+    return paginatedResult;
+}
+
+/*
+ * Close the sockets of the shards, so they exit, and wait for them
+ */
+void stopShards() {
+    int i;
+    
+    for (i = 0; i < NUM_OF_SHARDS; i++) {
+        if (shardSockets[i] >= 0) {
+            close(shardSockets[i]);
+        }
+    }
+    
+    for (i = 0; i < NUM_OF_SHARDS; i++) {
+        waitpid(shardProcesses[i], NULL, 0);
+    }
+    
+    trackedFree(MEMORY_QUERY, shardSockets);
+    trackedFree(MEMORY_QUERY, shardProcesses);
+    
+    shardSockets = NULL;
+    shardProcesses = NULL;
+    
+    /* The entries of the last merged page */
+    for (i = 0; i < MAX_SEARCH_RESULT; i++) {
+        trackedFree(MEMORY_QUERY, shardResults[i].documentId);
+        trackedFree(MEMORY_QUERY, shardResults[i].documentName);
+        
+        shardResults[i].documentId = NULL;
+        shardResults[i].documentName = NULL;
+    }
+}
+
+/*
+ * Print all the terms of the vocabulary
+ */
+void printVocabulary() {
+    
+    int i;
+    
+    for (i = 0; i < NUM_OF_TERMS; i++) {
+        Term *term = currentIndex->vocabulary[i];
+        
+        for (; term != NULL; term = term->next) {
+            
+            printf("\nTERM: %s", term->name);
+            
+            Document *document = term->document;
+            
+            printf("\nDOCUMENTS: ");
+            
+            for (; document != NULL; document = document->next) {
+                printf("\nDOCUMENT NAME: %s, DOCUMENT TERM: %s", document->name, document->term);
+            }
+        }
+    }
+    
+    printf("\n");
+}
+
+/*
+ * Report the compression ratio and the decode throughput of the doc-ordered postings, checking
+ * that every decoded posting matches the uncompressed postings of the term
+ */
+void reportPostingsCompression() {
+    ImpactPosting *postings = trackedMalloc(MEMORY_QUERY, NUM_OF_DOCUMENTS * sizeof(ImpactPosting));
+    
+    uint32_t docIds[POSTING_BLOCK_SIZE];
+    uint32_t tfs[POSTING_BLOCK_SIZE];
+    
+    long numOfPostings = 0;
+    long compressedSize = 0;
+    long positionalSize = 0;
+    long mismatches = 0;
+    
+    /* The terms are kept in an array, so the throughput is not affected by the empty vocabulary positions */
+    int numOfTerms = 0;
+    int maxOfTerms = 1024;
+    
+    Term **terms = trackedMalloc(MEMORY_QUERY, maxOfTerms * sizeof(Term *));
+    
+    int i;
+    
+    /* Correctness: decode all the blocks of every term and compare them with the documents list */
+    for (i = 0; i < NUM_OF_TERMS; i++) {
+        Term *term = currentIndex->vocabulary[i];
+        
+        for (; term != NULL; term = term->next) {
+            int numOfTermPostings = collectTermPostings(term, postings);
+            
+            qsort(postings, numOfTermPostings, sizeof(ImpactPosting), compareImpactPostingsByPosition);
+            
+            if (term->postings->numOfPostings != numOfTermPostings) {
+                mismatches++;
+                
+                continue;
+            }
+            
+            int block;
+            
+            for (block = 0; block < term->postings->numOfBlocks; block++) {
+                decodePostingBlock(term->postings, block, docIds, tfs);
+                
+                int j;
+                
+                for (j = 0; j < term->postings->blocks[block].numOfPostings; j++) {
+                    ImpactPosting *expected = &postings[block * POSTING_BLOCK_SIZE + j];
+                    
+                    if ((int) docIds[j] != expected->position || (int) tfs[j] != expected->tf) {
+                        mismatches++;
+                    }
+                }
+            }
+            
+            numOfPostings += numOfTermPostings;
+            compressedSize += getCompressedPostingsSize(term->postings);
+            
+            if (term->positions != NULL) {
+                positionalSize += getPositionalPostingsSize(term->positions);
+            }
+            
+            if (numOfTerms == maxOfTerms) {
+                maxOfTerms *= 2;
+                
+                terms = trackedRealloc(MEMORY_QUERY, terms, maxOfTerms * sizeof(Term *));
+            }
+            
+            terms[numOfTerms++] = term;
         }
+    }
+    
+    /* Throughput: decode all the blocks again, without the comparison */
+    double begin = getWallClockSeconds();
+    
+    for (i = 0; i < numOfTerms; i++) {
+        int block;
         
-        if(!xmlStrcmp(in_cur->name, (const xmlChar *) "preco")) {
-            newProduct->price = malloc(10 * sizeof(char));
-            newProduct->price = (char *) in_cur->children->content;
+        for (block = 0; block < terms[i]->postings->numOfBlocks; block++) {
+            decodePostingBlock(terms[i]->postings, block, docIds, tfs);
         }
+    }
+    
+    double decodeTimeSpent = getWallClockSeconds() - begin;
+    
+    /* An uncompressed posting is a 32 bits doc id and a 32 bits tf */
+    long uncompressedSize = numOfPostings * 2 * sizeof(uint32_t);
+    
+    printf("\nPostings: " ANSI_COLOR_YELLOW "%ld" ANSI_COLOR_RESET " (%s, decoded with %s)", numOfPostings,
+           COMPRESS_POSTINGS ? "bit-packed" : "plain", getPostingCodecInstructionSet());
+    printf("\nUncompressed size: " ANSI_COLOR_YELLOW "%ld" ANSI_COLOR_RESET " bytes", uncompressedSize);
+    printf("\nCompressed size (with skip entries): " ANSI_COLOR_YELLOW "%ld" ANSI_COLOR_RESET " bytes", compressedSize);
+    printf("\nCompression ratio: " ANSI_COLOR_YELLOW "%lf" ANSI_COLOR_RESET, (double) uncompressedSize / compressedSize);
+    printf("\nDecode throughput: " ANSI_COLOR_YELLOW "%lf" ANSI_COLOR_RESET " million postings per second",
+           numOfPostings / decodeTimeSpent / 1e6);
+    
+    if (POSITIONAL_INDEX) {
+        printf("\nPositional section size: " ANSI_COLOR_YELLOW "%ld" ANSI_COLOR_RESET " bytes", positionalSize);
+    }
+    
+    if (mismatches == 0) {
+        printf("\nDecoded postings match the uncompressed index: " ANSI_COLOR_GREEN "OK" ANSI_COLOR_RESET "\n");
+    } else {
+        printf("\nDecoded postings match the uncompressed index: " ANSI_COLOR_RED "%ld mismatches" ANSI_COLOR_RESET "\n", mismatches);
+    }
+    
+    trackedFree(MEMORY_QUERY, terms);
+    trackedFree(MEMORY_QUERY, postings);
+}
+
+/*
+ * Report the size of the term dictionary and its lookup time against the vocabulary chains, checking that
+ * every term is found in its slot, that unknown terms are rejected and that the dictionary survives a
+ * write and read back
+ */
+void reportTermDictionary() {
+    const TermDictionary *dictionary = currentIndex->dictionary;
+    
+    if (dictionary == NULL) {
+        printf("\nTerm dictionary: " ANSI_COLOR_RED "not built" ANSI_COLOR_RESET "\n");
         
-        if(!xmlStrcmp(in_cur->name, (const xmlChar *) "img")) {
-            newProduct->imgFileName = malloc(DOCUMENT_NAME_SIZE * sizeof(char));
-            newProduct->imgFileName = (char *) in_cur->children->content;
-        }
+        return;
+    }
+    
+    int numOfTerms = dictionary->numOfKeys;
+    
+    const char **names = trackedMalloc(MEMORY_QUERY, (numOfTerms + 1) * sizeof(char *));
+    
+    long mismatches = 0;
+    
+    int i;
+    
+    for (i = 0; i < numOfTerms; i++) {
+        names[i] = currentIndex->dictionaryTerms[i]->name;
         
-        if(!xmlStrcmp(in_cur->name, (const xmlChar *) "titulo")) {
-            newProduct->title = malloc(50 * sizeof(char));
-            newProduct->title = (char *) in_cur->children->content;
+        if (lookupTermDictionary(dictionary, names[i]) != i) {
+            mismatches++;
         }
+    }
+    
+    /* Unknown terms: the names with an extra character are not in the vocabulary (or are found as themselves) */
+    for (i = 0; i < numOfTerms; i++) {
+        char *unknown = trackedMalloc(MEMORY_QUERY, strlen(names[i]) + 2);
         
-        if(!xmlStrcmp(in_cur->name, (const xmlChar *) "categoria")) {
-            newProduct->category = malloc(50 * sizeof(char));
-            newProduct->category = (char *) in_cur->children->content;
+        sprintf(unknown, "%s#", names[i]);
+        
+        if (lookupTermDictionary(dictionary, unknown) >= 0) {
+            mismatches++;
         }
         
-        in_cur = in_cur->next;
+        trackedFree(MEMORY_QUERY, unknown);
     }
     
-    return newProduct;
-}
-/*
- * Generate the inverted index processing a XML file
- */
-int processXMLData(const char datasetFileName[]) {
-    xmlDocPtr doc;
-    xmlNodePtr cur;
+    /* Round trip: the dictionary read back must answer every lookup like the one in memory */
+    FILE *file = tmpfile();
     
-    clock_t begin, end;
-
-    doc = xmlParseFile(datasetFileName);
+    TermDictionary *readDictionary = NULL;
     
-    if(doc == NULL) {
-        fprintf(stderr, "Document not parsed sucessfully! \n");
+    if (file != NULL && writeTermDictionary(dictionary, file) == 0) {
+        rewind(file);
         
-        return EXIT_FAILURE;
+        readDictionary = readTermDictionary(file);
     }
     
-    cur = xmlDocGetRootElement(doc);
+    if (readDictionary == NULL) {
+        mismatches++;
+    } else {
+        for (i = 0; i < numOfTerms; i++) {
+            if (lookupTermDictionary(readDictionary, names[i]) != i) {
+                mismatches++;
+            }
+        }
+    }
     
-    if(cur == NULL) {
-        fprintf(stderr, "Empty XML document! \n");
-        
-        xmlFreeDoc(doc);
-        
-        return EXIT_FAILURE;
+    if (file != NULL) {
+        fclose(file);
     }
     
-    if (xmlStrcmp(cur->name, (const xmlChar *) "produtos")) {
-        fprintf(stderr,"Document with wrong type! (root node != produtos) \n");
-        
-        xmlFreeDoc(doc);
-        
-        return EXIT_FAILURE;
+    freeTermDictionary(readDictionary);
+    
+    /* Lookup time: every term found PROFILE_RUNS times with each structure */
+    long found = 0;
+    
+    double begin = getWallClockSeconds();
+    
+    int run;
+    
+    for (run = 0; run < PROFILE_RUNS; run++) {
+        for (i = 0; i < numOfTerms; i++) {
+            found += lookupTermDictionary(dictionary, names[i]) >= 0;
+        }
     }
     
-    printf("Indexing the documents... ");
+    double dictionaryTimeSpent = getWallClockSeconds() - begin;
     
-    begin = clock();
-
-    fflush(stdout); /* Ensure that the printf above will be printed in the terminal before the indexing process */
+    begin = getWallClockSeconds();
     
-    cur = cur->xmlChildrenNode;
+    for (run = 0; run < PROFILE_RUNS; run++) {
+        for (i = 0; i < numOfTerms; i++) {
+            found += findChainedTerm(names[i]) != NULL;
+        }
+    }
     
-    Product *currentProduct = NULL;
+    double chainedTimeSpent = getWallClockSeconds() - begin;
     
-    int numOfDocuments = 0;
+    double numOfLookups = (double) PROFILE_RUNS * numOfTerms;
     
-    while (cur != NULL && numOfDocuments < NUM_OF_DOCUMENTS) {
+    printf("\nTerm dictionary: " ANSI_COLOR_YELLOW "%d" ANSI_COLOR_RESET " terms", numOfTerms);
+    printf("\nPerfect hash size: " ANSI_COLOR_YELLOW "%ld" ANSI_COLOR_RESET " bytes (%.2lf bits per term)",
+           getTermDictionaryHashSize(dictionary), numOfTerms > 0 ? getTermDictionaryHashSize(dictionary) * 8.0 / numOfTerms : 0);
+    printf("\nDictionary size (with fingerprints and strings): " ANSI_COLOR_YELLOW "%ld" ANSI_COLOR_RESET " bytes",
+           getTermDictionarySize(dictionary));
+    printf("\nLookup time: " ANSI_COLOR_YELLOW "%.1lf" ANSI_COLOR_RESET " ns (dictionary), " ANSI_COLOR_YELLOW "%.1lf"
+           ANSI_COLOR_RESET " ns (vocabulary chains) for %ld lookups", dictionaryTimeSpent / numOfLookups * 1e9,
+           chainedTimeSpent / numOfLookups * 1e9, found);
+    
+    if (mismatches == 0) {
+        printf("\nDictionary lookups match the vocabulary: " ANSI_COLOR_GREEN "OK" ANSI_COLOR_RESET "\n");
+    } else {
+        printf("\nDictionary lookups match the vocabulary: " ANSI_COLOR_RED "%ld mismatches" ANSI_COLOR_RESET "\n", mismatches);
+    }
+    
+    trackedFree(MEMORY_QUERY, names);
+}
+
+/*
+ * Check that the suggestions trie survives a write and read back: the trie read back must complete every
+ * prefix of every term like the one in memory. Returns the number of prefixes answered differently
+ */
+long checkTermSuggestionsRoundTrip(const TermSuggestions *trie, TermSuggestions *readTrie) {
+    TermSuggestion expected[MAX_TERM_SUGGESTIONS];
+    TermSuggestion found[MAX_TERM_SUGGESTIONS];
+    
+    long mismatches = 0;
+    
+    int i, j;
+    
+    for (i = 0; i < currentIndex->dictionary->numOfKeys; i++) {
+        char *prefix = trackedStrdup(MEMORY_QUERY, currentIndex->dictionaryTerms[i]->name);
         
-        if (!xmlStrcmp(cur->name, (const xmlChar *) "produto")) {
+        int length = strlen(prefix);
+        
+        /* Every prefix of the term, from its first character to the whole term */
+        for (; length > 0; length--) {
+            prefix[length] = '\0';
             
-            currentProduct = (Product *) realloc(currentProduct, sizeof(Product));
-            currentProduct = createPopulatedStructProduct(cur->xmlChildrenNode);
+            int numOfExpected = suggestTerms(trie, prefix, MAX_TERM_SUGGESTIONS, expected);
+            int numOfFound = suggestTerms(readTrie, prefix, MAX_TERM_SUGGESTIONS, found);
+            
+            bool isSame = numOfExpected == numOfFound;
             
-            indexEntry(currentProduct);
+            for (j = 0; j < numOfExpected && isSame; j++) {
+                isSame = expected[j].weight == found[j].weight && strcmp(expected[j].term, found[j].term) == 0;
+            }
+            
+            mismatches += !isSame;
+            
+            for (j = 0; j < numOfExpected; j++) {
+                trackedFree(MEMORY_QUERY, expected[j].term);
+            }
             
-            numOfDocuments++;
+            for (j = 0; j < numOfFound; j++) {
+                trackedFree(MEMORY_QUERY, found[j].term);
+            }
         }
         
-        cur = cur->next;
+        trackedFree(MEMORY_QUERY, prefix);
     }
     
-    generateDocMagnitudeAndVocabularyTermsIDF();
-    
-    end = clock();
-
-    double searchTimeSpent = (double)(end - begin) / CLOCKS_PER_SEC;
-
-    printf(ANSI_BOLD_WHITE "[" ANSI_COLOR_GREEN " DONE " ANSI_COLOR_RESET 
-        ANSI_BOLD_WHITE "]" ANSI_COLOR_RESET " - " ANSI_COLOR_YELLOW "%d" ANSI_COLOR_RESET 
-        " documents (text) were indexed in %lf seconds!\n" ANSI_COLOR_RESET, numOfDocuments, searchTimeSpent);
-    
-    return EXIT_SUCCESS;
+    return mismatches;
 }
 
-char *getImageWord(const char imagePath[]) {
-    const int WORD_SIZE = 863 * 1296;
-
-    char *resultWord = malloc (WORD_SIZE * sizeof(char));
-
-    FILE *in;
-
-    char *pythonCmd = "python ../../img-histogram-gen/src/img-histogram-gen.py ";
-
-    char *command = malloc(strlen(pythonCmd) + strlen(imagePath) + 1);
-
-    strcat(command, pythonCmd);
-
-    strcat(command, imagePath); // image filename
-
-    if (!(in = popen(command, "r"))) {
-        exit(1);
+/*
+ * Report the size of the suggestions trie, checking that it survives a write and read back
+ */
+void reportTermSuggestions() {
+    const TermSuggestions *trie = currentIndex->suggestions;
+    
+    if (trie == NULL || currentIndex->dictionary == NULL) {
+        printf("\nSuggestions trie: " ANSI_COLOR_RED "not built" ANSI_COLOR_RESET "\n");
+        
+        return;
     }
+    
+    FILE *file = tmpfile();
+    
+    TermSuggestions *readTrie = NULL;
+    
+    if (file != NULL && writeTermSuggestions(trie, file) == 0) {
+        rewind(file);
+        
+        readTrie = readTermSuggestions(file);
+    }
+    
+    if (file != NULL) {
+        fclose(file);
+    }
+    
+    long mismatches = readTrie != NULL ? checkTermSuggestionsRoundTrip(trie, readTrie) : 1;
+    
+    freeTermSuggestions(readTrie);
+    
+    printf("\nSuggestions trie: " ANSI_COLOR_YELLOW "%u" ANSI_COLOR_RESET " terms in " ANSI_COLOR_YELLOW "%u"
+           ANSI_COLOR_RESET " nodes, " ANSI_COLOR_YELLOW "%ld" ANSI_COLOR_RESET " bytes", trie->numOfTerms, trie->numOfNodes,
+           getTermSuggestionsSize(trie));
+    
+    if (mismatches == 0) {
+        printf("\nSuggestions read back match the trie: " ANSI_COLOR_GREEN "OK" ANSI_COLOR_RESET "\n");
+    } else {
+        printf("\nSuggestions read back match the trie: " ANSI_COLOR_RED "%ld mismatches" ANSI_COLOR_RESET "\n", mismatches);
+    }
+}
 
-    fgets(resultWord, WORD_SIZE, in);
-
-    pclose(in);
-
-    return resultWord;
+/*
+ * Print a row of the report of the image vectors: a representation with its size in total and per image
+ */
+void printImageVectorsSize(const char name[], long size, int numOfImages) {
+    printf("\n%-28s " ANSI_COLOR_YELLOW "%14.1lf" ANSI_COLOR_RESET " %16.1lf", name, size / 1024.0, (double) size / numOfImages);
 }
 
 /*
- * Process all the images in a specific folder
+ * Report the quantized vectors of the image index (--quantize-images): their memory per image against the exact
+ * representations, and the recall@10 of their searches against the exhaustive search (exact cossene) on the
+ * evaluation queries, with and without the re-ranking
  */
-int processImageDataOnFolder(const char imgDatasetFolder[]) {
-    DIR *d;
+void reportImageVectors() {
+    const VectorStore *store = currentIndex->vectors;
     
-    clock_t begin, end;
-
-    struct dirent *dir;
-
-    extern FILE *popen();
-
-    d = opendir(imgDatasetFolder);
-
-    printf("Indexing the images from folder %s... ", imgDatasetFolder);
+    if (store == NULL) {
+        printf("\nThe image vectors are not quantized (--quantize-images pq|int8)");
+        
+        return;
+    }
     
-    fflush(stdout); /* Ensure that the printf above will be printed in the terminal before the indexing process */
-
-    int count = 0;
-
-    begin = clock();
-
-    if (d) {
-        while ((dir = readdir(d)) != NULL && count < NUM_OF_DOCUMENTS) {
-            if (dir->d_type == DT_REG) {
+    long postingsSize = 0;
+    
+    int i, j;
+    
+    for (i = 0; i < (int) currentIndex->dictionary->numOfKeys; i++) {
+        postingsSize += getCompressedPostingsSize(currentIndex->dictionaryTerms[i]->postings);
+    }
+    
+    int numOfImages = store->numOfVectors;
+    
+    printf("\nImage vectors: " ANSI_COLOR_YELLOW "%s" ANSI_COLOR_RESET ", %d images of %d histogram bins",
+           getVectorQuantizationName(store->quantization), numOfImages, store->dimension);
+    
+    if (store->quantization == QUANTIZATION_PQ) {
+        printf(", %d subspaces of %d bins", store->numOfSubspaces, store->subspaceDimension);
+    }
+    
+    printf("\n" ANSI_BOLD_WHITE "%-28s %14s %16s" ANSI_COLOR_RESET, "Representation", "Size (KB)", "Bytes per image");
+    
+    printImageVectorsSize("codes (scanned)", getVectorStoreCodesSize(store), numOfImages);
+    printImageVectorsSize("codebooks", getVectorStoreCodebooksSize(store), numOfImages);
+    printImageVectorsSize("exact vectors (re-ranking)", getVectorStoreExactSize(store), numOfImages);
+    printImageVectorsSize("dense float vectors", (long) numOfImages * store->dimension * sizeof(float), numOfImages);
+    printImageVectorsSize("postings", postingsSize, numOfImages);
+    
+    double recall[2] = { 0, 0 };
+    double timeSpent[3] = { 0, 0, 0 };
+    
+    int numOfQueries = 0;
+    
+    for (i = 0; i < NUMBER_OF_QUERIES_TO_EVAL; i++) {
+        char filename[64];
+        
+        snprintf(filename, sizeof(filename), "../dataset/evaluation/queries/%d.jpg", i + 1);
+        
+        if (access(filename, R_OK) != 0) {
+            continue;
+        }
+        
+        char *word = getImageWord(filename, MEMORY_QUERY);
+        
+        normalizeTerm(word);
+        
+        VectorQuery query = parseVectorQuery(word, NULL);
+        
+        int exactPositions[MAX_SEARCH_RESULT];
+        float exactScores[MAX_SEARCH_RESULT];
+        
+        double begin = getWallClockSeconds();
+        
+        resetAccumulators(accumulators);
+        
+        scoreVectorQueryRange(&query, 0, NUM_OF_DOCUMENTS, accumulators);
+        
+        int exactCount = selectTopAccumulators(accumulators, currentIndex->inverseNorms, MAX_SEARCH_RESULT, exactPositions, exactScores);
+        
+        timeSpent[0] += getWallClockSeconds() - begin;
+        
+        if (exactCount > 0) {
+            numOfQueries++;
+            
+            /* Codes only, then codes with the re-ranking of the best RERANK_CANDIDATES */
+            int run;
+            
+            for (run = 0; run < (store->exactVectors != NULL ? 2 : 1); run++) {
+                int positions[MAX_SEARCH_RESULT];
+                float scores[MAX_SEARCH_RESULT];
                 
-                char *imagePath = malloc(strlen(imgDatasetFolder) + strlen(dir->d_name) + 1);
-
-                strcat(imagePath, imgDatasetFolder);
-
-                strcat(imagePath, dir->d_name); // image filename
+                begin = getWallClockSeconds();
                 
-                char* word = getImageWord(imagePath);
-
-                Product *newProduct = (Product *) malloc(sizeof(Product));
+                int count = searchVectorQueryInStore(&query, run == 0 ? 0 : RERANK_CANDIDATES, positions, scores);
                 
-                char *documentId = malloc(sizeof(int));
-        
-                sprintf(documentId, "%d", ++count);
+                timeSpent[run + 1] += getWallClockSeconds() - begin;
                 
-                newProduct->id = documentId;
-                newProduct->imgFileName = (char *) dir->d_name;
-                newProduct->description = (char *) word;
-            
-                indexEntry(newProduct);
+                int numOfFound = 0;
+                
+                for (j = 0; j < count; j++) {
+                    int k;
+                    
+                    for (k = 0; k < exactCount && exactPositions[k] != positions[j]; k++) {
+                    }
+                    
+                    numOfFound += k < exactCount;
+                }
+                
+                recall[run] += (double) numOfFound / exactCount;
             }
         }
-
-        closedir(d);
+        
+        trackedFree(MEMORY_QUERY, query.terms);
+        trackedFree(MEMORY_QUERY, word);
     }
     
-    generateDocMagnitudeAndVocabularyTermsIDF();
-
-    end = clock();
+    if (numOfQueries == 0) {
+        printf("\nNo evaluation query (../dataset/evaluation/queries/<n>.jpg) has results, the recall is not measured\n");
+        
+        return;
+    }
     
-    double searchTimeSpent = (double)(end - begin) / CLOCKS_PER_SEC;
+    printf("\n\nRecall@%d against the exact cossene for %d evaluation queries:", MAX_SEARCH_RESULT, numOfQueries);
+    printf("\n" ANSI_BOLD_WHITE "%-28s %14s %16s" ANSI_COLOR_RESET, "Search", "Recall@10", "Latency (ms)");
+    printf("\n%-28s %14.3lf %16.3lf", "exhaustive (postings)", 1.0, timeSpent[0] / numOfQueries * 1000);
+    printf("\n%-28s " ANSI_COLOR_YELLOW "%14.3lf" ANSI_COLOR_RESET " %16.3lf", "codes", recall[0] / numOfQueries,
+           timeSpent[1] / numOfQueries * 1000);
     
-    printf(ANSI_BOLD_WHITE "[" ANSI_COLOR_GREEN " DONE " ANSI_COLOR_RESET 
-        ANSI_BOLD_WHITE "]" ANSI_COLOR_RESET " - " 
-        ANSI_COLOR_YELLOW "%d" ANSI_COLOR_RESET 
-        " documents (images) were indexed in %lf seconds!\n" ANSI_COLOR_RESET, count, searchTimeSpent);
-
-    return EXIT_SUCCESS;
+    if (store->exactVectors != NULL) {
+        char name[64];
+        
+        snprintf(name, sizeof(name), "codes + re-ranking of %d", RERANK_CANDIDATES);
+        
+        printf("\n%-28s " ANSI_COLOR_YELLOW "%14.3lf" ANSI_COLOR_RESET " %16.3lf", name, recall[1] / numOfQueries,
+               timeSpent[2] / numOfQueries * 1000);
+    }
+    
+    printf("\n");
 }
+
 /*
- * Print all the terms of the vocabulary
+ * Print the completions of a prefix with the highest df, as the search box shows them while the user types
  */
-void printVocabulary() {
+void printTermSuggestions(const char prefix[]) {
+    char *normalizedPrefix = trackedStrdup(MEMORY_QUERY, prefix);
     
-    int i;
-    
-    for (i = 0; i < NUM_OF_TERMS; i++) {
-        Term *term = vocabulary[i];
-        
-        for (; term != NULL; term = term->next) {
-            
-            printf("\nTERM: %s", term->name);
-            
-            Document *document = term->document;
-            
-            printf("\nDOCUMENTS: ");
-            
-            for (; document != NULL; document = document->next) {
-                printf("\nDOCUMENT NAME: %s, DOCUMENT TERM: %s", document->name, document->term);
-            }
-        }
+    tolowerStr(normalizedPrefix);
+    
+    TermSuggestion suggestions[MAX_TERM_SUGGESTIONS];
+    
+    double begin = getWallClockSeconds();
+    
+    int numOfSuggestions = suggestTerms(currentIndex->suggestions, normalizedPrefix, MAX_TERM_SUGGESTIONS, suggestions);
+    
+    double suggestTimeSpent = getWallClockSeconds() - begin;
+    
+    int i;
+    
+    for (i = 0; i < numOfSuggestions; i++) {
+        printf("\n" ANSI_COLOR_YELLOW "%s" ANSI_COLOR_RESET " (df %u)", suggestions[i].term, suggestions[i].weight);
+        
+        trackedFree(MEMORY_QUERY, suggestions[i].term);
     }
     
-    printf("\n");
+    if (numOfSuggestions == 0) {
+        printf("\nNo term starts with \"%s\"", normalizedPrefix);
+    }
+    
+    printf("\nSuggestions found in %.1lf microseconds (trie of " ANSI_COLOR_YELLOW "%ld" ANSI_COLOR_RESET " bytes)",
+           suggestTimeSpent * 1e6, getTermSuggestionsSize(currentIndex->suggestions));
+    
+    trackedFree(MEMORY_QUERY, normalizedPrefix);
 }
 
 /**
@@ -795,77 +4796,557 @@ char **loadRelevantsForQueryNumber(int queryNumber, char **resultRelevants) {
             }
         }
         
-        cur = cur->next;
+        cur = cur->next;
+    }
+    
+    return resultRelevants;
+}
+
+/**
+ * Calculate the precision in an specific point
+ */
+double getPrecisionAtPoint(int position, char *relevants[], Entry *resultsToEvaluate[]) {
+    
+    int numberOfRelevants = 0;
+    
+    int i;
+    int j;
+    
+    for (i = 0; i < position; i++) {
+        
+        for (j = 0; j < 110; j++) {
+            if (relevants[j] == NULL) {
+                break;
+            }
+            
+            if (strcmp(resultsToEvaluate[i]->documentName, relevants[j]) == 0) {
+                numberOfRelevants++;
+            }
+        }
+    }
+    
+    double precision = (double) numberOfRelevants / (double) position;
+    
+    return precision;
+}
+
+/**
+ * Calculate the MAP (Mean Average Precision)
+ */
+double getMAP(char *relevants[], Entry *resultsToEvaluate[]) {
+    
+    double sumOfPrecisions = 0;
+    
+    int i;
+    int j;
+    
+    for (i = 0; i < MAX_SEARCH_RESULT; i++) {
+        
+        for (j = 0; j < 110; j++) {
+            if (relevants[j] == NULL) {
+                break;
+            }
+            
+            if (strcmp(resultsToEvaluate[i]->documentName, relevants[j]) == 0) {
+                sumOfPrecisions += getPrecisionAtPoint(i + 1, relevants, resultsToEvaluate);
+            }
+        }
+    }
+    
+    long totalRelevants = 0;
+    
+    /* Workaround to count the number of relevant documents in the array */
+    for (j = 0; j < 110; j++) {
+        if (relevants[j] == NULL) {
+            break;
+        }
+        
+        totalRelevants++;
+    }
+    
+    double map = (double) sumOfPrecisions / (double) totalRelevants;
+    
+    return map;
+}
+
+/*
+ * Compare two latencies in increasing order
+ */
+int compareLatencies(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    
+    return (x > y) - (x < y);
+}
+
+/*
+ * Run a query PROFILE_RUNS times without printing the results and report the average, median and p99
+ * latencies and, when the hardware counters are available, the instructions and cache misses per query.
+ * Text queries may have filters and boolean operators, image queries are histogram words
+ */
+void profileQuery(char query[], SearchBudget *budget, bool isText) {
+    Entry **paginatedResult = trackedMalloc(MEMORY_QUERY, MAX_SEARCH_RESULT * sizeof(Entry *));
+    
+    /* The searches tokenize the query in place, so each run gets a fresh copy */
+    char *runQuery = trackedMalloc(MEMORY_QUERY, QUERY_SIZE * sizeof(char));
+    
+    /* The filters of a sharded index are parsed by the shards */
+    DocBitmap *filter = isText && shardSockets == NULL ? parseSearchFilter(query) : NULL;
+    
+    PerfCounters counters;
+    
+    bool hasCounters = openPerfCounters(&counters);
+    
+    long long totals[NUM_OF_PERF_COUNTERS] = { 0 };
+    
+    double seconds = 0;
+    double latencies[PROFILE_RUNS];
+    
+    int i, j;
+    
+    for (i = 0; i < PROFILE_RUNS; i++) {
+        strcpy(runQuery, query);
+        
+        double begin = getWallClockSeconds();
+        
+        startPerfCounters(&counters);
+        
+        if (shardSockets != NULL) {
+            searchShards(runQuery, false, paginatedResult, budget);
+        } else if (isText && isBooleanQuery(runQuery)) {
+            searchByBooleanQuery(runQuery, false, paginatedResult, filter);
+        } else if (budget != NULL) {
+            searchByImpactOrder(runQuery, false, paginatedResult, budget, filter);
+        } else {
+            searchByVectorModel(runQuery, false, paginatedResult, filter);
+        }
+        
+        stopPerfCounters(&counters);
+        
+        latencies[i] = getWallClockSeconds() - begin;
+        
+        seconds += latencies[i];
+        
+        for (j = 0; j < NUM_OF_PERF_COUNTERS; j++) {
+            totals[j] += counters.values[j];
+        }
+    }
+    
+    closePerfCounters(&counters);
+    
+    printf("\n" ANSI_BOLD_WHITE "Profile of " ANSI_COLOR_RESET "%.40s" ANSI_BOLD_WHITE " (%d runs, top-k selection: %s)" ANSI_COLOR_RESET,
+           query, PROFILE_RUNS, getAccumulatorsInstructionSet());
+    
+    qsort(latencies, PROFILE_RUNS, sizeof(double), compareLatencies);
+    
+    printf("\nSearch workers: " ANSI_COLOR_YELLOW "%d" ANSI_COLOR_RESET " (queries of at least %ld postings)",
+           workerPool != NULL ? workerPool->numOfWorkers : 1, PARALLEL_QUERY_COST);
+    printf("\nAverage latency: " ANSI_COLOR_YELLOW "%lf" ANSI_COLOR_RESET " ms, p50: " ANSI_COLOR_YELLOW "%lf" ANSI_COLOR_RESET
+           " ms, p99: " ANSI_COLOR_YELLOW "%lf" ANSI_COLOR_RESET " ms", seconds * 1000 / PROFILE_RUNS,
+           latencies[PROFILE_RUNS / 2] * 1000, latencies[PROFILE_RUNS * 99 / 100] * 1000);
+    
+    if (!hasCounters) {
+        printf("\nHardware counters: " ANSI_COLOR_RED "unavailable" ANSI_COLOR_RESET " (see /proc/sys/kernel/perf_event_paranoid)");
+    } else {
+        const char *names[NUM_OF_PERF_COUNTERS] = { "Instructions", "Cache references", "Cache misses" };
+        
+        for (j = 0; j < NUM_OF_PERF_COUNTERS; j++) {
+            if (isPerfCounterAvailable(&counters, j)) {
+                printf("\n%s per query: " ANSI_COLOR_YELLOW "%.1lf" ANSI_COLOR_RESET, names[j], (double) totals[j] / PROFILE_RUNS);
+            } else {
+                printf("\n%s per query: " ANSI_COLOR_RED "unavailable" ANSI_COLOR_RESET, names[j]);
+            }
+        }
+    }
+    
+    printf("\n");
+    
+    freeDocBitmap(filter);
+    trackedFree(MEMORY_QUERY, runQuery);
+    trackedFree(MEMORY_QUERY, paginatedResult);
+}
+
+/*
+ * Load a query log: one query per line, a text query or the path of an image. The image words are generated
+ * here, so the replay only measures the searches. Returns NULL if the log can't be read or has no queries
+ */
+char **loadQueryLog(const char path[], bool isText, int *numOfQueries, int *maxQueryLength) {
+    FILE *file = fopen(path, "r");
+    
+    if (file == NULL) {
+        perror(path);
+        
+        return NULL;
+    }
+    
+    char **queries = NULL;
+    
+    char line[1024];
+    
+    *numOfQueries = 0;
+    *maxQueryLength = 0;
+    
+    while (fgets(line, sizeof(line), file) != NULL) {
+        removeNewLineCharFromString(line);
+        
+        if (line[0] == 0) {
+            continue;
+        }
+        
+        char *query = isText ? trackedStrdup(MEMORY_QUERY, line) : getImageWord(line, MEMORY_QUERY);
+        
+        if (query == NULL) {
+            continue;
+        }
+        
+        queries = trackedRealloc(MEMORY_QUERY, queries, (*numOfQueries + 1) * sizeof(char *));
+        
+        queries[(*numOfQueries)++] = query;
+        
+        int queryLength = (int) strlen(query);
+        
+        if (queryLength > *maxQueryLength) {
+            *maxQueryLength = queryLength;
+        }
+    }
+    
+    fclose(file);
+    
+    if (*numOfQueries == 0) {
+        fprintf(stderr, "\nThe query log %s has no queries\n", path);
+    }
+    
+    return queries;
+}
+
+/*
+ * Wait until a monotonic wall clock time, in seconds
+ */
+void sleepUntilWallClockSeconds(double seconds) {
+#ifdef __linux__
+    struct timespec until;
+    
+    until.tv_sec = (time_t) seconds;
+    until.tv_nsec = (long) ((seconds - until.tv_sec) * 1e9);
+    
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) != 0) {
+    }
+#else
+    /* Without absolute sleeps, sleep for the time left until it is reached */
+    double remaining;
+    
+    while ((remaining = seconds - getWallClockSeconds()) > 0) {
+        struct timespec duration;
+        
+        duration.tv_sec = (time_t) remaining;
+        duration.tv_nsec = (long) ((remaining - duration.tv_sec) * 1e9);
+        
+        nanosleep(&duration, NULL);
+    }
+#endif
+}
+
+/*
+ * Thread of a replay client: send its queries and record their latencies. In open loop the query n is
+ * scheduled at startSeconds + n * queryInterval, whether the previous ones were answered or not, and its
+ * corrected latency is measured from that time (coordinated omission correction)
+ */
+void *runReplayClient(void *argument) {
+    ReplayClient *client = argument;
+    
+    currentIndex = client->index;
+    
+    accumulators = createAccumulators(NUM_OF_DOCUMENTS);
+    
+    Entry **paginatedResult = trackedMalloc(MEMORY_QUERY, MAX_SEARCH_RESULT * sizeof(Entry *));
+    
+    /* The searches tokenize the query in place, so each run gets a fresh copy */
+    char *runQuery = trackedMalloc(MEMORY_QUERY, client->maxQueryLength + 1);
+    
+#ifdef __linux__
+    /* Wake up at the scheduled times, not up to the default 50 us later, so the corrected latencies measure the engine */
+    prctl(PR_SET_TIMERSLACK, 1);
+#endif
+    
+    sleepUntilWallClockSeconds(client->startSeconds);
+    
+    long i;
+    
+    for (i = client->id; i < client->numOfQueries; i += client->numOfClients) {
+        strcpy(runQuery, client->queries[i % client->numOfLogQueries]);
+        
+        double scheduledSeconds = client->startSeconds + i * client->queryInterval;
+        
+        if (client->queryInterval > 0) {
+            if (getWallClockSeconds() < scheduledSeconds) {
+                sleepUntilWallClockSeconds(scheduledSeconds);
+            } else {
+                client->numOfLateQueries++;
+            }
+        }
+        
+        double sendSeconds = getWallClockSeconds();
+        
+        pthread_mutex_lock(&searchMutex);
+        
+        if (shardSockets != NULL) {
+            searchShards(runQuery, false, paginatedResult, client->budget);
+        } else {
+            searchQuery(runQuery, client->isText, false, paginatedResult, client->budget);
+        }
+        
+        pthread_mutex_unlock(&searchMutex);
+        
+        double answerSeconds = getWallClockSeconds();
+        
+        recordLatency(client->latencies, answerSeconds - sendSeconds);
+        
+        if (client->queryInterval > 0) {
+            recordLatency(client->correctedLatencies, answerSeconds - scheduledSeconds);
+        }
+    }
+    
+    trackedFree(MEMORY_QUERY, runQuery);
+    trackedFree(MEMORY_QUERY, paginatedResult);
+    
+    freeAccumulators(accumulators);
+    
+    return NULL;
+}
+
+/*
+ * Print a row of latency percentiles, in milliseconds
+ */
+void printLatencyPercentiles(const char name[], const LatencyHistogram *histogram) {
+    double percentiles[] = { 50, 90, 99, 99.9 };
+    
+    printf("\n%-12s", name);
+    
+    int i;
+    
+    for (i = 0; i < 4; i++) {
+        printf(" " ANSI_COLOR_YELLOW "%10.3lf" ANSI_COLOR_RESET, getLatencyPercentile(histogram, percentiles[i]) * 1000);
+    }
+    
+    printf(" %10.3lf %10.3lf", histogram->maxSeconds * 1000, getMeanLatency(histogram) * 1000);
+}
+
+/*
+ * Print the distribution of a histogram: the latency of each percentile, halving the share of the slowest
+ * queries at each line (50%, 75%, 87.5%...) as HdrHistogram does, up to the slowest query
+ */
+void printLatencyDistribution(const char name[], const LatencyHistogram *histogram) {
+    printf("\n\n" ANSI_BOLD_WHITE "%s latency distribution" ANSI_COLOR_RESET "\n%12s %12s %12s", name, "Percentile",
+           "Latency (ms)", "Queries");
+    
+    double tail = 50;
+    
+    while (true) {
+        double percentile = 100 - tail;
+        
+        printf("\n%12.4lf %12.3lf %12ld", percentile, getLatencyPercentile(histogram, percentile) * 1000,
+               (long) (percentile / 100 * histogram->totalCount + 0.5));
+        
+        /* Stop when less than one query is slower than the percentile */
+        if (tail / 100 * histogram->totalCount < 1) {
+            break;
+        }
+        
+        tail /= 2;
+    }
+    
+    printf("\n%12.4lf %12.3lf %12ld", 100.0, histogram->maxSeconds * 1000, histogram->totalCount);
+}
+
+/*
+ * Replay a query log with a number of concurrent clients (!l <log> [clients] [qps] [queries]), in closed loop or,
+ * with a target rate, in open loop, and report the throughput and the latency percentiles. The searches of a
+ * single index run one at a time (each one may use the search workers), so the replay finds the rate at which
+ * the queries start to wait: in open loop, a corrected p99 far above the uncorrected one means the engine is
+ * saturated at that rate. A coordinator sends the queries to its shards through their sockets
+ */
+void replayQueryLog(const char arguments[], bool isText, SearchBudget *budget) {
+    char path[1024] = { 0 };
+    
+    int numOfClients = 1;
+    
+    double targetRate = 0;
+    
+    long numOfQueries = 0;
+    
+    if (sscanf(arguments, "%1023s %d %lf %ld", path, &numOfClients, &targetRate, &numOfQueries) < 1) {
+        printf("\nUsage: !l <query log> [clients] [queries per second, 0 for closed loop] [number of queries]");
+        
+        return;
+    }
+    
+    if (numOfClients < 1 || numOfClients > MAX_REPLAY_CLIENTS) {
+        printf("\nThe number of clients must be between 1 and %d", MAX_REPLAY_CLIENTS);
+        
+        return;
+    }
+    
+    int numOfLogQueries = 0;
+    int maxQueryLength = 0;
+    
+    char **queries = loadQueryLog(path, isText, &numOfLogQueries, &maxQueryLength);
+    
+    if (numOfLogQueries == 0) {
+        trackedFree(MEMORY_QUERY, queries);
+        
+        return;
+    }
+    
+    if (numOfQueries <= 0) {
+        numOfQueries = numOfLogQueries;
+    }
+    
+    ReplayClient *clients = trackedCalloc(MEMORY_QUERY, numOfClients, sizeof(ReplayClient));
+    
+    /* The clients start a little later, so none of them is late because of the creation of the others */
+    double startSeconds = getWallClockSeconds() + 0.01;
+    
+    int i, numOfStartedClients = 0;
+    
+    for (i = 0; i < numOfClients; i++) {
+        ReplayClient *client = &clients[i];
+        
+        client->id = i;
+        client->numOfClients = numOfClients;
+        client->queries = queries;
+        client->numOfLogQueries = numOfLogQueries;
+        client->maxQueryLength = maxQueryLength;
+        client->numOfQueries = numOfQueries;
+        client->startSeconds = startSeconds;
+        client->queryInterval = targetRate > 0 ? 1 / targetRate : 0;
+        client->isText = isText;
+        client->budget = budget;
+        client->index = currentIndex;
+        client->latencies = createLatencyHistogram();
+        client->correctedLatencies = createLatencyHistogram();
+        
+        if (pthread_create(&client->thread, NULL, runReplayClient, client) != 0) {
+            perror("pthread_create");
+            
+            break;
+        }
+        
+        numOfStartedClients++;
+    }
+    
+    LatencyHistogram *latencies = createLatencyHistogram();
+    LatencyHistogram *correctedLatencies = createLatencyHistogram();
+    
+    int numOfLateQueries = 0;
+    
+    for (i = 0; i < numOfClients; i++) {
+        if (i < numOfStartedClients) {
+            pthread_join(clients[i].thread, NULL);
+            
+            addLatencyHistogram(latencies, clients[i].latencies);
+            addLatencyHistogram(correctedLatencies, clients[i].correctedLatencies);
+            
+            numOfLateQueries += clients[i].numOfLateQueries;
+        }
+        
+        freeLatencyHistogram(clients[i].latencies);
+        freeLatencyHistogram(clients[i].correctedLatencies);
     }
     
-    return resultRelevants;
-}
-
-/**
- * Calculate the precision in an specific point
- */
-double getPrecisionAtPoint(int position, char *relevants[], Entry *resultsToEvaluate[]) {
+    double seconds = getWallClockSeconds() - startSeconds;
     
-    int numberOfRelevants = 0;
+    printf("\n" ANSI_BOLD_WHITE "Replay of " ANSI_COLOR_RESET "%s" ANSI_BOLD_WHITE " (%ld queries of %d in the log, %d clients, ",
+           path, latencies->totalCount, numOfLogQueries, numOfStartedClients);
     
-    int i;
-    int j;
+    if (targetRate > 0) {
+        printf("open loop at %.1lf queries/s)" ANSI_COLOR_RESET, targetRate);
+    } else {
+        printf("closed loop)" ANSI_COLOR_RESET);
+    }
     
-    for (i = 0; i < position; i++) {
+    printf("\nThroughput: " ANSI_COLOR_YELLOW "%.1lf" ANSI_COLOR_RESET " queries/s (%lf seconds)",
+           latencies->totalCount / seconds, seconds);
+    
+    printf("\n\n" ANSI_BOLD_WHITE "%-12s %10s %10s %10s %10s %10s %10s" ANSI_COLOR_RESET, "Latency (ms)", "p50", "p90", "p99",
+           "p99.9", "max", "mean");
+    
+    if (targetRate > 0) {
+        printLatencyPercentiles("uncorrected", latencies);
+        printLatencyPercentiles("corrected", correctedLatencies);
         
-        for (j = 0; j < 110; j++) {
-            if (relevants[j] == NULL) {
-                break;
-            }
-            
-            if (strcmp(resultsToEvaluate[i]->documentName, relevants[j]) == 0) {
-                numberOfRelevants++;
-            }
+        /* A late query was still waiting for the previous ones at its scheduled time */
+        if (numOfLateQueries > latencies->totalCount / 100) {
+            printf("\n\n" ANSI_COLOR_RED "Saturated:" ANSI_COLOR_RESET " %d queries (%.1lf%%) were sent after their scheduled time,"
+                   " the engine does not sustain %.1lf queries/s", numOfLateQueries,
+                   100.0 * numOfLateQueries / latencies->totalCount, targetRate);
         }
+        
+        printLatencyDistribution("Corrected", correctedLatencies);
+    } else {
+        printLatencyPercentiles("all", latencies);
+        
+        printLatencyDistribution("Query", latencies);
     }
     
-    double precision = (double) numberOfRelevants / (double) position;
+    printf("\n");
     
-    return precision;
+    for (i = 0; i < numOfLogQueries; i++) {
+        trackedFree(MEMORY_QUERY, queries[i]);
+    }
+    
+    freeLatencyHistogram(latencies);
+    freeLatencyHistogram(correctedLatencies);
+    trackedFree(MEMORY_QUERY, clients);
+    trackedFree(MEMORY_QUERY, queries);
 }
 
 /**
- * Calculate the MAP (Mean Average Precision)
+ * Execute an evaluation query by the exhaustive search or, when a budget is given, by the
+ * impact-ordered search, counting the queries whose budget ran out
  */
-double getMAP(char *relevants[], Entry *resultsToEvaluate[]) {
-    
-    double sumOfPrecisions = 0;
-    
-    int i;
-    int j;
-    
-    for (i = 0; i < MAX_SEARCH_RESULT; i++) {
+Entry **searchForEvaluation(char query[], Entry **resultsToEvaluate, SearchBudget *budget, int *truncatedQueries) {
+    if (shardSockets != NULL) {
+        Entry **result = searchShards(query, false, resultsToEvaluate, budget);
         
-        for (j = 0; j < 110; j++) {
-            if (relevants[j] == NULL) {
-                break;
-            }
-            
-            if (strcmp(resultsToEvaluate[i]->documentName, relevants[j]) == 0) {
-                sumOfPrecisions += getPrecisionAtPoint(i + 1, relevants, resultsToEvaluate);
-            }
+        if (budget != NULL && budget->truncated) {
+            (*truncatedQueries)++;
         }
+        
+        return result;
     }
     
-    long totalRelevants = 0;
+    if (currentIndex->vectors != NULL) {
+        return searchByVectorStore(query, false, resultsToEvaluate);
+    }
     
-    /* Workaround to count the number of relevant documents in the array */
-    for (j = 0; j < 110; j++) {
-        if (relevants[j] == NULL) {
-            break;
-        }
-        
-        totalRelevants++;
+    if (budget == NULL) {
+        return searchByVectorModel(query, false, resultsToEvaluate, NULL);
     }
     
-    double map = (double) sumOfPrecisions / (double) totalRelevants;
+    Entry **result = searchByImpactOrder(query, false, resultsToEvaluate, budget, NULL);
     
-    return map;
+    if (budget->truncated) {
+        (*truncatedQueries)++;
+    }
+    
+    return result;
+}
+
+/*
+ * Print the scoring model of the current index, with its parameters and the average document length
+ */
+void printScoringModel() {
+    const ScoringStatistics *scoring = &currentIndex->scoring;
+    
+    printf("\nScoring model: " ANSI_COLOR_YELLOW "%s" ANSI_COLOR_RESET, getScoringModelName(scoring->model));
+    
+    if (scoring->model == SCORING_BM25) {
+        printf(" (k1 %.2lf, b %.2lf)", scoring->k1, scoring->b);
+    }
+    
+    /* The coordinator of a sharded index has no documents, only their number and length */
+    printf(", average document length %.1lf words",
+           scoring->numOfDocuments > 0 ? (double) scoring->totalDocumentLength / scoring->numOfDocuments : 0);
 }
 
 /**
@@ -875,8 +5356,10 @@ double getMAP(char *relevants[], Entry *resultsToEvaluate[]) {
  *
  * This evaluation executes 50 text queries or 50 image queries and evaluates the results 
  * comparing them with a file containing the  relevant results for each of these queries.
+ *
+ * When a budget is given the queries are executed by the impact-ordered (anytime) search.
  */
-void evaluateModelByMAPAndPat10(const char option[]) {
+void evaluateModelByMAPAndPat10(const char option[], SearchBudget *budget) {
     Entry **resultsToEvaluate = NULL;
     
     double resultPAt10 = 0; // Precision at point 10 (P@10)
@@ -884,6 +5367,12 @@ void evaluateModelByMAPAndPat10(const char option[]) {
     
     int i;
     
+    int truncatedQueries = 0;
+    
+    int numOfQueries = 0;
+    
+    double searchTimeSpent = 0;
+    
     char **relevants = NULL;
     
     for(i = 0; i < NUMBER_OF_QUERIES_TO_EVAL; i++) { // Fix to the normal value: 50
@@ -940,8 +5429,14 @@ void evaluateModelByMAPAndPat10(const char option[]) {
                 while (fgets(line, sizeof line, file) != NULL ) {
                     removeNewLineCharFromString(line);
 
+                    double begin = getWallClockSeconds();
+                    
                     // each line of the file is a query
-                    resultsToEvaluate = searchByVectorModel(line, false, resultsToEvaluate); 
+                    resultsToEvaluate = searchForEvaluation(line, resultsToEvaluate, budget, &truncatedQueries);
+                    
+                    searchTimeSpent += getWallClockSeconds() - begin;
+                    
+                    numOfQueries++;
                     
                     if (resultsToEvaluate == NULL) {
                         continue;
@@ -959,9 +5454,17 @@ void evaluateModelByMAPAndPat10(const char option[]) {
                 return;
             }
         } else if (strcmp(option, "2") == 0) {
-            char* query = getImageWord(filename);
+            char* query = getImageWord(filename, MEMORY_QUERY);
+
+            double begin = getWallClockSeconds();
+
+            resultsToEvaluate = searchForEvaluation(query, resultsToEvaluate, budget, &truncatedQueries);
+
+            searchTimeSpent += getWallClockSeconds() - begin;
 
-            resultsToEvaluate = searchByVectorModel(query, false, resultsToEvaluate);
+            trackedFree(MEMORY_QUERY, query);
+
+            numOfQueries++;
 
             if (resultsToEvaluate == NULL) {
                 continue;
@@ -973,60 +5476,368 @@ void evaluateModelByMAPAndPat10(const char option[]) {
         }
     }
     
+    printScoringModel();
+    
     printf("\nP@10 for %d query(ies): " ANSI_COLOR_YELLOW "%lf" ANSI_COLOR_RESET, NUMBER_OF_QUERIES_TO_EVAL,
            resultPAt10 / NUMBER_OF_QUERIES_TO_EVAL);
     printf("\nMAP for %d query(ies): " ANSI_COLOR_YELLOW "%lf" ANSI_COLOR_RESET, NUMBER_OF_QUERIES_TO_EVAL,
            resultMAP / NUMBER_OF_QUERIES_TO_EVAL);
     
+    if (numOfQueries > 0) {
+        printf("\nMean query latency: " ANSI_COLOR_YELLOW "%lf" ANSI_COLOR_RESET " ms for %d queries",
+               searchTimeSpent / numOfQueries * 1000, numOfQueries);
+    }
+    
+    if (budget != NULL) {
+        printf("\nTruncated queries: " ANSI_COLOR_YELLOW "%d" ANSI_COLOR_RESET, truncatedQueries);
+    }
+    
     printf("\n");
     
     free(resultsToEvaluate);
     free(relevants);
 }
 
+/*
+ * Report the analysis chain of the index together with its effect: the size of the vocabulary and the
+ * postings, and the latency, MAP and P@10 of the evaluation queries. Compare runs with different flags
+ */
+void reportAnalysisChain(const char option[]) {
+    long numOfTerms = 0;
+    long numOfPostings = 0;
+    long postingsSize = 0;
+    
+    int i;
+    
+    for (i = 0; i < NUM_OF_TERMS; i++) {
+        Term *term = currentIndex->vocabulary[i];
+        
+        for (; term != NULL; term = term->next) {
+            numOfTerms++;
+            
+            /* The coordinator of a sharded index has the terms, but not their postings */
+            if (term->postings != NULL) {
+                numOfPostings += term->postings->numOfPostings;
+                postingsSize += getCompressedPostingsSize(term->postings);
+            }
+        }
+    }
+    
+    printf("\nAnalysis chain: stopwords %s, stemming %s, max df ", REMOVE_STOPWORDS ? "on" : "off", STEM_TERMS ? "on" : "off");
+    
+    if (MAX_DOCUMENT_FREQUENCY > 0) {
+        printf("%lf (" ANSI_COLOR_YELLOW "%d" ANSI_COLOR_RESET " terms pruned)", MAX_DOCUMENT_FREQUENCY, currentIndex->numOfPrunedTerms);
+    } else {
+        printf("off");
+    }
+    
+    printScoringModel();
+    
+    if (currentIndex->numOfTokens > 0) {
+        printf("\nIndexed words: " ANSI_COLOR_YELLOW "%ld" ANSI_COLOR_RESET " (%ld dropped)",
+               currentIndex->numOfTokens - currentIndex->numOfDroppedTokens, currentIndex->numOfDroppedTokens);
+    }
+    
+    printf("\nVocabulary: " ANSI_COLOR_YELLOW "%ld" ANSI_COLOR_RESET " terms", numOfTerms);
+    
+    if (numOfPostings > 0) {
+        printf("\nPostings: " ANSI_COLOR_YELLOW "%ld" ANSI_COLOR_RESET " (%ld bytes)", numOfPostings, postingsSize);
+    }
+    
+    if (NEAR_DUPLICATE_SIMILARITY > 0) {
+        int numOfGroups = 0;
+        
+        for (i = 0; i < NUM_OF_DOCUMENTS; i++) {
+            numOfGroups += currentIndex->documents->entries[i] != NULL && currentIndex->documents->entries[i]->numOfDuplicates > 0;
+        }
+        
+        printf("\nNear-duplicates (similarity %.2lf): " ANSI_COLOR_YELLOW "%d" ANSI_COLOR_RESET " documents collapsed into %d groups, "
+               "%d documents indexed", NEAR_DUPLICATE_SIMILARITY, currentIndex->documents->numOfDuplicates, numOfGroups,
+               currentIndex->documents->numOfEntries - currentIndex->documents->numOfDuplicates);
+    }
+    
+    evaluateModelByMAPAndPat10(option, NULL);
+}
+
+/*
+ * Print the heap usage of each subsystem: live and peak bytes, allocations and frees (!u)
+ */
+void reportMemoryUsage() {
+    printf("\nMemory usage:\n" ANSI_BOLD_WHITE "%-16s %14s %14s %14s %14s" ANSI_COLOR_RESET, "Subsystem", "Live (KB)",
+           "Peak (KB)", "Allocations", "Frees");
+    
+    int i;
+    
+    for (i = 0; i < NUM_OF_MEMORY_SUBSYSTEMS; i++) {
+        MemoryUsage usage = getMemoryUsage(i);
+        
+        printf("\n%-16s " ANSI_COLOR_YELLOW "%14.1lf" ANSI_COLOR_RESET " %14.1lf %14ld %14ld", getMemorySubsystemName(i),
+               usage.liveBytes / 1024.0, usage.peakBytes / 1024.0, usage.numOfAllocations, usage.numOfFrees);
+    }
+    
+    MemoryUsage total = getTotalMemoryUsage();
+    
+    printf("\n%-16s " ANSI_COLOR_YELLOW "%14.1lf" ANSI_COLOR_RESET " %14.1lf %14ld %14ld\n", "total",
+           total.liveBytes / 1024.0, total.peakBytes / 1024.0, total.numOfAllocations, total.numOfFrees);
+}
+
+/*
+ * Check that no tracked memory outlives the index (--leak-check): it must be called once the index, the
+ * cursors and the query state are released. Returns false, reporting the subsystems with live blocks, if
+ * any memory leaked
+ */
+bool checkMemoryLeaks() {
+    bool hasLeaks = false;
+    
+    int i;
+    
+    for (i = 0; i < NUM_OF_MEMORY_SUBSYSTEMS; i++) {
+        MemoryUsage usage = getMemoryUsage(i);
+        
+        if (usage.liveBytes != 0 || usage.numOfAllocations != usage.numOfFrees) {
+            fprintf(stderr, ANSI_COLOR_RED "Leak check: %s has %ld bytes in %ld blocks still allocated\n" ANSI_COLOR_RESET,
+                    getMemorySubsystemName(i), usage.liveBytes, usage.numOfAllocations - usage.numOfFrees);
+            
+            hasLeaks = true;
+        }
+    }
+    
+    if (!hasLeaks) {
+        printf(ANSI_BOLD_WHITE "[" ANSI_COLOR_GREEN " DONE " ANSI_COLOR_RESET ANSI_BOLD_WHITE "]" ANSI_COLOR_RESET
+               " - Leak check: no memory outlived the index\n");
+    }
+    
+    return !hasLeaks;
+}
+
+/**
+ * Evaluate the MAP and P@10 of the impact-ordered search at increasing postings budgets, so the
+ * quality cost of each budget can be compared with the exhaustive search (!m)
+ */
+void evaluateModelAtSearchBudgets(const char option[]) {
+    long maxPostings[] = { 1000, 5000, 20000, 100000, 0 };
+    
+    int numOfBudgets = sizeof(maxPostings) / sizeof(maxPostings[0]);
+    
+    int i;
+    
+    for (i = 0; i < numOfBudgets; i++) {
+        SearchBudget budget = { maxPostings[i], 0, 0, false };
+        
+        if (maxPostings[i] == 0) {
+            printf("\n" ANSI_BOLD_WHITE "Budget: unlimited postings" ANSI_COLOR_RESET);
+        } else {
+            printf("\n" ANSI_BOLD_WHITE "Budget: %ld postings" ANSI_COLOR_RESET, maxPostings[i]);
+        }
+        
+        evaluateModelByMAPAndPat10(option, &budget);
+    }
+}
+
 int main(int argc, char **argv) {
     if (argc < 2) {
         printf("\nsearch-engine USAGE:");
         printf("\n");
-        printf("\n%s <option>", argv[0]);
+        printf("\n%s <option> [flags]", argv[0]);
         printf("\nwhere <option> values are:");
         printf("\n1 - Text searching");
         printf("\n2 - Image searching");
+        printf("\n3 - Text and image searching in one process, with hybrid queries");
+        printf("\nand [flags] values are:");
+        printf("\n--compress-postings - Bit-pack the doc-ordered postings");
+        printf("\n--positions - Index the positions of the terms, for phrase queries");
+        printf("\n--workers <n> - Number of threads scoring the long queries (default: one per processor, 1 disables them)");
+        printf("\n--parallel-cost <postings> - Min number of postings of a query scored by the workers (default: %ld)", PARALLEL_QUERY_COST);
+        printf("\n--shards <n> - Split the index in n shard processes queried by this one (default: 1)");
+        printf("\n--dataset <path> - Index this XML file (text) or folder (image) instead of the default dataset");
+        printf("\n--stopwords - Drop the Portuguese stopwords from the documents and the queries (text only)");
+        printf("\n--stemming - Reduce the terms to their Portuguese stems (text only)");
+        printf("\n--max-df <ratio> - Prune the terms found in more than this share of the documents (e.g. 0.5)");
+        printf("\n--scoring <cosine|bm25> - Scoring model of the text index (default: cosine)");
+        printf("\n--bm25-k1 <k1> - Saturation of the tf of the BM25 model (default: %.1lf)", BM25_DEFAULT_K1);
+        printf("\n--bm25-b <b> - Length normalization of the BM25 model, from 0 to 1 (default: %.2lf)", BM25_DEFAULT_B);
+        printf("\n--near-duplicates <similarity> - Index only the first product of each group of descriptions this similar (e.g. 0.8)");
+        printf("\n--image-dataset <folder> - Index the images of this folder with the text (option 3)");
+        printf("\n--text-weight <weight> - Weight of the text in the score of the hybrid queries (default: %.1lf)", HYBRID_TEXT_WEIGHT);
+        printf("\n--quantize-images <pq|int8> - Score the images by vectors quantized to a few bytes instead of their postings");
+        printf("\n--pq-subspaces <n> - Bytes per image of the product quantization (default: %d)", PQ_SUBSPACES);
+        printf("\n--rerank <n> - Quantized candidates scored again by their exact vectors, 0 keeps none (default: %d)", RERANK_CANDIDATES);
+        printf("\n--leak-check - Release the index at exit and fail if any accounted memory is still allocated");
         printf("\n\n");
 
         return EXIT_FAILURE;
     }
 
-    char *message = "";
-    
-    int result = 0;
+    int i;
 
-    if(strcmp(argv[1], "1") == 0) {
-        message = "Please, input the text to search";
+    for (i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--compress-postings") == 0) {
+            COMPRESS_POSTINGS = true;
+        } else if (strcmp(argv[i], "--positions") == 0) {
+            POSITIONAL_INDEX = true;
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            SEARCH_WORKERS = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--parallel-cost") == 0 && i + 1 < argc) {
+            PARALLEL_QUERY_COST = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--dataset") == 0 && i + 1 < argc) {
+            DATASET_PATH = argv[++i];
+        } else if (strcmp(argv[i], "--stopwords") == 0) {
+            REMOVE_STOPWORDS = true;
+        } else if (strcmp(argv[i], "--stemming") == 0) {
+            STEM_TERMS = true;
+        } else if (strcmp(argv[i], "--max-df") == 0 && i + 1 < argc) {
+            MAX_DOCUMENT_FREQUENCY = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--scoring") == 0 && i + 1 < argc) {
+            i++;
+
+            if (!parseScoringModel(argv[i], &TEXT_SCORING_MODEL)) {
+                fprintf(stderr, "Unknown scoring model %s (cosine or bm25)\n", argv[i]);
+
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--bm25-k1") == 0 && i + 1 < argc) {
+            BM25_K1 = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--bm25-b") == 0 && i + 1 < argc) {
+            BM25_B = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--near-duplicates") == 0 && i + 1 < argc) {
+            NEAR_DUPLICATE_SIMILARITY = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--image-dataset") == 0 && i + 1 < argc) {
+            IMAGE_DATASET_PATH = argv[++i];
+        } else if (strcmp(argv[i], "--text-weight") == 0 && i + 1 < argc) {
+            HYBRID_TEXT_WEIGHT = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--quantize-images") == 0 && i + 1 < argc) {
+            i++;
+
+            if (strcmp(argv[i], "pq") == 0) {
+                IMAGE_QUANTIZATION = QUANTIZATION_PQ;
+            } else if (strcmp(argv[i], "int8") == 0) {
+                IMAGE_QUANTIZATION = QUANTIZATION_INT8;
+            } else {
+                fprintf(stderr, "Unknown quantization %s (pq or int8)\n", argv[i]);
+
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--pq-subspaces") == 0 && i + 1 < argc) {
+            PQ_SUBSPACES = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rerank") == 0 && i + 1 < argc) {
+            RERANK_CANDIDATES = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--leak-check") == 0) {
+            LEAK_CHECK = true;
+        } else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            NUM_OF_SHARDS = atoi(argv[++i]);
+
+            if (NUM_OF_SHARDS < 1 || NUM_OF_SHARDS > MAX_SHARDS) {
+                fprintf(stderr, "The number of shards must be between 1 and %d\n", MAX_SHARDS);
+
+                return EXIT_FAILURE;
+            }
+        } else {
+            fprintf(stderr, "Unknown flag %s\n", argv[i]);
+
+            return EXIT_FAILURE;
+        }
+    }
 
-        DESCRIPTION_SIZE = 1000;
-        TERM_SIZE = 50;
+    /* The option 3 serves the text and the image indexes on one document table. Its commands run on the text
+     index, except the image searches (!i) and the hybrid queries (!h) */
+    bool isHybrid = strcmp(argv[1], "3") == 0;
 
-        result = processXMLData("../dataset/textDescDafitiPosthaus.xml");
+    const char *option = isHybrid ? "1" : argv[1];
+
+    IndexKind primaryKind = strcmp(option, "2") == 0 ? INDEX_IMAGE : INDEX_TEXT;
+
+    if (isHybrid && NUM_OF_SHARDS > 1) {
+        fprintf(stderr, "The text and image indexes of the option 3 can't be sharded\n");
+
+        return EXIT_FAILURE;
+    }
+
+    /* The words of an image are its histogram, not Portuguese */
+    if (strcmp(argv[1], "2") == 0 && (REMOVE_STOPWORDS || STEM_TERMS)) {
+        fprintf(stderr, "The stopwords and the stemming only apply to text searching, ignoring them\n");
+        
+        REMOVE_STOPWORDS = false;
+        STEM_TERMS = false;
+    }
+
+    /* The shards are forked before indexing, so each process only indexes its own documents */
+    bool isCoordinator = NUM_OF_SHARDS > 1 && !startShards(NUM_OF_SHARDS);
+
+    char *message = "";
+    
+    if (isHybrid) {
+        message = "Please, input the text to search (" ANSI_COLOR_YELLOW "!i <image path>" ANSI_COLOR_RESET " for an image, "
+            ANSI_COLOR_YELLOW "!h <image path> <text>" ANSI_COLOR_RESET " for both)";
+    } else if(strcmp(argv[1], "1") == 0) {
+        message = "Please, input the text to search";
     } else if (strcmp(argv[1], "2") == 0) {
         message = "Please, input the image path to search";
+    }
 
-        DESCRIPTION_SIZE = 863 * 1296;
-        TERM_SIZE = 863;
+    IndexSnapshot *snapshots[NUM_OF_INDEX_KINDS] = { NULL };
 
-        result = processImageDataOnFolder("../dataset/images/colecaoDafitiPosthaus/");
-    }
+    if (isCoordinator) {
+        currentIndex = createIndexSnapshot(primaryKind, NULL);
 
-    if (result == EXIT_FAILURE) {
+        snapshots[primaryKind] = currentIndex;
+
+        if (mergeDocumentFrequencies() == EXIT_FAILURE) {
+            return EXIT_FAILURE;
+        }
+    } else if (!buildIndexSnapshots(argv[1], snapshots)) {
         return EXIT_FAILURE;
     }
 
+    publishIndexSnapshots(snapshots);
+
+    accumulators = createAccumulators(NUM_OF_DOCUMENTS);
+
+    if (isHybrid) {
+        hybridAccumulators = createAccumulators(NUM_OF_DOCUMENTS);
+    }
+
+    if (SEARCH_WORKERS <= 0) {
+        SEARCH_WORKERS = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    if (!isCoordinator) {
+        createSearchWorkers(SEARCH_WORKERS);
+    }
+
+    if (SHARD_ID >= 0) {
+        serveShardQueries(strcmp(argv[1], "1") == 0);
+
+        freeSearchWorkers();
+
+        return EXIT_SUCCESS;
+    }
+
+    reportMemoryUsage();
+
     char query[QUERY_SIZE] = { 0 };
 
+    /* Budget of the impact-ordered search, set by '!b <postings> [milliseconds]'. No budget means exhaustive search */
+    SearchBudget sessionBudget = { 0, 0, 0, false };
+
+    bool hasBudget = false;
+
+    fflush(stdout); /* Ensure that a program reading the output through a pipe (scale-test) sees the index is ready */
+
     while (true) {
         
         printf("\n%s," ANSI_COLOR_YELLOW " !m " 
-            ANSI_COLOR_RESET "for model mestrics and " ANSI_COLOR_RED "!q" 
+            ANSI_COLOR_RESET "for model mestrics, " ANSI_COLOR_YELLOW "!mb " 
+            ANSI_COLOR_RESET "for model metrics per search budget, " ANSI_COLOR_YELLOW "!a "
+            ANSI_COLOR_RESET "for analysis chain stats, " ANSI_COLOR_YELLOW "!b <postings> [ms] "
+            ANSI_COLOR_RESET "to set the search budget, " ANSI_COLOR_YELLOW "!c "
+            ANSI_COLOR_RESET "for postings compression stats, " ANSI_COLOR_YELLOW "!p <query> "
+            ANSI_COLOR_RESET "to profile a query, " ANSI_COLOR_YELLOW "!n <cursor> "
+            ANSI_COLOR_RESET "for the next page of a search, " ANSI_COLOR_YELLOW "!s <prefix> "
+            ANSI_COLOR_RESET "for term suggestions, " ANSI_COLOR_YELLOW "!u "
+            ANSI_COLOR_RESET "for memory usage, " ANSI_COLOR_YELLOW "!v "
+            ANSI_COLOR_RESET "for image vectors stats, " ANSI_COLOR_YELLOW "!l <log> [clients] [qps] [queries] "
+            ANSI_COLOR_RESET "to replay a query log, " ANSI_COLOR_YELLOW "!r "
+            ANSI_COLOR_RESET "to reload the index and " ANSI_COLOR_RED "!q" 
             ANSI_COLOR_RESET " to exit: ", message);
         
         fgets(query, sizeof(query), stdin);
@@ -1037,28 +5848,145 @@ int main(int argc, char **argv) {
             break;
         }
         
+        /* The command runs on the snapshot published now, even if a reload publishes another one meanwhile */
+        currentIndex = acquireIndexSnapshot(primaryKind);
+        
         if (strcmp(query, "!m") == 0) {
             clock_t begin, end;
             
             begin = clock();
             
-            evaluateModelByMAPAndPat10(argv[1]);
+            evaluateModelByMAPAndPat10(option, NULL);
             
             end = clock();
 
             double searchTimeSpent = (double)(end - begin) / CLOCKS_PER_SEC;
             
             printf("\nTime spent: %lf seconds", searchTimeSpent);
+        } else if (strcmp(query, "!mb") == 0) {
+            evaluateModelAtSearchBudgets(option);
+        } else if (strcmp(query, "!a") == 0) {
+            reportAnalysisChain(option);
+        } else if (strcmp(query, "!u") == 0) {
+            reportMemoryUsage();
+        } else if (strcmp(query, "!r") == 0) {
+            if (isCoordinator) {
+                printf("\nThe index of a sharded deployment is built by the shards at startup");
+            } else {
+                startIndexReload(argv[1]);
+            }
+        } else if (strcmp(query, "!c") == 0) {
+            if (isCoordinator) {
+                printf("\nThe postings are kept by the shards");
+            } else {
+                reportPostingsCompression();
+                reportTermDictionary();
+                reportTermSuggestions();
+            }
+        } else if (strcmp(query, "!v") == 0 && (isHybrid || primaryKind == INDEX_IMAGE)) {
+            IndexSnapshot *primaryIndex = currentIndex;
+
+            if (isHybrid) {
+                currentIndex = acquireIndexSnapshot(INDEX_IMAGE);
+            }
+
+            reportImageVectors();
+
+            if (isHybrid) {
+                releaseIndexSnapshot(currentIndex);
+
+                currentIndex = primaryIndex;
+            }
+        } else if (strncmp(query, "!p ", 3) == 0) {
+            if (strcmp(option, "2") == 0) {
+                char *word = getImageWord(query + 3, MEMORY_QUERY);
+
+                profileQuery(word, hasBudget ? &sessionBudget : NULL, false);
+
+                trackedFree(MEMORY_QUERY, word);
+            } else {
+                profileQuery(query + 3, hasBudget ? &sessionBudget : NULL, true);
+            }
+        } else if (strncmp(query, "!l ", 3) == 0) {
+            replayQueryLog(query + 3, strcmp(option, "1") == 0, hasBudget ? &sessionBudget : NULL);
+        } else if (isHybrid && strncmp(query, "!h ", 3) == 0) {
+            searchHybridQuery(query + 3);
+        } else if (isHybrid && strncmp(query, "!i ", 3) == 0) {
+            IndexSnapshot *textIndex = currentIndex;
+
+            currentIndex = acquireIndexSnapshot(INDEX_IMAGE);
+
+            char *word = getImageWord(query + 3, MEMORY_QUERY);
+
+            searchQuery(word, false, true, NULL, hasBudget ? &sessionBudget : NULL);
+
+            trackedFree(MEMORY_QUERY, word);
+
+            releaseIndexSnapshot(currentIndex);
+
+            currentIndex = textIndex;
+        } else if (strcmp(query, "!n") == 0 || strncmp(query, "!n ", 3) == 0) {
+            printSearchCursorPage(query + 2);
+        } else if (strncmp(query, "!s ", 3) == 0) {
+            printTermSuggestions(query + 3);
+        } else if (strncmp(query, "!b ", 3) == 0) {
+            double milliseconds = 0;
+
+            sessionBudget.maxPostings = 0;
+
+            sscanf(query + 3, "%ld %lf", &sessionBudget.maxPostings, &milliseconds);
+
+            sessionBudget.maxSeconds = milliseconds / 1000;
+
+            hasBudget = sessionBudget.maxPostings > 0 || sessionBudget.maxSeconds > 0;
+
+            printf("\nSearch budget: %ld postings, %lf ms%s", sessionBudget.maxPostings, milliseconds,
+                   hasBudget ? "" : " (exhaustive search)");
         } else {
-            if(strcmp(argv[1], "1") == 0) {
-                searchByVectorModel(query, true, NULL);
-            } else if (strcmp(argv[1], "2") == 0) {
-                char* word = getImageWord(query);
+            char *word = query;
+
+            if (strcmp(option, "2") == 0) {
+                word = getImageWord(query, MEMORY_QUERY);
+            }
+
+            if (isCoordinator) {
+                searchShards(word, true, NULL, hasBudget ? &sessionBudget : NULL);
+            } else {
+                searchQuery(word, strcmp(option, "1") == 0, true, NULL, hasBudget ? &sessionBudget : NULL);
+            }
 
-                searchByVectorModel(word, true, NULL);
+            if (word != query) {
+                trackedFree(MEMORY_QUERY, word);
             }
         }
+
+        releaseIndexSnapshot(currentIndex);
+
+        currentIndex = NULL;
     }
 
-    return EXIT_SUCCESS;
+    if (isCoordinator) {
+        stopShards();
+    }
+
+    freeSearchCursors();
+
+    freeSearchWorkers();
+
+    freeAccumulators(accumulators);
+
+    freeAccumulators(hybridAccumulators);
+
+    if (!LEAK_CHECK) {
+        return EXIT_SUCCESS;
+    }
+
+    /* A background reload still holds its snapshot until it is published */
+    while (atomic_load(&isReloadingIndex)) {
+        usleep(10000);
+    }
+
+    unpublishIndexSnapshots();
+
+    return checkMemoryLeaks() ? EXIT_SUCCESS : EXIT_FAILURE;
 }
\ No newline at end of file
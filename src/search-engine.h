@@ -1,15 +1,59 @@
-/* Size of the collection of documents */
+#include <stdatomic.h>
+
+#include "posting-codec.h"
+#include "doc-bitmap.h"
+#include "accumulators.h"
+#include "perf-counters.h"
+#include "worker-pool.h"
+#include "shard-message.h"
+#include "term-dictionary.h"
+#include "term-suggestions.h"
+#include "term-analysis.h"
+#include "memory-accounting.h"
+#include "latency-histogram.h"
+#include "vector-store.h"
+#include "near-duplicates.h"
+#include "scoring-model.h"
+
+/* Size of the collection of documents. Scale tests build with a larger one (-DNUM_OF_DOCUMENTS=...) */
+#ifndef NUM_OF_DOCUMENTS
 #define NUM_OF_DOCUMENTS 23155
+#endif
 /* Number of terms that should be indexed */
+#ifndef NUM_OF_TERMS
 #define NUM_OF_TERMS NUM_OF_DOCUMENTS * 1296
+#endif
 /* Size of the user query */
 #define QUERY_SIZE 863 * 1296
+/* Number of times a query is executed by the profiler (!p) */
+#define PROFILE_RUNS 100
 /* Max size of the search result */
 #define MAX_SEARCH_RESULT 10
+/* Ids of near-duplicates printed after a result of their group */
+#define MAX_PRINTED_DUPLICATES 3
+/* Max number of ranked results kept by a search cursor, so the pages past the first one need no new search */
+#define MAX_CURSOR_RESULTS 1000
+/* Max number of search cursors alive at once. A new cursor replaces the least recently used one */
+#define MAX_SEARCH_CURSORS 32
+/* Seconds a search cursor lives without being used */
+#define SEARCH_CURSOR_TTL 300
 /* Size of the document name */
 #define DOCUMENT_NAME_SIZE 90
+/* Max number of distinct product categories */
+#define MAX_CATEGORIES 1024
+/* Max number of shards of a sharded index */
+#define MAX_SHARDS 64
 /* Number of queries to be evaluated */
 #define NUMBER_OF_QUERIES_TO_EVAL 50 // 50 is the maximum value considering the given evaluated results
+/* Number of postings per block in the impact-ordered layout */
+#define IMPACT_BLOCK_SIZE 64
+/* Max number of terms and clauses of a boolean query */
+#define MAX_QUERY_TERMS 64
+#define MAX_QUERY_CLAUSES 32
+/* Number of results of each index merged by a hybrid query */
+#define HYBRID_CANDIDATES 1000
+/* Max number of clients of a query log replay */
+#define MAX_REPLAY_CLIENTS 256
 
 /* Just for printf colors purposes */
 #define ANSI_COLOR_RED     "\x1b[31m"
@@ -35,16 +79,36 @@ typedef struct Product {
 typedef struct Entry {
     char *documentId;
     char *documentName;
-    double magnitude; /* vector magnitude without sqrt()*/
-    double sum; /* accumulator (wi,j) */
+    char *title;
+    int categoryId; /* position in the 'categories' collection, -1 if the product has no category */
+    double price; /* -1 if the product has no price */
+    /* Near-duplicate groups (--near-duplicates): only the first product of a group is indexed, and the others
+     are linked to it */
+    int duplicateOf; /* position of the indexed entry of the group, -1 if this entry is indexed */
+    int nextDuplicate; /* position of the next entry of the group, -1 for the last one */
+    int numOfDuplicates; /* entries linked to this indexed one */
 } Entry;
 
+/* This struct represents a product category and the bitmap of its documents */
+typedef struct Category {
+    char *name;
+    char *key; /* lower case name with '_' instead of spaces, as typed in 'categoria:' filters */
+    DocBitmap *documents; /* positions in the 'entries' collection */
+} Category;
+
+/* This struct represents an entry of the price column, sorted by price */
+typedef struct PriceEntry {
+    double price;
+    int position; /* position in the 'entries' collection */
+} PriceEntry;
+
 /* This struct represents the documents of the collection */
 typedef struct Document {
     const char *id;
     const char *name;
     const char *term;
     int tf; /* term frequency. The variable is named as 'tf' because the literature refers as it */
+    int *positions; /* positions of the term in the document (tf values), only kept for the positional index */
     struct Document *next;
 } Document;
 
@@ -53,11 +117,217 @@ typedef struct Term {
     const char *name;
     int totalNumOfOccurrences;
     int totalNumOfDocuments;
+    int collectionNumOfDocuments; /* df in the whole collection when the index is a shard, 0 otherwise */
     double idf;
     struct Term *next;
     struct Document *document;
+    /* Impact-ordered layout: postings sorted by decreasing impact (posting weight of the scoring model) and
+     split into blocks of IMPACT_BLOCK_SIZE, so the first posting of a block holds its max impact */
+    int *impactPositions; /* positions of the documents in the 'entries' collection */
+    double *impacts;
+    /* Doc-ordered layout: postings sorted by position in the 'entries' collection, in compressed blocks */
+    CompressedPostings *postings;
+    /* Positional section: positions of the term for each doc-ordered posting, NULL without the positional index */
+    PositionalPostings *positions;
 } Term;
 
+/* This struct represents a posting while the impact-ordered and doc-ordered layouts are generated */
+typedef struct ImpactPosting {
+    int position; /* position of the document in the 'entries' collection */
+    int tf;
+    double impact;
+    const int *positions;
+} ImpactPosting;
+
+/* This struct represents the next block of a query term to be scored by an impact-ordered search */
+typedef struct ImpactCursor {
+    Term *term;
+    double queryWeight; /* query tf, multiplied by the idf for the cossene */
+    int offset; /* first posting of the next block */
+} ImpactCursor;
+
+/* How a clause of a boolean query must occur in the matching documents */
+typedef enum ClauseOccur {
+    CLAUSE_SHOULD, /* term */
+    CLAUSE_MUST, /* +term */
+    CLAUSE_MUST_NOT /* -term */
+} ClauseOccur;
+
+/* This struct represents a term of a boolean query and its position in the term postings */
+typedef struct QueryTerm {
+    Term *term;
+    double queryWeight; /* idf * query tf, 0 if the term is not scored (excluded or repeated) */
+    PostingCursor cursor;
+} QueryTerm;
+
+/* This struct represents a clause of a boolean query: a term, a grouped OR of terms, as in '+(longo midi)', or a phrase */
+typedef struct QueryClause {
+    ClauseOccur occur;
+    int firstTerm; /* position of the first term of the clause in the query terms */
+    int numOfTerms;
+    bool isPhrase; /* the terms must occur in this order, as in '"manga longa"~1' */
+    int slop; /* max number of other words between two consecutive terms of a phrase */
+    bool hasMissingTerm; /* a term of the phrase was not indexed, so the clause matches nothing */
+    long cost; /* postings of the clause terms (of its rarest term for a phrase), so the rarest clause leads the intersection */
+    int docId; /* smallest current doc id of the clause terms, or -1 after the last posting */
+} QueryClause;
+
+/* This struct represents a parsed boolean query */
+typedef struct BooleanQuery {
+    int numOfTerms;
+    QueryTerm terms[MAX_QUERY_TERMS];
+    int numOfClauses;
+    QueryClause clauses[MAX_QUERY_CLAUSES];
+    bool hasMissingRequiredClause; /* a required clause has no indexed term, so nothing matches */
+} BooleanQuery;
+
+/* Kinds of index served by a process: the text of the descriptions and the histograms of the images */
+typedef enum IndexKind {
+    INDEX_TEXT,
+    INDEX_IMAGE,
+    NUM_OF_INDEX_KINDS
+} IndexKind;
+
+/* This struct represents the documents of the indexes built together (text and image), so their postings
+ refer to the same positions and the product metadata is kept once. It is released with its last index */
+typedef struct DocumentTable {
+    atomic_int references; /* indexes using the table */
+    Entry **entries; /* NUM_OF_DOCUMENTS positions */
+    int numOfEntries;
+    Category categories[MAX_CATEGORIES];
+    int numOfCategories;
+    PriceEntry *prices; /* price column: the documents with a price, sorted by price */
+    int numOfPrices;
+    int numOfDuplicates; /* entries collapsed into the group of a near-duplicate, without postings */
+} DocumentTable;
+
+/* This struct represents an immutable version of an index. Each command holds a reference to the snapshot
+ published when it started, so a new snapshot can be built and published while it runs, and the old one is
+ released when its last reader leaves */
+typedef struct IndexSnapshot {
+    long version;
+    atomic_int references; /* readers plus one while the snapshot is published */
+    IndexKind kind;
+    DocumentTable *documents; /* shared with the other indexes built with this one */
+    Term **vocabulary; /* NUM_OF_TERMS hash positions */
+    float *inverseNorms; /* factor of the score of each document: 1 / sqrt(magnitude) for the cossene, so it is a
+     multiplication, and 1 for BM25, whose postings are already normalized by the length of the document */
+    ScoringStatistics scoring; /* scoring model of the index, with the document lengths it needs */
+    /* Frozen vocabulary: minimal perfect hash dictionary of the term names, built once the index is complete.
+     NULL while the snapshot is built, so the lookups walk the 'vocabulary' chains meanwhile */
+    TermDictionary *dictionary;
+    Term **dictionaryTerms; /* term of each dictionary slot */
+    TermSuggestions *suggestions; /* trie of the term names weighted by df, for the prefix completions */
+    VectorStore *vectors; /* quantized vectors of the documents of an image index (--quantize-images), or NULL */
+    Term *prunedTerms; /* terms above the max df (--max-df), linked by 'next' and without postings */
+    int numOfPrunedTerms;
+    long numOfTokens; /* words of the indexed descriptions */
+    long numOfDroppedTokens; /* words dropped by the analysis chain (stopwords) */
+} IndexSnapshot;
+
+/* This struct represents a term of a vector model query */
+typedef struct WeightedTerm {
+    Term *term;
+    double queryWeight; /* query tf, multiplied by the idf for the cossene */
+} WeightedTerm;
+
+/* This struct represents a parsed vector model query */
+typedef struct VectorQuery {
+    int numOfTerms;
+    WeightedTerm *terms; /* one per query word found in the vocabulary, in the query order */
+    long cost; /* number of postings of the query terms */
+    const DocBitmap *filter; /* NULL if the query has no filter */
+    const IndexSnapshot *index; /* snapshot of the terms, shared with the search workers */
+} VectorQuery;
+
+/* This struct represents the share of a parallel query scored by a worker: a range of positions of the 'entries' collection */
+typedef struct QueryPartition {
+    int firstPosition;
+    int lastPosition; /* exclusive */
+    Accumulators *accumulators; /* indexed by position - firstPosition */
+    int numOfResults;
+    int topPositions[MAX_SEARCH_RESULT];
+    float topScores[MAX_SEARCH_RESULT];
+} QueryPartition;
+
+/* This struct represents the first page of results of the last search, with their cossenes */
+typedef struct SearchResultPage {
+    int countResult;
+    int countSearchResult; /* number of documents scored by the search */
+    Entry *entries[MAX_SEARCH_RESULT];
+    double scores[MAX_SEARCH_RESULT];
+} SearchResultPage;
+
+/* This struct represents the ranked results of a search, kept so its following pages are served without
+ scoring the query again (!n) */
+typedef struct SearchCursor {
+    uint64_t id; /* opaque to the user, 0 for a free cursor */
+    double lastUseSeconds;
+    IndexSnapshot *index; /* referenced by the cursor, so all its pages come from the snapshot searched */
+    char *query;
+    int countSearchResult;
+    int numOfResults;
+    int positions[MAX_CURSOR_RESULTS]; /* positions in the 'entries' collection, in decreasing order of cossene */
+    float scores[MAX_CURSOR_RESULTS];
+} SearchCursor;
+
+/* This struct represents a result received from a shard, before the results of all the shards are merged */
+typedef struct ShardResult {
+    char *documentId;
+    char *documentName;
+    double score;
+    int position; /* of the document in the 'entries' collection, to break the ties like a single index */
+} ShardResult;
+
+/* This struct limits the work done by an anytime (impact-ordered) search */
+typedef struct SearchBudget {
+    long maxPostings; /* 0 means no limit */
+    double maxSeconds; /* 0 means no limit */
+    long evaluatedPostings; /* output: number of postings scored by the search */
+    bool truncated; /* output: the budget ran out before all the postings were scored */
+} SearchBudget;
+
+/* This struct represents the retrieval of the candidates of one index for a hybrid query (!h). The retrievals
+ of the text and the image indexes run at the same time, each one on its own thread */
+typedef struct HybridRetrieval {
+    IndexSnapshot *index;
+    char *query; /* tokenized in place */
+    const DocBitmap *filter; /* NULL if the query has no filter */
+    int numOfCandidates;
+    int positions[HYBRID_CANDIDATES]; /* in decreasing order of cossene */
+    float scores[HYBRID_CANDIDATES];
+    int countSearchResult; /* number of documents scored */
+    double seconds;
+} HybridRetrieval;
+
+/* This struct represents a candidate of a hybrid query with its cossenes in both indexes */
+typedef struct HybridCandidate {
+    int position; /* position in the 'entries' collection shared by the indexes */
+    float textScore; /* divided by the best text cossene, 0 if the document is not a text candidate */
+    float imageScore; /* divided by the best image cossene, 0 if the document is not an image candidate */
+    double score; /* weighted sum of both */
+} HybridCandidate;
+
+/* This struct represents a client of a query log replay (!l). The client i sends the queries i, i + numOfClients...
+ of the replay, each one as soon as the previous one is answered (closed loop) or at its scheduled time (open loop) */
+typedef struct ReplayClient {
+    pthread_t thread;
+    int id;
+    int numOfClients;
+    char **queries; /* the log, shared by the clients and replayed from its start when it runs out */
+    int numOfLogQueries;
+    int maxQueryLength;
+    long numOfQueries; /* number of queries of the replay, of all the clients */
+    double startSeconds;
+    double queryInterval; /* seconds between two queries of the whole replay in open loop, 0 for closed loop */
+    bool isText;
+    SearchBudget *budget; /* NULL for the exhaustive search */
+    IndexSnapshot *index; /* snapshot searched by the whole replay */
+    LatencyHistogram *latencies; /* from the send of each query to its answer */
+    LatencyHistogram *correctedLatencies; /* from the scheduled send, so the wait behind a slow query is counted */
+    int numOfLateQueries; /* open loop: queries sent after their scheduled time */
+} ReplayClient;
+
 /*
  * Generate the inverted index processing a XML file
  */
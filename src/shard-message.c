@@ -0,0 +1,213 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "shard-message.h"
+
+/*
+ * Create an empty message of a type
+ */
+ShardMessage *createShardMessage(ShardMessageType type) {
+    ShardMessage *message = malloc(sizeof(ShardMessage));
+
+    message->type = type;
+    message->data = NULL;
+    message->size = 0;
+    message->capacity = 0;
+    message->offset = 0;
+
+    return message;
+}
+
+/*
+ * Release the memory of a message
+ */
+void freeShardMessage(ShardMessage *message) {
+    if (message == NULL) {
+        return;
+    }
+
+    free(message->data);
+    free(message);
+}
+
+/*
+ * Append raw bytes to the end of a message
+ */
+void appendShardMessageBytes(ShardMessage *message, const void *bytes, int size) {
+    if (message->size + size > message->capacity) {
+        while (message->size + size > message->capacity) {
+            message->capacity = message->capacity == 0 ? 256 : message->capacity * 2;
+        }
+
+        message->data = realloc(message->data, message->capacity);
+    }
+
+    memcpy(message->data + message->size, bytes, size);
+
+    message->size += size;
+}
+
+/*
+ * Read the next raw bytes of a message. Past the end of the message the bytes are zeros
+ */
+void readShardMessageBytes(ShardMessage *message, void *bytes, int size) {
+    if (message->offset + size > message->size) {
+        memset(bytes, 0, size);
+
+        message->offset = message->size;
+
+        return;
+    }
+
+    memcpy(bytes, message->data + message->offset, size);
+
+    message->offset += size;
+}
+
+void appendShardMessageInt(ShardMessage *message, int value) {
+    appendShardMessageBytes(message, &value, sizeof(int));
+}
+
+void appendShardMessageLong(ShardMessage *message, long value) {
+    appendShardMessageBytes(message, &value, sizeof(long));
+}
+
+void appendShardMessageDouble(ShardMessage *message, double value) {
+    appendShardMessageBytes(message, &value, sizeof(double));
+}
+
+/*
+ * Strings are written with their '\0', so they can be read in place
+ */
+void appendShardMessageString(ShardMessage *message, const char value[]) {
+    int length = strlen(value) + 1;
+
+    appendShardMessageInt(message, length);
+    appendShardMessageBytes(message, value, length);
+}
+
+int readShardMessageInt(ShardMessage *message) {
+    int value;
+
+    readShardMessageBytes(message, &value, sizeof(int));
+
+    return value;
+}
+
+long readShardMessageLong(ShardMessage *message) {
+    long value;
+
+    readShardMessageBytes(message, &value, sizeof(long));
+
+    return value;
+}
+
+double readShardMessageDouble(ShardMessage *message) {
+    double value;
+
+    readShardMessageBytes(message, &value, sizeof(double));
+
+    return value;
+}
+
+const char *readShardMessageString(ShardMessage *message) {
+    int length = readShardMessageInt(message);
+
+    if (length <= 0 || message->offset + length > message->size || message->data[message->offset + length - 1] != '\0') {
+        message->offset = message->size;
+
+        return "";
+    }
+
+    const char *value = message->data + message->offset;
+
+    message->offset += length;
+
+    return value;
+}
+
+/*
+ * Write all the bytes of a buffer to a socket, retrying the partial writes. A closed peer fails the write
+ * instead of raising SIGPIPE
+ */
+bool writeFully(int socket, const void *buffer, int size) {
+    const char *bytes = buffer;
+
+    while (size > 0) {
+        ssize_t written = send(socket, bytes, size, MSG_NOSIGNAL);
+
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (written <= 0) {
+            return false;
+        }
+
+        bytes += written;
+        size -= written;
+    }
+
+    return true;
+}
+
+/*
+ * Read exactly 'size' bytes from a socket, retrying the partial reads
+ */
+bool readFully(int socket, void *buffer, int size) {
+    char *bytes = buffer;
+
+    while (size > 0) {
+        ssize_t numOfBytes = read(socket, bytes, size);
+
+        if (numOfBytes < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (numOfBytes <= 0) {
+            return false;
+        }
+
+        bytes += numOfBytes;
+        size -= numOfBytes;
+    }
+
+    return true;
+}
+
+/*
+ * Write a message to a socket. Returns false if the peer is gone
+ */
+bool sendShardMessage(int socket, const ShardMessage *message) {
+    int header[2] = { message->type, message->size };
+
+    return writeFully(socket, header, sizeof(header)) && writeFully(socket, message->data, message->size);
+}
+
+/*
+ * Read a message from a socket. Returns NULL if the peer is gone
+ */
+ShardMessage *receiveShardMessage(int socket) {
+    int header[2];
+
+    if (!readFully(socket, header, sizeof(header)) || header[1] < 0) {
+        return NULL;
+    }
+
+    ShardMessage *message = createShardMessage(header[0]);
+
+    message->data = malloc(header[1] > 0 ? header[1] : 1);
+    message->size = header[1];
+    message->capacity = header[1];
+
+    if (!readFully(socket, message->data, message->size)) {
+        freeShardMessage(message);
+
+        return NULL;
+    }
+
+    return message;
+}
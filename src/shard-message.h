@@ -0,0 +1,61 @@
+#ifndef SHARD_MESSAGE_H
+#define SHARD_MESSAGE_H
+
+#include <stdbool.h>
+
+/* Types of the messages exchanged between the coordinator and the shards */
+typedef enum ShardMessageType {
+    SHARD_DOCUMENT_FREQUENCIES, /* shard -> coordinator: its number of documents and the df of its terms */
+    SHARD_GLOBAL_FREQUENCIES, /* coordinator -> shard: the number of documents and the df of the same terms in the whole collection */
+    SHARD_READY, /* shard -> coordinator: its index is built and it serves the queries */
+    SHARD_QUERY, /* coordinator -> shard: a query and its search budget */
+    SHARD_RESULTS /* shard -> coordinator: the top results of the shard for the query */
+} ShardMessageType;
+
+/* This struct represents a message written or read field by field. On the socket a message is
+ its type and size (two ints) followed by the fields */
+typedef struct ShardMessage {
+    int type;
+    char *data;
+    int size;
+    int capacity;
+    int offset; /* next field to be read */
+} ShardMessage;
+
+/*
+ * Create an empty message of a type
+ */
+ShardMessage *createShardMessage(ShardMessageType type);
+
+/*
+ * Release the memory of a message
+ */
+void freeShardMessage(ShardMessage *message);
+
+/*
+ * Append a field to the end of a message
+ */
+void appendShardMessageInt(ShardMessage *message, int value);
+void appendShardMessageLong(ShardMessage *message, long value);
+void appendShardMessageDouble(ShardMessage *message, double value);
+void appendShardMessageString(ShardMessage *message, const char value[]);
+
+/*
+ * Read the next field of a message. The strings point to the message data
+ */
+int readShardMessageInt(ShardMessage *message);
+long readShardMessageLong(ShardMessage *message);
+double readShardMessageDouble(ShardMessage *message);
+const char *readShardMessageString(ShardMessage *message);
+
+/*
+ * Write a message to a socket. Returns false if the peer is gone
+ */
+bool sendShardMessage(int socket, const ShardMessage *message);
+
+/*
+ * Read a message from a socket. Returns NULL if the peer is gone
+ */
+ShardMessage *receiveShardMessage(int socket);
+
+#endif
@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "term-analysis.h"
+
+/* Portuguese stopwords, accent folded and sorted for the binary search. 'sem' is not a stopword: in a
+ product description it changes the meaning, as in 'sem manga' */
+const char *PORTUGUESE_STOPWORDS[] = {
+    "a", "ao", "aos", "aquela", "aquelas", "aquele", "aqueles", "aquilo", "as", "ate", "com", "como", "da", "das",
+    "de", "dela", "delas", "dele", "deles", "depois", "do", "dos", "e", "ela", "elas", "ele", "eles", "em",
+    "entre", "era", "essa", "essas", "esse", "esses", "esta", "estas", "este", "estes", "eu", "foi", "ha", "isso",
+    "isto", "ja", "la", "lhe", "lhes", "mais", "mas", "me", "mesmo", "meu", "meus", "minha", "minhas", "muito",
+    "na", "nas", "nem", "no", "nos", "nossa", "nossas", "nosso", "nossos", "num", "numa", "o", "os", "ou", "para",
+    "pela", "pelas", "pelo", "pelos", "por", "qual", "quando", "que", "quem", "se", "seu", "seus", "so", "sua",
+    "suas", "tambem", "te", "tem", "ter", "um", "uma", "umas", "uns", "voce", "voces"
+};
+
+/*
+ * Base letter of the second byte of a two bytes UTF-8 latin letter (first byte 0xC3), or 0 if it is not
+ * an accented letter
+ */
+char getFoldedLetter(unsigned char second) {
+    /* Upper case letters (0x80 - 0x9F) fold like their lower case ones (0xA0 - 0xBF) */
+    switch (second | 0x20) {
+        case 0xA0: case 0xA1: case 0xA2: case 0xA3: case 0xA4: case 0xA5:
+            return 'a';
+        case 0xA7:
+            return 'c';
+        case 0xA8: case 0xA9: case 0xAA: case 0xAB:
+            return 'e';
+        case 0xAC: case 0xAD: case 0xAE: case 0xAF:
+            return 'i';
+        case 0xB1:
+            return 'n';
+        case 0xB2: case 0xB3: case 0xB4: case 0xB5: case 0xB6:
+            return 'o';
+        case 0xB9: case 0xBA: case 0xBB: case 0xBC:
+            return 'u';
+    }
+
+    return 0;
+}
+
+/*
+ * Replace the accented latin letters (UTF-8) of a lower case term by their base letters, as in
+ * 'algodão' -> 'algodao', so the terms match with or without accents
+ */
+void foldAccents(char term[]) {
+    char *read = term;
+    char *write = term;
+
+    while (*read != '\0') {
+        char letter = (unsigned char) read[0] == 0xC3 && read[1] != '\0' ? getFoldedLetter(read[1]) : 0;
+
+        if (letter != 0) {
+            *write++ = letter;
+
+            read += 2;
+        } else {
+            *write++ = *read++;
+        }
+    }
+
+    *write = '\0';
+}
+
+int compareStopwords(const void *a, const void *b) {
+    return strcmp(*(const char **) a, *(const char **) b);
+}
+
+/*
+ * Return true if an accent folded term is a Portuguese stopword
+ */
+bool isPortugueseStopword(const char term[]) {
+    int numOfStopwords = sizeof(PORTUGUESE_STOPWORDS) / sizeof(PORTUGUESE_STOPWORDS[0]);
+
+    return bsearch(&term, PORTUGUESE_STOPWORDS, numOfStopwords, sizeof(char *), compareStopwords) != NULL;
+}
+
+/*
+ * Return true if a term of length 'length' ends with a suffix
+ */
+bool hasSuffix(const char term[], int length, const char suffix[]) {
+    int suffixLength = strlen(suffix);
+
+    return length >= suffixLength && strcmp(term + length - suffixLength, suffix) == 0;
+}
+
+/*
+ * Replace the last 'numOfChars' characters of a term by a new ending. Returns the new length
+ */
+int replaceSuffix(char term[], int length, int numOfChars, const char ending[]) {
+    strcpy(term + length - numOfChars, ending);
+
+    return length - numOfChars + strlen(ending);
+}
+
+/*
+ * Reduce an accent folded Portuguese term to its stem, removing the plural and the final vowel of its gender,
+ * so 'vestido', 'vestidos', 'longo' and 'longas' become 'vestid', 'vestid', 'long' and 'long'
+ */
+void stemPortugueseTerm(char term[]) {
+    int length = strlen(term);
+
+    /* Short words are left as they are: 'cor', 'mar', 'bom' */
+    if (length < 4) {
+        return;
+    }
+
+    /* Plural: the irregular endings first (after accent folding 'ões' is 'oes') */
+    if (hasSuffix(term, length, "ns")) {
+        length = replaceSuffix(term, length, 2, "m");
+    } else if (length > 4 && (hasSuffix(term, length, "oes") || hasSuffix(term, length, "aes"))) {
+        length = replaceSuffix(term, length, 3, "ao");
+    } else if (length > 4 && hasSuffix(term, length, "ais")) {
+        length = replaceSuffix(term, length, 3, "al");
+    } else if (length > 4 && hasSuffix(term, length, "eis")) {
+        length = replaceSuffix(term, length, 3, "el");
+    } else if (length > 4 && hasSuffix(term, length, "ois")) {
+        length = replaceSuffix(term, length, 3, "ol");
+    } else if (length > 4 && (hasSuffix(term, length, "res") || hasSuffix(term, length, "zes") || hasSuffix(term, length, "les"))) {
+        length = replaceSuffix(term, length, 2, "");
+    } else if (hasSuffix(term, length, "s") && !hasSuffix(term, length, "ss") && !hasSuffix(term, length, "us")
+               && !hasSuffix(term, length, "is")) {
+        length = replaceSuffix(term, length, 1, "");
+    }
+
+    /* Gender and the final vowel: 'longo' and 'longa' share the stem 'long' */
+    if (length > 4 && (term[length - 1] == 'a' || term[length - 1] == 'e' || term[length - 1] == 'o')) {
+        replaceSuffix(term, length, 1, "");
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef TERM_ANALYSIS_H
+#define TERM_ANALYSIS_H
+
+#include <stdbool.h>
+
+/*
+ * Replace the accented latin letters (UTF-8) of a lower case term by their base letters, as in
+ * 'algodão' -> 'algodao', so the terms match with or without accents
+ */
+void foldAccents(char term[]);
+
+/*
+ * Return true if an accent folded term is a Portuguese stopword
+ */
+bool isPortugueseStopword(const char term[]);
+
+/*
+ * Reduce an accent folded Portuguese term to its stem, removing the plural and the final vowel of its gender,
+ * so 'vestido', 'vestidos', 'longo' and 'longas' become 'vestid', 'vestid', 'long' and 'long'
+ */
+void stemPortugueseTerm(char term[]);
+
+#endif
@@ -0,0 +1,419 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "term-dictionary.h"
+#include "memory-accounting.h"
+
+/* Magic number of a dictionary file: "TDIC" */
+#define TERM_DICTIONARY_MAGIC 0x43494454u
+/* Max number of seeds tried before giving up (each failed seed has a tiny probability) */
+#define TERM_DICTIONARY_MAX_SEEDS 64
+
+/* This struct represents a key while the dictionary is built */
+typedef struct DictionaryKey {
+    uint64_t hash;
+    uint32_t bucket;
+    uint32_t key; /* position in the keys given to createTermDictionary() */
+} DictionaryKey;
+
+/* This struct represents a bucket while the dictionary is built */
+typedef struct DictionaryBucket {
+    uint32_t bucket;
+    uint32_t firstKey; /* position of its first key in the keys sorted by bucket */
+    uint32_t numOfKeys;
+} DictionaryBucket;
+
+/*
+ * Mix the bits of a 64 bits value (splitmix64 finalizer)
+ */
+uint64_t mixDictionaryHash(uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    value ^= value >> 31;
+
+    return value;
+}
+
+/*
+ * Hash a key with a seed (FNV-1a, then mixed)
+ */
+uint64_t hashDictionaryKey(const char key[], uint64_t seed) {
+    uint64_t hash = 0xcbf29ce484222325ULL ^ seed;
+
+    for (; *key != '\0'; key++) {
+        hash ^= (unsigned char) *key;
+        hash *= 0x100000001b3ULL;
+    }
+
+    return mixDictionaryHash(hash);
+}
+
+/*
+ * Bucket of a key hash
+ */
+uint32_t getDictionaryBucket(uint64_t hash, uint32_t numOfBuckets) {
+    return (uint32_t) ((hash >> 32) % numOfBuckets);
+}
+
+/*
+ * Slot of a key hash in the table (before the remapping), displaced by the pilot of its bucket
+ */
+uint32_t getDictionaryPosition(uint64_t hash, uint16_t pilot, uint32_t tableSize) {
+    return (uint32_t) (mixDictionaryHash(hash ^ mixDictionaryHash(pilot + 1)) % tableSize);
+}
+
+/*
+ * Fingerprint of a key hash, independent of its bucket and position
+ */
+uint16_t getDictionaryFingerprint(uint64_t hash) {
+    return (uint16_t) (hash & 0xFFFF);
+}
+
+int compareDictionaryKeysByBucket(const void *a, const void *b) {
+    const DictionaryKey *x = a;
+    const DictionaryKey *y = b;
+
+    return (x->bucket > y->bucket) - (x->bucket < y->bucket);
+}
+
+/*
+ * Compare two buckets by decreasing number of keys, so the hardest buckets are placed on the emptiest table
+ */
+int compareDictionaryBucketsBySize(const void *a, const void *b) {
+    const DictionaryBucket *x = a;
+    const DictionaryBucket *y = b;
+
+    if (x->numOfKeys != y->numOfKeys) {
+        return (x->numOfKeys < y->numOfKeys) - (x->numOfKeys > y->numOfKeys);
+    }
+
+    return (x->bucket > y->bucket) - (x->bucket < y->bucket);
+}
+
+/*
+ * Search the pilot of every bucket for a seed. Returns 0 if all the buckets were placed
+ */
+int placeDictionaryBuckets(TermDictionary *dictionary, DictionaryKey keys[], uint32_t positions[]) {
+    uint32_t numOfKeys = dictionary->numOfKeys;
+
+    qsort(keys, numOfKeys, sizeof(DictionaryKey), compareDictionaryKeysByBucket);
+
+    DictionaryBucket *buckets = trackedMalloc(MEMORY_DICTIONARY, (dictionary->numOfBuckets + 1) * sizeof(DictionaryBucket));
+
+    uint32_t numOfBuckets = 0;
+    uint32_t i, j;
+
+    for (i = 0; i < numOfKeys; i = j) {
+        for (j = i; j < numOfKeys && keys[j].bucket == keys[i].bucket; j++) {
+            /* A bucket with two equal hashes can never be placed */
+            if (j > i && keys[j].hash == keys[j - 1].hash) {
+                trackedFree(MEMORY_DICTIONARY, buckets);
+
+                return -1;
+            }
+        }
+
+        buckets[numOfBuckets].bucket = keys[i].bucket;
+        buckets[numOfBuckets].firstKey = i;
+        buckets[numOfBuckets].numOfKeys = j - i;
+
+        numOfBuckets++;
+    }
+
+    qsort(buckets, numOfBuckets, sizeof(DictionaryBucket), compareDictionaryBucketsBySize);
+
+    uint8_t *taken = trackedCalloc(MEMORY_DICTIONARY, dictionary->tableSize, sizeof(uint8_t));
+
+    memset(dictionary->pilots, 0, dictionary->numOfBuckets * sizeof(uint16_t));
+
+    int result = 0;
+
+    for (i = 0; i < numOfBuckets && result == 0; i++) {
+        DictionaryBucket *bucket = &buckets[i];
+
+        uint32_t pilot;
+
+        for (pilot = 0; pilot <= UINT16_MAX; pilot++) {
+            uint32_t k;
+
+            for (k = 0; k < bucket->numOfKeys; k++) {
+                uint32_t position = getDictionaryPosition(keys[bucket->firstKey + k].hash, pilot, dictionary->tableSize);
+
+                if (taken[position]) {
+                    break;
+                }
+
+                /* Mark the positions of the bucket, so two keys of the bucket don't share one */
+                taken[position] = 1;
+                positions[k] = position;
+            }
+
+            if (k == bucket->numOfKeys) {
+                break;
+            }
+
+            /* Undo the positions of the keys already marked */
+            while (k > 0) {
+                taken[positions[--k]] = 0;
+            }
+        }
+
+        if (pilot > UINT16_MAX) {
+            result = -1;
+        } else {
+            dictionary->pilots[bucket->bucket] = pilot;
+        }
+    }
+
+    trackedFree(MEMORY_DICTIONARY, taken);
+    trackedFree(MEMORY_DICTIONARY, buckets);
+
+    return result;
+}
+
+/*
+ * Build a dictionary over distinct keys. The slot of keys[i] is returned in slots[i]
+ */
+TermDictionary *createTermDictionary(const char *keys[], int numOfKeys, uint32_t slots[]) {
+    TermDictionary *dictionary = trackedCalloc(MEMORY_DICTIONARY, 1, sizeof(TermDictionary));
+
+    dictionary->numOfKeys = numOfKeys;
+    dictionary->numOfBuckets = numOfKeys / TERM_DICTIONARY_BUCKET_SIZE + 1;
+    dictionary->tableSize = (uint32_t) (numOfKeys / TERM_DICTIONARY_LOAD_FACTOR) + 1;
+    dictionary->pilots = trackedMalloc(MEMORY_DICTIONARY, dictionary->numOfBuckets * sizeof(uint16_t));
+
+    DictionaryKey *dictionaryKeys = trackedMalloc(MEMORY_DICTIONARY, (numOfKeys + 1) * sizeof(DictionaryKey));
+
+    /* Scratch for the positions of the keys of one bucket */
+    uint32_t *positions = trackedMalloc(MEMORY_DICTIONARY, (numOfKeys + 1) * sizeof(uint32_t));
+
+    int attempt;
+    int i;
+
+    for (attempt = 0; attempt < TERM_DICTIONARY_MAX_SEEDS; attempt++) {
+        dictionary->seed = mixDictionaryHash(attempt + 0x9e3779b97f4a7c15ULL);
+
+        for (i = 0; i < numOfKeys; i++) {
+            dictionaryKeys[i].hash = hashDictionaryKey(keys[i], dictionary->seed);
+            dictionaryKeys[i].bucket = getDictionaryBucket(dictionaryKeys[i].hash, dictionary->numOfBuckets);
+            dictionaryKeys[i].key = i;
+        }
+
+        if (placeDictionaryBuckets(dictionary, dictionaryKeys, positions) == 0) {
+            break;
+        }
+    }
+
+    if (attempt == TERM_DICTIONARY_MAX_SEEDS) {
+        trackedFree(MEMORY_DICTIONARY, positions);
+        trackedFree(MEMORY_DICTIONARY, dictionaryKeys);
+        freeTermDictionary(dictionary);
+
+        return NULL;
+    }
+
+    /* Remap the slots past numOfKeys to the free slots below it, in order */
+    uint8_t *taken = trackedCalloc(MEMORY_DICTIONARY, dictionary->tableSize, sizeof(uint8_t));
+
+    for (i = 0; i < numOfKeys; i++) {
+        const DictionaryKey *key = &dictionaryKeys[i];
+
+        uint16_t pilot = dictionary->pilots[key->bucket];
+
+        positions[key->key] = getDictionaryPosition(key->hash, pilot, dictionary->tableSize);
+
+        taken[positions[key->key]] = 1;
+    }
+
+    uint32_t numOfRemapped = dictionary->tableSize - numOfKeys;
+
+    dictionary->remappedSlots = trackedMalloc(MEMORY_DICTIONARY, (numOfRemapped + 1) * sizeof(uint32_t));
+
+    uint32_t freeSlot = 0;
+    uint32_t slot;
+
+    for (slot = numOfKeys; slot < dictionary->tableSize; slot++) {
+        while (freeSlot < (uint32_t) numOfKeys && taken[freeSlot]) {
+            freeSlot++;
+        }
+
+        if (taken[slot]) {
+            dictionary->remappedSlots[slot - numOfKeys] = freeSlot++;
+        } else {
+            /* Never read: no key is hashed to this slot */
+            dictionary->remappedSlots[slot - numOfKeys] = 0;
+        }
+    }
+
+    trackedFree(MEMORY_DICTIONARY, taken);
+
+    /* Pack the keys in slot order */
+    dictionary->fingerprints = trackedMalloc(MEMORY_DICTIONARY, (numOfKeys + 1) * sizeof(uint16_t));
+    dictionary->stringOffsets = trackedMalloc(MEMORY_DICTIONARY, (numOfKeys + 1) * sizeof(uint32_t));
+    dictionary->stringsSize = 0;
+
+    for (i = 0; i < numOfKeys; i++) {
+        dictionary->stringsSize += strlen(keys[i]) + 1;
+    }
+
+    dictionary->strings = trackedMalloc(MEMORY_DICTIONARY, dictionary->stringsSize + 1);
+
+    for (i = 0; i < numOfKeys; i++) {
+        uint32_t position = positions[dictionaryKeys[i].key];
+
+        slots[dictionaryKeys[i].key] = position < (uint32_t) numOfKeys ? position : dictionary->remappedSlots[position - numOfKeys];
+    }
+
+    uint32_t offset = 0;
+
+    for (i = 0; i < numOfKeys; i++) {
+        int length = strlen(keys[i]) + 1;
+
+        memcpy(dictionary->strings + offset, keys[i], length);
+
+        dictionary->stringOffsets[slots[i]] = offset;
+        dictionary->fingerprints[slots[i]] = getDictionaryFingerprint(hashDictionaryKey(keys[i], dictionary->seed));
+
+        offset += length;
+    }
+
+    trackedFree(MEMORY_DICTIONARY, positions);
+    trackedFree(MEMORY_DICTIONARY, dictionaryKeys);
+
+    return dictionary;
+}
+
+/*
+ * Release the memory of a dictionary
+ */
+void freeTermDictionary(TermDictionary *dictionary) {
+    if (dictionary == NULL) {
+        return;
+    }
+
+    trackedFree(MEMORY_DICTIONARY, dictionary->pilots);
+    trackedFree(MEMORY_DICTIONARY, dictionary->remappedSlots);
+    trackedFree(MEMORY_DICTIONARY, dictionary->fingerprints);
+    trackedFree(MEMORY_DICTIONARY, dictionary->stringOffsets);
+    trackedFree(MEMORY_DICTIONARY, dictionary->strings);
+    trackedFree(MEMORY_DICTIONARY, dictionary);
+}
+
+/*
+ * Slot of a key, or -1 if the key is not in the dictionary
+ */
+int lookupTermDictionary(const TermDictionary *dictionary, const char key[]) {
+    if (dictionary->numOfKeys == 0) {
+        return -1;
+    }
+
+    uint64_t hash = hashDictionaryKey(key, dictionary->seed);
+
+    uint16_t pilot = dictionary->pilots[getDictionaryBucket(hash, dictionary->numOfBuckets)];
+
+    uint32_t slot = getDictionaryPosition(hash, pilot, dictionary->tableSize);
+
+    if (slot >= dictionary->numOfKeys) {
+        slot = dictionary->remappedSlots[slot - dictionary->numOfKeys];
+    }
+
+    /* An unknown key lands on the slot of some other key: the fingerprint rejects it almost always */
+    if (dictionary->fingerprints[slot] != getDictionaryFingerprint(hash)
+        || strcmp(dictionary->strings + dictionary->stringOffsets[slot], key) != 0) {
+        return -1;
+    }
+
+    return slot;
+}
+
+/*
+ * Size in bytes of the perfect hash function (pilots and remapped slots), without the fingerprints and strings
+ */
+long getTermDictionaryHashSize(const TermDictionary *dictionary) {
+    return dictionary->numOfBuckets * sizeof(uint16_t) + (dictionary->tableSize - dictionary->numOfKeys) * sizeof(uint32_t);
+}
+
+/*
+ * Size in bytes of the whole dictionary
+ */
+long getTermDictionarySize(const TermDictionary *dictionary) {
+    return sizeof(TermDictionary) + getTermDictionaryHashSize(dictionary)
+        + dictionary->numOfKeys * (sizeof(uint16_t) + sizeof(uint32_t)) + dictionary->stringsSize;
+}
+
+/*
+ * Write a dictionary to a file. Returns 0 on success
+ */
+int writeTermDictionary(const TermDictionary *dictionary, FILE *file) {
+    uint32_t header[5] = {
+        TERM_DICTIONARY_MAGIC, dictionary->numOfKeys, dictionary->numOfBuckets, dictionary->tableSize, dictionary->stringsSize
+    };
+
+    uint32_t numOfRemapped = dictionary->tableSize - dictionary->numOfKeys;
+
+    if (fwrite(header, sizeof(header), 1, file) != 1
+        || fwrite(&dictionary->seed, sizeof(uint64_t), 1, file) != 1
+        || fwrite(dictionary->pilots, sizeof(uint16_t), dictionary->numOfBuckets, file) != dictionary->numOfBuckets
+        || fwrite(dictionary->remappedSlots, sizeof(uint32_t), numOfRemapped, file) != numOfRemapped
+        || fwrite(dictionary->fingerprints, sizeof(uint16_t), dictionary->numOfKeys, file) != dictionary->numOfKeys
+        || fwrite(dictionary->stringOffsets, sizeof(uint32_t), dictionary->numOfKeys, file) != dictionary->numOfKeys
+        || fwrite(dictionary->strings, 1, dictionary->stringsSize, file) != dictionary->stringsSize) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Read a dictionary written by writeTermDictionary(). Returns NULL if the file is not a valid dictionary
+ */
+TermDictionary *readTermDictionary(FILE *file) {
+    uint32_t header[5];
+
+    if (fread(header, sizeof(header), 1, file) != 1 || header[0] != TERM_DICTIONARY_MAGIC || header[3] < header[1]) {
+        return NULL;
+    }
+
+    TermDictionary *dictionary = trackedCalloc(MEMORY_DICTIONARY, 1, sizeof(TermDictionary));
+
+    dictionary->numOfKeys = header[1];
+    dictionary->numOfBuckets = header[2];
+    dictionary->tableSize = header[3];
+    dictionary->stringsSize = header[4];
+
+    uint32_t numOfRemapped = dictionary->tableSize - dictionary->numOfKeys;
+
+    dictionary->pilots = trackedMalloc(MEMORY_DICTIONARY, (dictionary->numOfBuckets + 1) * sizeof(uint16_t));
+    dictionary->remappedSlots = trackedMalloc(MEMORY_DICTIONARY, (numOfRemapped + 1) * sizeof(uint32_t));
+    dictionary->fingerprints = trackedMalloc(MEMORY_DICTIONARY, (dictionary->numOfKeys + 1) * sizeof(uint16_t));
+    dictionary->stringOffsets = trackedMalloc(MEMORY_DICTIONARY, (dictionary->numOfKeys + 1) * sizeof(uint32_t));
+    dictionary->strings = trackedMalloc(MEMORY_DICTIONARY, dictionary->stringsSize + 1);
+
+    if (fread(&dictionary->seed, sizeof(uint64_t), 1, file) != 1
+        || fread(dictionary->pilots, sizeof(uint16_t), dictionary->numOfBuckets, file) != dictionary->numOfBuckets
+        || fread(dictionary->remappedSlots, sizeof(uint32_t), numOfRemapped, file) != numOfRemapped
+        || fread(dictionary->fingerprints, sizeof(uint16_t), dictionary->numOfKeys, file) != dictionary->numOfKeys
+        || fread(dictionary->stringOffsets, sizeof(uint32_t), dictionary->numOfKeys, file) != dictionary->numOfKeys
+        || fread(dictionary->strings, 1, dictionary->stringsSize, file) != dictionary->stringsSize) {
+        freeTermDictionary(dictionary);
+
+        return NULL;
+    }
+
+    /* The lookups read the strings at their offsets, so they must stay inside the pool */
+    uint32_t i;
+
+    for (i = 0; i < dictionary->numOfKeys; i++) {
+        if (dictionary->stringOffsets[i] >= dictionary->stringsSize) {
+            freeTermDictionary(dictionary);
+
+            return NULL;
+        }
+    }
+
+    dictionary->strings[dictionary->stringsSize] = '\0';
+
+    return dictionary;
+}
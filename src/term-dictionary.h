@@ -0,0 +1,65 @@
+#ifndef TERM_DICTIONARY_H
+#define TERM_DICTIONARY_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Average number of keys per bucket of the perfect hash function */
+#define TERM_DICTIONARY_BUCKET_SIZE 5
+/* The positions are hashed in a table of numOfKeys / TERM_DICTIONARY_LOAD_FACTOR slots, and the slots past
+ numOfKeys are remapped to the free slots below it, so the function is minimal */
+#define TERM_DICTIONARY_LOAD_FACTOR 0.98
+
+/* This struct represents a read-only dictionary of strings built over a minimal perfect hash function
+ (PTHash style): each key is hashed to a bucket, and the pilot of the bucket displaces its keys to
+ distinct slots. A lookup hashes the key once, reads one pilot and checks one fingerprint and one string,
+ so it never probes. All the arrays are flat, so the dictionary is written and read as a whole */
+typedef struct TermDictionary {
+    uint32_t numOfKeys;
+    uint32_t numOfBuckets;
+    uint32_t tableSize; /* slots of the table before the remapping, >= numOfKeys */
+    uint64_t seed;
+    uint16_t *pilots; /* one per bucket */
+    uint32_t *remappedSlots; /* slot < numOfKeys of each slot >= numOfKeys (tableSize - numOfKeys values) */
+    uint16_t *fingerprints; /* one per slot, to reject most of the unknown keys without reading the strings */
+    uint32_t *stringOffsets; /* offset in the string pool of the key of each slot */
+    char *strings; /* packed keys, each one followed by '\0' */
+    uint32_t stringsSize;
+} TermDictionary;
+
+/*
+ * Build a dictionary over distinct keys. The slot of keys[i] is returned in slots[i]
+ */
+TermDictionary *createTermDictionary(const char *keys[], int numOfKeys, uint32_t slots[]);
+
+/*
+ * Release the memory of a dictionary
+ */
+void freeTermDictionary(TermDictionary *dictionary);
+
+/*
+ * Slot of a key, or -1 if the key is not in the dictionary
+ */
+int lookupTermDictionary(const TermDictionary *dictionary, const char key[]);
+
+/*
+ * Size in bytes of the perfect hash function (pilots and remapped slots), without the fingerprints and strings
+ */
+long getTermDictionaryHashSize(const TermDictionary *dictionary);
+
+/*
+ * Size in bytes of the whole dictionary
+ */
+long getTermDictionarySize(const TermDictionary *dictionary);
+
+/*
+ * Write a dictionary to a file. Returns 0 on success
+ */
+int writeTermDictionary(const TermDictionary *dictionary, FILE *file);
+
+/*
+ * Read a dictionary written by writeTermDictionary(). Returns NULL if the file is not a valid dictionary
+ */
+TermDictionary *readTermDictionary(FILE *file);
+
+#endif
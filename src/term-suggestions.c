@@ -0,0 +1,468 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "term-suggestions.h"
+#include "memory-accounting.h"
+
+/* Magic number of a trie file: "TSUG" */
+#define TERM_SUGGESTIONS_MAGIC 0x47555354u
+
+/* This struct represents the state of a trie while it is built */
+typedef struct SuggestionsBuilder {
+    TermSuggestions *suggestions;
+    const char **terms; /* sorted */
+    uint32_t *weights; /* in the order of 'terms' */
+    uint32_t labelsCapacity;
+} SuggestionsBuilder;
+
+/* This struct represents a candidate of a top completions search: a subtree, or the term ending at a node */
+typedef struct SuggestionCandidate {
+    uint32_t weight; /* max weight of the subtree, or weight of the term */
+    uint32_t node;
+    int isTerm;
+} SuggestionCandidate;
+
+/* Terms and weights to be sorted together */
+typedef struct WeightedSuggestion {
+    const char *term;
+    uint32_t weight;
+} WeightedSuggestion;
+
+int compareWeightedSuggestions(const void *a, const void *b) {
+    return strcmp(((const WeightedSuggestion *) a)->term, ((const WeightedSuggestion *) b)->term);
+}
+
+/*
+ * Append a label to the label pool. Returns its offset
+ */
+uint32_t appendSuggestionLabel(SuggestionsBuilder *builder, const char label[], uint32_t length) {
+    TermSuggestions *suggestions = builder->suggestions;
+
+    if (length == 0) {
+        return suggestions->labelsSize;
+    }
+
+    if (suggestions->labelsSize + length > builder->labelsCapacity) {
+        builder->labelsCapacity = (suggestions->labelsSize + length) * 2;
+
+        suggestions->labels = trackedRealloc(MEMORY_DICTIONARY, suggestions->labels, builder->labelsCapacity);
+    }
+
+    memcpy(suggestions->labels + suggestions->labelsSize, label, length);
+
+    suggestions->labelsSize += length;
+
+    return suggestions->labelsSize - length;
+}
+
+/*
+ * Fill a node with the sorted terms [first, last), which share their first 'depth' characters. The label of
+ * the node is the rest of their common prefix (empty for the root), and its children split the terms by
+ * the next character
+ */
+void buildSuggestionNode(SuggestionsBuilder *builder, uint32_t nodeIndex, int first, int last, uint32_t depth) {
+    TermSuggestions *suggestions = builder->suggestions;
+
+    SuggestionNode *node = &suggestions->nodes[nodeIndex];
+
+    /* An empty trie: only the root, without a label */
+    if (first == last) {
+        return;
+    }
+
+    /* The terms are sorted, so the common prefix of the range is the one of its first and last terms */
+    uint32_t end = depth;
+
+    if (nodeIndex != 0) {
+        const char *a = builder->terms[first];
+        const char *b = builder->terms[last - 1];
+
+        while (a[end] != '\0' && a[end] == b[end]) {
+            end++;
+        }
+    }
+
+    node->labelOffset = appendSuggestionLabel(builder, builder->terms[first] + depth, end - depth);
+    node->labelLength = end - depth;
+    node->weight = 0;
+
+    if (builder->terms[first][end] == '\0') {
+        node->weight = builder->weights[first];
+
+        first++;
+    }
+
+    node->maxWeight = node->weight;
+    node->numOfChildren = 0;
+
+    int i, j;
+
+    for (i = first; i < last; i = j) {
+        for (j = i; j < last && builder->terms[j][end] == builder->terms[i][end]; j++);
+
+        node->numOfChildren++;
+    }
+
+    /* The children are allocated before any grandchild, so they are consecutive */
+    node->firstChild = suggestions->numOfNodes;
+
+    suggestions->numOfNodes += node->numOfChildren;
+
+    uint32_t child = node->firstChild;
+
+    for (i = first; i < last; i = j) {
+        for (j = i; j < last && builder->terms[j][end] == builder->terms[i][end]; j++);
+
+        suggestions->nodes[child].parent = nodeIndex;
+
+        buildSuggestionNode(builder, child, i, j, end);
+
+        if (suggestions->nodes[child].maxWeight > node->maxWeight) {
+            node->maxWeight = suggestions->nodes[child].maxWeight;
+        }
+
+        child++;
+    }
+}
+
+/*
+ * Build a trie over distinct terms with a weight (higher weights are suggested first). Terms with weight 0
+ * are not suggested
+ */
+TermSuggestions *createTermSuggestions(const char *terms[], const uint32_t weights[], int numOfTerms) {
+    WeightedSuggestion *sorted = trackedMalloc(MEMORY_DICTIONARY, (numOfTerms + 1) * sizeof(WeightedSuggestion));
+
+    int i;
+
+    for (i = 0; i < numOfTerms; i++) {
+        sorted[i].term = terms[i];
+        sorted[i].weight = weights[i];
+    }
+
+    qsort(sorted, numOfTerms, sizeof(WeightedSuggestion), compareWeightedSuggestions);
+
+    SuggestionsBuilder builder;
+
+    builder.terms = trackedMalloc(MEMORY_DICTIONARY, (numOfTerms + 1) * sizeof(char *));
+    builder.weights = trackedMalloc(MEMORY_DICTIONARY, (numOfTerms + 1) * sizeof(uint32_t));
+    builder.labelsCapacity = 64;
+
+    for (i = 0; i < numOfTerms; i++) {
+        builder.terms[i] = sorted[i].term;
+        builder.weights[i] = sorted[i].weight;
+    }
+
+    TermSuggestions *suggestions = trackedCalloc(MEMORY_DICTIONARY, 1, sizeof(TermSuggestions));
+
+    /* A radix trie has at most one leaf per term and one branching node per leaf */
+    suggestions->nodes = trackedCalloc(MEMORY_DICTIONARY, 2 * numOfTerms + 1, sizeof(SuggestionNode));
+    suggestions->numOfNodes = 1;
+    suggestions->numOfTerms = numOfTerms;
+    suggestions->labels = trackedMalloc(MEMORY_DICTIONARY, builder.labelsCapacity);
+
+    builder.suggestions = suggestions;
+
+    buildSuggestionNode(&builder, 0, 0, numOfTerms, 0);
+
+    /* The nodes are not moved while the trie is built, so the spare ones are only released at the end */
+    suggestions->nodes = trackedRealloc(MEMORY_DICTIONARY, suggestions->nodes, suggestions->numOfNodes * sizeof(SuggestionNode));
+
+    trackedFree(MEMORY_DICTIONARY, builder.weights);
+    trackedFree(MEMORY_DICTIONARY, builder.terms);
+    trackedFree(MEMORY_DICTIONARY, sorted);
+
+    return suggestions;
+}
+
+/*
+ * Release the memory of a trie
+ */
+void freeTermSuggestions(TermSuggestions *suggestions) {
+    if (suggestions == NULL) {
+        return;
+    }
+
+    trackedFree(MEMORY_DICTIONARY, suggestions->nodes);
+    trackedFree(MEMORY_DICTIONARY, suggestions->labels);
+    trackedFree(MEMORY_DICTIONARY, suggestions);
+}
+
+/*
+ * Find the child of a node whose label starts with a character, or -1 if there is none
+ */
+int findSuggestionChild(const TermSuggestions *suggestions, const SuggestionNode *node, unsigned char character) {
+    int low = node->firstChild;
+    int high = node->firstChild + node->numOfChildren;
+
+    while (low < high) {
+        int middle = (low + high) / 2;
+
+        unsigned char first = suggestions->labels[suggestions->nodes[middle].labelOffset];
+
+        if (first < character) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (low < (int) (node->firstChild + node->numOfChildren)
+        && (unsigned char) suggestions->labels[suggestions->nodes[low].labelOffset] == character) {
+        return low;
+    }
+
+    return -1;
+}
+
+/*
+ * Find the node whose subtree has all the terms starting with a prefix, or -1 if there is none
+ */
+int findSuggestionPrefix(const TermSuggestions *suggestions, const char prefix[]) {
+    int nodeIndex = 0;
+
+    while (1) {
+        const SuggestionNode *node = &suggestions->nodes[nodeIndex];
+
+        const char *label = suggestions->labels + node->labelOffset;
+
+        uint32_t i;
+
+        for (i = 0; i < node->labelLength && prefix[i] != '\0'; i++) {
+            if (label[i] != prefix[i]) {
+                return -1;
+            }
+        }
+
+        prefix += i;
+
+        /* The prefix may end in the middle of the label: all the terms of the subtree still start with it */
+        if (*prefix == '\0') {
+            return nodeIndex;
+        }
+
+        nodeIndex = findSuggestionChild(suggestions, node, *prefix);
+
+        if (nodeIndex < 0) {
+            return -1;
+        }
+    }
+}
+
+/*
+ * Return true if the candidate 'a' must be taken before 'b': higher weight first, and at the same weight the
+ * term before its subtree and the lowest node (so the order is deterministic)
+ */
+int isBetterSuggestionCandidate(const SuggestionCandidate *a, const SuggestionCandidate *b) {
+    if (a->weight != b->weight) {
+        return a->weight > b->weight;
+    }
+
+    if (a->isTerm != b->isTerm) {
+        return a->isTerm;
+    }
+
+    return a->node < b->node;
+}
+
+/*
+ * Insert a candidate in a max-heap
+ */
+void pushSuggestionCandidate(SuggestionCandidate **heap, int *size, int *capacity, SuggestionCandidate candidate) {
+    if (*size == *capacity) {
+        *capacity *= 2;
+
+        *heap = trackedRealloc(MEMORY_QUERY, *heap, *capacity * sizeof(SuggestionCandidate));
+    }
+
+    SuggestionCandidate *candidates = *heap;
+
+    int i = (*size)++;
+
+    while (i > 0 && isBetterSuggestionCandidate(&candidate, &candidates[(i - 1) / 2])) {
+        candidates[i] = candidates[(i - 1) / 2];
+
+        i = (i - 1) / 2;
+    }
+
+    candidates[i] = candidate;
+}
+
+/*
+ * Remove the best candidate of a max-heap
+ */
+SuggestionCandidate popSuggestionCandidate(SuggestionCandidate heap[], int *size) {
+    SuggestionCandidate best = heap[0];
+    SuggestionCandidate last = heap[--(*size)];
+
+    int i = 0;
+
+    while (2 * i + 1 < *size) {
+        int child = 2 * i + 1;
+
+        if (child + 1 < *size && isBetterSuggestionCandidate(&heap[child + 1], &heap[child])) {
+            child++;
+        }
+
+        if (!isBetterSuggestionCandidate(&heap[child], &last)) {
+            break;
+        }
+
+        heap[i] = heap[child];
+
+        i = child;
+    }
+
+    heap[i] = last;
+
+    return best;
+}
+
+/*
+ * Rebuild the term ending at a node, concatenating the labels from the root
+ */
+char *getSuggestionTerm(const TermSuggestions *suggestions, uint32_t nodeIndex) {
+    uint32_t length = 0;
+    uint32_t i;
+
+    for (i = nodeIndex; i != 0; i = suggestions->nodes[i].parent) {
+        length += suggestions->nodes[i].labelLength;
+    }
+
+    char *term = trackedMalloc(MEMORY_QUERY, length + 1);
+
+    term[length] = '\0';
+
+    for (i = nodeIndex; i != 0; i = suggestions->nodes[i].parent) {
+        length -= suggestions->nodes[i].labelLength;
+
+        memcpy(term + length, suggestions->labels + suggestions->nodes[i].labelOffset, suggestions->nodes[i].labelLength);
+    }
+
+    return term;
+}
+
+/*
+ * Find the (at most) 'k' completions of a prefix with the highest weights, in decreasing order of weight.
+ * Returns the number of completions
+ */
+int suggestTerms(const TermSuggestions *suggestions, const char prefix[], int k, TermSuggestion result[]) {
+    int nodeIndex = findSuggestionPrefix(suggestions, prefix);
+
+    if (nodeIndex < 0 || suggestions->nodes[nodeIndex].maxWeight == 0) {
+        return 0;
+    }
+
+    /* Best-first search: a subtree is only expanded when its max weight beats every pending candidate, so
+     the search visits about k paths instead of the whole subtree */
+    int capacity = 64;
+    int size = 0;
+
+    SuggestionCandidate *heap = trackedMalloc(MEMORY_QUERY, capacity * sizeof(SuggestionCandidate));
+
+    SuggestionCandidate candidate = { suggestions->nodes[nodeIndex].maxWeight, nodeIndex, 0 };
+
+    pushSuggestionCandidate(&heap, &size, &capacity, candidate);
+
+    int count = 0;
+
+    while (size > 0 && count < k) {
+        candidate = popSuggestionCandidate(heap, &size);
+
+        if (candidate.isTerm) {
+            result[count].term = getSuggestionTerm(suggestions, candidate.node);
+            result[count].weight = candidate.weight;
+
+            count++;
+
+            continue;
+        }
+
+        const SuggestionNode *node = &suggestions->nodes[candidate.node];
+
+        if (node->weight > 0) {
+            SuggestionCandidate term = { node->weight, candidate.node, 1 };
+
+            pushSuggestionCandidate(&heap, &size, &capacity, term);
+        }
+
+        uint32_t child;
+
+        for (child = node->firstChild; child < node->firstChild + node->numOfChildren; child++) {
+            if (suggestions->nodes[child].maxWeight > 0) {
+                SuggestionCandidate subtree = { suggestions->nodes[child].maxWeight, child, 0 };
+
+                pushSuggestionCandidate(&heap, &size, &capacity, subtree);
+            }
+        }
+    }
+
+    trackedFree(MEMORY_QUERY, heap);
+
+    return count;
+}
+
+/*
+ * Size in bytes of a trie
+ */
+long getTermSuggestionsSize(const TermSuggestions *suggestions) {
+    return sizeof(TermSuggestions) + suggestions->numOfNodes * sizeof(SuggestionNode) + suggestions->labelsSize;
+}
+
+/*
+ * Write a trie to a file. Returns 0 on success
+ */
+int writeTermSuggestions(const TermSuggestions *suggestions, FILE *file) {
+    uint32_t header[4] = { TERM_SUGGESTIONS_MAGIC, suggestions->numOfNodes, suggestions->numOfTerms, suggestions->labelsSize };
+
+    if (fwrite(header, sizeof(header), 1, file) != 1
+        || fwrite(suggestions->nodes, sizeof(SuggestionNode), suggestions->numOfNodes, file) != suggestions->numOfNodes
+        || fwrite(suggestions->labels, 1, suggestions->labelsSize, file) != suggestions->labelsSize) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Read a trie written by writeTermSuggestions(). Returns NULL if the file is not a valid trie
+ */
+TermSuggestions *readTermSuggestions(FILE *file) {
+    uint32_t header[4];
+
+    if (fread(header, sizeof(header), 1, file) != 1 || header[0] != TERM_SUGGESTIONS_MAGIC || header[1] == 0) {
+        return NULL;
+    }
+
+    TermSuggestions *suggestions = trackedCalloc(MEMORY_DICTIONARY, 1, sizeof(TermSuggestions));
+
+    suggestions->numOfNodes = header[1];
+    suggestions->numOfTerms = header[2];
+    suggestions->labelsSize = header[3];
+    suggestions->nodes = trackedMalloc(MEMORY_DICTIONARY, suggestions->numOfNodes * sizeof(SuggestionNode));
+    suggestions->labels = trackedMalloc(MEMORY_DICTIONARY, suggestions->labelsSize + 1);
+
+    if (fread(suggestions->nodes, sizeof(SuggestionNode), suggestions->numOfNodes, file) != suggestions->numOfNodes
+        || fread(suggestions->labels, 1, suggestions->labelsSize, file) != suggestions->labelsSize) {
+        freeTermSuggestions(suggestions);
+
+        return NULL;
+    }
+
+    /* The searches follow the offsets of the nodes, so they must stay inside the arrays */
+    uint32_t i;
+
+    for (i = 0; i < suggestions->numOfNodes; i++) {
+        const SuggestionNode *node = &suggestions->nodes[i];
+
+        if (node->parent >= suggestions->numOfNodes
+            || (uint64_t) node->firstChild + node->numOfChildren > suggestions->numOfNodes
+            || (uint64_t) node->labelOffset + node->labelLength > suggestions->labelsSize
+            || (i != 0 && node->parent >= i) || (node->numOfChildren > 0 && node->firstChild <= i)) {
+            freeTermSuggestions(suggestions);
+
+            return NULL;
+        }
+    }
+
+    return suggestions;
+}
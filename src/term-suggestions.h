@@ -0,0 +1,71 @@
+#ifndef TERM_SUGGESTIONS_H
+#define TERM_SUGGESTIONS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Max number of completions of a prefix */
+#define MAX_TERM_SUGGESTIONS 10
+
+/* This struct represents a node of the suggestions trie. The chains of nodes with a single child are
+ merged in one node, whose label has all their characters (radix trie) */
+typedef struct SuggestionNode {
+    uint32_t parent;
+    uint32_t firstChild; /* the children of a node are consecutive, sorted by the first character of their labels */
+    uint32_t numOfChildren;
+    uint32_t labelOffset; /* offset of the label in the label pool */
+    uint32_t labelLength;
+    uint32_t weight; /* weight of the term ending at the node, 0 if no term ends at it */
+    uint32_t maxWeight; /* highest weight of a term in the subtree of the node */
+} SuggestionNode;
+
+/* This struct represents a trie of weighted terms, answering the top completions of a prefix. It is made
+ of two flat arrays with offsets only (no pointers), so it is written and read (or mapped) as a whole.
+ The node 0 is the root */
+typedef struct TermSuggestions {
+    uint32_t numOfNodes;
+    uint32_t numOfTerms;
+    uint32_t labelsSize;
+    SuggestionNode *nodes;
+    char *labels;
+} TermSuggestions;
+
+/* This struct represents a completion of a prefix */
+typedef struct TermSuggestion {
+    char *term; /* to be released by the caller with trackedFree(MEMORY_QUERY, ...) */
+    uint32_t weight;
+} TermSuggestion;
+
+/*
+ * Build a trie over distinct terms with a weight (higher weights are suggested first). Terms with weight 0
+ * are not suggested
+ */
+TermSuggestions *createTermSuggestions(const char *terms[], const uint32_t weights[], int numOfTerms);
+
+/*
+ * Release the memory of a trie
+ */
+void freeTermSuggestions(TermSuggestions *suggestions);
+
+/*
+ * Find the (at most) 'k' completions of a prefix with the highest weights, in decreasing order of weight.
+ * Returns the number of completions
+ */
+int suggestTerms(const TermSuggestions *suggestions, const char prefix[], int k, TermSuggestion result[]);
+
+/*
+ * Size in bytes of a trie
+ */
+long getTermSuggestionsSize(const TermSuggestions *suggestions);
+
+/*
+ * Write a trie to a file. Returns 0 on success
+ */
+int writeTermSuggestions(const TermSuggestions *suggestions, FILE *file);
+
+/*
+ * Read a trie written by writeTermSuggestions(). Returns NULL if the file is not a valid trie
+ */
+TermSuggestions *readTermSuggestions(FILE *file);
+
+#endif
@@ -0,0 +1,633 @@
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#include "vector-store.h"
+#include "accumulators.h"
+#include "memory-accounting.h"
+
+/*
+ * Create empty sparse vectors with room for a number of nonzero values
+ */
+SparseVectors *createSparseVectors(int numOfVectors, int dimension, long numOfValues) {
+    SparseVectors *vectors = trackedMalloc(MEMORY_VECTORS, sizeof(SparseVectors));
+
+    vectors->numOfVectors = numOfVectors;
+    vectors->dimension = dimension;
+    vectors->rowStarts = trackedCalloc(MEMORY_VECTORS, numOfVectors + 1, sizeof(uint32_t));
+    vectors->indices = trackedMalloc(MEMORY_VECTORS, (numOfValues + 1) * sizeof(uint16_t));
+    vectors->values = trackedMalloc(MEMORY_VECTORS, (numOfValues + 1) * sizeof(float));
+
+    return vectors;
+}
+
+/*
+ * Release the memory of sparse vectors
+ */
+void freeSparseVectors(SparseVectors *vectors) {
+    if (vectors == NULL) {
+        return;
+    }
+
+    trackedFree(MEMORY_VECTORS, vectors->rowStarts);
+    trackedFree(MEMORY_VECTORS, vectors->indices);
+    trackedFree(MEMORY_VECTORS, vectors->values);
+    trackedFree(MEMORY_VECTORS, vectors);
+}
+
+/*
+ * Copy a sparse vector into a dense one, which must be all zeros
+ */
+void scatterSparseVector(const SparseVectors *vectors, int row, float dense[]) {
+    uint32_t i;
+
+    for (i = vectors->rowStarts[row]; i < vectors->rowStarts[row + 1]; i++) {
+        dense[vectors->indices[i]] = vectors->values[i];
+    }
+}
+
+/*
+ * Zero the values of a dense vector set by scatterSparseVector()
+ */
+void clearSparseVector(const SparseVectors *vectors, int row, float dense[]) {
+    uint32_t i;
+
+    for (i = vectors->rowStarts[row]; i < vectors->rowStarts[row + 1]; i++) {
+        dense[vectors->indices[i]] = 0;
+    }
+}
+
+/*
+ * Squared norm of each centroid of a subspace, so the nearest centroid of a subvector is the one with the lowest
+ * norm - 2 * inner product
+ */
+void computeCentroidNorms(const float centroids[], int subspaceDimension, float norms[]) {
+    int k, j;
+
+    for (k = 0; k < PQ_CENTROIDS; k++) {
+        const float *centroid = centroids + (long) k * subspaceDimension;
+
+        norms[k] = 0;
+
+        for (j = 0; j < subspaceDimension; j++) {
+            norms[k] += centroid[j] * centroid[j];
+        }
+    }
+}
+
+/*
+ * Nearest centroid of a subvector, by the euclidean distance
+ */
+int findNearestCentroid(const float centroids[], const float norms[], int subspaceDimension, const float subvector[]) {
+    int best = 0;
+    float bestDistance = FLT_MAX;
+
+    int k, j;
+
+    for (k = 0; k < PQ_CENTROIDS; k++) {
+        const float *centroid = centroids + (long) k * subspaceDimension;
+
+        float product = 0;
+
+        for (j = 0; j < subspaceDimension; j++) {
+            product += subvector[j] * centroid[j];
+        }
+
+        float distance = norms[k] - 2 * product;
+
+        if (distance < bestDistance) {
+            bestDistance = distance;
+            best = k;
+        }
+    }
+
+    return best;
+}
+
+/*
+ * Train the centroids of a subspace by k-means over the subvectors of the sample. The centroids start at
+ * subvectors of the sample spread over it, and an empty cluster takes half of the largest one
+ */
+void trainSubspaceCentroids(const float training[], int numOfSamples, int subspaceDimension, float centroids[]) {
+    float *norms = trackedMalloc(MEMORY_INGEST, PQ_CENTROIDS * sizeof(float));
+    float *sums = trackedMalloc(MEMORY_INGEST, (long) PQ_CENTROIDS * subspaceDimension * sizeof(float));
+    int *counts = trackedMalloc(MEMORY_INGEST, PQ_CENTROIDS * sizeof(int));
+
+    int iteration, s, k, j;
+
+    for (k = 0; k < PQ_CENTROIDS; k++) {
+        /* Multiplicative hash of the centroid, so the first centroids are not all taken from the first vectors */
+        int sample = (int) (((uint64_t) k * 2654435761u) % numOfSamples);
+
+        memcpy(centroids + (long) k * subspaceDimension, training + (long) sample * subspaceDimension,
+               subspaceDimension * sizeof(float));
+    }
+
+    for (iteration = 0; iteration < PQ_TRAINING_ITERATIONS; iteration++) {
+        computeCentroidNorms(centroids, subspaceDimension, norms);
+
+        memset(sums, 0, (long) PQ_CENTROIDS * subspaceDimension * sizeof(float));
+        memset(counts, 0, PQ_CENTROIDS * sizeof(int));
+
+        for (s = 0; s < numOfSamples; s++) {
+            const float *subvector = training + (long) s * subspaceDimension;
+
+            int nearest = findNearestCentroid(centroids, norms, subspaceDimension, subvector);
+
+            for (j = 0; j < subspaceDimension; j++) {
+                sums[(long) nearest * subspaceDimension + j] += subvector[j];
+            }
+
+            counts[nearest]++;
+        }
+
+        for (k = 0; k < PQ_CENTROIDS; k++) {
+            if (counts[k] > 0) {
+                for (j = 0; j < subspaceDimension; j++) {
+                    centroids[(long) k * subspaceDimension + j] = sums[(long) k * subspaceDimension + j] / counts[k];
+                }
+            }
+        }
+
+        for (k = 0; k < PQ_CENTROIDS; k++) {
+            if (counts[k] > 0) {
+                continue;
+            }
+
+            int largest = 0;
+
+            for (j = 1; j < PQ_CENTROIDS; j++) {
+                if (counts[j] > counts[largest]) {
+                    largest = j;
+                }
+            }
+
+            if (counts[largest] < 2) {
+                break;
+            }
+
+            /* Both halves of the split cluster move a little apart, so the next assignment divides it */
+            for (j = 0; j < subspaceDimension; j++) {
+                float value = centroids[(long) largest * subspaceDimension + j];
+
+                centroids[(long) k * subspaceDimension + j] = value * (j % 2 == 0 ? 1.001 : 0.999);
+                centroids[(long) largest * subspaceDimension + j] = value * (j % 2 == 0 ? 0.999 : 1.001);
+            }
+
+            counts[k] = counts[largest] / 2;
+            counts[largest] -= counts[k];
+        }
+    }
+
+    trackedFree(MEMORY_INGEST, norms);
+    trackedFree(MEMORY_INGEST, sums);
+    trackedFree(MEMORY_INGEST, counts);
+}
+
+/*
+ * Train the product quantizer over a sample of the vectors and encode all of them
+ */
+void trainProductQuantizer(VectorStore *store, const SparseVectors *vectors) {
+    int numOfSubspaces = store->numOfSubspaces;
+    int subspaceDimension = store->subspaceDimension;
+
+    long centroidsPerSubspace = (long) PQ_CENTROIDS * subspaceDimension;
+
+    store->centroids = trackedCalloc(MEMORY_VECTORS, numOfSubspaces * centroidsPerSubspace, sizeof(float));
+
+    int numOfSamples = vectors->numOfVectors < PQ_TRAINING_SAMPLE ? vectors->numOfVectors : PQ_TRAINING_SAMPLE;
+
+    float *training = trackedMalloc(MEMORY_INGEST, (long) numOfSamples * subspaceDimension * sizeof(float));
+
+    /* Next nonzero value of each sampled vector: the subspaces are trained in order of their dimensions, so the
+     values of a vector are read once in all */
+    uint32_t *cursors = trackedMalloc(MEMORY_INGEST, numOfSamples * sizeof(uint32_t));
+
+    int s, m, i;
+
+    for (s = 0; s < numOfSamples; s++) {
+        cursors[s] = vectors->rowStarts[(long) s * vectors->numOfVectors / numOfSamples];
+    }
+
+    for (m = 0; m < numOfSubspaces; m++) {
+        int firstDimension = m * subspaceDimension;
+
+        memset(training, 0, (long) numOfSamples * subspaceDimension * sizeof(float));
+
+        for (s = 0; s < numOfSamples; s++) {
+            int row = (long) s * vectors->numOfVectors / numOfSamples;
+
+            for (; cursors[s] < vectors->rowStarts[row + 1] && vectors->indices[cursors[s]] < firstDimension + subspaceDimension;
+                 cursors[s]++) {
+                training[(long) s * subspaceDimension + vectors->indices[cursors[s]] - firstDimension] = vectors->values[cursors[s]];
+            }
+        }
+
+        trainSubspaceCentroids(training, numOfSamples, subspaceDimension, store->centroids + m * centroidsPerSubspace);
+    }
+
+    trackedFree(MEMORY_INGEST, cursors);
+    trackedFree(MEMORY_INGEST, training);
+
+    float *norms = trackedMalloc(MEMORY_INGEST, (long) numOfSubspaces * PQ_CENTROIDS * sizeof(float));
+
+    /* Code of a subvector of zeros, the most common one in sparse vectors */
+    uint8_t *zeroCodes = trackedMalloc(MEMORY_INGEST, numOfSubspaces);
+
+    float *dense = trackedCalloc(MEMORY_INGEST, (long) numOfSubspaces * subspaceDimension, sizeof(float));
+
+    for (m = 0; m < numOfSubspaces; m++) {
+        computeCentroidNorms(store->centroids + m * centroidsPerSubspace, subspaceDimension, norms + m * PQ_CENTROIDS);
+
+        zeroCodes[m] = findNearestCentroid(store->centroids + m * centroidsPerSubspace, norms + m * PQ_CENTROIDS,
+                                           subspaceDimension, dense);
+    }
+
+    for (i = 0; i < vectors->numOfVectors; i++) {
+        uint8_t *code = store->codes + (long) i * store->codeSize;
+
+        memcpy(code, zeroCodes, numOfSubspaces);
+
+        scatterSparseVector(vectors, i, dense);
+
+        uint32_t j;
+
+        /* Only the subspaces with a nonzero value are searched, once each */
+        for (j = vectors->rowStarts[i]; j < vectors->rowStarts[i + 1]; j++) {
+            m = vectors->indices[j] / subspaceDimension;
+
+            if (j > vectors->rowStarts[i] && vectors->indices[j - 1] / subspaceDimension == m) {
+                continue;
+            }
+
+            code[m] = findNearestCentroid(store->centroids + m * centroidsPerSubspace, norms + m * PQ_CENTROIDS,
+                                          subspaceDimension, dense + (long) m * subspaceDimension);
+        }
+
+        clearSparseVector(vectors, i, dense);
+    }
+
+    trackedFree(MEMORY_INGEST, dense);
+    trackedFree(MEMORY_INGEST, zeroCodes);
+    trackedFree(MEMORY_INGEST, norms);
+}
+
+/*
+ * Code of a value of a dimension of the scalar quantizer
+ */
+uint8_t quantizeScalar(const VectorStore *store, int dimension, float value) {
+    if (store->scales[dimension] == 0) {
+        return 0;
+    }
+
+    long code = lrintf((value - store->minimums[dimension]) / store->scales[dimension]);
+
+    return code < 0 ? 0 : code > 255 ? 255 : code;
+}
+
+/*
+ * Find the range of each dimension and encode the vectors with the scalar quantizer
+ */
+void trainScalarQuantizer(VectorStore *store, const SparseVectors *vectors) {
+    int dimension = store->dimension;
+
+    store->minimums = trackedMalloc(MEMORY_VECTORS, dimension * sizeof(float));
+    store->scales = trackedMalloc(MEMORY_VECTORS, dimension * sizeof(float));
+
+    float *maximums = trackedMalloc(MEMORY_INGEST, dimension * sizeof(float));
+    int *counts = trackedCalloc(MEMORY_INGEST, dimension, sizeof(int));
+
+    int d, i;
+
+    for (d = 0; d < dimension; d++) {
+        store->minimums[d] = FLT_MAX;
+        maximums[d] = -FLT_MAX;
+    }
+
+    uint32_t j;
+
+    for (j = 0; j < vectors->rowStarts[vectors->numOfVectors]; j++) {
+        d = vectors->indices[j];
+
+        store->minimums[d] = fminf(store->minimums[d], vectors->values[j]);
+        maximums[d] = fmaxf(maximums[d], vectors->values[j]);
+
+        counts[d]++;
+    }
+
+    for (d = 0; d < dimension; d++) {
+        /* The vectors without a value in the dimension are zero in it */
+        if (counts[d] < vectors->numOfVectors) {
+            store->minimums[d] = fminf(store->minimums[d], 0);
+            maximums[d] = fmaxf(maximums[d], 0);
+        }
+
+        store->scales[d] = (maximums[d] - store->minimums[d]) / 255;
+    }
+
+    uint8_t *zeroCodes = trackedMalloc(MEMORY_INGEST, dimension);
+
+    for (d = 0; d < dimension; d++) {
+        zeroCodes[d] = quantizeScalar(store, d, 0);
+    }
+
+    for (i = 0; i < vectors->numOfVectors; i++) {
+        uint8_t *code = store->codes + (long) i * store->codeSize;
+
+        memcpy(code, zeroCodes, dimension);
+
+        for (j = vectors->rowStarts[i]; j < vectors->rowStarts[i + 1]; j++) {
+            code[vectors->indices[j]] = quantizeScalar(store, vectors->indices[j], vectors->values[j]);
+        }
+    }
+
+    trackedFree(MEMORY_INGEST, zeroCodes);
+    trackedFree(MEMORY_INGEST, counts);
+    trackedFree(MEMORY_INGEST, maximums);
+}
+
+/*
+ * Build a store of quantized vectors, training the codebooks over them. The vectors must have unit length so
+ * their inner product is their cossene. The store takes the vectors if they are kept for the re-ranking, and
+ * releases them otherwise. Returns NULL if the dimension is too large
+ */
+VectorStore *createVectorStore(VectorQuantization quantization, SparseVectors *vectors, const int ids[], int numOfSubspaces,
+                               bool keepExactVectors) {
+    if (vectors->dimension > VECTOR_STORE_MAX_DIMENSION || vectors->dimension < 1 || vectors->numOfVectors < 1) {
+        freeSparseVectors(vectors);
+
+        return NULL;
+    }
+
+    VectorStore *store = trackedCalloc(MEMORY_VECTORS, 1, sizeof(VectorStore));
+
+    store->quantization = quantization;
+    store->dimension = vectors->dimension;
+    store->numOfVectors = vectors->numOfVectors;
+
+    store->ids = trackedMalloc(MEMORY_VECTORS, store->numOfVectors * sizeof(int));
+
+    memcpy(store->ids, ids, store->numOfVectors * sizeof(int));
+
+    if (quantization == QUANTIZATION_PQ) {
+        if (numOfSubspaces < 1) {
+            numOfSubspaces = 1;
+        } else if (numOfSubspaces > store->dimension) {
+            numOfSubspaces = store->dimension;
+        }
+
+        store->subspaceDimension = (store->dimension + numOfSubspaces - 1) / numOfSubspaces;
+        store->numOfSubspaces = (store->dimension + store->subspaceDimension - 1) / store->subspaceDimension;
+        store->codeSize = store->numOfSubspaces;
+    } else {
+        store->codeSize = store->dimension;
+    }
+
+    store->codes = trackedMalloc(MEMORY_VECTORS, (long) store->numOfVectors * store->codeSize);
+
+    if (quantization == QUANTIZATION_PQ) {
+        trainProductQuantizer(store, vectors);
+    } else {
+        trainScalarQuantizer(store, vectors);
+    }
+
+    if (keepExactVectors) {
+        store->exactVectors = vectors;
+    } else {
+        freeSparseVectors(vectors);
+    }
+
+    return store;
+}
+
+/*
+ * Release the memory of a store
+ */
+void freeVectorStore(VectorStore *store) {
+    if (store == NULL) {
+        return;
+    }
+
+    freeSparseVectors(store->exactVectors);
+
+    trackedFree(MEMORY_VECTORS, store->ids);
+    trackedFree(MEMORY_VECTORS, store->codes);
+    trackedFree(MEMORY_VECTORS, store->centroids);
+    trackedFree(MEMORY_VECTORS, store->minimums);
+    trackedFree(MEMORY_VECTORS, store->scales);
+    trackedFree(MEMORY_VECTORS, store);
+}
+
+/*
+ * Score every vector by its codes with the product quantizer. The lookup table has the inner product of each
+ * centroid with the query, and only the subspaces where the query is not zero are read
+ */
+int scanProductCodes(const VectorStore *store, const float query[], int numOfDimensions, const int dimensions[], int k,
+                     int topRows[], float topScores[]) {
+    long centroidsPerSubspace = (long) PQ_CENTROIDS * store->subspaceDimension;
+
+    float *table = trackedCalloc(MEMORY_QUERY, (long) store->numOfSubspaces * PQ_CENTROIDS, sizeof(float));
+    int *subspaces = trackedMalloc(MEMORY_QUERY, store->numOfSubspaces * sizeof(int));
+    char *isActive = trackedCalloc(MEMORY_QUERY, store->numOfSubspaces, 1);
+
+    int numOfSubspaces = 0;
+
+    int i, j, c;
+
+    for (i = 0; i < numOfDimensions; i++) {
+        int m = dimensions[i] / store->subspaceDimension;
+        int offset = dimensions[i] % store->subspaceDimension;
+
+        const float *centroids = store->centroids + m * centroidsPerSubspace;
+
+        for (c = 0; c < PQ_CENTROIDS; c++) {
+            table[m * PQ_CENTROIDS + c] += query[dimensions[i]] * centroids[(long) c * store->subspaceDimension + offset];
+        }
+
+        if (!isActive[m]) {
+            isActive[m] = 1;
+            subspaces[numOfSubspaces++] = m;
+        }
+    }
+
+    int count = 0;
+
+    for (i = 0; i < store->numOfVectors; i++) {
+        const uint8_t *code = store->codes + (long) i * store->codeSize;
+
+        float score = 0;
+
+        for (j = 0; j < numOfSubspaces; j++) {
+            score += table[subspaces[j] * PQ_CENTROIDS + code[subspaces[j]]];
+        }
+
+        count = insertTopAccumulator(k, count, topRows, topScores, i, score);
+    }
+
+    trackedFree(MEMORY_QUERY, isActive);
+    trackedFree(MEMORY_QUERY, subspaces);
+    trackedFree(MEMORY_QUERY, table);
+
+    return count;
+}
+
+/*
+ * Score every vector by its codes with the scalar quantizer: the offset of the minimums is the same for all the
+ * vectors, and the lookup table has the weight of one step of each dimension of the query
+ */
+int scanScalarCodes(const VectorStore *store, const float query[], int numOfDimensions, const int dimensions[], int k,
+                    int topRows[], float topScores[]) {
+    float *steps = trackedMalloc(MEMORY_QUERY, numOfDimensions * sizeof(float));
+
+    float offset = 0;
+
+    int i, j;
+
+    for (i = 0; i < numOfDimensions; i++) {
+        offset += query[dimensions[i]] * store->minimums[dimensions[i]];
+
+        steps[i] = query[dimensions[i]] * store->scales[dimensions[i]];
+    }
+
+    int count = 0;
+
+    for (i = 0; i < store->numOfVectors; i++) {
+        const uint8_t *code = store->codes + (long) i * store->codeSize;
+
+        float score = offset;
+
+        for (j = 0; j < numOfDimensions; j++) {
+            score += steps[j] * code[dimensions[j]];
+        }
+
+        count = insertTopAccumulator(k, count, topRows, topScores, i, score);
+    }
+
+    trackedFree(MEMORY_QUERY, steps);
+
+    return count;
+}
+
+/*
+ * Select the 'k' vectors with the highest inner product with a sparse query (its dimensions may repeat, their
+ * weights are added), in descending order. The vectors are scored by their codes, and the best 'numOfReranked'
+ * of them are scored again by their exact vectors, if kept. Returns the number of selected vectors
+ */
+int searchVectorStore(const VectorStore *store, int numOfTerms, const int dimensions[], const float weights[], int k,
+                      int numOfReranked, int topIds[], float topScores[]) {
+    float *query = trackedCalloc(MEMORY_QUERY, store->dimension, sizeof(float));
+    int *queryDimensions = trackedMalloc(MEMORY_QUERY, (numOfTerms + 1) * sizeof(int));
+
+    int numOfDimensions = 0;
+
+    int i;
+
+    for (i = 0; i < numOfTerms; i++) {
+        if (dimensions[i] < 0 || dimensions[i] >= store->dimension) {
+            continue;
+        }
+
+        if (query[dimensions[i]] == 0) {
+            queryDimensions[numOfDimensions++] = dimensions[i];
+        }
+
+        query[dimensions[i]] += weights[i];
+    }
+
+    if (store->exactVectors == NULL || numOfReranked < k) {
+        numOfReranked = k;
+    }
+
+    int *candidateRows = trackedMalloc(MEMORY_QUERY, numOfReranked * sizeof(int));
+    float *candidateScores = trackedMalloc(MEMORY_QUERY, numOfReranked * sizeof(float));
+
+    int numOfCandidates = 0;
+
+    if (store->quantization == QUANTIZATION_PQ) {
+        numOfCandidates = scanProductCodes(store, query, numOfDimensions, queryDimensions, numOfReranked, candidateRows, candidateScores);
+    } else {
+        numOfCandidates = scanScalarCodes(store, query, numOfDimensions, queryDimensions, numOfReranked, candidateRows, candidateScores);
+    }
+
+    int count = 0;
+
+    if (store->exactVectors != NULL && numOfReranked > k) {
+        const SparseVectors *vectors = store->exactVectors;
+
+        for (i = 0; i < numOfCandidates; i++) {
+            int row = candidateRows[i];
+
+            float score = 0;
+
+            uint32_t j;
+
+            for (j = vectors->rowStarts[row]; j < vectors->rowStarts[row + 1]; j++) {
+                score += vectors->values[j] * query[vectors->indices[j]];
+            }
+
+            count = insertTopAccumulator(k, count, topIds, topScores, row, score);
+        }
+    } else {
+        count = numOfCandidates < k ? numOfCandidates : k;
+
+        memcpy(topIds, candidateRows, count * sizeof(int));
+        memcpy(topScores, candidateScores, count * sizeof(float));
+    }
+
+    for (i = 0; i < count; i++) {
+        topIds[i] = store->ids[topIds[i]];
+    }
+
+    trackedFree(MEMORY_QUERY, candidateScores);
+    trackedFree(MEMORY_QUERY, candidateRows);
+    trackedFree(MEMORY_QUERY, queryDimensions);
+    trackedFree(MEMORY_QUERY, query);
+
+    return count;
+}
+
+/*
+ * Size in bytes of the codes
+ */
+long getVectorStoreCodesSize(const VectorStore *store) {
+    return (long) store->numOfVectors * store->codeSize;
+}
+
+/*
+ * Size in bytes of the codebooks (centroids, or minimums and scales)
+ */
+long getVectorStoreCodebooksSize(const VectorStore *store) {
+    if (store->quantization == QUANTIZATION_PQ) {
+        return (long) store->numOfSubspaces * PQ_CENTROIDS * store->subspaceDimension * sizeof(float);
+    }
+
+    return 2L * store->dimension * sizeof(float);
+}
+
+/*
+ * Size in bytes of the exact vectors kept for the re-ranking
+ */
+long getVectorStoreExactSize(const VectorStore *store) {
+    if (store->exactVectors == NULL) {
+        return 0;
+    }
+
+    long numOfValues = store->exactVectors->rowStarts[store->numOfVectors];
+
+    return (store->numOfVectors + 1L) * sizeof(uint32_t) + numOfValues * (sizeof(uint16_t) + sizeof(float));
+}
+
+/*
+ * Name of a quantization, as printed in the reports
+ */
+const char *getVectorQuantizationName(VectorQuantization quantization) {
+    switch (quantization) {
+        case QUANTIZATION_PQ:
+            return "product quantization";
+        case QUANTIZATION_INT8:
+            return "int8 scalar quantization";
+        default:
+            return "none";
+    }
+}
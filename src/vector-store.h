@@ -0,0 +1,106 @@
+#ifndef VECTOR_STORE_H
+#define VECTOR_STORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Number of centroids of each subspace of a product quantizer, so a code is one byte */
+#define PQ_CENTROIDS 256
+/* Max number of vectors the k-means of the product quantizer is trained on */
+#define PQ_TRAINING_SAMPLE 8192
+/* Number of k-means iterations of the product quantizer */
+#define PQ_TRAINING_ITERATIONS 10
+/* The dimensions of the exact vectors are 16 bits */
+#define VECTOR_STORE_MAX_DIMENSION 65536
+
+/* Quantization of the vectors of a store */
+typedef enum VectorQuantization {
+    QUANTIZATION_NONE,
+    QUANTIZATION_PQ, /* product quantization: one byte (a centroid) per subspace */
+    QUANTIZATION_INT8 /* scalar quantization: one byte per dimension, on the range of the dimension */
+} VectorQuantization;
+
+/* This struct represents sparse vectors in compressed rows: the nonzero values of the row i are
+ values[rowStarts[i]] to values[rowStarts[i + 1] - 1], with their dimensions in ascending order */
+typedef struct SparseVectors {
+    int numOfVectors;
+    int dimension;
+    uint32_t *rowStarts; /* numOfVectors + 1 */
+    uint16_t *indices;
+    float *values;
+} SparseVectors;
+
+/* This struct represents a store of unit vectors compressed to a few bytes each, scored against a query by
+ asymmetric distance: the query stays exact and a lookup table of its products with the quantized values
+ turns the score of a vector into one table read per code byte. The codes of all the vectors are one flat
+ array, small enough to stay in cache while it is scanned */
+typedef struct VectorStore {
+    VectorQuantization quantization;
+    int dimension;
+    int numOfVectors;
+    int *ids; /* caller id of each vector */
+    int codeSize; /* bytes per vector */
+    uint8_t *codes; /* numOfVectors * codeSize */
+    /* Product quantization: the dimensions are split in numOfSubspaces ranges of subspaceDimension (the last
+     one padded with zeros), each one with PQ_CENTROIDS centroids */
+    int numOfSubspaces;
+    int subspaceDimension;
+    float *centroids; /* numOfSubspaces * PQ_CENTROIDS * subspaceDimension */
+    /* Scalar quantization: value = minimums[d] + code * scales[d] */
+    float *minimums;
+    float *scales;
+    SparseVectors *exactVectors; /* for the re-ranking, NULL if they are not kept */
+} VectorStore;
+
+/*
+ * Create empty sparse vectors with room for a number of nonzero values
+ */
+SparseVectors *createSparseVectors(int numOfVectors, int dimension, long numOfValues);
+
+/*
+ * Release the memory of sparse vectors
+ */
+void freeSparseVectors(SparseVectors *vectors);
+
+/*
+ * Build a store of quantized vectors, training the codebooks over them. The vectors must have unit length so
+ * their inner product is their cossene. The store takes the vectors if they are kept for the re-ranking, and
+ * releases them otherwise. Returns NULL if the dimension is too large
+ */
+VectorStore *createVectorStore(VectorQuantization quantization, SparseVectors *vectors, const int ids[], int numOfSubspaces,
+                               bool keepExactVectors);
+
+/*
+ * Release the memory of a store
+ */
+void freeVectorStore(VectorStore *store);
+
+/*
+ * Select the 'k' vectors with the highest inner product with a sparse query (its dimensions may repeat, their
+ * weights are added), in descending order. The vectors are scored by their codes, and the best 'numOfReranked'
+ * of them are scored again by their exact vectors, if kept. Returns the number of selected vectors
+ */
+int searchVectorStore(const VectorStore *store, int numOfTerms, const int dimensions[], const float weights[], int k,
+                      int numOfReranked, int topIds[], float topScores[]);
+
+/*
+ * Size in bytes of the codes
+ */
+long getVectorStoreCodesSize(const VectorStore *store);
+
+/*
+ * Size in bytes of the codebooks (centroids, or minimums and scales)
+ */
+long getVectorStoreCodebooksSize(const VectorStore *store);
+
+/*
+ * Size in bytes of the exact vectors kept for the re-ranking
+ */
+long getVectorStoreExactSize(const VectorStore *store);
+
+/*
+ * Name of a quantization, as printed in the reports
+ */
+const char *getVectorQuantizationName(VectorQuantization quantization);
+
+#endif
@@ -0,0 +1,138 @@
+#include <stdlib.h>
+
+#include "worker-pool.h"
+
+/* This struct represents the arguments of a thread of the pool */
+typedef struct WorkerThread {
+    WorkerPool *pool;
+    int worker;
+} WorkerThread;
+
+/*
+ * Loop of a thread of the pool: wait for a task, run it and report it is done
+ */
+void *runWorkerThread(void *argument) {
+    WorkerThread *thread = argument;
+    WorkerPool *pool = thread->pool;
+
+    long generation = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    while (true) {
+        while (!pool->stopping && pool->generation == generation) {
+            pthread_cond_wait(&pool->taskReady, &pool->mutex);
+        }
+
+        if (pool->stopping) {
+            break;
+        }
+
+        generation = pool->generation;
+
+        pthread_mutex_unlock(&pool->mutex);
+
+        pool->task(pool->argument, thread->worker);
+
+        pthread_mutex_lock(&pool->mutex);
+
+        if (--pool->pendingWorkers == 0) {
+            pthread_cond_signal(&pool->taskDone);
+        }
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    free(thread);
+
+    return NULL;
+}
+
+/*
+ * Create a pool of workers and start its threads
+ */
+WorkerPool *createWorkerPool(int numOfWorkers) {
+    WorkerPool *pool = malloc(sizeof(WorkerPool));
+
+    pool->numOfWorkers = numOfWorkers < 1 ? 1 : numOfWorkers;
+    pool->threads = malloc(pool->numOfWorkers * sizeof(pthread_t));
+    pool->generation = 0;
+    pool->pendingWorkers = 0;
+    pool->stopping = false;
+    pool->task = NULL;
+    pool->argument = NULL;
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->taskReady, NULL);
+    pthread_cond_init(&pool->taskDone, NULL);
+
+    int i;
+
+    /* The worker 0 is the caller of runWorkerPool() */
+    for (i = 1; i < pool->numOfWorkers; i++) {
+        WorkerThread *thread = malloc(sizeof(WorkerThread));
+
+        thread->pool = pool;
+        thread->worker = i;
+
+        pthread_create(&pool->threads[i], NULL, runWorkerThread, thread);
+    }
+
+    return pool;
+}
+
+/*
+ * Run a task on all the workers of the pool and wait until all of them are done
+ */
+void runWorkerPool(WorkerPool *pool, WorkerTask task, void *argument) {
+    pthread_mutex_lock(&pool->mutex);
+
+    pool->task = task;
+    pool->argument = argument;
+    pool->pendingWorkers = pool->numOfWorkers - 1;
+    pool->generation++;
+
+    pthread_cond_broadcast(&pool->taskReady);
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    task(argument, 0);
+
+    pthread_mutex_lock(&pool->mutex);
+
+    while (pool->pendingWorkers > 0) {
+        pthread_cond_wait(&pool->taskDone, &pool->mutex);
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/*
+ * Stop the threads and release the memory of the pool
+ */
+void freeWorkerPool(WorkerPool *pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+
+    pool->stopping = true;
+
+    pthread_cond_broadcast(&pool->taskReady);
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    int i;
+
+    for (i = 1; i < pool->numOfWorkers; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->taskReady);
+    pthread_cond_destroy(&pool->taskDone);
+
+    free(pool->threads);
+    free(pool);
+}
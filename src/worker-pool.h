@@ -0,0 +1,40 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stdbool.h>
+#include <pthread.h>
+
+/* Function run by every worker of the pool: 'worker' goes from 0 to the number of workers - 1 */
+typedef void (*WorkerTask)(void *argument, int worker);
+
+/* This struct represents a fixed group of threads that run the same task at once. The thread that
+ calls runWorkerPool() works as the worker 0, so a pool of N workers has N - 1 threads */
+typedef struct WorkerPool {
+    int numOfWorkers;
+    pthread_t *threads;
+    pthread_mutex_t mutex;
+    pthread_cond_t taskReady;
+    pthread_cond_t taskDone;
+    long generation; /* incremented for each task, so the threads know a new one is ready */
+    int pendingWorkers;
+    bool stopping;
+    WorkerTask task;
+    void *argument;
+} WorkerPool;
+
+/*
+ * Create a pool of workers and start its threads
+ */
+WorkerPool *createWorkerPool(int numOfWorkers);
+
+/*
+ * Run a task on all the workers of the pool and wait until all of them are done
+ */
+void runWorkerPool(WorkerPool *pool, WorkerTask task, void *argument);
+
+/*
+ * Stop the threads and release the memory of the pool
+ */
+void freeWorkerPool(WorkerPool *pool);
+
+#endif